@@ -0,0 +1,762 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_backup.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <set>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <rocksdb/db.h>
+#include <rocksdb/env.h>
+#include <rocksdb/options.h>
+#include <rocksdb/rate_limiter.h>
+#include <rocksdb/transaction_log.h>
+#include <rocksdb/version.h>
+#include <rocksdb/write_batch.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/db/client.h"
+#include "mongo/stdx/chrono.h"
+#include "mongo/stdx/functional.h"
+#include "mongo/stdx/thread.h"
+#include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/time_support.h"
+#include "mongo/util/timer.h"
+
+#include "rocks_util.h"
+
+namespace mongo {
+
+    namespace {
+        const std::string kTimeMarkerPrefix = "mongorocks-time:";
+        const std::string kIdentityFile = "IDENTITY";
+        const std::string kInfoFile = "INFO";
+        const std::string kSharedDir = "shared";
+        const std::string kWalDir = "wal";
+        const std::string kMetaDir = "meta";
+        const std::string kTmpSuffix = ".tmp";
+        const size_t kCopyChunkSize = 1024 * 1024;
+
+        bool endsWith(const std::string& str, const std::string& suffix) {
+            return str.size() >= suffix.size() &&
+                str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+        }
+
+        // "/archive/000012.log" -> "000012.log"
+        std::string baseName(const std::string& path) {
+            size_t pos = path.rfind('/');
+            return pos == std::string::npos ? path : path.substr(pos + 1);
+        }
+
+        bool fileSize(const std::string& file, uint64_t* size) {
+            return rocksdb::Env::Default()->GetFileSize(file, size).ok();
+        }
+
+        // lists the entries of dir, without "." and ".."
+        Status listDir(const std::string& dir, std::vector<std::string>* children) {
+            std::vector<std::string> all;
+            auto s = rocksdb::Env::Default()->GetChildren(dir, &all);
+            if (!s.ok()) {
+                return rocksToMongoStatus(s);
+            }
+            for (auto& child : all) {
+                if (child != "." && child != "..") {
+                    children->push_back(std::move(child));
+                }
+            }
+            return Status::OK();
+        }
+
+        class TimeMarkerHandler : public rocksdb::WriteBatch::Handler {
+        public:
+            virtual void LogData(const rocksdb::Slice& blob) {
+                if (blob.starts_with(kTimeMarkerPrefix)) {
+                    found = true;
+                    millis = std::strtoll(
+                        blob.ToString().substr(kTimeMarkerPrefix.size()).c_str(), nullptr, 10);
+                }
+            }
+
+            bool found = false;
+            long long millis = 0;
+        };
+
+        // Copies job.size bytes of job.from to a temporary file, syncs it and renames it to
+        // job.to, so that a file with the final name is always complete
+        Status copyFile(const RocksIncrementalBackup::CopyJob& job, rocksdb::RateLimiter* limiter,
+                        const stdx::function<void(uint64_t)>& onProgress) {
+            rocksdb::Env* env = rocksdb::Env::Default();
+            rocksdb::EnvOptions envOptions;
+            const std::string tmpFile = job.to + kTmpSuffix;
+
+            std::unique_ptr<rocksdb::SequentialFile> in;
+            std::unique_ptr<rocksdb::WritableFile> out;
+            auto s = env->NewSequentialFile(job.from, &in, envOptions);
+            if (s.ok()) {
+                s = env->NewWritableFile(tmpFile, &out, envOptions);
+            }
+
+            size_t chunkSize = kCopyChunkSize;
+            if (limiter) {
+                chunkSize =
+                    std::min(chunkSize, static_cast<size_t>(limiter->GetSingleBurstBytes()));
+            }
+            std::unique_ptr<char[]> buffer(new char[chunkSize]);
+            uint64_t remaining = job.size;
+            while (s.ok() && remaining > 0) {
+                size_t bytes = static_cast<size_t>(std::min<uint64_t>(chunkSize, remaining));
+                if (limiter) {
+                    limiter->Request(bytes, rocksdb::Env::IO_LOW);
+                }
+                rocksdb::Slice data;
+                s = in->Read(bytes, &data, buffer.get());
+                if (s.ok() && data.empty()) {
+                    s = rocksdb::Status::IOError("file is shorter than expected", job.from);
+                }
+                if (s.ok()) {
+                    s = out->Append(data);
+                }
+                remaining -= data.size();
+                onProgress(data.size());
+            }
+            if (s.ok()) {
+                s = out->Sync();
+            }
+            if (s.ok()) {
+                s = out->Close();
+            }
+            if (s.ok()) {
+                s = env->RenameFile(tmpFile, job.to);
+            }
+            if (!s.ok()) {
+                env->DeleteFile(tmpFile);
+                return Status(ErrorCodes::FileStreamFailed,
+                              str::stream() << "failed to copy " << job.from << " to " << job.to
+                                            << ": " << s.ToString());
+            }
+            return Status::OK();
+        }
+
+        // Runs the copies on up to `threads` threads. Stops handing out jobs after the first
+        // error, which is returned
+        Status copyFiles(const std::vector<RocksIncrementalBackup::CopyJob>& jobs, int threads,
+                         rocksdb::RateLimiter* limiter,
+                         const stdx::function<void(uint64_t)>& onProgress,
+                         const stdx::function<void()>& onFileDone) {
+            std::atomic<size_t> next{0};  // NOLINT
+            stdx::mutex errorMutex;
+            Status firstError = Status::OK();
+            std::atomic<bool> failed{false};  // NOLINT
+
+            auto worker = [&] {
+                while (!failed.load()) {
+                    size_t i = next.fetch_add(1);
+                    if (i >= jobs.size()) {
+                        break;
+                    }
+                    Status status = copyFile(jobs[i], limiter, onProgress);
+                    if (!status.isOK()) {
+                        stdx::lock_guard<stdx::mutex> lk(errorMutex);
+                        if (firstError.isOK()) {
+                            firstError = status;
+                        }
+                        failed.store(true);
+                        break;
+                    }
+                    onFileDone();
+                }
+            };
+
+            size_t numThreads = std::min(jobs.size(), static_cast<size_t>(std::max(threads, 1)));
+            std::vector<stdx::thread> workers;
+            for (size_t i = 0; i < numThreads; ++i) {
+                workers.emplace_back(worker);
+            }
+            for (auto& t : workers) {
+                t.join();
+            }
+            return firstError;
+        }
+
+        // backups in meta/ by age, oldest first. Unfinished ones are left out
+        Status listBackups(const std::string& metaDir, std::vector<long long>* backups) {
+            std::vector<std::string> children;
+            Status status = listDir(metaDir, &children);
+            if (!status.isOK()) {
+                return status;
+            }
+            for (const auto& name : children) {
+                if (!endsWith(name, kTmpSuffix)) {
+                    backups->push_back(std::strtoll(name.c_str(), nullptr, 10));
+                }
+            }
+            std::sort(backups->begin(), backups->end());
+            return Status::OK();
+        }
+
+        Status readInfo(const std::string& file, BSONObj* info) {
+            std::string data;
+            auto s = rocksdb::ReadFileToString(rocksdb::Env::Default(), file, &data);
+            if (!s.ok()) {
+                return rocksToMongoStatus(s);
+            }
+            if (data.size() < 5 ||
+                static_cast<size_t>(BSONObj(data.data()).objsize()) != data.size()) {
+                return Status(ErrorCodes::FailedToParse, str::stream() << file << " is corrupted");
+            }
+            *info = BSONObj(data.data()).getOwned();
+            return Status::OK();
+        }
+    }
+
+    RocksIncrementalBackup::RocksIncrementalBackup(rocksdb::DB* db, int threads, int maxMBPerSec,
+                                                   int keepBackups)
+        : BackgroundJob(false /* deleteSelf */),
+          _db(db),
+          _threads(std::max(threads, 1)),
+          _keepBackups(keepBackups) {
+        if (maxMBPerSec > 0) {
+            _rateLimiter.reset(rocksdb::NewGenericRateLimiter(static_cast<int64_t>(maxMBPerSec) *
+                                                              1024 * 1024));
+        }
+    }
+
+    RocksIncrementalBackup::~RocksIncrementalBackup() = default;
+
+    void RocksIncrementalBackup::run() {
+        Client::initThread(name().c_str());
+
+        LOG(1) << "starting " << name() << " thread";
+
+        while (true) {
+            {
+                stdx::unique_lock<stdx::mutex> lk(_mutex);
+                _shutdownCondition.wait_for(lk, stdx::chrono::seconds(kTimeMarkerIntervalSecs),
+                                            [this] { return _shuttingDown; });
+                if (_shuttingDown) {
+                    break;
+                }
+            }
+            _writeTimeMarker();
+        }
+        LOG(1) << "stopping " << name() << " thread";
+    }
+
+    void RocksIncrementalBackup::shutdown() {
+        if (!running()) {
+            return;
+        }
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _shuttingDown = true;
+        }
+        _shutdownCondition.notify_all();
+        wait();
+    }
+
+    void RocksIncrementalBackup::_writeTimeMarker() {
+        // an idle DB doesn't need markers, the previous one is just as precise
+        uint64_t sequence = _db->GetLatestSequenceNumber();
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            if (sequence == _markedSequence) {
+                return;
+            }
+            _markedSequence = sequence;
+        }
+        // a batch with only log data doesn't use a sequence number, it only shows up in the WAL
+        rocksdb::WriteBatch batch;
+        batch.PutLogData(kTimeMarkerPrefix + std::to_string(curTimeMillis64()));
+        auto s = _db->Write(rocksdb::WriteOptions(), &batch);
+        if (!s.ok()) {
+            warning() << "Failed to write WAL time marker: " << s.ToString();
+        }
+    }
+
+    bool RocksIncrementalBackup::parseTimeMarker(const rocksdb::WriteBatch& batch,
+                                                 long long* millis) {
+        if (batch.Count() != 0) {
+            return false;
+        }
+        TimeMarkerHandler handler;
+        batch.Iterate(&handler);
+        *millis = handler.millis;
+        return handler.found;
+    }
+
+    Status RocksIncrementalBackup::backup(const std::string& root) {
+        return _run(root, false);
+    }
+
+    Status RocksIncrementalBackup::archiveWal(const std::string& root) {
+        return _run(root, true);
+    }
+
+    Status RocksIncrementalBackup::_checkIdentity(const std::string& root) {
+        std::string identity;
+        auto s = _db->GetDbIdentity(identity);
+        if (!s.ok()) {
+            return rocksToMongoStatus(s);
+        }
+        const std::string identityFile = root + "/" + kIdentityFile;
+        uint64_t size;
+        if (!fileSize(identityFile, &size)) {
+            s = rocksdb::WriteStringToFile(rocksdb::Env::Default(), identity, identityFile,
+                                           true /* should_sync */);
+            return rocksToMongoStatus(s);
+        }
+        std::string rootIdentity;
+        s = rocksdb::ReadFileToString(rocksdb::Env::Default(), identityFile, &rootIdentity);
+        if (!s.ok()) {
+            return rocksToMongoStatus(s);
+        }
+        if (rootIdentity != identity) {
+            return Status(ErrorCodes::BadValue,
+                          str::stream() << root << " holds backups of another database");
+        }
+        return Status::OK();
+    }
+
+    Status RocksIncrementalBackup::_walJobs(const std::string& root, std::vector<CopyJob>* jobs,
+                                            std::vector<std::string>* walFiles,
+                                            uint64_t* minLogNumber) {
+        rocksdb::VectorLogPtr logs;
+        auto s = _db->GetSortedWalFiles(logs);
+        if (!s.ok()) {
+            return rocksToMongoStatus(s);
+        }
+        std::string walDir = _db->GetDBOptions().wal_dir;
+        if (walDir.empty()) {
+            walDir = _db->GetName();
+        }
+        for (const auto& log : logs) {
+            if (log->Type() == rocksdb::kAliveLogFile) {
+                *minLogNumber = std::min(*minLogNumber, log->LogNumber());
+            }
+            const std::string name = baseName(log->PathName());
+            walFiles->push_back(name);
+            CopyJob job{walDir + log->PathName(), root + "/" + kWalDir + "/" + name,
+                        log->SizeFileBytes()};
+            // archived segments never change. The live one is copied again once it grew
+            uint64_t archivedSize;
+            if (fileSize(job.to, &archivedSize) && archivedSize >= job.size) {
+                stdx::lock_guard<stdx::mutex> lk(_mutex);
+                ++_filesSkipped;
+                continue;
+            }
+            jobs->push_back(std::move(job));
+        }
+        return Status::OK();
+    }
+
+    Status RocksIncrementalBackup::_copy(const std::vector<CopyJob>& jobs) {
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _filesTotal += jobs.size();
+            for (const auto& job : jobs) {
+                _bytesTotal += job.size;
+            }
+        }
+        return copyFiles(jobs, _threads, _rateLimiter.get(),
+                         [this](uint64_t bytes) {
+                             stdx::lock_guard<stdx::mutex> lk(_mutex);
+                             _bytesCopied += bytes;
+                         },
+                         [this] {
+                             stdx::lock_guard<stdx::mutex> lk(_mutex);
+                             ++_filesCopied;
+                         });
+    }
+
+    Status RocksIncrementalBackup::_run(const std::string& root, bool walOnly) {
+        stdx::unique_lock<stdx::mutex> runLock(_runMutex, stdx::try_to_lock);
+        if (!runLock.owns_lock()) {
+            return Status(ErrorCodes::ConflictingOperationInProgress,
+                          "a backup or WAL archival is already running");
+        }
+        if (!boost::filesystem::path(root).is_absolute()) {
+            return Status(ErrorCodes::BadValue, "backup root needs to be an absolute path");
+        }
+        if (_db->GetDBOptions().WAL_ttl_seconds == 0) {
+            // the WAL written between two runs would be deleted before we can copy it
+            return Status(ErrorCodes::IllegalOperation,
+                          "incremental backups need WAL archiving, set "
+                          "storage.rocksdb.walArchiveTTLSecs to more than the time between two "
+                          "backups or WAL archivals");
+        }
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _state = walOnly ? "archiving wal" : "backing up";
+            _root = root;
+            _startedAt = curTimeMillis64();
+            _filesTotal = _filesCopied = _filesSkipped = _bytesTotal = _bytesCopied = 0;
+            _backupsPruned = _filesPruned = 0;
+            _lastError.clear();
+        }
+        Timer timer;
+
+        boost::system::error_code ec;
+        for (const auto& dir : {kSharedDir, kWalDir, kMetaDir}) {
+            boost::filesystem::create_directories(root + "/" + dir, ec);
+            if (ec) {
+                break;
+            }
+        }
+        Status status = ec ? Status(ErrorCodes::FileNotOpen,
+                                    str::stream() << "failed to create " << root << ": "
+                                                  << ec.message())
+                           : _checkIdentity(root);
+
+        // keeps the files we list from being deleted until they are copied. Obsolete WAL
+        // segments are moved to the archive instead while WAL archiving is on
+        if (status.isOK()) {
+            status = rocksToMongoStatus(_db->DisableFileDeletions());
+        }
+        if (status.isOK()) {
+            std::vector<CopyJob> jobs;
+            std::vector<std::string> sstFiles;
+            std::vector<std::string> metaFiles;
+            std::vector<std::string> walFiles;
+            uint64_t minLogNumber = std::numeric_limits<uint64_t>::max();
+            long long backupMillis = 0;
+            const std::string metaDir = root + "/" + kMetaDir + "/";
+            std::string backupDir;
+
+            if (!walOnly) {
+                std::vector<std::string> liveFiles;
+                uint64_t manifestSize = 0;
+                status = rocksToMongoStatus(
+                    _db->GetLiveFiles(liveFiles, &manifestSize, true /* flush_memtable */));
+                // everything written before now is either in the SST files or in WAL segments
+                // that are replayed after this backup
+                backupMillis = curTimeMillis64();
+                backupDir = metaDir + std::to_string(backupMillis);
+                if (status.isOK()) {
+                    status = rocksToMongoStatus(
+                        rocksdb::Env::Default()->CreateDirIfMissing(backupDir + kTmpSuffix));
+                }
+                for (size_t i = 0; status.isOK() && i < liveFiles.size(); ++i) {
+                    const std::string name = baseName(liveFiles[i]);
+                    CopyJob job{_db->GetName() + "/" + name, "", 0};
+                    if (endsWith(name, ".sst")) {
+                        sstFiles.push_back(name);
+                        job.to = root + "/" + kSharedDir + "/" + name;
+                        fileSize(job.from, &job.size);
+                        uint64_t sharedSize;
+                        if (fileSize(job.to, &sharedSize) && sharedSize == job.size) {
+                            stdx::lock_guard<stdx::mutex> lk(_mutex);
+                            ++_filesSkipped;
+                            continue;
+                        }
+                    } else {
+                        metaFiles.push_back(name);
+                        job.to = backupDir + kTmpSuffix + "/" + name;
+                        if (name.compare(0, 9, "MANIFEST-") == 0) {
+                            job.size = manifestSize;
+                        } else {
+                            fileSize(job.from, &job.size);
+                        }
+                    }
+                    jobs.push_back(std::move(job));
+                }
+            }
+            if (status.isOK()) {
+                status = _walJobs(root, &jobs, &walFiles, &minLogNumber);
+            }
+            if (status.isOK()) {
+                status = _copy(jobs);
+            }
+            if (status.isOK() && !walOnly) {
+                BSONObjBuilder info;
+                info.append("millis", backupMillis);
+                info.append("sequence", static_cast<long long>(_db->GetLatestSequenceNumber()));
+                info.append("minLogNumber", static_cast<long long>(minLogNumber));
+                info.append("files", sstFiles);
+                info.append("meta", metaFiles);
+                info.append("wal", walFiles);
+                BSONObj obj = info.obj();
+                auto s = rocksdb::WriteStringToFile(
+                    rocksdb::Env::Default(), rocksdb::Slice(obj.objdata(), obj.objsize()),
+                    backupDir + kTmpSuffix + "/" + kInfoFile, true /* should_sync */);
+                if (s.ok()) {
+                    // the backup only becomes visible to restore() once it's complete
+                    s = rocksdb::Env::Default()->RenameFile(backupDir + kTmpSuffix, backupDir);
+                }
+                status = rocksToMongoStatus(s);
+            }
+#if defined(ROCKSDB_MAJOR) && ROCKSDB_MAJOR >= 9
+            _db->EnableFileDeletions();
+#else
+            _db->EnableFileDeletions(false /* force */);
+#endif
+            if (status.isOK() && !walOnly) {
+                {
+                    stdx::lock_guard<stdx::mutex> lk(_mutex);
+                    _lastBackupMillis = backupMillis;
+                }
+                // the backup is complete either way
+                Status pruneStatus = _prune(root);
+                if (!pruneStatus.isOK()) {
+                    warning() << "Failed to prune old backups in " << root << ": " << pruneStatus;
+                }
+            }
+        }
+
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        _state = status.isOK() ? "done" : "failed";
+        if (!status.isOK()) {
+            _lastError = status.toString();
+        }
+        log() << (walOnly ? "WAL archival" : "Incremental backup") << " to " << root << " "
+              << _state << " after " << timer.millis() << "ms: copied " << _filesCopied
+              << " files (" << _bytesCopied << " bytes), skipped " << _filesSkipped
+              << " files that were already there, pruned " << _backupsPruned << " backups and "
+              << _filesPruned << " files";
+        return status;
+    }
+
+    Status RocksIncrementalBackup::_prune(const std::string& root) {
+        // called with _runMutex held, nothing else writes to the root
+        const std::string metaDir = root + "/" + kMetaDir + "/";
+        rocksdb::Env* env = rocksdb::Env::Default();
+        boost::system::error_code ec;
+        long long backupsPruned = 0;
+        long long filesPruned = 0;
+
+        std::vector<std::string> children;
+        Status status = listDir(metaDir, &children);
+        if (!status.isOK()) {
+            return status;
+        }
+        for (const auto& name : children) {
+            // left behind by backups that failed or crashed
+            if (endsWith(name, kTmpSuffix)) {
+                boost::filesystem::remove_all(metaDir + name, ec);
+            }
+        }
+
+        std::vector<long long> backups;
+        status = listBackups(metaDir, &backups);
+        if (!status.isOK()) {
+            return status;
+        }
+        size_t keep = backups.size();
+        if (_keepBackups > 0) {
+            keep = std::min(keep, static_cast<size_t>(_keepBackups));
+        }
+        for (size_t i = 0; i < backups.size() - keep; ++i) {
+            boost::filesystem::remove_all(metaDir + std::to_string(backups[i]), ec);
+            if (ec) {
+                return Status(ErrorCodes::FileStreamFailed,
+                              str::stream() << "failed to remove backup " << backups[i] << ": "
+                                            << ec.message());
+            }
+            ++backupsPruned;
+        }
+        backups.erase(backups.begin(), backups.end() - keep);
+        if (backups.empty()) {
+            return Status::OK();
+        }
+
+        // what the remaining backups need
+        std::set<std::string> sstFiles;
+        uint64_t minLogNumber = std::numeric_limits<uint64_t>::max();
+        for (long long backup : backups) {
+            BSONObj info;
+            status = readInfo(metaDir + std::to_string(backup) + "/" + kInfoFile, &info);
+            if (!status.isOK()) {
+                // don't delete files a backup we can't read might need
+                return status;
+            }
+            for (const auto& e : info["files"].Array()) {
+                sstFiles.insert(e.String());
+            }
+            minLogNumber = std::min(minLogNumber,
+                                    static_cast<uint64_t>(info["minLogNumber"].numberLong()));
+        }
+
+        children.clear();
+        status = listDir(root + "/" + kSharedDir, &children);
+        if (!status.isOK()) {
+            return status;
+        }
+        for (const auto& name : children) {
+            if (sstFiles.count(name) == 0 &&
+                env->DeleteFile(root + "/" + kSharedDir + "/" + name).ok()) {
+                ++filesPruned;
+            }
+        }
+        // segments before the oldest backup are in its SST files already
+        children.clear();
+        status = listDir(root + "/" + kWalDir, &children);
+        if (!status.isOK()) {
+            return status;
+        }
+        for (const auto& name : children) {
+            if ((endsWith(name, kTmpSuffix) ||
+                 std::strtoull(name.c_str(), nullptr, 10) < minLogNumber) &&
+                env->DeleteFile(root + "/" + kWalDir + "/" + name).ok()) {
+                ++filesPruned;
+            }
+        }
+
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        _backupsPruned = backupsPruned;
+        _filesPruned = filesPruned;
+        return Status::OK();
+    }
+
+    void RocksIncrementalBackup::appendProgress(BSONObjBuilder* builder) const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        builder->append("state", _state);
+        builder->append("root", _root);
+        builder->appendDate("startedAt", Date_t::fromMillisSinceEpoch(_startedAt));
+        builder->append("files-total", _filesTotal);
+        builder->append("files-copied", _filesCopied);
+        builder->append("files-skipped", _filesSkipped);
+        builder->append("bytes-total", _bytesTotal);
+        builder->append("bytes-copied", _bytesCopied);
+        builder->append("backups-pruned", _backupsPruned);
+        builder->append("files-pruned", _filesPruned);
+        if (_lastBackupMillis) {
+            builder->appendDate("lastBackup", Date_t::fromMillisSinceEpoch(_lastBackupMillis));
+        }
+        if (!_lastError.empty()) {
+            builder->append("lastError", _lastError);
+        }
+    }
+
+    Status RocksIncrementalBackup::restore(const std::string& root, const std::string& dbPath,
+                                           const std::string& walDir, long long targetMillis,
+                                           int threads) {
+        uint64_t size;
+        if (fileSize(dbPath + "/CURRENT", &size)) {
+            return Status(ErrorCodes::IllegalOperation,
+                          str::stream() << dbPath << " already contains a database");
+        }
+
+        // pick the latest complete backup taken at or before the target
+        std::vector<long long> backups;
+        Status status = listBackups(root + "/" + kMetaDir, &backups);
+        if (!status.isOK()) {
+            return status;
+        }
+        long long backupMillis = -1;
+        for (long long millis : backups) {
+            if (targetMillis == 0 || millis <= targetMillis) {
+                backupMillis = millis;
+            }
+        }
+        if (backupMillis < 0) {
+            return Status(ErrorCodes::NoSuchKey,
+                          str::stream() << "no backup in " << root << " was taken at or before "
+                                        << targetMillis);
+        }
+        const std::string backupDir =
+            root + "/" + kMetaDir + "/" + std::to_string(backupMillis);
+        BSONObj info;
+        status = readInfo(backupDir + "/" + kInfoFile, &info);
+        if (!status.isOK()) {
+            return status;
+        }
+
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(dbPath, ec);
+        if (!ec) {
+            boost::filesystem::create_directories(walDir, ec);
+        }
+        if (ec) {
+            return Status(ErrorCodes::FileNotOpen,
+                          str::stream() << "failed to create " << dbPath << ": " << ec.message());
+        }
+
+        std::vector<CopyJob> jobs;
+        auto addJob = [&jobs](const std::string& from, const std::string& to) {
+            CopyJob job{from, to, 0};
+            fileSize(from, &job.size);
+            jobs.push_back(std::move(job));
+        };
+        for (const auto& e : info["meta"].Array()) {
+            addJob(backupDir + "/" + e.String(), dbPath + "/" + e.String());
+        }
+        for (const auto& e : info["files"].Array()) {
+            addJob(root + "/" + kSharedDir + "/" + e.String(), dbPath + "/" + e.String());
+        }
+        // WAL segments older than the backup are already in its SST files
+        const uint64_t minLogNumber = static_cast<uint64_t>(info["minLogNumber"].numberLong());
+        std::vector<std::string> walFiles;
+        status = listDir(root + "/" + kWalDir, &walFiles);
+        if (!status.isOK()) {
+            return status;
+        }
+        for (const auto& name : walFiles) {
+            if (endsWith(name, ".log") &&
+                std::strtoull(name.c_str(), nullptr, 10) >= minLogNumber) {
+                addJob(root + "/" + kWalDir + "/" + name, walDir + "/" + name);
+            }
+        }
+
+        log() << "Restoring backup " << backupDir << " to " << dbPath << ", " << jobs.size()
+              << " files";
+        Timer timer;
+        status = copyFiles(jobs, threads, nullptr, [](uint64_t) {}, [] {});
+        if (!status.isOK()) {
+            // a partial restore must not look like a database on the next attempt
+            for (const auto& job : jobs) {
+                rocksdb::Env::Default()->DeleteFile(job.to);
+            }
+            return status;
+        }
+        log() << "Restored backup " << backupDir << " in " << timer.millis() << "ms";
+        return status;
+    }
+
+    rocksdb::WalFilter::WalProcessingOption RocksPointInTimeWalFilter::LogRecord(
+        const rocksdb::WriteBatch& batch, rocksdb::WriteBatch* newBatch, bool* batchChanged) const {
+        long long millis;
+        if (_targetMillis > 0 && RocksIncrementalBackup::parseTimeMarker(batch, &millis) &&
+            millis > _targetMillis) {
+            log() << "Stopping WAL replay at time marker "
+                  << Date_t::fromMillisSinceEpoch(millis);
+            return WalProcessingOption::kStopReplay;
+        }
+        return WalProcessingOption::kContinueProcessing;
+    }
+}
@@ -0,0 +1,182 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <rocksdb/wal_filter.h>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/base/status.h"
+#include "mongo/bson/bsonobj.h"
+#include "mongo/stdx/condition_variable.h"
+#include "mongo/stdx/mutex.h"
+#include "mongo/util/background.h"
+
+namespace rocksdb {
+    class DB;
+    class RateLimiter;
+    class WriteBatch;
+}
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Incremental backups into a backup root directory that is reused from one backup to the
+     * next. Layout of the root:
+     *
+     *   IDENTITY        identity of the backed up DB, a root only takes backups of one DB
+     *   shared/         SST files. SST files are immutable and their names are never reused by
+     *                   a DB, so a file that is already here is never copied again
+     *   wal/            archived WAL segments
+     *   meta/<millis>/  CURRENT, MANIFEST and OPTIONS of one backup, plus INFO (BSON) with the
+     *                   list of SST files and WAL segments it needs
+     *
+     * A backup flushes the memtables, copies the SST files that are not in shared/ yet and the
+     * WAL segments that are not fully in wal/ yet. archiveWal() only does the last part, so it
+     * can run much more often than backups. WAL segments only survive between two runs if
+     * storage.rocksdb.walArchiveTTLSecs keeps obsolete segments around for long enough, so both
+     * refuse to run while WAL archiving is off.
+     *
+     * After each backup only the latest keepBackups backups are kept. SST files and WAL segments
+     * that none of them needs anymore are deleted from the root.
+     *
+     * While WAL archiving is on, run() writes a time marker into the WAL once a second (if there
+     * were writes), which restore() uses to stop the WAL replay at a point in time.
+     *
+     * Copies run on several threads and share a rate limiter of their own, so a backup doesn't
+     * steal the flush and compaction budget.
+     */
+    class RocksIncrementalBackup : public BackgroundJob {
+        MONGO_DISALLOW_COPYING(RocksIncrementalBackup);
+
+    public:
+        // maxMBPerSec <= 0 means that copies are not rate limited, keepBackups <= 0 that all
+        // backups are kept
+        RocksIncrementalBackup(rocksdb::DB* db, int threads, int maxMBPerSec, int keepBackups);
+        ~RocksIncrementalBackup();
+
+        virtual std::string name() const { return "RocksIncrementalBackup"; }
+
+        // writes the time markers. Only started if WAL archiving is enabled
+        virtual void run();
+
+        void shutdown();
+
+        // Only one backup or WAL archival runs at a time, others fail with
+        // ConflictingOperationInProgress
+        Status backup(const std::string& root);
+        Status archiveWal(const std::string& root);
+
+        void appendProgress(BSONObjBuilder* builder) const;
+
+        /**
+         * Fills an empty dbPath (and walDir) from the latest backup in root that was taken at or
+         * before targetMillis (the latest backup if targetMillis is 0), together with the
+         * archived WAL segments that follow it. Open the DB with a RocksPointInTimeWalFilter for
+         * targetMillis to stop the replay at that time. If the restore fails, the files it
+         * already copied are removed again.
+         */
+        static Status restore(const std::string& root, const std::string& dbPath,
+                              const std::string& walDir, long long targetMillis, int threads);
+
+        // Returns true if the batch is a time marker, and the time it carries
+        static bool parseTimeMarker(const rocksdb::WriteBatch& batch, long long* millis);
+
+        struct CopyJob {
+            std::string from;
+            std::string to;
+            // copies only the first `size` bytes of `from`. The live WAL and MANIFEST keep
+            // growing while we copy them
+            uint64_t size;
+        };
+
+    private:
+        Status _run(const std::string& root, bool walOnly);
+        Status _checkIdentity(const std::string& root);
+        Status _walJobs(const std::string& root, std::vector<CopyJob>* jobs,
+                        std::vector<std::string>* walFiles, uint64_t* minLogNumber);
+        Status _copy(const std::vector<CopyJob>& jobs);
+        Status _prune(const std::string& root);
+        void _writeTimeMarker();
+
+        rocksdb::DB* _db;  // not owned
+        const int _threads;
+        const int _keepBackups;
+        std::unique_ptr<rocksdb::RateLimiter> _rateLimiter;
+
+        // serializes backups and WAL archivals
+        stdx::mutex _runMutex;
+
+        mutable stdx::mutex _mutex;
+        stdx::condition_variable _shutdownCondition;
+        // protected by _mutex
+        bool _shuttingDown = false;
+        std::string _state = "idle";
+        std::string _root;
+        long long _startedAt = 0;
+        long long _filesTotal = 0;
+        long long _filesCopied = 0;
+        long long _filesSkipped = 0;
+        long long _bytesTotal = 0;
+        long long _bytesCopied = 0;
+        long long _backupsPruned = 0;
+        long long _filesPruned = 0;
+        long long _lastBackupMillis = 0;
+        std::string _lastError;
+        // sequence number at the last time marker
+        uint64_t _markedSequence = 0;
+
+        static const int kTimeMarkerIntervalSecs = 1;
+    };
+
+    /**
+     * Stops the WAL replay of a restored DB at the first time marker after targetMillis.
+     * Everything before that marker is replayed, so the restored state can be up to
+     * kTimeMarkerIntervalSecs newer than the target.
+     */
+    class RocksPointInTimeWalFilter : public rocksdb::WalFilter {
+    public:
+        explicit RocksPointInTimeWalFilter(long long targetMillis) : _targetMillis(targetMillis) {}
+
+        virtual WalProcessingOption LogRecord(const rocksdb::WriteBatch& batch,
+                                              rocksdb::WriteBatch* newBatch,
+                                              bool* batchChanged) const;
+
+        virtual const char* Name() const { return "RocksPointInTimeWalFilter"; }
+
+    private:
+        const long long _targetMillis;
+    };
+}
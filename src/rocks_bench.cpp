@@ -0,0 +1,932 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+/**
+ * Microbenchmarks for storage engine components that can run without a mongod. Usage:
+ *   storage_rocks_bench [--threads=N] [--docs=N] [--docSize=N] [--readers=N]
+ *                       [--oplogSizeMB=N] [benchmark...]
+ * Runs all benchmarks if none is given. Every result is one line starting with the
+ * benchmark's name, so runs can be diffed for regression tracking.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <rocksdb/cache.h>
+#include <rocksdb/db.h>
+#include <rocksdb/options.h>
+#include <rocksdb/perf_context.h>
+#include <rocksdb/perf_level.h>
+#include <rocksdb/table.h>
+
+#include "mongo/base/checked_cast.h"
+#include "mongo/base/initializer.h"
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/db/catalog/collection_options.h"
+#include "mongo/db/client.h"
+#include "mongo/db/concurrency/write_conflict_exception.h"
+#include "mongo/db/operation_context_noop.h"
+#include "mongo/db/storage/record_store.h"
+#include "mongo/platform/endian.h"
+#include "mongo/stdx/chrono.h"
+#include "mongo/stdx/memory.h"
+#include "mongo/stdx/thread.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/time_support.h"
+#include "mongo/util/timer.h"
+
+#include "rocks_engine.h"
+#include "rocks_global_options.h"
+#include "rocks_histogram.h"
+#include "rocks_index.h"
+#include "rocks_record_store.h"
+#include "rocks_row_cache.h"
+
+namespace mongo {
+    namespace {
+
+        /**
+         * Returns item indexes in [0, numItems) with a Zipfian distribution, item 0 being the
+         * most popular. Uses a precomputed CDF, fine for the item counts used here.
+         */
+        class ZipfianGenerator {
+        public:
+            ZipfianGenerator(size_t numItems, double theta, uint64_t seed = 42)
+                : _cdf(numItems), _random(seed) {
+                double sum = 0;
+                for (size_t i = 0; i < numItems; ++i) {
+                    sum += 1.0 / std::pow(static_cast<double>(i + 1), theta);
+                    _cdf[i] = sum;
+                }
+                for (auto& c : _cdf) {
+                    c /= sum;
+                }
+            }
+
+            size_t next() {
+                double u = _uniform(_random);
+                return std::lower_bound(_cdf.begin(), _cdf.end(), u) - _cdf.begin();
+            }
+
+        private:
+            std::vector<double> _cdf;
+            std::mt19937_64 _random;
+            std::uniform_real_distribution<double> _uniform{0.0, 1.0};
+        };
+
+        std::string tempPath() {
+            return (boost::filesystem::temp_directory_path() /
+                    boost::filesystem::unique_path("mongo-rocks-bench-%%%%-%%%%"))
+                .string();
+        }
+
+        // RocksDB instance in a temporary directory, removed on destruction
+        class BenchDB {
+        public:
+            explicit BenchDB(rocksdb::Options options) : _path(tempPath()) {
+                options.create_if_missing = true;
+                rocksdb::DB* db;
+                auto s = rocksdb::DB::Open(options, _path, &db);
+                if (!s.ok()) {
+                    std::cerr << "failed to open " << _path << ": " << s.ToString() << std::endl;
+                    std::exit(1);
+                }
+                _db.reset(db);
+            }
+
+            ~BenchDB() {
+                _db.reset();
+                boost::system::error_code ec;
+                boost::filesystem::remove_all(_path, ec);
+            }
+
+            rocksdb::DB* get() { return _db.get(); }
+
+        private:
+            std::string _path;
+            std::unique_ptr<rocksdb::DB> _db;
+        };
+
+        void report(const std::string& name, long long ops, long long micros) {
+            std::cout << name << ": " << ops << " ops in " << micros / 1000 << "ms, "
+                      << (micros > 0 ? ops * 1000000 / micros : 0) << " ops/s" << std::endl;
+        }
+
+        void reportLatency(const std::string& name, long long ops, long long micros,
+                           const RocksHistogram::Snapshot& nanos) {
+            std::cout << name << ": " << ops << " ops in " << micros / 1000 << "ms, "
+                      << (micros > 0 ? ops * 1000000 / micros : 0) << " ops/s, p50 "
+                      << nanos.percentile(0.5) << "ns, p99 " << nanos.percentile(0.99)
+                      << "ns, p99.9 " << nanos.percentile(0.999) << "ns" << std::endl;
+        }
+
+        // parameters of the record store and index workloads, set with --name=value
+        struct BenchParams {
+            // every workload runs on one thread, and on this many if it's more than one
+            int threads = 8;
+            // documents or keys inserted, then read, updated and deleted
+            int docs = 200 * 1000;
+            int docSize = 256;
+            // tailing readers of the oplog benchmark
+            int readers = 2;
+            // oplog cap, small enough for --docs oplog entries to be truncated continuously
+            int oplogSizeMB = 16;
+        };
+
+        BenchParams benchParams;
+
+        bool parseParam(const std::string& arg) {
+            auto equals = arg.find('=');
+            if (arg.compare(0, 2, "--") != 0 || equals == std::string::npos) {
+                return false;
+            }
+            const std::string name = arg.substr(2, equals - 2);
+            const int value = std::atoi(arg.c_str() + equals + 1);
+            if (value <= 0) {
+                return false;
+            }
+            if (name == "threads") {
+                benchParams.threads = value;
+            } else if (name == "docs") {
+                benchParams.docs = value;
+            } else if (name == "docSize") {
+                benchParams.docSize = value;
+            } else if (name == "readers") {
+                benchParams.readers = value;
+            } else if (name == "oplogSizeMB") {
+                benchParams.oplogSizeMB = value;
+            } else {
+                return false;
+            }
+            return true;
+        }
+
+        std::vector<int> threadCounts() {
+            std::vector<int> counts = {1};
+            if (benchParams.threads > 1) {
+                counts.push_back(benchParams.threads);
+            }
+            return counts;
+        }
+
+        long long nowNanos() {
+            return stdx::chrono::duration_cast<stdx::chrono::nanoseconds>(
+                       stdx::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+
+        /**
+         * Runs op(opCtx, i) for every i in [0, numOps), split in contiguous ranges between
+         * numThreads threads. Every thread has its own operation context. Reports throughput and
+         * the latency of single ops.
+         */
+        void runWorkload(RocksEngine* engine, const std::string& name, int numThreads,
+                         int numOps, const std::function<void(OperationContext*, int)>& op) {
+            RocksHistogram latency;
+            std::vector<stdx::thread> threads;
+            Timer timer;
+            for (int t = 0; t < numThreads; ++t) {
+                threads.emplace_back([&, t] {
+                    OperationContextNoop opCtx(engine->newRecoveryUnit());
+                    const int begin = static_cast<long long>(numOps) * t / numThreads;
+                    const int end = static_cast<long long>(numOps) * (t + 1) / numThreads;
+                    for (int i = begin; i < end; ++i) {
+                        const long long start = nowNanos();
+                        op(&opCtx, i);
+                        latency.record(nowNanos() - start);
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            reportLatency(name + "-" + std::to_string(numThreads) + "t", numOps, timer.micros(),
+                          latency.snapshot());
+        }
+
+        // Runs f in a unit of work, retrying on write conflicts between the bench threads
+        void writeWithRetry(OperationContext* opCtx, const std::function<void()>& f) {
+            while (true) {
+                try {
+                    WriteUnitOfWork wuow(opCtx);
+                    f();
+                    wuow.commit();
+                    return;
+                } catch (const WriteConflictException&) {
+                    opCtx->recoveryUnit()->abandonSnapshot();
+                }
+            }
+        }
+
+        // spreads consecutive ops over the key space
+        int scatter(int i, int numItems) {
+            return static_cast<int>(static_cast<long long>(i) * 7919 % numItems);
+        }
+
+        std::string recordKey(const std::string& prefix, int64_t id) {
+            int64_t bigEndian = endian::nativeToBig(id);
+            return prefix + std::string(reinterpret_cast<const char*>(&bigEndian),
+                                        sizeof(bigEndian));
+        }
+
+        /**
+         * Point reads of 512 byte documents with a Zipfian distribution, through the block cache
+         * only and through RocksRowCache. The data set is several times larger than the block
+         * cache, as it is for the collections the row cache is meant for.
+         */
+        void benchRowCache() {
+            const int kNumDocs = 200 * 1000;
+            const int kDocSize = 512;
+            const int kNumReads = 1000 * 1000;
+            const std::string prefix("\0\0\0\1", 4);
+
+            rocksdb::Options options;
+            rocksdb::BlockBasedTableOptions tableOptions;
+            tableOptions.block_cache = rocksdb::NewLRUCache(16 << 20);
+            tableOptions.block_size = 16 * 1024;
+            options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(tableOptions));
+            options.compression = rocksdb::kSnappyCompression;
+            BenchDB db(options);
+
+            std::mt19937_64 random(1);
+            std::string doc(kDocSize, '\0');
+            for (int i = 0; i < kNumDocs; ++i) {
+                for (auto& c : doc) {
+                    // compressible, like BSON with repeated field names
+                    c = 'a' + random() % 4;
+                }
+                db.get()->Put(rocksdb::WriteOptions(), recordKey(prefix, i), doc);
+            }
+            db.get()->Flush(rocksdb::FlushOptions());
+            db.get()->CompactRange(rocksdb::CompactRangeOptions(), nullptr, nullptr);
+
+            std::vector<std::string> keys;
+            {
+                ZipfianGenerator zipf(kNumDocs, 0.99);
+                keys.reserve(kNumReads);
+                for (int i = 0; i < kNumReads; ++i) {
+                    // scatter the popular documents over the key space
+                    int64_t id = (static_cast<int64_t>(zipf.next()) * 7919) % kNumDocs;
+                    keys.push_back(recordKey(prefix, id));
+                }
+            }
+
+            std::string value;
+            {
+                Timer timer;
+                for (const auto& key : keys) {
+                    const rocksdb::Snapshot* snapshot = db.get()->GetSnapshot();
+                    rocksdb::ReadOptions readOptions;
+                    readOptions.snapshot = snapshot;
+                    db.get()->Get(readOptions, key, &value);
+                    db.get()->ReleaseSnapshot(snapshot);
+                }
+                report("rowcache/block-cache-only", kNumReads, timer.micros());
+            }
+            {
+                RocksRowCache rowCache(64 << 20);
+                Timer timer;
+                long long hits = 0;
+                for (const auto& key : keys) {
+                    // same as RocksRecoveryUnit::GetWithRowCache
+                    const rocksdb::Snapshot* snapshot = db.get()->GetSnapshot();
+                    if (rowCache.lookup(key, snapshot->GetSequenceNumber(), &value)) {
+                        ++hits;
+                    } else {
+                        rocksdb::ReadOptions readOptions;
+                        readOptions.snapshot = snapshot;
+                        if (db.get()->Get(readOptions, key, &value).ok()) {
+                            rowCache.insert(key, value, snapshot->GetSequenceNumber());
+                        }
+                    }
+                    db.get()->ReleaseSnapshot(snapshot);
+                }
+                report("rowcache/row-cache", kNumReads, timer.micros());
+                std::cout << "rowcache/row-cache: hit rate " << hits * 100 / kNumReads << "%"
+                          << std::endl;
+            }
+        }
+
+        /**
+         * Compression ratio and read cost of each codec on small documents shaped like typical
+         * JSON records: the same field names in every document and values from small
+         * vocabularies. Everything is compacted into the bottommost level, where the zstd
+         * dictionary is used, and read back through a block cache too small to hold it, so most
+         * reads decompress a block.
+         */
+        void benchCompression() {
+            struct Codec {
+                const char* name;
+                rocksdb::CompressionType type;
+                uint32_t maxDictBytes;
+            };
+            const std::vector<Codec> codecs = {
+                {"none", rocksdb::kNoCompression, 0},
+                {"snappy", rocksdb::kSnappyCompression, 0},
+                {"lz4", rocksdb::kLZ4Compression, 0},
+                {"zstd", rocksdb::kZSTD, 0},
+                {"zstd-dict16k", rocksdb::kZSTD, 16 * 1024},
+            };
+            const char* const kStatuses[] = {"active", "pending", "suspended", "closed"};
+            const char* const kCities[] = {"New York", "Berlin", "Paris",  "Sao Paulo",
+                                           "Mumbai",   "Tokyo",  "London", "Sydney"};
+            const char* const kTags[] = {"new",    "premium", "mobile", "web",
+                                         "trial",  "partner", "beta",   "newsletter"};
+            const int numDocs = benchParams.docs;
+            const int kNumReads = 200 * 1000;
+            const std::string prefix("\0\0\0\1", 4);
+
+            std::vector<std::string> docs;
+            long long rawBytes = 0;
+            std::mt19937_64 random(1);
+            docs.reserve(numDocs);
+            for (int i = 0; i < numDocs; ++i) {
+                BSONObjBuilder b;
+                b.append("_id", i);
+                const std::string user = "user" + std::to_string(random() % 100000);
+                b.append("user", user);
+                b.append("email", user + "@example.com");
+                b.append("status", kStatuses[random() % 4]);
+                b.append("score", static_cast<double>(random() % 10000) / 100);
+                b.appendDate("createdAt", Date_t::fromMillisSinceEpoch(
+                                              1500000000000LL + random() % 1000000000));
+                {
+                    BSONObjBuilder address(b.subobjStart("address"));
+                    address.append("street", std::to_string(random() % 1000) + " Main Street");
+                    address.append("city", kCities[random() % 8]);
+                    address.append("zip", std::to_string(10000 + random() % 90000));
+                }
+                {
+                    BSONArrayBuilder tags(b.subarrayStart("tags"));
+                    for (int j = 0; j < 3; ++j) {
+                        tags.append(kTags[random() % 8]);
+                    }
+                }
+                BSONObj obj = b.obj();
+                rawBytes += obj.objsize();
+                docs.emplace_back(obj.objdata(), obj.objsize());
+            }
+
+            for (const auto& codec : codecs) {
+                const std::string name = std::string("compression/") + codec.name;
+                rocksdb::Options options;
+                rocksdb::BlockBasedTableOptions tableOptions;
+                tableOptions.block_cache = rocksdb::NewLRUCache(1 << 20);
+                tableOptions.block_size = 16 * 1024;
+                options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(tableOptions));
+                options.compression = codec.type;
+                options.compression_opts.max_dict_bytes = codec.maxDictBytes;
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 11))
+                options.compression_opts.zstd_max_train_bytes = 100 * codec.maxDictBytes;
+#endif
+                BenchDB db(options);
+
+                Timer loadTimer;
+                for (int i = 0; i < numDocs; ++i) {
+                    db.get()->Put(rocksdb::WriteOptions(), recordKey(prefix, i), docs[i]);
+                }
+                db.get()->Flush(rocksdb::FlushOptions());
+                db.get()->CompactRange(rocksdb::CompactRangeOptions(), nullptr, nullptr);
+                const long long loadMicros = loadTimer.micros();
+                uint64_t sstBytes = 0;
+                db.get()->GetIntProperty("rocksdb.total-sst-files-size", &sstBytes);
+                std::cout << name << ": ratio "
+                          << (sstBytes > 0 ? static_cast<double>(rawBytes) / sstBytes : 0)
+                          << ", " << rawBytes / 1024 << "KB raw, " << sstBytes / 1024
+                          << "KB on disk, load and compact " << loadMicros / 1000 << "ms"
+                          << std::endl;
+
+                std::string value;
+                rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableTime);
+                rocksdb::perf_context.Reset();
+                Timer readTimer;
+                for (int i = 0; i < kNumReads; ++i) {
+                    db.get()->Get(rocksdb::ReadOptions(), recordKey(prefix, scatter(i, numDocs)),
+                                  &value);
+                }
+                const long long readMicros = readTimer.micros();
+                const uint64_t decompressNanos = rocksdb::perf_context.block_decompress_time;
+                rocksdb::SetPerfLevel(rocksdb::PerfLevel::kDisable);
+                report(name + "/read", kNumReads, readMicros);
+                std::cout << name << "/read: " << decompressNanos / kNumReads
+                          << "ns decompressing per read" << std::endl;
+            }
+        }
+
+        /**
+         * Time spent by the storage engine at startup with many collections: opening the engine
+         * and then every record store, which is what mongod does before it accepts connections.
+         * Every collection has a few documents, so finding the next RecordId isn't free.
+         */
+        void benchStartup() {
+            const int kNumCollections = 20 * 1000;
+            const std::string path = tempPath();
+            auto ident = [](int i) { return "collection-" + std::to_string(i); };
+            auto ns = [](int i) { return "bench.c" + std::to_string(i); };
+
+            {
+                RocksEngine engine(path, false, 3, false);
+                for (int i = 0; i < kNumCollections; ++i) {
+                    OperationContextNoop opCtx(engine.newRecoveryUnit());
+                    CollectionOptions options;
+                    invariant(engine.createRecordStore(&opCtx, ns(i), ident(i), options).isOK());
+                    auto rs = engine.getRecordStore(&opCtx, ns(i), ident(i), options);
+                    WriteUnitOfWork wuow(&opCtx);
+                    for (int j = 0; j < 3; ++j) {
+                        const char doc[] = "document";
+                        invariant(rs->insertRecord(&opCtx, doc, sizeof(doc), false).isOK());
+                    }
+                    wuow.commit();
+                }
+            }
+
+            Timer timer;
+            {
+                RocksEngine engine(path, false, 3, false);
+                long long openEngineMicros = timer.micros();
+                std::vector<std::unique_ptr<RecordStore>> recordStores;
+                for (int i = 0; i < kNumCollections; ++i) {
+                    OperationContextNoop opCtx(engine.newRecoveryUnit());
+                    recordStores.push_back(
+                        engine.getRecordStore(&opCtx, ns(i), ident(i), CollectionOptions()));
+                }
+                report("startup/open-engine", 1, openEngineMicros);
+                report("startup/open-collections", kNumCollections,
+                       timer.micros() - openEngineMicros);
+            }
+
+            boost::system::error_code ec;
+            boost::filesystem::remove_all(path, ec);
+        }
+
+        /**
+         * Cost of RocksHistogram::record() on one and on many threads, compared to a point read
+         * served from the block cache, the cheapest operation that records a latency. The
+         * recovery unit already reads the clock for the rate limiter tuner, so record() is the
+         * whole added cost and should stay under 1% of the read.
+         */
+        void benchHistogram() {
+            const int kNumRecords = 20 * 1000 * 1000;
+            const int kNumThreads = 8;
+            const int kNumDocs = 100 * 1000;
+            const int kNumReads = 1000 * 1000;
+
+            RocksHistogram histogram;
+            {
+                Timer timer;
+                for (int i = 0; i < kNumRecords; ++i) {
+                    histogram.record(i & 0xFFFF);
+                }
+                report("histogram/record", kNumRecords, timer.micros());
+            }
+            long long singleThreadNanos = 0;
+            {
+                Timer timer;
+                for (int i = 0; i < kNumRecords; ++i) {
+                    histogram.record(i & 0xFFFF);
+                }
+                singleThreadNanos = timer.micros() * 1000 / kNumRecords;
+            }
+            {
+                std::vector<stdx::thread> threads;
+                Timer timer;
+                for (int t = 0; t < kNumThreads; ++t) {
+                    threads.emplace_back([&histogram, t] {
+                        for (int i = 0; i < kNumRecords / kNumThreads; ++i) {
+                            histogram.record((i * (t + 1)) & 0xFFFF);
+                        }
+                    });
+                }
+                for (auto& thread : threads) {
+                    thread.join();
+                }
+                report("histogram/record-" + std::to_string(kNumThreads) + "-threads",
+                       kNumRecords, timer.micros());
+            }
+
+            const std::string prefix("\0\0\0\1", 4);
+            BenchDB db{rocksdb::Options()};
+            for (int i = 0; i < kNumDocs; ++i) {
+                db.get()->Put(rocksdb::WriteOptions(), recordKey(prefix, i), "document");
+            }
+            db.get()->Flush(rocksdb::FlushOptions());
+            std::string value;
+            long long getNanos = 0;
+            {
+                Timer timer;
+                for (int i = 0; i < kNumReads; ++i) {
+                    db.get()->Get(rocksdb::ReadOptions(), recordKey(prefix, (i * 7919) % kNumDocs),
+                                  &value);
+                }
+                getNanos = timer.micros() * 1000 / kNumReads;
+                report("histogram/cached-get", kNumReads, timer.micros());
+            }
+            double overhead = getNanos > 0 ? 100.0 * singleThreadNanos / getNanos : 0;
+            std::cout << "histogram: record() takes " << singleThreadNanos << "ns, "
+                      << overhead << "% of a cached point read (" << getNanos << "ns) -- "
+                      << (overhead < 1.0 ? "OK" : "ABOVE 1%") << std::endl;
+        }
+
+        /**
+         * Inserts, point reads, short range scans, updates and deletes of documents through
+         * RocksRecordStore, on one and on --threads threads. Each thread count gets a collection
+         * of its own.
+         */
+        void benchRecordStore() {
+            const int kScanLength = 100;
+            const int numDocs = benchParams.docs;
+            const std::string path = tempPath();
+            const std::string doc(benchParams.docSize, 'x');
+            {
+                RocksEngine engine(path, false, 3, false);
+                for (int numThreads : threadCounts()) {
+                    const std::string ns = "bench.c" + std::to_string(numThreads);
+                    const std::string ident = "collection-" + std::to_string(numThreads);
+                    std::unique_ptr<RecordStore> rs;
+                    {
+                        OperationContextNoop opCtx(engine.newRecoveryUnit());
+                        invariant(
+                            engine.createRecordStore(&opCtx, ns, ident, CollectionOptions())
+                                .isOK());
+                        rs = engine.getRecordStore(&opCtx, ns, ident, CollectionOptions());
+                    }
+
+                    std::vector<RecordId> ids(numDocs);
+                    runWorkload(&engine, "recordstore/insert", numThreads, numDocs,
+                                [&](OperationContext* opCtx, int i) {
+                                    writeWithRetry(opCtx, [&] {
+                                        ids[i] = rs->insertRecord(opCtx, doc.data(), doc.size(),
+                                                                  false)
+                                                     .getValue();
+                                    });
+                                });
+                    runWorkload(&engine, "recordstore/read", numThreads, numDocs,
+                                [&](OperationContext* opCtx, int i) {
+                                    RecordData data;
+                                    invariant(rs->findRecord(opCtx, ids[scatter(i, numDocs)],
+                                                             &data));
+                                    opCtx->recoveryUnit()->abandonSnapshot();
+                                });
+                    runWorkload(&engine, "recordstore/scan" + std::to_string(kScanLength),
+                                numThreads, numDocs / kScanLength,
+                                [&](OperationContext* opCtx, int i) {
+                                    auto cursor = rs->getCursor(opCtx);
+                                    invariant(cursor->seekExact(ids[i * kScanLength]));
+                                    for (int j = 1; j < kScanLength; ++j) {
+                                        invariant(cursor->next());
+                                    }
+                                    cursor.reset();
+                                    opCtx->recoveryUnit()->abandonSnapshot();
+                                });
+                    runWorkload(&engine, "recordstore/update", numThreads, numDocs,
+                                [&](OperationContext* opCtx, int i) {
+                                    writeWithRetry(opCtx, [&] {
+                                        invariant(rs->updateRecord(opCtx, ids[scatter(i, numDocs)],
+                                                                   doc.data(), doc.size(), false,
+                                                                   nullptr)
+                                                      .isOK());
+                                    });
+                                });
+                    runWorkload(&engine, "recordstore/delete", numThreads, numDocs,
+                                [&](OperationContext* opCtx, int i) {
+                                    writeWithRetry(opCtx,
+                                                   [&] { rs->deleteRecord(opCtx, ids[i]); });
+                                });
+                }
+            }
+            boost::system::error_code ec;
+            boost::filesystem::remove_all(path, ec);
+        }
+
+        /**
+         * Inserts, point seeks, short range scans and deletes of {"": <int>} keys through
+         * RocksStandardIndex or RocksUniqueIndex, on one and on --threads threads.
+         */
+        void benchIndex(bool unique) {
+            const int kScanLength = 100;
+            const int numKeys = benchParams.docs;
+            const std::string name = unique ? "uniqueindex" : "index";
+            const std::string path = tempPath();
+            {
+                RocksEngine engine(path, false, 3, false);
+                BSONObjBuilder configBuilder;
+                RocksIndexBase::generateConfig(&configBuilder, 3,
+                                               IndexDescriptor::IndexVersion::kV2);
+                const BSONObj config = configBuilder.obj();
+                auto key = [](int i) { return BSON("" << i); };
+                for (int numThreads : threadCounts()) {
+                    // far above the prefixes the engine hands out
+                    const std::string prefix = recordKey("", 0x7f000000 + numThreads).substr(4);
+                    std::unique_ptr<SortedDataInterface> index;
+                    if (unique) {
+                        index = stdx::make_unique<RocksUniqueIndex>(
+                            engine.getDB(), prefix, name, Ordering::make(BSONObj()), config);
+                    } else {
+                        index = stdx::make_unique<RocksStandardIndex>(
+                            engine.getDB(), prefix, name, Ordering::make(BSONObj()), config);
+                    }
+                    // standard indexes always allow dups
+                    const bool dupsAllowed = !unique;
+
+                    runWorkload(&engine, name + "/insert", numThreads, numKeys,
+                                [&](OperationContext* opCtx, int i) {
+                                    writeWithRetry(opCtx, [&] {
+                                        invariant(index->insert(opCtx, key(i), RecordId(i + 1),
+                                                                dupsAllowed)
+                                                      .isOK());
+                                    });
+                                });
+                    runWorkload(&engine, name + "/seek", numThreads, numKeys,
+                                [&](OperationContext* opCtx, int i) {
+                                    auto cursor = index->newCursor(opCtx);
+                                    invariant(cursor->seek(key(scatter(i, numKeys)), true));
+                                    cursor.reset();
+                                    opCtx->recoveryUnit()->abandonSnapshot();
+                                });
+                    runWorkload(&engine, name + "/scan" + std::to_string(kScanLength),
+                                numThreads, numKeys / kScanLength,
+                                [&](OperationContext* opCtx, int i) {
+                                    auto cursor = index->newCursor(opCtx);
+                                    invariant(cursor->seek(key(i * kScanLength), true));
+                                    for (int j = 1; j < kScanLength; ++j) {
+                                        invariant(cursor->next());
+                                    }
+                                    cursor.reset();
+                                    opCtx->recoveryUnit()->abandonSnapshot();
+                                });
+                    runWorkload(&engine, name + "/delete", numThreads, numKeys,
+                                [&](OperationContext* opCtx, int i) {
+                                    writeWithRetry(opCtx, [&] {
+                                        index->unindex(opCtx, key(i), RecordId(i + 1),
+                                                       dupsAllowed);
+                                    });
+                                });
+                }
+            }
+            boost::system::error_code ec;
+            boost::filesystem::remove_all(path, ec);
+        }
+
+        /**
+         * --threads oplog writers, --readers tailing readers and a truncation thread on a
+         * --oplogSizeMB oplog, once in the default column family and once with
+         * useSeparateOplogCF.
+         *
+         * Writers register their optime and insert in optime order, like replication does, but
+         * hold their unit of work open for a varying time, so that commits complete out of order
+         * and visibility waits on the holes. Readers wait in
+         * waitForAllEarlierOplogWritesToBeVisible() and read everything after their last entry,
+         * restarting from the oldest entry if truncation overtook them. The visibility lag is the
+         * time from an entry's commit to a reader seeing it. The truncation thread deletes on the
+         * schedule of the mongod's RocksRecordStoreThread, which the mock service context lacks:
+         * woken up by inserts, back to back while behind.
+         * The oplog's size is reported once a second.
+         */
+        void benchOplog(bool separateCF) {
+            const int kMaxCommitDelayMicros = 100;
+            const int numWrites = benchParams.docs;
+            const std::string name = separateCF ? "oplog-separatecf" : "oplog-sharedcf";
+            const std::string path = tempPath();
+            const std::string padding(benchParams.docSize, 'x');
+            const bool oldSeparateCF = rocksGlobalOptions.useSeparateOplogCF;
+            rocksGlobalOptions.useSeparateOplogCF = separateCF;
+            {
+                RocksEngine engine(path, false, 3, false);
+                const std::string ns = "local.oplog.rs";
+                const std::string ident = "oplog";
+                CollectionOptions options;
+                options.capped = true;
+                options.cappedSize = benchParams.oplogSizeMB * 1024LL * 1024;
+                std::unique_ptr<RecordStore> recordStore;
+                {
+                    OperationContextNoop opCtx(engine.newRecoveryUnit());
+                    invariant(engine.createRecordStore(&opCtx, ns, ident, options).isOK());
+                    recordStore = engine.getRecordStore(&opCtx, ns, ident, options);
+                }
+                RocksRecordStore* rs = checked_cast<RocksRecordStore*>(recordStore.get());
+
+                // entry i has optime (1, i + 1). Read by the readers once the entry is visible
+                std::unique_ptr<std::atomic<long long>[]> commitNanos(
+                    new std::atomic<long long>[numWrites]);
+                stdx::mutex optimeMutex;
+                int nextOptime = 0;
+                std::atomic<bool> writersDone(false);
+
+                RocksHistogram lag;
+                std::atomic<long long> entriesRead(0), readerRestarts(0);
+                std::vector<stdx::thread> readers;
+                Timer readTimer;
+                for (int r = 0; r < benchParams.readers; ++r) {
+                    readers.emplace_back([&] {
+                        Client::initThread("oplog-reader");
+                        OperationContextNoop opCtx(&cc(), 0, engine.newRecoveryUnit());
+                        RecordId last;
+                        while (true) {
+                            const bool done = writersDone.load();
+                            rs->waitForAllEarlierOplogWritesToBeVisible(&opCtx);
+                            auto cursor = rs->getCursor(&opCtx);
+                            auto record = last.isNull() ? cursor->next() : cursor->seekExact(last);
+                            if (!last.isNull()) {
+                                if (record) {
+                                    record = cursor->next();
+                                } else {
+                                    // truncated past our position
+                                    readerRestarts.fetch_add(1);
+                                    cursor = rs->getCursor(&opCtx);
+                                    record = cursor->next();
+                                }
+                            }
+                            bool advanced = false;
+                            for (; record; record = cursor->next()) {
+                                const int i = static_cast<int>(record->id.repr() & 0xffffffff) - 1;
+                                lag.record(nowNanos() - commitNanos[i].load());
+                                entriesRead.fetch_add(1);
+                                last = record->id;
+                                advanced = true;
+                            }
+                            cursor.reset();
+                            opCtx.recoveryUnit()->abandonSnapshot();
+                            if (!advanced) {
+                                if (done) {
+                                    break;
+                                }
+                                sleepmicros(100);
+                            }
+                        }
+                    });
+                }
+
+                std::atomic<long long> truncated(0), truncatePasses(0);
+                stdx::thread truncator([&] {
+                    Client::initThread("oplog-truncator");
+                    OperationContextNoop opCtx(&cc(), 0, engine.newRecoveryUnit());
+                    while (!writersDone.load()) {
+                        int64_t removed;
+                        bool behind;
+                        {
+                            WriteUnitOfWork wuow(&opCtx);
+                            stdx::lock_guard<boost::timed_mutex> lock(rs->cappedDeleterMutex());
+                            removed = rs->cappedDeleteAsNeeded_inlock(&opCtx, RecordId::max());
+                            wuow.commit();
+                            behind = rs->cappedDeleterBehind();
+                        }
+                        truncated.fetch_add(removed);
+                        truncatePasses.fetch_add(1);
+                        if (!behind || removed == 0) {
+                            rs->cappedDeleterSignal()->wait(
+                                stdx::chrono::milliseconds(behind ? 100 : 1000));
+                        }
+                    }
+                });
+
+                stdx::thread sampler([&] {
+                    OperationContextNoop opCtx(engine.newRecoveryUnit());
+                    for (int seconds = 1; !writersDone.load(); ++seconds) {
+                        sleepmillis(1000);
+                        uint64_t sstBytes = 0;
+                        engine.getDB()->GetAggregatedIntProperty("rocksdb.total-sst-files-size",
+                                                                 &sstBytes);
+                        std::cout << name << "/size: " << seconds << "s, "
+                                  << rs->numRecords(&opCtx) << " entries, data "
+                                  << rs->dataSize(&opCtx) / 1024 << "KB, stored "
+                                  << rs->storageSize(&opCtx) / 1024 << "KB, sst "
+                                  << sstBytes / 1024 << "KB" << std::endl;
+                    }
+                });
+
+                runWorkload(&engine, name + "/write", benchParams.threads, numWrites,
+                            [&](OperationContext* opCtx, int) {
+                                WriteUnitOfWork wuow(opCtx);
+                                int i;
+                                {
+                                    stdx::lock_guard<stdx::mutex> lk(optimeMutex);
+                                    i = nextOptime++;
+                                    invariant(rs->oplogDiskLocRegister(opCtx, Timestamp(1, i + 1))
+                                                  .isOK());
+                                }
+                                BSONObj entry = BSON("ts" << Timestamp(1, i + 1) << "op"
+                                                          << "i"
+                                                          << "o"
+                                                          << BSON("_id" << i << "pad" << padding));
+                                invariant(rs->insertRecord(opCtx, entry.objdata(), entry.objsize(),
+                                                           false)
+                                              .isOK());
+                                sleepmicros((i * 2654435761u) % kMaxCommitDelayMicros);
+                                commitNanos[i].store(nowNanos());
+                                wuow.commit();
+                            });
+                writersDone.store(true);
+                sampler.join();
+                truncator.join();
+                for (auto& reader : readers) {
+                    reader.join();
+                }
+                reportLatency(name + "/visibility-lag-" + std::to_string(benchParams.readers) +
+                                  "r",
+                              entriesRead.load(), readTimer.micros(), lag.snapshot());
+                std::cout << name << "/truncate: " << truncated.load() << " entries in "
+                          << truncatePasses.load() << " passes, " << readerRestarts.load()
+                          << " reader restarts" << std::endl;
+                {
+                    OperationContextNoop opCtx(engine.newRecoveryUnit());
+                    BSONObjBuilder stats;
+                    rs->appendCustomStats(&opCtx, &stats, 1);
+                    std::cout << name << "/truncate: deleter "
+                              << stats.obj().getObjectField("cappedDeleter").toString()
+                              << std::endl;
+                }
+            }
+            rocksGlobalOptions.useSeparateOplogCF = oldSeparateCF;
+            boost::system::error_code ec;
+            boost::filesystem::remove_all(path, ec);
+        }
+
+        typedef void (*BenchFunction)();
+
+        const std::map<std::string, BenchFunction>& benchmarks() {
+            static const std::map<std::string, BenchFunction> kBenchmarks = {
+                {"compression", benchCompression},
+                {"histogram", benchHistogram},
+                {"index", [] { benchIndex(false); }},
+                {"oplog", [] {
+                     benchOplog(false);
+                     benchOplog(true);
+                 }},
+                {"recordstore", benchRecordStore},
+                {"rowcache", benchRowCache},
+                {"startup", benchStartup},
+                {"uniqueindex", [] { benchIndex(true); }},
+            };
+            return kBenchmarks;
+        }
+
+    }  // namespace
+}  // namespace mongo
+
+int main(int argc, char** argv, char** envp) {
+    mongo::runGlobalInitializersOrDie(argc, argv, envp);
+
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg.compare(0, 2, "--") != 0) {
+            selected.push_back(arg);
+        } else if (!mongo::parseParam(arg)) {
+            std::cerr << "invalid parameter " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (selected.empty()) {
+        for (const auto& entry : mongo::benchmarks()) {
+            selected.push_back(entry.first);
+        }
+    }
+    for (const auto& name : selected) {
+        auto it = mongo::benchmarks().find(name);
+        if (it == mongo::benchmarks().end()) {
+            std::cerr << "unknown benchmark " << name << std::endl;
+            return 1;
+        }
+        it->second();
+    }
+    return 0;
+}
@@ -0,0 +1,412 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_bulk_loader.h"
+
+#include <fstream>
+#include <queue>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <rocksdb/db.h>
+#include <rocksdb/env.h>
+#include <rocksdb/options.h>
+#include <rocksdb/sst_file_writer.h>
+
+#include "mongo/db/storage/recovery_unit.h"
+#include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+
+#include "rocks_util.h"
+
+namespace mongo {
+
+    namespace {
+        Status createDir(const std::string& dir) {
+            boost::system::error_code ec;
+            boost::filesystem::create_directories(dir, ec);
+            if (ec) {
+                return Status(ErrorCodes::InternalError,
+                              str::stream() << "can't create " << dir << ": " << ec.message());
+            }
+            return Status::OK();
+        }
+
+        void writeString(std::ofstream* out, const std::string& str) {
+            uint32_t size = static_cast<uint32_t>(str.size());
+            out->write(reinterpret_cast<const char*>(&size), sizeof(size));
+            out->write(str.data(), str.size());
+        }
+
+        /**
+         * Reads back a sorted run, a sequence of <key size><key><value size><value> with sizes
+         * as uint32_t in host byte order. The run only lives as long as its loader.
+         */
+        class RunReader {
+        public:
+            explicit RunReader(const std::string& file) : _in(file, std::ios::binary) {
+                _failed = !_in.is_open();
+            }
+
+            // false at the end of the run, or if it can't be read
+            bool next() {
+                if (_failed) {
+                    return false;
+                }
+                uint32_t size = 0;
+                if (!_in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+                    // a clean end of the run stops right before a key
+                    _failed = _in.gcount() != 0 || !_in.eof();
+                    return false;
+                }
+                if (!_readString(size, &key) || !_in.read(reinterpret_cast<char*>(&size),
+                                                          sizeof(size)) ||
+                    !_readString(size, &value)) {
+                    _failed = true;
+                    return false;
+                }
+                return true;
+            }
+
+            bool failed() const { return _failed; }
+
+            std::string key;
+            std::string value;
+
+        private:
+            bool _readString(uint32_t size, std::string* str) {
+                str->resize(size);
+                return size == 0 || static_cast<bool>(_in.read(&(*str)[0], size));
+            }
+
+            std::ifstream _in;
+            bool _failed = false;
+        };
+
+        class AddOnCommitChange : public RecoveryUnit::Change {
+        public:
+            AddOnCommitChange(std::shared_ptr<RocksBulkLoader> loader, std::string key,
+                              std::string value)
+                : _loader(std::move(loader)), _key(std::move(key)), _value(std::move(value)) {}
+
+            // errors are returned again by finish()
+            virtual void commit() { _loader->add(_key, _value); }
+
+            virtual void rollback() {}
+
+        private:
+            const std::shared_ptr<RocksBulkLoader> _loader;
+            const std::string _key;
+            const std::string _value;
+        };
+    }  // namespace
+
+    RocksBulkLoader::RocksBulkLoader(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                                     std::string dir, std::string name)
+        : _db(db),
+          _cf(cf ? cf : db->DefaultColumnFamily()),
+          _dir(std::move(dir)),
+          _name(std::move(name)) {}
+
+    RocksBulkLoader::~RocksBulkLoader() {
+        // ingestion moves the SST files unless it had to copy them
+        _removeFiles();
+    }
+
+    Status RocksBulkLoader::add(const rocksdb::Slice& key, const rocksdb::Slice& value) {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        if (!_status.isOK()) {
+            return _status;
+        }
+        if (_finished) {
+            // finish() already returned, so the key is lost unless someone hears about it
+            _status = Status(ErrorCodes::IllegalOperation,
+                             str::stream() << "bulk load of " << _name
+                                           << " got a key after it finished");
+            warning() << _status.reason();
+            return _status;
+        }
+        if (!_buffer.emplace(key.ToString(), value.ToString()).second) {
+            _status = Status(ErrorCodes::DuplicateKey,
+                             str::stream() << "bulk load of " << _name
+                                           << " got the same key twice");
+            return _status;
+        }
+        ++_numKeys;
+        _valueBytes += value.size();
+        _bufferBytes += key.size() + value.size();
+        if (_bufferBytes >= kMaxBufferBytes) {
+            _status = _spill();
+        }
+        return _status;
+    }
+
+    void RocksBulkLoader::addOnCommit(RecoveryUnit* ru, std::shared_ptr<RocksBulkLoader> loader,
+                                      std::string key, std::string value) {
+        ru->registerChange(
+            new AddOnCommitChange(std::move(loader), std::move(key), std::move(value)));
+    }
+
+    Status RocksBulkLoader::finish() {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        invariant(!_finished);
+        _finished = true;
+        if (_status.isOK()) {
+            _status = _writeFiles();
+        }
+        return _status;
+    }
+
+    long long RocksBulkLoader::numKeys() const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        return _numKeys;
+    }
+
+    long long RocksBulkLoader::valueBytes() const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        return _valueBytes;
+    }
+
+    size_t RocksBulkLoader::numFiles() const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        return _files.size();
+    }
+
+    Status RocksBulkLoader::_spill() {
+        if (_buffer.empty()) {
+            return Status::OK();
+        }
+        Status status = createDir(_dir);
+        if (!status.isOK()) {
+            return status;
+        }
+        std::string file = str::stream() << _dir << "/" << _name << "-run-" << _runs.size();
+        _runs.push_back(file);
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        for (const auto& entry : _buffer) {
+            writeString(&out, entry.first);
+            writeString(&out, entry.second);
+        }
+        out.close();
+        if (!out) {
+            return Status(ErrorCodes::InternalError,
+                          str::stream() << "bulk load of " << _name << " can't write " << file);
+        }
+        _buffer.clear();
+        _bufferBytes = 0;
+        return Status::OK();
+    }
+
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 8))
+    namespace {
+        // writes sorted entries into SST files of about kTargetFileSize
+        class SstFilesWriter {
+        public:
+            SstFilesWriter(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                           const std::string& dir, const std::string& name,
+                           std::vector<std::string>* files)
+                : _db(db), _cf(cf), _dir(dir), _name(name), _files(files) {}
+
+            // fails unless key is greater than the previous one
+            Status put(const std::string& key, const std::string& value) {
+                if (!_writer) {
+                    Status status = createDir(_dir);
+                    if (!status.isOK()) {
+                        return status;
+                    }
+                    std::string file = str::stream() << _dir << "/" << _name << "-"
+                                                     << _files->size() << ".sst";
+                    _files->push_back(file);
+                    _writer.reset(new rocksdb::SstFileWriter(rocksdb::EnvOptions(),
+                                                             _db->GetOptions(_cf), _cf));
+                    auto s = _writer->Open(file);
+                    if (!s.ok()) {
+                        _writer.reset();
+                        return rocksToMongoStatus(s);
+                    }
+                }
+                auto s = _writer->Put(key, value);
+                if (!s.ok()) {
+                    return rocksToMongoStatus(s);
+                }
+                if (_writer->FileSize() >= RocksBulkLoader::kTargetFileSize) {
+                    return finish();
+                }
+                return Status::OK();
+            }
+
+            Status finish() {
+                if (!_writer) {
+                    return Status::OK();
+                }
+                rocksdb::ExternalSstFileInfo info;
+                auto s = _writer->Finish(&info);
+                _writer.reset();
+                if (!s.ok()) {
+                    return rocksToMongoStatus(s);
+                }
+                _numEntries += info.num_entries;
+                return Status::OK();
+            }
+
+            long long numEntries() const { return _numEntries; }
+
+        private:
+            rocksdb::DB* _db;
+            rocksdb::ColumnFamilyHandle* _cf;
+            const std::string& _dir;
+            const std::string& _name;
+            std::vector<std::string>* _files;
+            std::unique_ptr<rocksdb::SstFileWriter> _writer;
+            long long _numEntries = 0;
+        };
+    }  // namespace
+
+    Status RocksBulkLoader::_writeFiles() {
+        SstFilesWriter writer(_db, _cf, _dir, _name, &_files);
+        if (_runs.empty()) {
+            // everything fit in memory
+            for (const auto& entry : _buffer) {
+                Status status = writer.put(entry.first, entry.second);
+                if (!status.isOK()) {
+                    return status;
+                }
+            }
+        } else {
+            Status status = _spill();
+            if (!status.isOK()) {
+                return status;
+            }
+            std::vector<std::unique_ptr<RunReader>> readers;
+            for (const auto& run : _runs) {
+                readers.emplace_back(new RunReader(run));
+            }
+            // the reader with the smallest key on top
+            auto greater = [&readers](size_t a, size_t b) {
+                return readers[a]->key > readers[b]->key;
+            };
+            std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+            std::string lastKey;
+            bool first = true;
+            for (size_t i = 0; i < readers.size(); ++i) {
+                if (readers[i]->next()) {
+                    heap.push(i);
+                }
+            }
+            while (!heap.empty()) {
+                size_t i = heap.top();
+                heap.pop();
+                RunReader* reader = readers[i].get();
+                if (!first && reader->key == lastKey) {
+                    return Status(ErrorCodes::DuplicateKey,
+                                  str::stream() << "bulk load of " << _name
+                                                << " got the same key twice");
+                }
+                status = writer.put(reader->key, reader->value);
+                if (!status.isOK()) {
+                    return status;
+                }
+                lastKey.swap(reader->key);
+                first = false;
+                if (reader->next()) {
+                    heap.push(i);
+                }
+            }
+            for (size_t i = 0; i < readers.size(); ++i) {
+                if (readers[i]->failed()) {
+                    return Status(ErrorCodes::InternalError,
+                                  str::stream() << "bulk load of " << _name << " can't read "
+                                                << _runs[i]);
+                }
+            }
+        }
+        _buffer.clear();
+        _bufferBytes = 0;
+
+        Status status = writer.finish();
+        if (!status.isOK()) {
+            return status;
+        }
+        if (writer.numEntries() != _numKeys) {
+            return Status(ErrorCodes::InternalError,
+                          str::stream() << "bulk load of " << _name << " wrote "
+                                        << writer.numEntries() << " entries to SST files, "
+                                        << "expected " << _numKeys);
+        }
+        return Status::OK();
+    }
+
+    Status RocksBulkLoader::ingest(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                                   const std::vector<RocksBulkLoader*>& loaders) {
+        std::vector<std::string> files;
+        for (auto loader : loaders) {
+            stdx::lock_guard<stdx::mutex> lk(loader->_mutex);
+            invariant(loader->_finished && loader->_status.isOK() && !loader->_ingested);
+            files.insert(files.end(), loader->_files.begin(), loader->_files.end());
+        }
+        if (!files.empty()) {
+            rocksdb::IngestExternalFileOptions options;
+            options.move_files = true;
+            auto s = db->IngestExternalFile(cf, files, options);
+            if (!s.ok()) {
+                return rocksToMongoStatus(s);
+            }
+        }
+        for (auto loader : loaders) {
+            stdx::lock_guard<stdx::mutex> lk(loader->_mutex);
+            loader->_ingested = true;
+            LOG(1) << "bulk load of " << loader->_name << " ingested " << loader->_numKeys
+                   << " keys in " << loader->_files.size() << " SST files";
+        }
+        return Status::OK();
+    }
+#else
+    Status RocksBulkLoader::_writeFiles() {
+        return Status(ErrorCodes::CommandNotSupported, "bulk load needs RocksDB 5.8 or newer");
+    }
+
+    Status RocksBulkLoader::ingest(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                                   const std::vector<RocksBulkLoader*>& loaders) {
+        return Status(ErrorCodes::CommandNotSupported, "bulk load needs RocksDB 5.8 or newer");
+    }
+#endif
+
+    void RocksBulkLoader::_removeFiles() {
+        for (const auto* files : {&_runs, &_files}) {
+            for (const auto& file : *files) {
+                boost::system::error_code ec;
+                boost::filesystem::remove(file, ec);
+            }
+        }
+    }
+}
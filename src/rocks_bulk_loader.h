@@ -0,0 +1,125 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/base/status.h"
+#include "mongo/stdx/mutex.h"
+
+namespace rocksdb {
+    class ColumnFamilyHandle;
+    class DB;
+    class Slice;
+}
+
+namespace mongo {
+
+    class RecoveryUnit;
+
+    /**
+     * Collects the keys of one ident during a bulk load and writes them into SST files, which are
+     * ingested together with the files of the other idents of the load (see ingest()). That
+     * bypasses the WAL, the memtable and the compactions that would otherwise move the data down
+     * level by level.
+     *
+     * Keys can be added in any order. They are kept sorted in memory, spilled into sorted runs in
+     * dir once kMaxBufferBytes are buffered, and merged into SST files by finish(). A key that is
+     * added twice fails finish() with DuplicateKey. Errors of add() are sticky and returned again
+     * by finish(), so that add() can run from RecoveryUnit::Change::commit(), see addOnCommit().
+     *
+     * Nothing is visible before ingest(). Runs, and SST files that ingest() didn't move, are
+     * deleted with the loader. Thread-safe.
+     */
+    class RocksBulkLoader {
+        MONGO_DISALLOW_COPYING(RocksBulkLoader);
+
+    public:
+        // files are created in dir, which is created if it doesn't exist, and named after name
+        RocksBulkLoader(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf, std::string dir,
+                        std::string name);
+        ~RocksBulkLoader();
+
+        Status add(const rocksdb::Slice& key, const rocksdb::Slice& value);
+
+        // adds key and value to loader when the unit of work of ru commits
+        static void addOnCommit(RecoveryUnit* ru, std::shared_ptr<RocksBulkLoader> loader,
+                                std::string key, std::string value);
+
+        // Writes everything that was added into SST files. Nothing can be added afterwards
+        Status finish();
+
+        /**
+         * Ingests the SST files of finished loaders in one step, so that either all of them or
+         * none become visible. The loaders have to hold different idents of cf, so that their
+         * files don't overlap.
+         */
+        static Status ingest(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                             const std::vector<RocksBulkLoader*>& loaders);
+
+        long long numKeys() const;
+        long long valueBytes() const;
+        size_t numFiles() const;
+
+        // SST files are rolled over at this size, so that compactions of the ingested data don't
+        // have to rewrite huge files
+        static const uint64_t kTargetFileSize = 256 * 1024 * 1024;
+        static const size_t kMaxBufferBytes = 64 * 1024 * 1024;
+
+    private:
+        // require _mutex
+        Status _spill();
+        Status _writeFiles();
+        void _removeFiles();
+
+        rocksdb::DB* _db;                  // not owned
+        rocksdb::ColumnFamilyHandle* _cf;  // not owned
+        const std::string _dir;
+        const std::string _name;
+
+        mutable stdx::mutex _mutex;
+        // protected by _mutex
+        Status _status = Status::OK();
+        std::map<std::string, std::string> _buffer;
+        size_t _bufferBytes = 0;
+        // sorted runs spilled from _buffer
+        std::vector<std::string> _runs;
+        // SST files written by finish()
+        std::vector<std::string> _files;
+        long long _numKeys = 0;
+        long long _valueBytes = 0;
+        bool _finished = false;
+        bool _ingested = false;
+    };
+}
@@ -0,0 +1,332 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_cache_warmer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <rocksdb/cache.h>
+#include <rocksdb/db.h>
+#include <rocksdb/iterator.h>
+#include <rocksdb/options.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/db/client.h"
+#include "mongo/platform/endian.h"
+#include "mongo/stdx/chrono.h"
+#include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    bool RocksHotKeySampler::shouldSample() {
+        // per thread, so that reads don't contend on a shared counter. Threads start at different
+        // points so that short lived ones still get sampled
+        static thread_local int readsUntilSample =
+            1 + std::hash<std::thread::id>()(std::this_thread::get_id()) % kSampleEvery;
+        if (--readsUntilSample > 0) {
+            return false;
+        }
+        readsUntilSample = kSampleEvery;
+        return true;
+    }
+
+    void RocksHotKeySampler::record(uint32_t cfId, const rocksdb::Slice& key) {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        if (_keys.size() < _maxKeys) {
+            _keys.emplace_back(cfId, key.ToString());
+        } else {
+            _keys[_next].first = cfId;
+            _keys[_next].second.assign(key.data(), key.size());
+        }
+        _next = (_next + 1) % _maxKeys;
+    }
+
+    std::vector<RocksHotKeySampler::HotKey> RocksHotKeySampler::snapshot() const {
+        std::vector<HotKey> keys;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            keys = _keys;
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        return keys;
+    }
+
+    RocksCacheWarmer::RocksCacheWarmer(rocksdb::DB* db,
+                                       std::vector<rocksdb::ColumnFamilyHandle*> cfHandles,
+                                       std::shared_ptr<rocksdb::Cache> blockCache,
+                                       std::string hotKeysFile, int keysPerSec,
+                                       RocksHotKeySampler* sampler)
+        : BackgroundJob(false /* deleteSelf */),
+          _db(db),
+          _cfHandles(std::move(cfHandles)),
+          _blockCache(std::move(blockCache)),
+          _hotKeysFile(std::move(hotKeysFile)),
+          _keysPerSec(std::max(keysPerSec, 1)),
+          _sampler(sampler) {
+        _sampler->setEnabled(true);
+    }
+
+    void RocksCacheWarmer::run() {
+        Client::initThread(name().c_str());
+
+        LOG(1) << "starting " << name() << " thread";
+
+        std::vector<HotKey> keys;
+        if (boost::filesystem::exists(_hotKeysFile)) {
+            Status status = readHotKeys(_hotKeysFile, &keys);
+            if (!status.isOK()) {
+                warning() << "Failed to read hot keys for block cache warm-up: " << status;
+                keys.clear();
+            }
+        }
+        if (!keys.empty()) {
+            _warmUp(keys);
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _previousKeys = std::move(keys);
+        }
+
+        while (true) {
+            {
+                stdx::unique_lock<stdx::mutex> lk(_mutex);
+                _shutdownCondition.wait_for(lk, stdx::chrono::seconds(kPersistIntervalSecs),
+                                            [this] { return _shuttingDown; });
+                if (_shuttingDown) {
+                    break;
+                }
+            }
+            _persist();
+        }
+        LOG(1) << "stopping " << name() << " thread";
+    }
+
+    void RocksCacheWarmer::shutdown() {
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _shuttingDown = true;
+        }
+        _shutdownCondition.notify_all();
+        wait();
+        _sampler->setEnabled(false);
+        _persist();
+    }
+
+    bool RocksCacheWarmer::_shouldStop() const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        return _shuttingDown;
+    }
+
+    rocksdb::ColumnFamilyHandle* RocksCacheWarmer::_findCF(uint32_t cfId) const {
+        for (auto cfHandle : _cfHandles) {
+            if (cfHandle->GetID() == cfId) {
+                return cfHandle;
+            }
+        }
+        return nullptr;
+    }
+
+    void RocksCacheWarmer::_warmUp(const std::vector<HotKey>& keys) {
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _state = "running";
+            _keysTotal = keys.size();
+        }
+        log() << "Warming up block cache with " << keys.size() << " keys at up to "
+              << _keysPerSec << " keys/s";
+
+        Timer timer;
+        std::string finalState = "done";
+        const size_t kBatchSize = 100;
+        for (size_t start = 0; start < keys.size(); start += kBatchSize) {
+            if (_shouldStop()) {
+                finalState = "interrupted";
+                break;
+            }
+            if (_blockCache->GetUsage() * 100 >=
+                _blockCache->GetCapacity() * kMaxCacheFillPercent) {
+                finalState = "cache full";
+                break;
+            }
+            // keys are sorted, so consecutive seeks mostly hit blocks that are already loaded
+            // and the reads on disk are close to sequential. A fresh iterator per batch doesn't
+            // pin old versions for the whole warm-up
+            size_t end = std::min(keys.size(), start + kBatchSize);
+            {
+                std::unique_ptr<rocksdb::Iterator> iter;
+                uint32_t iterCFId = 0;
+                for (size_t i = start; i < end; ++i) {
+                    if (!iter || iterCFId != keys[i].first) {
+                        auto cfHandle = _findCF(keys[i].first);
+                        if (cfHandle == nullptr) {
+                            continue;
+                        }
+                        iter.reset(_db->NewIterator(rocksdb::ReadOptions(), cfHandle));
+                        iterCFId = keys[i].first;
+                    }
+                    iter->Seek(keys[i].second);
+                }
+            }
+
+            {
+                stdx::lock_guard<stdx::mutex> lk(_mutex);
+                _keysWarmed = end;
+                _warmUpMillis = timer.millis();
+            }
+
+            // rate limit
+            long long expectedMillis = static_cast<long long>(end) * 1000 / _keysPerSec;
+            long long aheadMillis = expectedMillis - timer.millis();
+            if (aheadMillis > 0) {
+                sleepmillis(aheadMillis);
+            }
+        }
+
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        _state = finalState;
+        _warmUpMillis = timer.millis();
+        log() << "Block cache warm-up " << finalState << " after " << _warmUpMillis << "ms, "
+              << _keysWarmed << " of " << _keysTotal << " keys";
+    }
+
+    void RocksCacheWarmer::_persist() {
+        std::vector<HotKey> keys = _sampler->snapshot();
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            // right after a restart the sampler knows little. Keep the keys of the previous run
+            // until it has seen enough on its own
+            if (keys.size() < _sampler->maxKeys() / 2 && !_previousKeys.empty()) {
+                size_t room = _sampler->maxKeys() - keys.size();
+                keys.insert(keys.end(), _previousKeys.begin(),
+                            _previousKeys.begin() + std::min(room, _previousKeys.size()));
+                std::sort(keys.begin(), keys.end());
+                keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+            } else {
+                _previousKeys.clear();
+            }
+        }
+        if (keys.empty()) {
+            return;
+        }
+        Status status = writeHotKeys(_hotKeysFile, keys);
+        if (!status.isOK()) {
+            warning() << "Failed to persist hot keys for block cache warm-up: " << status;
+            return;
+        }
+        LOG(1) << "Persisted " << keys.size() << " hot keys to " << _hotKeysFile;
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        _keysPersisted = keys.size();
+    }
+
+    void RocksCacheWarmer::appendStats(BSONObjBuilder* builder) const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        builder->append("state", _state);
+        builder->append("keys-total", _keysTotal);
+        builder->append("keys-warmed", _keysWarmed);
+        builder->append("elapsed-millis", _warmUpMillis);
+        builder->append("keys-persisted", _keysPersisted);
+    }
+
+    // File format: a sequence of <little endian uint32 column family ID><little endian uint32
+    // length><key bytes>. Written to a temporary file first and renamed, so a crash never leaves
+    // a truncated file behind
+    Status RocksCacheWarmer::writeHotKeys(const std::string& file,
+                                          const std::vector<HotKey>& keys) {
+        const std::string tmpFile = file + ".tmp";
+        boost::system::error_code ec;
+        {
+            std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+            // the keys hold user data
+            boost::filesystem::permissions(
+                tmpFile, boost::filesystem::owner_read | boost::filesystem::owner_write, ec);
+            if (ec) {
+                return Status(ErrorCodes::FileStreamFailed,
+                              str::stream() << "failed to restrict permissions of " << tmpFile
+                                            << ": " << ec.message());
+            }
+            for (const auto& key : keys) {
+                uint32_t cfId = endian::nativeToLittle(key.first);
+                uint32_t size = endian::nativeToLittle(static_cast<uint32_t>(key.second.size()));
+                out.write(reinterpret_cast<const char*>(&cfId), sizeof(cfId));
+                out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                out.write(key.second.data(), key.second.size());
+            }
+            out.flush();
+            if (!out) {
+                return Status(ErrorCodes::FileStreamFailed,
+                              str::stream() << "failed to write " << tmpFile);
+            }
+        }
+        boost::filesystem::rename(tmpFile, file, ec);
+        if (ec) {
+            return Status(ErrorCodes::FileRenameFailed,
+                          str::stream() << "failed to rename " << tmpFile << ": " << ec.message());
+        }
+        return Status::OK();
+    }
+
+    Status RocksCacheWarmer::readHotKeys(const std::string& file, std::vector<HotKey>* keys) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) {
+            return Status(ErrorCodes::FileNotOpen, str::stream() << "failed to open " << file);
+        }
+        keys->clear();
+        uint32_t cfId;
+        uint32_t size;
+        while (in.read(reinterpret_cast<char*>(&cfId), sizeof(cfId))) {
+            if (!in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+                return Status(ErrorCodes::FileStreamFailed,
+                              str::stream() << file << " is truncated");
+            }
+            size = endian::littleToNative(size);
+            // keys are small, anything bigger means the file is garbage
+            if (size > 16 * 1024 * 1024) {
+                return Status(ErrorCodes::FileStreamFailed,
+                              str::stream() << file << " is corrupted");
+            }
+            std::string key(size, '\0');
+            if (!in.read(&key[0], size)) {
+                return Status(ErrorCodes::FileStreamFailed,
+                              str::stream() << file << " is truncated");
+            }
+            keys->emplace_back(endian::littleToNative(cfId), std::move(key));
+        }
+        return Status::OK();
+    }
+}
@@ -0,0 +1,159 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <rocksdb/slice.h>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/base/status.h"
+#include "mongo/stdx/condition_variable.h"
+#include "mongo/stdx/mutex.h"
+#include "mongo/util/background.h"
+#include "mongo/util/timer.h"
+
+namespace rocksdb {
+    class Cache;
+    class ColumnFamilyHandle;
+    class DB;
+}
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Keeps the most recently sampled keys and the column family they were read from. Callers
+     * decide which reads to sample (RocksRecoveryUnit samples one out of kSampleEvery reads of
+     * each thread), so that keys that are read often are more likely to be here. Sampling is off
+     * until the cache warmer enables it.
+     */
+    class RocksHotKeySampler {
+        MONGO_DISALLOW_COPYING(RocksHotKeySampler);
+
+    public:
+        // column family ID and full key
+        typedef std::pair<uint32_t, std::string> HotKey;
+
+        static const int kSampleEvery = 128;
+
+        explicit RocksHotKeySampler(size_t maxKeys = 64 * 1024) : _maxKeys(maxKeys) {}
+
+        // true for one out of kSampleEvery calls on the calling thread
+        static bool shouldSample();
+
+        bool enabled() const { return _enabled.load(std::memory_order_relaxed); }
+        void setEnabled(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+
+        void record(uint32_t cfId, const rocksdb::Slice& key);
+
+        // Returns the sampled keys, sorted and deduplicated
+        std::vector<HotKey> snapshot() const;
+
+        size_t maxKeys() const { return _maxKeys; }
+
+    private:
+        const size_t _maxKeys;
+        std::atomic<bool> _enabled{false};  // NOLINT
+        mutable stdx::mutex _mutex;
+        // ring buffer, protected by _mutex
+        std::vector<HotKey> _keys;
+        size_t _next = 0;
+    };
+
+    /**
+     * Persists the hot keys to a file every few minutes and on shutdown. On startup it reads the
+     * file left by the previous run and reads those keys back, in key order and rate limited, to
+     * fill the block cache before clients need it. It stops early if the block cache is almost
+     * full, so that it never evicts what foreground reads loaded.
+     *
+     * The file holds raw keys, which contain _id and indexed field values, so the warmer only
+     * runs if the user asked for it (storage.rocksdb.cacheWarmup) and the file is only readable
+     * by its owner.
+     */
+    class RocksCacheWarmer : public BackgroundJob {
+        MONGO_DISALLOW_COPYING(RocksCacheWarmer);
+
+    public:
+        // keys of column families that are not in cfHandles are not warmed up
+        RocksCacheWarmer(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*> cfHandles,
+                         std::shared_ptr<rocksdb::Cache> blockCache, std::string hotKeysFile,
+                         int keysPerSec, RocksHotKeySampler* sampler);
+
+        virtual std::string name() const { return "RocksCacheWarmer"; }
+
+        virtual void run();
+
+        // stops the warm-up and persists the hot keys one last time
+        void shutdown();
+
+        void appendStats(BSONObjBuilder* builder) const;
+
+        typedef RocksHotKeySampler::HotKey HotKey;
+
+        static Status writeHotKeys(const std::string& file, const std::vector<HotKey>& keys);
+        static Status readHotKeys(const std::string& file, std::vector<HotKey>* keys);
+
+    private:
+        void _warmUp(const std::vector<HotKey>& keys);
+        void _persist();
+        bool _shouldStop() const;
+        rocksdb::ColumnFamilyHandle* _findCF(uint32_t cfId) const;
+
+        rocksdb::DB* _db;  // not owned
+        const std::vector<rocksdb::ColumnFamilyHandle*> _cfHandles;  // not owned
+        std::shared_ptr<rocksdb::Cache> _blockCache;
+        const std::string _hotKeysFile;
+        const int _keysPerSec;
+        RocksHotKeySampler* _sampler;  // not owned
+
+        mutable stdx::mutex _mutex;
+        stdx::condition_variable _shutdownCondition;
+        // protected by _mutex
+        bool _shuttingDown = false;
+        std::string _state = "idle";
+        long long _keysTotal = 0;
+        long long _keysWarmed = 0;
+        long long _warmUpMillis = 0;
+        long long _keysPersisted = 0;
+        // keys loaded on startup, kept until the sampler has enough of its own
+        std::vector<HotKey> _previousKeys;
+
+        static const int kPersistIntervalSecs = 300;
+        // stop warming up once the block cache is this full (in percent)
+        static const int kMaxCacheFillPercent = 90;
+    };
+}
@@ -53,6 +53,13 @@ namespace mongo {
             if (itr != _counters.end()) {
                 return itr->second;
             }
+            // a preloaded value is only good until the collection is opened and starts writing
+            itr = _preloaded.find(counterKey);
+            if (itr != _preloaded.end()) {
+                long long ret = itr->second;
+                _preloaded.erase(itr);
+                return ret;
+            }
         }
         std::string value;
         auto s = _db->Get(rocksdb::ReadOptions(), counterKey, &value);
@@ -60,12 +67,21 @@ namespace mongo {
             return 0;
         }
         invariantRocksOK(s);
+        return _decodeCounter(value);
+    }
 
-        int64_t ret;
-        invariant(sizeof(ret) == value.size());
-        memcpy(&ret, value.data(), sizeof(ret));
-        // we store counters in little endian
-        return static_cast<long long>(endian::littleToNative(ret));
+    void RocksCounterManager::preload(const std::vector<std::string>& keyPrefixes) {
+        std::unordered_map<std::string, long long> preloaded;
+        std::unique_ptr<rocksdb::Iterator> iter(_db->NewIterator(rocksdb::ReadOptions()));
+        for (const auto& keyPrefix : keyPrefixes) {
+            for (iter->Seek(keyPrefix); iter->Valid() && iter->key().starts_with(keyPrefix);
+                 iter->Next()) {
+                preloaded[iter->key().ToString()] = _decodeCounter(iter->value());
+            }
+            invariantRocksOK(iter->status());
+        }
+        stdx::lock_guard<stdx::mutex> lk(_lock);
+        _preloaded = std::move(preloaded);
     }
 
     void RocksCounterManager::updateCounter(const std::string& counterKey, long long count,
@@ -90,6 +106,16 @@ namespace mongo {
         }
     }
 
+    void RocksCounterManager::dropCounter(const std::string& counterKey,
+                                          rocksdb::WriteBatch* writeBatch) {
+        {
+            stdx::lock_guard<stdx::mutex> lk(_lock);
+            _counters.erase(counterKey);
+            _preloaded.erase(counterKey);
+        }
+        writeBatch->Delete(counterKey);
+    }
+
     void RocksCounterManager::sync() {
         rocksdb::WriteBatch wb;
         {
@@ -113,6 +139,14 @@ namespace mongo {
         }
     }
 
+    long long RocksCounterManager::_decodeCounter(const rocksdb::Slice& value) {
+        int64_t ret;
+        invariant(sizeof(ret) == value.size());
+        memcpy(&ret, value.data(), sizeof(ret));
+        // we store counters in little endian
+        return static_cast<long long>(endian::littleToNative(ret));
+    }
+
     rocksdb::Slice RocksCounterManager::_encodeCounter(long long counter, int64_t* storage) {
         *storage = static_cast<int64_t>(endian::littleToNative(counter));
         return rocksdb::Slice(reinterpret_cast<const char*>(storage), sizeof(*storage));
@@ -34,6 +34,7 @@
 #include <memory>
 #include <string>
 #include <list>
+#include <vector>
 
 #include <rocksdb/db.h>
 #include <rocksdb/slice.h>
@@ -50,15 +51,24 @@ namespace mongo {
 
         long long loadCounter(const std::string& counterKey);
 
+        // Reads all counters with one of the keyPrefixes in one scan per prefix. loadCounter()
+        // then serves them from memory (once), instead of doing a point read for every
+        // collection opened at startup
+        void preload(const std::vector<std::string>& keyPrefixes);
+
         void updateCounter(const std::string& counterKey, long long count,
                            rocksdb::WriteBatch* writeBatch);
 
         void sync();
 
+        // forgets a counter that isn't updated anymore and deletes it with writeBatch
+        void dropCounter(const std::string& counterKey, rocksdb::WriteBatch* writeBatch);
+
         bool crashSafe() const { return _crashSafe; }
 
     private:
         static rocksdb::Slice _encodeCounter(long long counter, int64_t* storage);
+        static long long _decodeCounter(const rocksdb::Slice& value);
 
         rocksdb::DB* _db; // not owned
         const bool _crashSafe;
@@ -69,6 +79,8 @@ namespace mongo {
         std::unordered_map<std::string, long long> _counters;
         // protected by _lock
         int _syncCounter;
+        // values read by preload() that weren't loaded yet. protected by _lock
+        std::unordered_map<std::string, long long> _preloaded;
 
         static const int kSyncEvery = 10000;
     };
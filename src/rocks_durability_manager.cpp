@@ -31,6 +31,7 @@
 #include <rocksdb/db.h>
 
 #include "rocks_durability_manager.h"
+#include "rocks_histogram.h"
 #include "rocks_util.h"
 
 namespace mongo {
@@ -48,6 +49,7 @@ namespace mongo {
         if (!_durable || forceFlush) {
             invariantRocksOK(_db->Flush(rocksdb::FlushOptions()));
         } else {
+            RocksHistogramTimer syncTimer(rocksHotPathHistogram(RocksHotPath::kSyncWal));
             invariantRocksOK(_db->SyncWAL());
         }
         _journalListener->onDurable(token);
@@ -30,11 +30,15 @@
 #define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
 
 #include "mongo/platform/basic.h"
+#include "mongo/util/exit_code.h"
 #include "mongo/util/quick_exit.h"
 
 #include "rocks_engine.h"
 
 #include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <limits>
 #include <mutex>
 
 #include <boost/filesystem/operations.hpp>
@@ -49,6 +53,7 @@
 #include <rocksdb/options.h>
 #include <rocksdb/rate_limiter.h>
 #include <rocksdb/table.h>
+#include <rocksdb/write_buffer_manager.h>
 #include <rocksdb/convenience.h>
 #include <rocksdb/filter_policy.h>
 #include <rocksdb/utilities/write_batch_with_index.h>
@@ -68,8 +73,20 @@
 #include "mongo/util/log.h"
 #include "mongo/util/processinfo.h"
 
+#include "rocks_backup.h"
+#include "rocks_bulk_loader.h"
 #include "rocks_counter_manager.h"
+#include "rocks_cache_warmer.h"
+#include "rocks_event_listener.h"
 #include "rocks_global_options.h"
+#include "rocks_histogram.h"
+#include "rocks_memory_budget.h"
+#include "rocks_perf_profile.h"
+#include "rocks_row_cache.h"
+#include "rocks_rate_limiter_tuner.h"
+#include "rocks_secondary.h"
+#include "rocks_table_properties.h"
+#include "rocks_ticket_controller.h"
 #include "rocks_record_store.h"
 #include "rocks_recovery_unit.h"
 #include "rocks_index.h"
@@ -139,12 +156,37 @@ namespace mongo {
             return std::string(reinterpret_cast<const char*>(&bigEndianPrefix), sizeof(uint32_t));
         }
 
+        // names of storage.rocksdb.compression and compressionPerLevel
+        rocksdb::CompressionType compressionTypeFromName(const std::string& name) {
+            if (name == "none") {
+                return rocksdb::kNoCompression;
+            } else if (name == "snappy") {
+                return rocksdb::kSnappyCompression;
+            } else if (name == "zlib") {
+                return rocksdb::kZlibCompression;
+            } else if (name == "lz4") {
+                return rocksdb::kLZ4Compression;
+            } else if (name == "lz4hc") {
+                return rocksdb::kLZ4HCCompression;
+            } else if (name == "zstd") {
+                return rocksdb::kZSTD;
+            }
+            log() << "Unknown compression, will use default (snappy)";
+            return rocksdb::kSnappyCompression;
+        }
+
         class PrefixDeletingCompactionFilter : public rocksdb::CompactionFilter {
         public:
-            explicit PrefixDeletingCompactionFilter(std::unordered_set<uint32_t> droppedPrefixes)
+            PrefixDeletingCompactionFilter(
+                std::shared_ptr<const RocksDroppedPrefixes> droppedPrefixes,
+                std::shared_ptr<const RocksTTLPrefixes> ttlPrefixes)
                 : _droppedPrefixes(std::move(droppedPrefixes)),
+                  _ttlPrefixes(std::move(ttlPrefixes)),
+                  _expiredBeforeSecs(RocksTTL::nowSecs() - RocksTTL::kCompactionGraceSecs),
                   _prefixCache(0),
-                  _droppedCache(false) {}
+                  _droppedCache(false),
+                  _ttlCache(nullptr),
+                  _ttlExpiredBeforeCache(0) {}
 
             // filter is not called from multiple threads simultaneously
             virtual bool Filter(int level, const rocksdb::Slice& key,
@@ -157,13 +199,54 @@ namespace mongo {
                     // filter's job to report corruption, so we just silently continue
                     return false;
                 }
-                if (prefix == _prefixCache) {
-                    return _droppedCache;
+                if (prefix != _prefixCache) {
+                    _prefixCache = prefix;
+                    _droppedCache = _droppedPrefixes->contains(prefix);
+                    _updateTTLCache(prefix);
+                }
+                return _droppedCache || _isExpired(key, existing_value);
+            }
+
+            // kRemoveAndSkipUntil is available since RocksDB 5.0. Once we see the first key of a
+            // dropped prefix we ask compaction to jump over the whole range of dropped prefixes
+            // instead of calling us for each of the keys in it. Skipped keys don't leave
+            // tombstones behind, which is fine here because nobody ever reads a dropped prefix and
+            // older versions in lower levels get the same treatment when they are compacted.
+            // Expired TTL entries are removed with kRemove, which does leave a tombstone so that
+            // older versions of the key don't resurface.
+#if defined(ROCKSDB_MAJOR) && ROCKSDB_MAJOR >= 5
+            virtual Decision FilterV2(int level, const rocksdb::Slice& key, ValueType value_type,
+                                      const rocksdb::Slice& existing_value, std::string* new_value,
+                                      std::string* skip_until) const {
+                uint32_t prefix = 0;
+                if (!extractPrefix(key, &prefix)) {
+                    // see the comment in Filter()
+                    return Decision::kKeep;
+                }
+                uint32_t nextAlivePrefix = 0;
+                bool hasNextAlive = false;
+                if (prefix != _prefixCache) {
+                    _prefixCache = prefix;
+                    _droppedCache =
+                        _droppedPrefixes->droppedRange(prefix, &nextAlivePrefix, &hasNextAlive);
+                    _updateTTLCache(prefix);
+                } else if (_droppedCache) {
+                    // we only get here if the previous skip didn't make it past this prefix
+                    _droppedPrefixes->droppedRange(prefix, &nextAlivePrefix, &hasNextAlive);
+                }
+                if (_droppedCache) {
+                    if (!hasNextAlive) {
+                        return Decision::kRemove;
+                    }
+                    *skip_until = encodePrefix(nextAlivePrefix);
+                    return Decision::kRemoveAndSkipUntil;
                 }
-                _prefixCache = prefix;
-                _droppedCache = _droppedPrefixes.find(prefix) != _droppedPrefixes.end();
-                return _droppedCache;
+                if (value_type == ValueType::kValue && _isExpired(key, existing_value)) {
+                    return Decision::kRemove;
+                }
+                return Decision::kKeep;
             }
+#endif
 
             // IgnoreSnapshots is available since RocksDB 4.3
 #if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 4 || (ROCKSDB_MAJOR == 4 && ROCKSDB_MINOR >= 3))
@@ -173,25 +256,51 @@ namespace mongo {
             virtual const char* Name() const { return "PrefixDeletingCompactionFilter"; }
 
         private:
-            std::unordered_set<uint32_t> _droppedPrefixes;
+            void _updateTTLCache(uint32_t prefix) const {
+                _ttlCache = _ttlPrefixes->find(prefix);
+                _ttlExpiredBeforeCache = _expiredBeforeSecs;
+                if (_ttlCache && _ttlCache->kind == RocksTTLPrefixes::Kind::kRecordStore) {
+                    // documents stay until their record store has taken them out of its counters
+                    const auto& accounted = _ttlCache->accountedBeforeSecs;
+                    _ttlExpiredBeforeCache = std::min(
+                        _ttlExpiredBeforeCache,
+                        accounted ? static_cast<int64_t>(accounted->load()) - 1 : int64_t(-1));
+                }
+            }
+
+            // requires _ttlCache to be up to date for the key's prefix
+            bool _isExpired(const rocksdb::Slice& key, const rocksdb::Slice& value) const {
+                return _ttlCache != nullptr &&
+                    RocksTTLPrefixes::isExpired(*_ttlCache, key, value, _ttlExpiredBeforeCache);
+            }
+
+            std::shared_ptr<const RocksDroppedPrefixes> _droppedPrefixes;
+            std::shared_ptr<const RocksTTLPrefixes> _ttlPrefixes;
+            const int64_t _expiredBeforeSecs;
             mutable uint32_t _prefixCache;
             mutable bool _droppedCache;
+            mutable const RocksTTLPrefixes::Entry* _ttlCache;
+            // entries of _ttlCache's prefix that expired at or before this can be dropped
+            mutable int64_t _ttlExpiredBeforeCache;
         };
 
         class PrefixDeletingCompactionFilterFactory : public rocksdb::CompactionFilterFactory {
         public:
             explicit
-            PrefixDeletingCompactionFilterFactory(const RocksEngine* engine) : _engine(engine) {}
+            PrefixDeletingCompactionFilterFactory(RocksEngine* engine) : _engine(engine) {}
 
             virtual std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
                 const rocksdb::CompactionFilter::Context& context) override {
+                // this only bumps reference counts, the snapshots are shared between all filters
                 auto droppedPrefixes = _engine->getDroppedPrefixes();
-                if (droppedPrefixes.size() == 0) {
+                auto ttlPrefixes = _engine->getTTLPrefixes();
+                if (droppedPrefixes->empty() && ttlPrefixes->empty()) {
                     // no compaction filter needed
                     return std::unique_ptr<rocksdb::CompactionFilter>(nullptr);
                 } else {
                     return std::unique_ptr<rocksdb::CompactionFilter>(
-                        new PrefixDeletingCompactionFilter(std::move(droppedPrefixes)));
+                        new PrefixDeletingCompactionFilter(std::move(droppedPrefixes),
+                                                           std::move(ttlPrefixes)));
                 }
             }
 
@@ -200,7 +309,7 @@ namespace mongo {
             }
 
         private:
-            const RocksEngine* _engine;
+            RocksEngine* _engine;  // not owned
         };
         
         // ServerParameter to limit concurrency, to prevent thousands of threads running
@@ -211,6 +320,8 @@ namespace mongo {
         public:
             RocksTicketServerParameter(TicketHolder* holder, const std::string& name)
                 : ServerParameter(ServerParameterSet::getGlobal(), name, true, true), _holder(holder) {};
+            // true once set at startup or at runtime
+            bool setManually() const { return _setManually.load(); }
             virtual void append(OperationContext* txn, BSONObjBuilder& b, const std::string& name) {
                 b.append(name, _holder->outof());
             }
@@ -233,10 +344,15 @@ namespace mongo {
                     return Status(ErrorCodes::BadValue, str::stream() << name() << " has to be > 0");
                 }
 
-                return _holder->resize(newNum);
+                Status status = _holder->resize(newNum);
+                if (status.isOK()) {
+                    _setManually.store(true);
+                }
+                return status;
             }
             
             TicketHolder* _holder;
+            std::atomic<bool> _setManually{false};  // NOLINT
         };
 
         TicketHolder openWriteTransaction(128);
@@ -249,17 +365,43 @@ namespace mongo {
 
     }  // anonymous namespace
 
+    bool RocksDroppedPrefixes::contains(uint32_t prefix) const {
+        return std::binary_search(_prefixes.begin(), _prefixes.end(), prefix);
+    }
+
+    bool RocksDroppedPrefixes::droppedRange(uint32_t prefix, uint32_t* nextAlivePrefix,
+                                            bool* hasNextAlive) const {
+        auto it = std::lower_bound(_prefixes.begin(), _prefixes.end(), prefix);
+        if (it == _prefixes.end() || *it != prefix) {
+            return false;
+        }
+        // extend the range over all consecutive dropped prefixes
+        uint32_t last = prefix;
+        for (++it; it != _prefixes.end() && *it == last + 1; ++it) {
+            ++last;
+        }
+        *hasNextAlive = last != std::numeric_limits<uint32_t>::max();
+        *nextAlivePrefix = last + 1;
+        return true;
+    }
+
     // first four bytes are the default prefix 0
     const std::string RocksEngine::kMetadataPrefix("\0\0\0\0metadata-", 12);
     const std::string RocksEngine::kDroppedPrefix("\0\0\0\0droppedprefix-", 18);
     const std::string RocksEngine::kOplogCF("oplogCF");
+    const std::string RocksEngine::kHotKeysFile("hotkeys");
+    const std::string RocksEngine::kBulkLoadDir("bulkload");
 
     RocksEngine::RocksEngine(const std::string& path, bool durable, int formatVersion,
                              bool readOnly)
         : _path(path)
         , _durable(durable)
+        , _secondary(!rocksGlobalOptions.secondaryOf.empty())
         , _formatVersion(formatVersion)
-        , _maxPrefix(0) {
+        , _maxPrefix(0)
+        , _droppedPrefixes(std::make_shared<RocksDroppedPrefixes>(0, std::vector<uint32_t>()))
+        , _ttlPrefixes(
+              std::make_shared<RocksTTLPrefixes>(0, std::vector<RocksTTLPrefixes::Entry>())) {
         {  // create block cache
             uint64_t cacheSizeGB = rocksGlobalOptions.cacheSizeGB;
             if (cacheSizeGB == 0) {
@@ -274,14 +416,79 @@ namespace mongo {
                     cacheSizeGB = 1;
                 }
             }
-            _block_cache = rocksdb::NewLRUCache(cacheSizeGB * 1024 * 1024 * 1024LL, 6);
+            size_t cacheSize = cacheSizeGB * 1024 * 1024 * 1024LL;
+            const uint64_t memoryBudget =
+                static_cast<uint64_t>(rocksGlobalOptions.memoryBudgetMB) * 1024 * 1024;
+            RocksMemoryBudget::Split split;
+            if (memoryBudget > 0) {
+                split = RocksMemoryBudget::split(memoryBudget, rocksGlobalOptions.terarkEnable);
+                cacheSize = split.blockCache;
+                log() << "Memory budget of " << rocksGlobalOptions.memoryBudgetMB
+                      << "MB, block cache: " << split.blockCache << " (memtables: "
+                      << split.memtables << "), write batches: " << split.writeBatches
+                      << ", terark zip: " << split.terarkZip;
+            } else if (rocksGlobalOptions.terarkEnable) {
+                split.terarkZip = rocksGlobalOptions.hardZipWorkingMemLimit;
+            }
+            if (!rocksGlobalOptions.secondaryOf.empty()) {
+                // a secondary runs next to its primary, it shouldn't take memory from it
+                cacheSize = static_cast<size_t>(rocksGlobalOptions.secondaryCacheSizeMB) * 1024 *
+                    1024;
+                log() << "Secondary instance of " << rocksGlobalOptions.secondaryOf
+                      << ", block cache: " << cacheSize;
+            }
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 6))
+            // index and filter blocks go to the high priority pool, so that large scans can't
+            // push out the blocks every point read needs
+            _block_cache = rocksdb::NewLRUCache(cacheSize, 6, false /* strict_capacity_limit */,
+                                                rocksGlobalOptions.cacheHighPriPoolRatio);
+#else
+            _block_cache = rocksdb::NewLRUCache(cacheSize, 6);
+#endif
+            if (rocksGlobalOptions.compressedCacheSizeMB > 0) {
+#if defined(ROCKSDB_MAJOR) && ROCKSDB_MAJOR < 8
+                // second tier with compressed blocks, checked on a block cache miss before
+                // going to the file system
+                _compressedBlockCache = rocksdb::NewLRUCache(
+                    static_cast<size_t>(rocksGlobalOptions.compressedCacheSizeMB) * 1024 * 1024,
+                    6);
+#else
+                warning() << "RocksDB version doesn't support a compressed block cache, "
+                             "ignoring compressedCacheSizeMB";
+#endif
+            }
+            if (memoryBudget > 0) {
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 8))
+                // memtables reserve their memory in the block cache, which evicts blocks to
+                // make room. Flushes are triggered once they use split.memtables
+                _writeBufferManager = std::make_shared<rocksdb::WriteBufferManager>(
+                    split.memtables, _block_cache);
+#else
+                warning() << "RocksDB version can't charge memtables to the block cache, "
+                             "memtables are not part of the memory budget";
+#endif
+            }
+            _memoryBudget.reset(
+                new RocksMemoryBudget(memoryBudget, split, _block_cache, _writeBufferManager));
+            // a secondary's data changes underneath it, the row cache would never see it
+            if (rocksGlobalOptions.rowCacheSizeMB > 0 && rocksGlobalOptions.secondaryOf.empty()) {
+                _rowCache.reset(new RocksRowCache(
+                    static_cast<size_t>(rocksGlobalOptions.rowCacheSizeMB) * 1024 * 1024));
+            }
         }
         _maxWriteMBPerSec = rocksGlobalOptions.maxWriteMBPerSec;
-        _rateLimiter.reset(
-            rocksdb::NewGenericRateLimiter(static_cast<int64_t>(_maxWriteMBPerSec) * 1024 * 1024));
+        const int64_t maxWriteBytesPerSec = static_cast<int64_t>(_maxWriteMBPerSec) * 1024 * 1024;
+        // With rateLimiterAutoTune RocksRateLimiterTuner moves the rate. RocksDB's own auto-tuned
+        // limiter would move it as well and treat every rate we set as a new maximum
+        _rateLimiter.reset(rocksdb::NewGenericRateLimiter(maxWriteBytesPerSec));
         if (rocksGlobalOptions.counters) {
             _statistics = rocksdb::CreateDBStatistics();
         }
+        if (rocksGlobalOptions.eventHistorySize > 0) {
+            _eventListener = std::make_shared<RocksEventListener>(
+                static_cast<size_t>(rocksGlobalOptions.eventHistorySize));
+        }
+        RocksPerfProfile::setSampleEvery(rocksGlobalOptions.perfContextSampleEvery);
         _useSeparateOplogCF = rocksGlobalOptions.useSeparateOplogCF;
         _oplogCFIndex = _useSeparateOplogCF ? 1 : 0;
         log() << "useSeparateOplogCF: " << _useSeparateOplogCF << ", oplogCFIndex: " << _oplogCFIndex;
@@ -294,16 +501,48 @@ namespace mongo {
             rocksdb::ColumnFamilyDescriptor(rocksdb::kDefaultColumnFamilyName, options)
         };
         if (_useSeparateOplogCF) {
-            cfDescriptors.emplace_back(kOplogCF, rocksdb::ColumnFamilyOptions());
+            if (rocksGlobalOptions.oplogCompactionStyle == "fifo") {
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 8))
+                _oplogFIFO = true;
+#else
+                warning() << "RocksDB version can't resize FIFO compaction at runtime, using "
+                             "level compaction for the oplog column family";
+#endif
+            }
+            cfDescriptors.emplace_back(kOplogCF, _oplogCFOptions(options));
+        }
+        if (!rocksGlobalOptions.restoreFromBackup.empty()) {
+            if (boost::filesystem::exists(_path + "/CURRENT")) {
+                log() << "Not restoring from backup " << rocksGlobalOptions.restoreFromBackup
+                      << ", " << _path << " already contains a database";
+            } else {
+                Status status = RocksIncrementalBackup::restore(
+                    rocksGlobalOptions.restoreFromBackup, _path, options.wal_dir,
+                    rocksGlobalOptions.restoreToTimeMillis, rocksGlobalOptions.backupThreads);
+                if (!status.isOK()) {
+                    error() << "Failed to restore from backup "
+                            << rocksGlobalOptions.restoreFromBackup << ": " << status;
+                    mongo::quickExit(EXIT_BADOPTIONS);
+                }
+                _pointInTimeWalFilter.reset(
+                    new RocksPointInTimeWalFilter(rocksGlobalOptions.restoreToTimeMillis));
+                options.wal_filter = _pointInTimeWalFilter.get();
+            }
         }
         rocksdb::DB* db;
         rocksdb::Status s = openDB(options, cfDescriptors, readOnly, &db);
         invariantRocksOK(s);
         _db.reset(db);
+        if (_eventListener) {
+            _eventListener->setDB(_db.get(), _cfHandles);
+        }
 
         _counterManager.reset(
             new RocksCounterManager(_db.get(), rocksGlobalOptions.crashSafeCounters));
+        _counterManager->preload(RocksRecordStore::counterKeyPrefixes());
         _compactionScheduler.reset(new RocksCompactionScheduler(_db.get()));
+        _prefixStats.reset(new RocksPrefixStatsCache(_db.get(), _cfHandles));
+        _prefixStats->go();
 
         // open iterator
         std::unique_ptr<rocksdb::Iterator> iter(_db->NewIterator(rocksdb::ReadOptions()));
@@ -319,6 +558,8 @@ namespace mongo {
 
         // load ident to prefix map. also update _maxPrefix if there's any prefix bigger than
         // current _maxPrefix
+        std::vector<RocksTTLPrefixes::Entry> ttlEntries;
+        std::vector<std::string> interruptedBulkLoads;
         {
             stdx::lock_guard<stdx::mutex> lk(_identMapMutex);
             for (iter->Seek(kMetadataPrefix);
@@ -340,16 +581,27 @@ namespace mongo {
                 _identMap[StringData(ident.data(), ident.size())] =
                     identConfig.getOwned();
 
+                RocksTTLPrefixes::Entry ttlEntry;
+                if (_ttlEntryFromConfig(identConfig, &ttlEntry)) {
+                    ttlEntries.push_back(ttlEntry);
+                }
+                if (identConfig.getBoolField("bulkLoad")) {
+                    interruptedBulkLoads.push_back(ident.ToString());
+                }
+
                 _maxPrefix = std::max(_maxPrefix, identPrefix);
             }
         }
+        // needs to be in place before the first compaction can run
+        _addTTLPrefixes(ttlEntries);
 
-        // just to be extra sure. we need this if last collection is oplog -- in that case we
-        // reserve prefix+1 for oplog key tracker
+        // just to be extra sure. we need this if last collection is oplog or capped -- in that
+        // case we reserve prefix+1 for the key tracker
         ++_maxPrefix;
 
         // load dropped prefixes
         {
+            std::vector<uint32_t> droppedPrefixes;
             rocksdb::WriteBatch wb;
             // we will use this iter to check if prefixes are still alive
             std::unique_ptr<rocksdb::Iterator> prefixIter(_db->NewIterator(rocksdb::ReadOptions()));
@@ -365,20 +617,30 @@ namespace mongo {
                     uint32_t int_prefix;
                     bool ok = extractPrefix(prefix, &int_prefix);
                     invariant(ok);
-                    {
-                        stdx::lock_guard<stdx::mutex> lk(_droppedPrefixesMutex);
-                        _droppedPrefixes.insert(int_prefix);
-                    }
+                    droppedPrefixes.push_back(int_prefix);
                 } else {
                     // prefix is no longer alive. let's remove the prefix from our dropped prefixes
                     // list
                     wb.Delete(iter->key());
                 }
             }
-            if (wb.Count() > 0) {
+            if (wb.Count() > 0 && !readOnly) {
                 auto s = _db->Write(rocksdb::WriteOptions(), &wb);
                 invariantRocksOK(s);
             }
+            _addDroppedPrefixes(droppedPrefixes);
+        }
+
+        for (const auto& ident : interruptedBulkLoads) {
+            warning() << "bulk load of " << ident << " was interrupted, its documents were "
+                      << (readOnly ? "maybe not counted" : "maybe not counted, recounting them "
+                                                            "when it is opened");
+        }
+        if (!readOnly) {
+            _interruptedBulkLoads.insert(interruptedBulkLoads.begin(), interruptedBulkLoads.end());
+            // runs and SST files of bulk loads that didn't finish before a crash
+            boost::system::error_code ec;
+            boost::filesystem::remove_all(_path + "/" + kBulkLoadDir, ec);
         }
 
         _durabilityManager.reset(new RocksDurabilityManager(_db.get(), _durable));
@@ -388,6 +650,51 @@ namespace mongo {
             _journalFlusher->go();
         }
 
+        if (rocksGlobalOptions.rateLimiterAutoTune && !readOnly) {
+            _rateLimiterTuner = stdx::make_unique<RocksRateLimiterTuner>(
+                _db.get(), _rateLimiter.get(), _maxWriteMBPerSec,
+                rocksGlobalOptions.rateLimiterMinMBPerSec,
+                rocksGlobalOptions.rateLimiterTargetP99Micros,
+                rocksHotPathHistogram(RocksHotPath::kGet),
+                rocksHotPathHistogram(RocksHotPath::kCommit));
+            _rateLimiterTuner->go();
+        }
+
+        if (rocksGlobalOptions.cacheWarmup && !readOnly) {
+            _cacheWarmer = stdx::make_unique<RocksCacheWarmer>(
+                _db.get(), _cfHandles, _block_cache, _path + "/" + kHotKeysFile,
+                rocksGlobalOptions.cacheWarmupKeysPerSec, RocksRecoveryUnit::getHotKeySampler());
+            _cacheWarmer->go();
+        } else if (!readOnly) {
+            // don't leave user keys behind once the warm-up is turned off
+            boost::system::error_code ec;
+            boost::filesystem::remove(_path + "/" + kHotKeysFile, ec);
+        }
+
+        if (!rocksGlobalOptions.secondaryOf.empty()) {
+            _secondaryCatchUp = stdx::make_unique<RocksSecondaryCatchUp>(
+                _db.get(), rocksGlobalOptions.secondaryCatchUpIntervalMs);
+            _secondaryCatchUp->go();
+        }
+
+        _incrementalBackup = stdx::make_unique<RocksIncrementalBackup>(
+            _db.get(), rocksGlobalOptions.backupThreads, rocksGlobalOptions.backupMaxMBPerSec,
+            rocksGlobalOptions.backupRetentionCount);
+        if (rocksGlobalOptions.walArchiveTTLSecs > 0 && !readOnly) {
+            _incrementalBackup->go();
+        }
+
+        if (rocksGlobalOptions.adaptiveTickets) {
+            _ticketController = stdx::make_unique<RocksTicketController>(
+                _db.get(), _cfHandles, &openReadTransaction,
+                [] { return openReadTransactionParam.setManually(); }, &openWriteTransaction,
+                [] { return openWriteTransactionParam.setManually(); },
+                rocksGlobalOptions.adaptiveTicketsMin,
+                std::max(rocksGlobalOptions.adaptiveTicketsMin,
+                         rocksGlobalOptions.adaptiveTicketsMax));
+            _ticketController->go();
+        }
+
         Locker::setGlobalThrottling(&openReadTransaction, &openWriteTransaction);
     }
 
@@ -403,12 +710,43 @@ namespace mongo {
         std::string ReopenTagKey("\0\0\0\0ReopenTag", 13);
         rocksdb::DB* db = nullptr;
         rocksdb::Status s;
+        if (!rocksGlobalOptions.secondaryOf.empty()) {
+            // _path only holds the secondary's own info log
+            boost::filesystem::create_directories(_path);
+#if defined(ROCKSDB_MAJOR) && ROCKSDB_MAJOR >= 6
+            s = rocksdb::DB::OpenAsSecondary(options, rocksGlobalOptions.secondaryOf, _path,
+                                             cfDescriptors, &_cfHandles, &db);
+#else
+            s = rocksdb::Status::NotSupported("secondary instances need RocksDB 6.0");
+#endif
+            // none of the fallbacks below apply, the primary owns the column families
+            if (s.ok()) {
+                *outdb = db;
+            }
+            return s;
+        }
         if (readOnly) {
             s = rocksdb::DB::OpenForReadOnly(options, _path, cfDescriptors, &_cfHandles, &db);
         }
         else {
             s = rocksdb::DB::Open(options, _path, cfDescriptors, &_cfHandles, &db);
         }
+        if (!s.ok() && _oplogFIFO) {
+            // an existing oplog column family with files below L0 (written with level compaction)
+            // can't be opened with FIFO compaction. Keep level compaction until the node is
+            // resynced
+            std::vector<std::string> cfNames;
+            auto listStatus = rocksdb::DB::ListColumnFamilies(options, _path, &cfNames);
+            if (listStatus.ok() &&
+                std::find(cfNames.begin(), cfNames.end(), kOplogCF) != cfNames.end()) {
+                warning() << "Failed to open " << kOplogCF << " with FIFO compaction: "
+                          << s.ToString() << ". Falling back to level compaction for the oplog";
+                _oplogFIFO = false;
+                std::vector<rocksdb::ColumnFamilyDescriptor> levelDescriptors(cfDescriptors);
+                levelDescriptors[1].options = _oplogCFOptions(options);
+                return openDB(options, levelDescriptors, readOnly, outdb);
+            }
+        }
         if (!s.ok()) {
             if (_useSeparateOplogCF) {
                 // Note: we could only get CFHandle* by the time db::open()ed
@@ -425,7 +763,7 @@ namespace mongo {
                 }
                 // case 3, need to manually create oplogCF
                 rocksdb::ColumnFamilyHandle* cf = nullptr;
-                s = db->CreateColumnFamily(rocksdb::ColumnFamilyOptions(), kOplogCF, &cf);
+                s = db->CreateColumnFamily(cfDescriptors[1].options, kOplogCF, &cf);
                 assert(s.ok());
                 delete cf;
                 delete db;
@@ -442,7 +780,7 @@ namespace mongo {
         return s;
     }
     
-    void RocksEngine::appendGlobalStats(BSONObjBuilder& b) {
+    void RocksEngine::appendGlobalStats(BSONObjBuilder& b) const {
         BSONObjBuilder bb(b.subobjStart("concurrentTransactions"));
         {
             BSONObjBuilder bbb(bb.subobjStart("write"));
@@ -458,13 +796,19 @@ namespace mongo {
             bbb.append("totalTickets", openReadTransaction.outof());
             bbb.done();
         }
+        if (_ticketController) {
+            BSONObjBuilder bbb(bb.subobjStart("adaptive"));
+            _ticketController->appendStats(&bbb);
+            bbb.done();
+        }
         bb.done();
     }
 
     RecoveryUnit* RocksEngine::newRecoveryUnit() {
         return new RocksRecoveryUnit(&_transactionEngine, &_snapshotManager, _db.get(),
                                      _counterManager.get(), _compactionScheduler.get(),
-                                     _durabilityManager.get(), _durable);
+                                     _durabilityManager.get(), _durable, _memoryBudget.get(),
+                                     _secondary);
     }
 
     Status RocksEngine::createRecordStore(OperationContext* opCtx, StringData ns, StringData ident,
@@ -473,54 +817,55 @@ namespace mongo {
             return createOplogStore(opCtx, ident, options);
         } else {
             BSONObjBuilder configBuilder;
+            Status status = _recordStoreConfig(ns, options, &configBuilder);
+            if (!status.isOK()) {
+                return status;
+            }
             return _createIdent(ident, &configBuilder);
         }
     }
 
-    Status RocksEngine::createOplogStore(OperationContext* opCtx,
-                                         StringData ident,
-                                         const CollectionOptions& options) {
-        BSONObj config;
-        uint32_t prefix = 0;
-        BSONObjBuilder configBuilder;
-        {
-            stdx::lock_guard<stdx::mutex> lk(_identMapMutex);
-            if (_identMap.find(ident) != _identMap.end()) {
-                // already exists
-                return Status::OK();
+    Status RocksEngine::_recordStoreConfig(StringData ns, const CollectionOptions& options,
+                                           BSONObjBuilder* configBuilder) {
+        invariant(!NamespaceString::oplog(ns));
+        int64_t expireAfterSeconds = 0;
+        Status status =
+            RocksTTL::parseCollectionOptions(options.storageEngine, &expireAfterSeconds);
+        if (!status.isOK()) {
+            return status;
+        }
+        bool rowCache = false;
+        status = RocksRowCache::parseCollectionOptions(options.storageEngine, &rowCache);
+        if (!status.isOK()) {
+            return status;
+        }
+        if (expireAfterSeconds > 0) {
+            if (options.capped) {
+                return Status(ErrorCodes::InvalidOptions,
+                              "expireAfterSeconds is not supported for capped collections");
             }
-            // TBD(kg) should we use a diffrent prefix + prefix-number,
-            // or should we stick to this maxPrefix one ?
-            prefix = ++_maxPrefix;
-            configBuilder.append("prefix", static_cast<int32_t>(prefix));
-
-            config = configBuilder.obj();
-            _identMap[ident] = config.copy();
+            configBuilder->append("expireAfterSeconds",
+                                  static_cast<long long>(expireAfterSeconds));
         }
-        // still, we need to register oplog-table into meta-info
-        auto s = _db->Put(rocksdb::WriteOptions(), kMetadataPrefix + ident.toString(),
-                          rocksdb::Slice(config.objdata(), config.objsize()));
-        if (s.ok()) {
-            // As an optimization, add a key <prefix> to the DB
-            std::string encodedPrefix(encodePrefix(prefix));
-            s = _db->Put(rocksdb::WriteOptions(), encodedPrefix, rocksdb::Slice());
+        if (options.capped) {
+            // document sizes are tracked at prefix + 1, see enableCappedKeyTracker()
+            configBuilder->appendBool("keyTracker", true);
         }
-        _oplogIdent = ident.toString();
+        return Status::OK();
+    }
 
-        // oplog tracker
-        {
-            // oplog needs two prefixes, so we also reserve the next one
-            uint64_t oplogTrackerPrefix = 0;
-            {
-                stdx::lock_guard<stdx::mutex> lk(_identMapMutex);
-                oplogTrackerPrefix = ++_maxPrefix;
-            }
-            // we also need to write out the new prefix to the database. this is just an
-            // optimization
-            std::string encodedPrefix(encodePrefix(oplogTrackerPrefix));
-            s = _db->Put(rocksdb::WriteOptions(), encodedPrefix, rocksdb::Slice());
+    Status RocksEngine::createOplogStore(OperationContext* opCtx,
+                                         StringData ident,
+                                         const CollectionOptions& options) {
+        // TBD(kg) should we use a diffrent prefix + prefix-number,
+        // or should we stick to this maxPrefix one ?
+        // oplog needs two prefixes, the next one is for the oplog key tracker
+        BSONObjBuilder configBuilder;
+        Status status = _createIdent(ident, &configBuilder, true /* reserveNextPrefix */);
+        if (status.isOK()) {
+            _oplogIdent = ident.toString();
         }
-        return rocksToMongoStatus(s);
+        return status;
     }
 
 
@@ -542,29 +887,87 @@ namespace mongo {
                 : stdx::make_unique<RocksRecordStore>(ns, ident, _db.get(), _counterManager.get(),
                                                       _durabilityManager.get(), prefix);
 
+        int64_t expireAfterSeconds = config.getField("expireAfterSeconds").safeNumberLong();
+        if (expireAfterSeconds > 0) {
+            recordStore->setExpireAfterSeconds(expireAfterSeconds);
+            _setTTLAccountedBefore(static_cast<uint32_t>(config.getField("prefix").numberInt()),
+                                   recordStore->ttlAccountedBeforeSecs());
+        }
+        if (options.capped && config.getBoolField("keyTracker")) {
+            recordStore->enableCappedKeyTracker();
+            // until getSortedDataInterface() opens an index of the collection
+            recordStore->setCappedDocumentsNeeded(false);
+        }
+        recordStore->setPrefixStats(_prefixStats.get());
+        bool rowCache = false;
+        // already validated by createRecordStore()
+        RocksRowCache::parseCollectionOptions(options.storageEngine, &rowCache);
+        if (rowCache && !NamespaceString::oplog(ns)) {
+            if (_rowCache) {
+                recordStore->setRowCache(_rowCache.get());
+            } else {
+                warning() << ns << " was created with rowCache, but storage.rocksdb.rowCacheSizeMB"
+                          << " is 0";
+            }
+        }
+
         {
             stdx::lock_guard<stdx::mutex> lk(_identObjectMapMutex);
             _identCollectionMap[ident] = recordStore.get();
+            _collectionIdents[ns] = ident.toString();
+            if (expireAfterSeconds > 0) {
+                _ttlCollections[ns] = expireAfterSeconds;
+            } else {
+                _ttlCollections.erase(ns);
+            }
         }
 
         auto store = dynamic_cast<RocksRecordStore*>(recordStore.get());
         if (NamespaceString::oplog(ns)) {
                 _oplogIdent = ident.toString();
-            store->setCFHandle(_cfHandles[_oplogCFIndex]);
+            store->setCFHandle(_cfHandles[_oplogCFIndex], _oplogFIFO);
+            _sizeOplogCF(options.cappedSize);
             } else {
             store->setCFHandle(_cfHandles[_defaultCFIndex]);
         }
+
+        bool interruptedBulkLoad = false;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+            interruptedBulkLoad = _interruptedBulkLoads.erase(ident.toString()) > 0;
+        }
+        if (interruptedBulkLoad) {
+            store->recomputeStats();
+            Status status = _setBulkLoadFlag(ident, false);
+            if (!status.isOK()) {
+                warning() << "failed to clear the bulk load flag of " << ns << ": " << status;
+            }
+        }
         return std::move(recordStore);
     }
 
     Status RocksEngine::createSortedDataInterface(OperationContext* opCtx, StringData ident,
                                                   const IndexDescriptor* desc) {
         BSONObjBuilder configBuilder;
-        // let index add its own config things
-        RocksIndexBase::generateConfig(&configBuilder, _formatVersion, desc->version());
+        _indexConfig(desc, &configBuilder);
         return _createIdent(ident, &configBuilder);
     }
 
+    void RocksEngine::_indexConfig(const IndexDescriptor* desc, BSONObjBuilder* configBuilder) {
+        // let index add its own config things
+        RocksIndexBase::generateConfig(configBuilder, _formatVersion, desc->version());
+        bool ttl = false;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_identObjectMapMutex);
+            ttl = _ttlCollections.find(desc->parentNS()) != _ttlCollections.end();
+        }
+        if (ttl) {
+            // the compaction filter needs to know where to find the RecordId in index entries
+            configBuilder->appendBool("ttl", true);
+            configBuilder->appendBool("unique", desc->unique());
+        }
+    }
+
     SortedDataInterface* RocksEngine::getSortedDataInterface(OperationContext* opCtx,
                                                              StringData ident,
                                                              const IndexDescriptor* desc) {
@@ -584,10 +987,24 @@ namespace mongo {
             }
             index = si;
         }
+        index->setPrefixStats(_prefixStats.get());
+        index->setNamespace(desc->parentNS());
         {
             stdx::lock_guard<stdx::mutex> lk(_identObjectMapMutex);
             _identIndexMap[ident] = index;
         }
+        // after the index can be found, so that a concurrent beginBulkLoad() doesn't miss it
+        std::string bulkLoadDir = getBulkLoadDir(desc->parentNS());
+        if (!bulkLoadDir.empty()) {
+            index->beginBulkLoad(bulkLoadDir);
+        }
+        RocksRecordStore* recordStore = _findRecordStore(desc->parentNS());
+        if (recordStore && recordStore->isCapped()) {
+            // capped deletes have to remove the index entries of the documents. Never reset
+            // while the collection is open, which is only a few more reads if the index is
+            // dropped
+            recordStore->setCappedDocumentsNeeded(true);
+        }
         return index;
     }
 
@@ -595,13 +1012,16 @@ namespace mongo {
     Status RocksEngine::dropIdent(OperationContext* opCtx, StringData ident) {
         rocksdb::WriteBatch wb;
         wb.Delete(kMetadataPrefix + ident.toString());
+        RocksEngine::stopTTLMonitor(ident);
+        _counterManager->dropCounter(RocksRecordStore::ttlAccountedKey(ident), &wb);
 
         // calculate which prefixes we need to drop
         std::vector<std::string> prefixesToDrop;
-        prefixesToDrop.push_back(_extractPrefix(_getIdentConfig(ident)));
-        if (_oplogIdent == ident.toString()) {
-            // if we're dropping oplog, we also need to drop keys from RocksOplogKeyTracker (they
-            // are stored at prefix+1)
+        BSONObj config = _getIdentConfig(ident);
+        prefixesToDrop.push_back(_extractPrefix(config));
+        if (_oplogIdent == ident.toString() || config.getBoolField("keyTracker")) {
+            // if we're dropping oplog or a capped collection, we also need to drop keys from
+            // RocksOplogKeyTracker (they are stored at prefix+1)
             prefixesToDrop.push_back(rocksGetNextPrefix(prefixesToDrop[0]));
         }
 
@@ -627,13 +1047,14 @@ namespace mongo {
 
         // instruct compaction filter to start deleting
         {
-            stdx::lock_guard<stdx::mutex> lk(_droppedPrefixesMutex);
+            std::vector<uint32_t> droppedPrefixes;
             for (const auto& prefix : prefixesToDrop) {
                 uint32_t int_prefix;
                 bool ok = extractPrefix(prefix, &int_prefix);
                 invariant(ok);
-                _droppedPrefixes.insert(int_prefix);
+                droppedPrefixes.push_back(int_prefix);
             }
+            _addDroppedPrefixes(droppedPrefixes);
         }
 
         // Suggest compaction for the prefixes that we need to drop, So that
@@ -666,36 +1087,248 @@ namespace mongo {
     }
 
     void RocksEngine::cleanShutdown() {
+        if (_ticketController) {
+            _ticketController->shutdown();
+            _ticketController.reset();
+        }
+        if (_rateLimiterTuner) {
+            _rateLimiterTuner->shutdown();
+            _rateLimiterTuner.reset();
+        }
         if (_journalFlusher) {
             _journalFlusher->shutdown();
             _journalFlusher.reset();
         }
+        if (_cacheWarmer) {
+            _cacheWarmer->shutdown();
+            _cacheWarmer.reset();
+        }
+        if (_secondaryCatchUp) {
+            _secondaryCatchUp->shutdown();
+            _secondaryCatchUp.reset();
+        }
+        if (_incrementalBackup) {
+            _incrementalBackup->shutdown();
+            _incrementalBackup.reset();
+        }
         _durabilityManager.reset();
         _snapshotManager.dropAllSnapshots();
         _counterManager->sync();
         _counterManager.reset();
         _compactionScheduler.reset();
+        _prefixStats->shutdown();
+        _prefixStats.reset();
+        if (_eventListener) {
+            _eventListener->setDB(nullptr, {});
+        }
         _db.reset();
     }
 
+    Status RocksEngine::beginBulkLoad(StringData ns) {
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 8))
+        RocksRecordStore* recordStore = _findRecordStore(ns);
+        if (!recordStore) {
+            return Status(ErrorCodes::NamespaceNotFound,
+                          str::stream() << "collection " << ns << " is not open");
+        }
+        {
+            stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+            if (!_bulkLoadNamespaces.insert(ns.toString()).second) {
+                return Status(ErrorCodes::IllegalOperation,
+                              str::stream() << ns << " is already bulk loading");
+            }
+        }
+        const std::string dir = _path + "/" + kBulkLoadDir;
+        // on disk before anything is loaded, so that the next startup knows about a crash
+        Status status = _setBulkLoadFlag(recordStore->getIdent(), true);
+        if (status.isOK()) {
+            status = recordStore->beginBulkLoad(dir);
+            if (!status.isOK()) {
+                _setBulkLoadFlag(recordStore->getIdent(), false);
+            }
+        }
+        if (!status.isOK()) {
+            stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+            _bulkLoadNamespaces.erase(ns.toString());
+            return status;
+        }
+        for (auto index : _findIndexes(ns)) {
+            index->beginBulkLoad(dir);
+        }
+        log() << "started bulk load of " << ns;
+        return Status::OK();
+#else
+        return Status(ErrorCodes::CommandNotSupported, "bulk load needs RocksDB 5.8 or newer");
+#endif
+    }
+
+    Status RocksEngine::endBulkLoad(StringData ns) {
+        {
+            stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+            if (_bulkLoadNamespaces.erase(ns.toString()) == 0) {
+                return Status(ErrorCodes::IllegalOperation,
+                              str::stream() << ns << " is not bulk loading");
+            }
+        }
+        RocksRecordStore* recordStore = _findRecordStore(ns);
+        if (!recordStore) {
+            return Status(ErrorCodes::NamespaceNotFound,
+                          str::stream() << "collection " << ns << " was dropped");
+        }
+
+        // the collection's loader first
+        std::vector<std::shared_ptr<RocksBulkLoader>> loaders;
+        loaders.push_back(recordStore->stopBulkLoad());
+        invariant(loaders.front());
+        for (auto index : _findIndexes(ns)) {
+            auto loader = index->stopBulkLoad();
+            if (loader) {
+                loaders.push_back(std::move(loader));
+            }
+        }
+
+        Status status = Status::OK();
+        std::vector<RocksBulkLoader*> finished;
+        for (const auto& loader : loaders) {
+            status = loader->finish();
+            if (!status.isOK()) {
+                break;
+            }
+            finished.push_back(loader.get());
+        }
+        if (status.isOK()) {
+            status = RocksBulkLoader::ingest(_db.get(), _cfHandles[_defaultCFIndex], finished);
+        }
+        if (status.isOK()) {
+            const auto& documents = loaders.front();
+            recordStore->addBulkLoadedRecords(documents->numKeys(), documents->valueBytes());
+            size_t numFiles = 0;
+            for (const auto& loader : loaders) {
+                numFiles += loader->numFiles();
+            }
+            log() << "bulk load of " << ns << " ingested " << documents->numKeys()
+                  << " documents (" << documents->valueBytes() << " bytes) and the keys of "
+                  << loaders.size() - 1 << " indexes in " << numFiles << " SST files";
+        } else {
+            error() << "bulk load of " << ns << " failed, nothing was ingested: " << status;
+        }
+
+        // either way the collection and its indexes are consistent again
+        Status flagStatus = _setBulkLoadFlag(recordStore->getIdent(), false);
+        return status.isOK() ? flagStatus : status;
+    }
+
+    std::string RocksEngine::getBulkLoadDir(StringData ns) const {
+        stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+        if (_bulkLoadNamespaces.find(ns.toString()) == _bulkLoadNamespaces.end()) {
+            return "";
+        }
+        return _path + "/" + kBulkLoadDir;
+    }
+
+    std::vector<std::string> RocksEngine::getBulkLoadNamespaces() const {
+        stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+        return std::vector<std::string>(_bulkLoadNamespaces.begin(), _bulkLoadNamespaces.end());
+    }
+
+    RocksRecordStore* RocksEngine::_findRecordStore(StringData ns) {
+        std::string ident;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_identObjectMapMutex);
+            auto identIter = _collectionIdents.find(ns);
+            if (identIter == _collectionIdents.end()) {
+                return nullptr;
+            }
+            ident = identIter->second;
+        }
+        // the collection map keeps entries of dropped idents
+        if (!hasIdent(nullptr, ident)) {
+            return nullptr;
+        }
+        stdx::lock_guard<stdx::mutex> lk(_identObjectMapMutex);
+        auto collectionIter = _identCollectionMap.find(ident);
+        return collectionIter == _identCollectionMap.end() ? nullptr : collectionIter->second;
+    }
+
+    std::vector<RocksIndexBase*> RocksEngine::_findIndexes(StringData ns) {
+        std::vector<std::pair<std::string, RocksIndexBase*>> candidates;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_identObjectMapMutex);
+            for (const auto& entry : _identIndexMap) {
+                candidates.emplace_back(entry.first, entry.second);
+            }
+        }
+        std::vector<RocksIndexBase*> indexes;
+        for (const auto& candidate : candidates) {
+            // the index map keeps entries of dropped idents
+            if (hasIdent(nullptr, candidate.first) && candidate.second->ns() == ns) {
+                indexes.push_back(candidate.second);
+            }
+        }
+        return indexes;
+    }
+
+    Status RocksEngine::_setBulkLoadFlag(StringData ident, bool bulkLoad) {
+        BSONObj config;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_identMapMutex);
+            auto configIter = _identMap.find(ident);
+            if (configIter == _identMap.end()) {
+                return Status(ErrorCodes::NoSuchKey, str::stream() << ident << " was dropped");
+            }
+            BSONObjBuilder configBuilder;
+            BSONObjIterator configIterator(configIter->second);
+            while (configIterator.more()) {
+                BSONElement element = configIterator.next();
+                if (element.fieldNameStringData() != "bulkLoad") {
+                    configBuilder.append(element);
+                }
+            }
+            if (bulkLoad) {
+                configBuilder.appendBool("bulkLoad", true);
+            }
+            config = configBuilder.obj();
+            configIter->second = config;
+        }
+        rocksdb::WriteOptions syncOptions;
+        syncOptions.sync = true;
+        return rocksToMongoStatus(_db->Put(syncOptions, kMetadataPrefix + ident.toString(),
+                                           rocksdb::Slice(config.objdata(), config.objsize())));
+    }
+
     void RocksEngine::setJournalListener(JournalListener* jl) {
         _durabilityManager->setJournalListener(jl);
     }
 
     int64_t RocksEngine::getIdentSize(OperationContext* opCtx, StringData ident) {
-        stdx::lock_guard<stdx::mutex> lk(_identObjectMapMutex);
+        {
+            stdx::lock_guard<stdx::mutex> lk(_identObjectMapMutex);
 
-        auto indexIter = _identIndexMap.find(ident);
-        if (indexIter != _identIndexMap.end()) {
-            return static_cast<int64_t>(indexIter->second->getSpaceUsedBytes(opCtx));
-        }
-        auto collectionIter = _identCollectionMap.find(ident);
-        if (collectionIter != _identCollectionMap.end()) {
-            return collectionIter->second->storageSize(opCtx);
+            auto indexIter = _identIndexMap.find(ident);
+            if (indexIter != _identIndexMap.end()) {
+                return static_cast<int64_t>(indexIter->second->getSpaceUsedBytes(opCtx));
+            }
+            auto collectionIter = _identCollectionMap.find(ident);
+            if (collectionIter != _identCollectionMap.end()) {
+                return collectionIter->second->storageSize(opCtx);
+            }
         }
 
         // this can only happen if collection or index exists, but it's not opened (i.e.
-        // getRecordStore or getSortedDataInterface are not called)
+        // getRecordStore or getSortedDataInterface are not called). SST properties still know
+        // its size
+        BSONObj config;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_identMapMutex);
+            auto configIter = _identMap.find(ident);
+            if (configIter != _identMap.end()) {
+                config = configIter->second;
+            }
+        }
+        RocksPrefixStats stats;
+        if (!config.isEmpty() && _prefixStats->get(_extractPrefix(config), &stats)) {
+            return std::max(stats.onDiskBytes(), 1LL);
+        }
         return 1;
     }
 
@@ -714,9 +1347,73 @@ namespace mongo {
 
     void RocksEngine::setMaxWriteMBPerSec(int maxWriteMBPerSec) {
         _maxWriteMBPerSec = maxWriteMBPerSec;
+        if (_rateLimiterTuner) {
+            // the tuner keeps the budget at or below the new maximum
+            _rateLimiterTuner->setMaxMBPerSec(maxWriteMBPerSec);
+            return;
+        }
         _rateLimiter->SetBytesPerSecond(static_cast<int64_t>(_maxWriteMBPerSec) * 1024 * 1024);
     }
 
+    void RocksEngine::appendRateLimiterStats(BSONObjBuilder* builder) const {
+        builder->append("auto-tune", static_cast<bool>(_rateLimiterTuner));
+        builder->append("max-write-mb-per-sec", _maxWriteMBPerSec);
+        if (_rateLimiterTuner) {
+            _rateLimiterTuner->appendStats(builder);
+        }
+        builder->append("total-bytes-through",
+                        static_cast<long long>(_rateLimiter->GetTotalBytesThrough()));
+    }
+
+    void RocksEngine::appendCacheWarmerStats(BSONObjBuilder* builder) const {
+        builder->append("enabled", static_cast<bool>(_cacheWarmer));
+        if (_cacheWarmer) {
+            _cacheWarmer->appendStats(builder);
+        }
+    }
+
+    void RocksEngine::appendBlobFileStats(BSONObjBuilder* builder) const {
+        builder->append("min-blob-size", rocksGlobalOptions.blobMinSizeKB << 10);
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 6 || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR >= 18))
+        uint64_t numFiles = 0;
+        uint64_t totalSize = 0;
+        uint64_t liveSize = 0;
+        _db->GetIntProperty(_cfHandles[_defaultCFIndex], "rocksdb.num-blob-files", &numFiles);
+        _db->GetIntProperty(_cfHandles[_defaultCFIndex], "rocksdb.total-blob-file-size",
+                            &totalSize);
+        _db->GetIntProperty(_cfHandles[_defaultCFIndex], "rocksdb.live-blob-file-size",
+                            &liveSize);
+        builder->append("num-files", static_cast<long long>(numFiles));
+        builder->append("total-size", static_cast<long long>(totalSize));
+        builder->append("live-size", static_cast<long long>(liveSize));
+        // blob files of older versions not yet garbage collected
+        builder->append("garbage-size",
+                        static_cast<long long>(totalSize > liveSize ? totalSize - liveSize : 0));
+        if (_statistics) {
+            builder->append("bytes-written", static_cast<long long>(_statistics->getTickerCount(
+                                                 rocksdb::BLOB_DB_BLOB_FILE_BYTES_WRITTEN)));
+            builder->append("bytes-read", static_cast<long long>(_statistics->getTickerCount(
+                                              rocksdb::BLOB_DB_BLOB_FILE_BYTES_READ)));
+            builder->append("gc-keys-relocated", static_cast<long long>(_statistics->getTickerCount(
+                                                     rocksdb::BLOB_DB_GC_NUM_KEYS_RELOCATED)));
+            builder->append("gc-bytes-relocated",
+                            static_cast<long long>(_statistics->getTickerCount(
+                                rocksdb::BLOB_DB_GC_BYTES_RELOCATED)));
+        }
+#endif
+    }
+
+    void RocksEngine::appendSecondaryStats(BSONObjBuilder* builder) const {
+        builder->append("primary", rocksGlobalOptions.secondaryOf);
+        _secondaryCatchUp->appendStats(builder);
+    }
+
+    void RocksEngine::appendMemoryBudgetStats(BSONObjBuilder* builder) const {
+        uint64_t memtableUsage = 0;
+        _db->GetAggregatedIntProperty("rocksdb.cur-size-all-mem-tables", &memtableUsage);
+        _memoryBudget->appendStats(builder, memtableUsage);
+    }
+
     Status RocksEngine::backup(const std::string& path) {
         rocksdb::Checkpoint* checkpoint;
         auto s = rocksdb::Checkpoint::Create(_db.get(), &checkpoint);
@@ -727,43 +1424,129 @@ namespace mongo {
         return rocksToMongoStatus(s);
     }
 
-    std::unordered_set<uint32_t> RocksEngine::getDroppedPrefixes() const {
+    std::shared_ptr<const RocksDroppedPrefixes> RocksEngine::getDroppedPrefixes() const {
         stdx::lock_guard<stdx::mutex> lk(_droppedPrefixesMutex);
-        // this will copy the set. that way compaction filter has its own copy and doesn't need to
-        // worry about thread safety
+        // the snapshot is immutable, so compaction filters can use it without any locking
         return _droppedPrefixes;
     }
 
+    void RocksEngine::_addDroppedPrefixes(const std::vector<uint32_t>& prefixes) {
+        if (prefixes.empty()) {
+            return;
+        }
+        stdx::lock_guard<stdx::mutex> lk(_droppedPrefixesMutex);
+        // copy-on-write: filters created from the previous snapshot keep using it until their
+        // compaction finishes
+        std::vector<uint32_t> sorted(prefixes);
+        std::sort(sorted.begin(), sorted.end());
+        const auto& existing = _droppedPrefixes->prefixes();
+        std::vector<uint32_t> merged;
+        merged.reserve(existing.size() + sorted.size());
+        std::set_union(existing.begin(), existing.end(), sorted.begin(), sorted.end(),
+                       std::back_inserter(merged));
+        _droppedPrefixes = std::make_shared<RocksDroppedPrefixes>(_droppedPrefixes->version() + 1,
+                                                                  std::move(merged));
+    }
+
+    std::shared_ptr<const RocksTTLPrefixes> RocksEngine::getTTLPrefixes() const {
+        stdx::lock_guard<stdx::mutex> lk(_ttlPrefixesMutex);
+        return _ttlPrefixes;
+    }
+
+    void RocksEngine::_setTTLAccountedBefore(
+        uint32_t prefix, std::shared_ptr<const std::atomic<long long>> accountedBeforeSecs) {
+        stdx::lock_guard<stdx::mutex> lk(_ttlPrefixesMutex);
+        std::vector<RocksTTLPrefixes::Entry> entries(_ttlPrefixes->entries());
+        for (auto& entry : entries) {
+            if (entry.prefix == prefix && entry.kind == RocksTTLPrefixes::Kind::kRecordStore) {
+                entry.accountedBeforeSecs = std::move(accountedBeforeSecs);
+                _ttlPrefixes = std::make_shared<RocksTTLPrefixes>(_ttlPrefixes->version() + 1,
+                                                                  std::move(entries));
+                return;
+            }
+        }
+    }
+
+    void RocksEngine::_addTTLPrefixes(const std::vector<RocksTTLPrefixes::Entry>& entries) {
+        if (entries.empty()) {
+            return;
+        }
+        stdx::lock_guard<stdx::mutex> lk(_ttlPrefixesMutex);
+        std::vector<RocksTTLPrefixes::Entry> merged(_ttlPrefixes->entries());
+        merged.insert(merged.end(), entries.begin(), entries.end());
+        std::sort(merged.begin(), merged.end());
+        _ttlPrefixes =
+            std::make_shared<RocksTTLPrefixes>(_ttlPrefixes->version() + 1, std::move(merged));
+    }
+
+    bool RocksEngine::_ttlEntryFromConfig(const BSONObj& config, RocksTTLPrefixes::Entry* entry) {
+        entry->prefix = static_cast<uint32_t>(config.getField("prefix").numberInt());
+        if (config.getField("expireAfterSeconds").safeNumberLong() > 0) {
+            entry->kind = RocksTTLPrefixes::Kind::kRecordStore;
+            entry->keyStringVersion = KeyString::Version::V0;
+            return true;
+        }
+        if (config.getField("ttl").trueValue()) {
+            entry->kind = config.getField("unique").trueValue()
+                ? RocksTTLPrefixes::Kind::kUniqueIndex
+                : RocksTTLPrefixes::Kind::kStandardIndex;
+            entry->keyStringVersion = config.getField("index_format_version").numberInt() >= 1
+                ? KeyString::Version::V1
+                : KeyString::Version::V0;
+            return true;
+        }
+        return false;
+    }
+
     // non public api
-    Status RocksEngine::_createIdent(StringData ident, BSONObjBuilder* configBuilder) {
-        BSONObj config;
+    Status RocksEngine::_createIdent(StringData ident, BSONObjBuilder* configBuilder,
+                                     bool reserveNextPrefix) {
         uint32_t prefix = 0;
+        // capped collections need the next prefix for their key tracker
+        const bool nextPrefix =
+            reserveNextPrefix || configBuilder->asTempObj().getBoolField("keyTracker");
         {
             stdx::lock_guard<stdx::mutex> lk(_identMapMutex);
             if (_identMap.find(ident) != _identMap.end()) {
                 // already exists
                 return Status::OK();
             }
-
+            // Only the prefixes are taken here, the ident becomes visible once it is written.
+            // The catalog doesn't create the same ident concurrently. If the write fails, the
+            // prefixes are just never used
             prefix = ++_maxPrefix;
-            configBuilder->append("prefix", static_cast<int32_t>(prefix));
-
-            config = configBuilder->obj();
-            _identMap[ident] = config.copy();
+            if (nextPrefix) {
+                ++_maxPrefix;
+            }
         }
+        configBuilder->append("prefix", static_cast<int32_t>(prefix));
+        BSONObj config = configBuilder->obj();
 
-        BSONObjBuilder builder;
-
-        auto s = _db->Put(rocksdb::WriteOptions(), kMetadataPrefix + ident.toString(),
-                          rocksdb::Slice(config.objdata(), config.objsize()));
-
-        if (s.ok()) {
-            // As an optimization, add a key <prefix> to the DB
-            std::string encodedPrefix(encodePrefix(prefix));
-            s = _db->Put(rocksdb::WriteOptions(), encodedPrefix, rocksdb::Slice());
+        // metadata and prefix markers are written together, so a crash can't leave an ident
+        // without its prefix
+        rocksdb::WriteBatch wb;
+        wb.Put(kMetadataPrefix + ident.toString(),
+               rocksdb::Slice(config.objdata(), config.objsize()));
+        // As an optimization, add a key <prefix> to the DB
+        wb.Put(encodePrefix(prefix), rocksdb::Slice());
+        if (nextPrefix) {
+            // so that the next startup knows the second prefix is taken
+            wb.Put(encodePrefix(prefix + 1), rocksdb::Slice());
+        }
+        auto s = _db->Write(rocksdb::WriteOptions(), &wb);
+        if (!s.ok()) {
+            return rocksToMongoStatus(s);
         }
 
-        return rocksToMongoStatus(s);
+        {
+            stdx::lock_guard<stdx::mutex> lk(_identMapMutex);
+            _identMap[ident] = config.copy();
+        }
+        RocksTTLPrefixes::Entry ttlEntry;
+        if (_ttlEntryFromConfig(config, &ttlEntry)) {
+            _addTTLPrefixes({ttlEntry});
+        }
+        return Status::OK();
     }
 
     BSONObj RocksEngine::_getIdentConfig(StringData ident) {
@@ -777,15 +1560,96 @@ namespace mongo {
         return encodePrefix(config.getField("prefix").numberInt());
     }
     
-    rocksdb::Options RocksEngine::_options() const {
-        // default options
-        rocksdb::Options options;
-        options.rate_limiter = _rateLimiter;
+    rocksdb::ColumnFamilyOptions RocksEngine::_oplogCFOptions(
+        const rocksdb::Options& baseOptions) {
+        rocksdb::ColumnFamilyOptions options;
+        // oplog reads are mostly tailing scans and exact seeks by optime
+        options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(_tableOptions()));
+        options.compression = baseOptions.compression_per_level.empty()
+                                  ? baseOptions.compression
+                                  : baseOptions.compression_per_level.back();
+        // until _sizeOplogCF() is called; resized once the oplog's cappedSize is known
+        options.write_buffer_size = 64 << 20;
+        options.max_write_buffer_number = 4;
+        options.table_properties_collector_factories =
+            baseOptions.table_properties_collector_factories;
+
+        if (_oplogFIFO) {
+            // The oplog is written once and deleted from the oldest end. FIFO compaction never
+            // rewrites files, it drops the oldest ones when the column family grows over
+            // max_table_files_size. Don't drop anything until _sizeOplogCF() knows the size.
+            // There is no compaction filter, it would never run. The files of a dropped oplog
+            // are dropped the same way once the new oplog fills the column family.
+            options.compaction_style = rocksdb::kCompactionStyleFIFO;
+            options.compaction_options_fifo.max_table_files_size =
+                std::numeric_limits<uint64_t>::max();
+            // all files live in L0, don't stall writes on L0 file count
+            options.level0_file_num_compaction_trigger = std::numeric_limits<int>::max() / 2;
+            options.level0_slowdown_writes_trigger = std::numeric_limits<int>::max() / 2;
+            options.level0_stop_writes_trigger = std::numeric_limits<int>::max() / 2;
+        } else {
+            options.level_compaction_dynamic_level_bytes = true;
+            // clears dropped oplogs
+            options.compaction_filter_factory = baseOptions.compaction_filter_factory;
+        }
+        return options;
+    }
+
+    void RocksEngine::_sizeOplogCF(long long cappedSize) {
+        if (!_oplogFIFO || cappedSize <= 0) {
+            return;
+        }
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 8))
+        // FIFO drops the oldest files by size only. Keep twice the capped size so that a file is
+        // only dropped once the capped deleter has truncated everything in it, with room for
+        // tombstones and a deleter that's running behind
+        uint64_t maxTableFilesSize = 2 * static_cast<uint64_t>(cappedSize);
+        // Every file is a flushed memtable and all of them stay in L0, so every oplog read
+        // merges all of them. ~8 files per capped size (16 in the column family) keeps that
+        // bounded while a dropped file is still a small part of the oplog. Oplogs above 8GB
+        // get more files rather than bigger memtables
+        uint64_t writeBufferSize = std::min<uint64_t>(
+            1ull << 30, std::max<uint64_t>(16 << 20, static_cast<uint64_t>(cappedSize) / 8));
+        auto s = _db->SetOptions(
+            _cfHandles[_oplogCFIndex],
+            {{"compaction_options_fifo",
+              "{max_table_files_size=" + std::to_string(maxTableFilesSize) + ";}"},
+             {"write_buffer_size", std::to_string(writeBufferSize)}});
+        if (!s.ok()) {
+            warning() << "Failed to size FIFO compaction of " << kOplogCF << ": " << s.ToString();
+            return;
+        }
+        log() << "Oplog column family uses FIFO compaction, max_table_files_size: "
+              << maxTableFilesSize << ", write_buffer_size: " << writeBufferSize;
+#endif
+    }
+
+    rocksdb::BlockBasedTableOptions RocksEngine::_tableOptions() const {
         rocksdb::BlockBasedTableOptions table_options;
         table_options.block_cache = _block_cache;
         table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, false));
         table_options.block_size = 16 * 1024; // 16KB
         table_options.format_version = 2;
+        // if enabled, index and filter blocks are charged to the block cache instead of living
+        // on the heap of every open table, pinned for L0 files which are read the most
+        table_options.cache_index_and_filter_blocks = rocksGlobalOptions.cacheIndexAndFilterBlocks;
+        table_options.pin_l0_filter_and_index_blocks_in_cache =
+            rocksGlobalOptions.cacheIndexAndFilterBlocks &&
+            rocksGlobalOptions.pinL0FilterAndIndexBlocks;
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 6))
+        table_options.cache_index_and_filter_blocks_with_high_priority = true;
+#endif
+#if defined(ROCKSDB_MAJOR) && ROCKSDB_MAJOR < 8
+        table_options.block_cache_compressed = _compressedBlockCache;
+#endif
+        return table_options;
+    }
+
+    rocksdb::Options RocksEngine::_options() {
+        // default options
+        rocksdb::Options options;
+        options.rate_limiter = _rateLimiter;
+        rocksdb::BlockBasedTableOptions table_options = _tableOptions();
         if (rocksGlobalOptions.terarkEnable) {
             rocksdb::TerarkZipTableOptions terark_zip_table_options;
             terark_zip_table_options.indexNestLevel = rocksGlobalOptions.indexNestLevel;
@@ -813,6 +1677,15 @@ namespace mongo {
             terark_zip_table_options.indexType = rocksGlobalOptions.indexType;
             terark_zip_table_options.softZipWorkingMemLimit = uint64_t(rocksGlobalOptions.softZipWorkingMemLimit);
             terark_zip_table_options.hardZipWorkingMemLimit = uint64_t(rocksGlobalOptions.hardZipWorkingMemLimit);
+            if (_memoryBudget->enabled()) {
+                // keep zip working memory within its share of the memory budget
+                terark_zip_table_options.hardZipWorkingMemLimit = std::min<uint64_t>(
+                    terark_zip_table_options.hardZipWorkingMemLimit,
+                    _memoryBudget->getSplit().terarkZip);
+                terark_zip_table_options.softZipWorkingMemLimit = std::min<uint64_t>(
+                    terark_zip_table_options.softZipWorkingMemLimit,
+                    terark_zip_table_options.hardZipWorkingMemLimit / 2);
+            }
             terark_zip_table_options.smallTaskMemory = uint64_t(rocksGlobalOptions.smallTaskMemory);
             terark_zip_table_options.indexCacheRatio = rocksGlobalOptions.indexCacheRatio;
             options.table_factory.reset(rocksdb::NewTerarkZipTableFactory(terark_zip_table_options,
@@ -874,35 +1747,80 @@ namespace mongo {
         // keep all RocksDB files opened.
         options.max_open_files = -1;
         options.optimize_filters_for_hits = true;
+        options.write_buffer_manager = _writeBufferManager;
         options.compaction_filter_factory.reset(new PrefixDeletingCompactionFilterFactory(this));
+        options.table_properties_collector_factories.push_back(
+            std::make_shared<RocksPrefixStatsCollectorFactory>());
         options.enable_thread_tracking = true;
         // Enable concurrent memtable
         options.allow_concurrent_memtable_write = true;
         options.enable_write_thread_adaptive_yield = true;
 
-        options.compression_per_level.resize(3);
-        options.compression_per_level[0] = rocksdb::kNoCompression;
-        options.compression_per_level[1] = rocksdb::kNoCompression;
-        if (rocksGlobalOptions.compression == "snappy") {
-            options.compression_per_level[2] = rocksdb::kSnappyCompression;
-        } else if (rocksGlobalOptions.compression == "zlib") {
-            options.compression_per_level[2] = rocksdb::kZlibCompression;
-        } else if (rocksGlobalOptions.compression == "none") {
-            options.compression_per_level[2] = rocksdb::kNoCompression;
-        } else if (rocksGlobalOptions.compression == "lz4") {
-            options.compression_per_level[2] = rocksdb::kLZ4Compression;
-        } else if (rocksGlobalOptions.compression == "lz4hc") {
-            options.compression_per_level[2] = rocksdb::kLZ4HCCompression;
+        if (rocksGlobalOptions.compressionPerLevel.empty()) {
+            options.compression_per_level.resize(3);
+            options.compression_per_level[0] = rocksdb::kNoCompression;
+            options.compression_per_level[1] = rocksdb::kNoCompression;
+            options.compression_per_level[2] =
+                compressionTypeFromName(rocksGlobalOptions.compression);
         } else {
-            log() << "Unknown compression, will use default (snappy)";
-            options.compression_per_level[2] = rocksdb::kSnappyCompression;
+            for (const auto& name : rocksGlobalOptions.compressionPerLevel) {
+                options.compression_per_level.push_back(compressionTypeFromName(name));
+            }
+        }
+        if (rocksGlobalOptions.compressionMaxDictBytes > 0) {
+            // Every SST file written by a compaction gets a dictionary sampled from its own data.
+            // Files below L1 mostly hold a key range of a single collection or index, so that's
+            // close to a dictionary per collection. Older RocksDB versions only build them for
+            // the bottommost level
+            options.compression_opts.max_dict_bytes = rocksGlobalOptions.compressionMaxDictBytes;
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 11))
+            // train the dictionary with zstd instead of using raw samples as the dictionary
+            options.compression_opts.zstd_max_train_bytes =
+                rocksGlobalOptions.zstdMaxTrainBytes > 0
+                    ? rocksGlobalOptions.zstdMaxTrainBytes
+                    : 100 * rocksGlobalOptions.compressionMaxDictBytes;
+#endif
+        }
+        if (rocksGlobalOptions.blobMinSizeKB > 0 && rocksGlobalOptions.terarkEnable) {
+            // RocksGlobalOptions::store() rejects this, options set in code end up here
+            warning() << "blob files don't work with Terark tables, "
+                      << "storage.rocksdb.blobMinSizeKB is ignored";
+        } else if (rocksGlobalOptions.blobMinSizeKB > 0) {
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 6 || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR >= 18))
+            // Large documents go to blob files when flushed, the SST files only keep a reference
+            // to them, so compactions don't rewrite them at every level. Index entries are much
+            // smaller than the threshold and stay in SST files. Garbage collection relocates the
+            // live documents of the oldest blob files during compactions, so it is throttled by
+            // the rate limiter like any other compaction write. The oplog column family has its
+            // own options and doesn't use blob files, its entries are deleted soon anyway
+            options.enable_blob_files = true;
+            options.min_blob_size = static_cast<uint64_t>(rocksGlobalOptions.blobMinSizeKB) << 10;
+            options.blob_file_size = static_cast<uint64_t>(rocksGlobalOptions.blobFileSizeMB)
+                                     << 20;
+            options.blob_compression_type = options.compression_per_level.back();
+            options.enable_blob_garbage_collection = rocksGlobalOptions.blobGCAgeCutoff > 0;
+            options.blob_garbage_collection_age_cutoff = rocksGlobalOptions.blobGCAgeCutoff;
+#else
+            warning() << "RocksDB version doesn't support blob files, "
+                      << "storage.rocksdb.blobMinSizeKB is ignored";
+#endif
         }
 
         options.statistics = _statistics;
+        if (_eventListener) {
+            options.listeners.push_back(_eventListener);
+        }
 
         // create the DB if it's not already present
         options.create_if_missing = true;
         options.wal_dir = _path + "/journal";
+        if (!rocksGlobalOptions.secondaryOf.empty()) {
+            // a secondary tails the WAL of its primary
+            options.wal_dir = rocksGlobalOptions.secondaryOf + "/journal";
+        }
+        // obsolete WAL segments are moved to journal/archive, incremental backups copy them
+        // from there
+        options.WAL_ttl_seconds = rocksGlobalOptions.walArchiveTTLSecs;
 
         // allow override
         if (!rocksGlobalOptions.configString.empty()) {
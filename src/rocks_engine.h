@@ -31,9 +31,10 @@
 
 #include <list>
 #include <map>
+#include <set>
 #include <string>
 #include <memory>
-#include <unordered_set>
+#include <vector>
 
 #include <boost/optional.hpp>
 
@@ -52,8 +53,10 @@
 #include "rocks_transaction.h"
 #include "rocks_snapshot_manager.h"
 #include "rocks_durability_manager.h"
+#include "rocks_ttl.h"
 
 namespace rocksdb {
+    struct BlockBasedTableOptions;
     class ColumnFamilyHandle;
     struct ColumnFamilyDescriptor;
     struct ColumnFamilyOptions;
@@ -62,15 +65,58 @@ namespace rocksdb {
     class Iterator;
     struct Options;
     struct ReadOptions;
+    class WriteBufferManager;
 }
 
 namespace mongo {
 
     struct CollectionOptions;
+    class CappedDeleterSignal;
     class RocksIndexBase;
     class RocksRecordStore;
+    class RocksCacheWarmer;
+    class RocksEventListener;
+    class RocksIncrementalBackup;
+    class RocksPointInTimeWalFilter;
+    class RocksMemoryBudget;
+    class RocksRowCache;
+    class RocksRateLimiterTuner;
+    class RocksSecondaryCatchUp;
+    class RocksTicketController;
+    class RocksPrefixStatsCache;
     class JournalListener;
 
+    /**
+     * Immutable, sorted snapshot of all prefixes that are dropped but whose data may still be
+     * present in the database. A new snapshot is published every time the set changes, so
+     * compaction filters can hold on to one without copying or locking.
+     */
+    class RocksDroppedPrefixes {
+    public:
+        RocksDroppedPrefixes(uint64_t version, std::vector<uint32_t> prefixes)
+            : _version(version), _prefixes(std::move(prefixes)) {}
+
+        uint64_t version() const { return _version; }
+        bool empty() const { return _prefixes.empty(); }
+        size_t size() const { return _prefixes.size(); }
+        const std::vector<uint32_t>& prefixes() const { return _prefixes; }
+
+        bool contains(uint32_t prefix) const;
+
+        /**
+         * If prefix is dropped, returns the first prefix after it that is not dropped (i.e.
+         * consecutive dropped prefixes are collapsed into a single range). *hasNextAlive is false
+         * if the range extends to the end of the 32-bit prefix space. Returns false if prefix is
+         * not dropped.
+         */
+        bool droppedRange(uint32_t prefix, uint32_t* nextAlivePrefix, bool* hasNextAlive) const;
+
+    private:
+        const uint64_t _version;
+        // sorted, no duplicates
+        const std::vector<uint32_t> _prefixes;
+    };
+
     class RocksEngine final : public KVEngine {
         MONGO_DISALLOW_COPYING( RocksEngine );
     public:
@@ -81,7 +127,7 @@ namespace mongo {
         RocksEngine(const std::string& path, bool durable, int formatVersion, bool readOnly);
         virtual ~RocksEngine();
 
-        static void appendGlobalStats(BSONObjBuilder& b);
+        void appendGlobalStats(BSONObjBuilder& b) const;
 
         virtual RecoveryUnit* newRecoveryUnit() override;
 
@@ -146,6 +192,24 @@ namespace mongo {
          */
         static bool initRsOplogBackgroundThread(StringData ns);
 
+        /**
+         * Hands the deletion of excess documents of any other capped collection to a pool of
+         * background threads shared by all of them, woken up through signal. Returns true if
+         * the pool deletes for the namespace, false if inserts have to delete themselves.
+         */
+        static bool initCappedDeleter(StringData ns,
+                                      const std::shared_ptr<CappedDeleterSignal>& signal);
+
+        /**
+         * Has a background thread call RocksRecordStore::accountExpiredRecords() for the
+         * collection ident with engine-native TTL every few seconds, until stopTTLMonitor().
+         * The collection is looked up as ns, the namespace it was opened as last. Returns true
+         * if the thread takes care of the collection.
+         */
+        static bool initTTLMonitor(StringData ident, StringData ns);
+        // the collection ident was dropped
+        static void stopTTLMonitor(StringData ident);
+
         virtual void setJournalListener(JournalListener* jl);
 
         // rocks specific api
@@ -154,14 +218,52 @@ namespace mongo {
         const rocksdb::DB* getDB() const { return _db.get(); }
         size_t getBlockCacheUsage() const { return _block_cache->GetUsage(); }
         std::shared_ptr<rocksdb::Cache> getBlockCache() { return _block_cache; }
-        std::unordered_set<uint32_t> getDroppedPrefixes() const;
+        // nullptr unless storage.rocksdb.compressedCacheSizeMB is set
+        std::shared_ptr<rocksdb::Cache> getCompressedBlockCache() { return _compressedBlockCache; }
+        // nullptr if storage.rocksdb.rowCacheSizeMB is 0
+        RocksRowCache* getRowCache() { return _rowCache.get(); }
+        std::shared_ptr<const RocksDroppedPrefixes> getDroppedPrefixes() const;
+        std::shared_ptr<const RocksTTLPrefixes> getTTLPrefixes() const;
 
         RocksTransactionEngine* getTransactionEngine() { return &_transactionEngine; }
+        RocksMemoryBudget* getMemoryBudget() { return _memoryBudget.get(); }
 
         int getMaxWriteMBPerSec() const { return _maxWriteMBPerSec; }
         void setMaxWriteMBPerSec(int maxWriteMBPerSec);
+        void appendRateLimiterStats(BSONObjBuilder* builder) const;
+        void appendCacheWarmerStats(BSONObjBuilder* builder) const;
+        void appendMemoryBudgetStats(BSONObjBuilder* builder) const;
+        // storage.rocksdb.blobMinSizeKB: blob files and their garbage collection
+        void appendBlobFileStats(BSONObjBuilder* builder) const;
+        // true if opened with storage.rocksdb.secondaryOf
+        bool isSecondary() const { return _secondary; }
+        void appendSecondaryStats(BSONObjBuilder* builder) const;
+        // nullptr if storage.rocksdb.eventHistorySize is 0
+        RocksEventListener* getEventListener() const { return _eventListener.get(); }
+
+        /**
+         * Bulk load mode of a collection, for initial sync and restores into a new collection.
+         * Until endBulkLoad(), documents inserted into ns and the keys inserted into its indexes,
+         * by bulk builders or not, are collected by RocksBulkLoaders under <dbpath>/bulkload
+         * instead of going to the WAL and the memtable. Only units of work that commit add to
+         * the loaders. endBulkLoad() ingests the documents and keys of all loaders in a single
+         * step and then counts the documents, so the collection and its indexes change
+         * together. Nothing is visible before that, and units of work writing to ns have to be
+         * done when endBulkLoad() is called. A load that fails leaves the collection as it was.
+         *
+         * The collection's ident config is flagged with bulkLoad while the load runs. A flag
+         * found on startup means that the load was interrupted, maybe after ingestion but before
+         * the documents were counted, so the counters are computed again when the collection is
+         * opened.
+         */
+        Status beginBulkLoad(StringData ns);
+        Status endBulkLoad(StringData ns);
+        // empty unless ns is bulk loading
+        std::string getBulkLoadDir(StringData ns) const;
+        std::vector<std::string> getBulkLoadNamespaces() const;
 
         Status backup(const std::string& path);
+        RocksIncrementalBackup* getIncrementalBackup() { return _incrementalBackup.get(); }
 
         rocksdb::Statistics* getStatistics() const {
           return _statistics.get();
@@ -175,21 +277,52 @@ namespace mongo {
         StringData ident,
         const CollectionOptions& options);
 
-        Status _createIdent(StringData ident, BSONObjBuilder* configBuilder);
+        // reserveNextPrefix also takes the prefix after the ident's, which keyTracker configs do
+        // anyway
+        Status _createIdent(StringData ident, BSONObjBuilder* configBuilder,
+                            bool reserveNextPrefix = false);
+        Status _recordStoreConfig(StringData ns, const CollectionOptions& options,
+                                  BSONObjBuilder* configBuilder);
+        void _indexConfig(const IndexDescriptor* desc, BSONObjBuilder* configBuilder);
         BSONObj _getIdentConfig(StringData ident);
         std::string _extractPrefix(const BSONObj& config);
-
-        rocksdb::Options _options() const;
+        void _addDroppedPrefixes(const std::vector<uint32_t>& prefixes);
+        void _addTTLPrefixes(const std::vector<RocksTTLPrefixes::Entry>& entries);
+        static bool _ttlEntryFromConfig(const BSONObj& config, RocksTTLPrefixes::Entry* entry);
+        // lets compaction drop the documents of the TTL collection with prefix that its record
+        // store has accounted for
+        void _setTTLAccountedBefore(
+            uint32_t prefix, std::shared_ptr<const std::atomic<long long>> accountedBeforeSecs);
+        // nullptr if ns isn't open or was dropped
+        RocksRecordStore* _findRecordStore(StringData ns);
+        // open indexes of ns
+        std::vector<RocksIndexBase*> _findIndexes(StringData ns);
+        // sets or clears bulkLoad in the config of ident, synced to disk
+        Status _setBulkLoadFlag(StringData ident, bool bulkLoad);
+
+        rocksdb::BlockBasedTableOptions _tableOptions() const;
+        rocksdb::Options _options();
+        rocksdb::ColumnFamilyOptions _oplogCFOptions(const rocksdb::Options& baseOptions);
+        void _sizeOplogCF(long long cappedSize);
 
         std::string _path;
         std::unique_ptr<rocksdb::DB> _db;
         std::shared_ptr<rocksdb::Cache> _block_cache;
+        std::shared_ptr<rocksdb::Cache> _compressedBlockCache;
+        // only with storage.rocksdb.memoryBudgetMB, charges memtables to _block_cache
+        std::shared_ptr<rocksdb::WriteBufferManager> _writeBufferManager;
+        std::unique_ptr<RocksMemoryBudget> _memoryBudget;
+        // documents of collections created with rowCache: true. nullptr if rowCacheSizeMB is 0
+        std::unique_ptr<RocksRowCache> _rowCache;
         int _maxWriteMBPerSec;
         std::shared_ptr<rocksdb::RateLimiter> _rateLimiter;
         // can be nullptr
         std::shared_ptr<rocksdb::Statistics> _statistics;
+        // can be nullptr. Registered in the options of all column families
+        std::shared_ptr<RocksEventListener> _eventListener;
 
         const bool _durable;
+        const bool _secondary;
         const int _formatVersion;
 
         // ident map stores mapping from ident to a BSON config
@@ -208,10 +341,29 @@ namespace mongo {
         StringMap<RocksIndexBase*> _identIndexMap;
         // mapping from ident --> collection object
         StringMap<RocksRecordStore*> _identCollectionMap;
-
-        // set of all prefixes that are deleted. we delete them in the background thread
+        // mapping from namespace --> expireAfterSeconds for collections with engine-native TTL.
+        // Used to tag indexes of those collections when they are created
+        StringMap<int64_t> _ttlCollections;
+        // mapping from namespace --> ident of open collections
+        StringMap<std::string> _collectionIdents;
+
+        // namespaces between beginBulkLoad() and endBulkLoad()
+        mutable stdx::mutex _bulkLoadMutex;
+        std::set<std::string> _bulkLoadNamespaces;
+        // idents that were flagged with bulkLoad on startup, until they are opened. Protected by
+        // _bulkLoadMutex
+        std::set<std::string> _interruptedBulkLoads;
+
+        // set of all prefixes that are deleted. we delete them in the background thread.
+        // _droppedPrefixesMutex only protects swapping the pointer, the snapshot itself is
+        // immutable
         mutable stdx::mutex _droppedPrefixesMutex;
-        std::unordered_set<uint32_t> _droppedPrefixes;
+        std::shared_ptr<const RocksDroppedPrefixes> _droppedPrefixes;
+
+        // prefixes of collections with engine-native TTL and their indexes. Same copy-on-write
+        // scheme as _droppedPrefixes
+        mutable stdx::mutex _ttlPrefixesMutex;
+        std::shared_ptr<const RocksTTLPrefixes> _ttlPrefixes;
 
         // This is for concurrency control
         RocksTransactionEngine _transactionEngine;
@@ -223,18 +375,37 @@ namespace mongo {
 
         std::unique_ptr<RocksCompactionScheduler> _compactionScheduler;
 
+        // per-prefix storage statistics collected in SST properties
+        std::unique_ptr<RocksPrefixStatsCache> _prefixStats;
+
         static const std::string kMetadataPrefix;
         static const std::string kDroppedPrefix;
         static const std::string kOplogCF;
+        static const std::string kHotKeysFile;
+        static const std::string kBulkLoadDir;
 
         std::vector<rocksdb::ColumnFamilyHandle*> _cfHandles;
         bool _useSeparateOplogCF = false;
+        // oplog column family uses FIFO compaction. Only with _useSeparateOplogCF
+        bool _oplogFIFO = false;
         int _defaultCFIndex = 0;
         int _oplogCFIndex = 0;
 
         std::unique_ptr<RocksDurabilityManager> _durabilityManager;
         class RocksJournalFlusher;
         std::unique_ptr<RocksJournalFlusher> _journalFlusher;  // Depends on _durabilityManager
+        // only set with storage.rocksdb.rateLimiterAutoTune. Depends on _db and _rateLimiter
+        std::unique_ptr<RocksRateLimiterTuner> _rateLimiterTuner;
+        // not set in read-only mode. Depends on _db
+        std::unique_ptr<RocksCacheWarmer> _cacheWarmer;
+        // only for secondary instances. Depends on _db
+        std::unique_ptr<RocksSecondaryCatchUp> _secondaryCatchUp;
+        // nullptr unless storage.rocksdb.adaptiveTickets is set
+        std::unique_ptr<RocksTicketController> _ticketController;
+        // writes WAL time markers if storage.rocksdb.walArchiveTTLSecs is set. Depends on _db
+        std::unique_ptr<RocksIncrementalBackup> _incrementalBackup;
+        // only when restoring from an incremental backup, used while opening _db
+        std::unique_ptr<RocksPointInTimeWalFilter> _pointInTimeWalFilter;
     };
 
 }
@@ -31,18 +31,42 @@
 #include "mongo/stdx/memory.h"
 
 #include <boost/filesystem/operations.hpp>
+#include <iterator>
 #include <memory>
 
 #include <rocksdb/comparator.h>
 #include <rocksdb/db.h>
 #include <rocksdb/options.h>
+#include <rocksdb/rate_limiter.h>
 #include <rocksdb/slice.h>
+#include <rocksdb/version.h>
+#include <rocksdb/write_batch.h>
 
+#include "mongo/db/catalog/collection_options.h"
+#include "mongo/db/concurrency/lock_state.h"
+#include "mongo/db/index/index_descriptor.h"
+#include "mongo/db/operation_context_noop.h"
 #include "mongo/db/storage/kv/kv_engine.h"
 #include "mongo/db/storage/kv/kv_engine_test_harness.h"
 #include "mongo/unittest/temp_dir.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/time_support.h"
 
+#include "rocks_backup.h"
+#include "rocks_cache_warmer.h"
 #include "rocks_engine.h"
+#include "rocks_event_listener.h"
+#include "rocks_global_options.h"
+#include "rocks_histogram.h"
+#include "rocks_memory_budget.h"
+#include "rocks_perf_profile.h"
+#include "rocks_rate_limiter_tuner.h"
+#include "rocks_record_store.h"
+#include "rocks_row_cache.h"
+#include "rocks_secondary.h"
+#include "rocks_table_properties.h"
+#include "rocks_ticket_controller.h"
+#include "rocks_ttl.h"
 
 namespace mongo {
 namespace {
@@ -77,5 +101,767 @@ namespace {
         KVHarnessHelper::registerFactory(makeHelper);
         return Status::OK();
     }
+
+    TEST(RocksEngineTest, CreateIdentIsDurable) {
+        unittest::TempDir tempDir("mongo-rocks-create-ident-test");
+        {
+            RocksEngine engine(tempDir.path(), false, 3, false);
+            OperationContextNoop opCtx(engine.newRecoveryUnit());
+            ASSERT_OK(engine.createRecordStore(&opCtx, "test.coll", "collection-1",
+                                               CollectionOptions()));
+            // the duplicate is skipped
+            ASSERT_OK(engine.createRecordStore(&opCtx, "test.coll", "collection-1",
+                                               CollectionOptions()));
+            ASSERT_TRUE(engine.hasIdent(&opCtx, "collection-1"));
+        }
+        {
+            RocksEngine engine(tempDir.path(), false, 3, false);
+            OperationContextNoop opCtx(engine.newRecoveryUnit());
+            ASSERT_EQ(1U, engine.getAllIdents(&opCtx).size());
+        }
+        {
+            // the write fails, the ident must not show up
+            RocksEngine engine(tempDir.path(), false, 3, true);
+            OperationContextNoop opCtx(engine.newRecoveryUnit());
+            ASSERT_NOT_OK(engine.createRecordStore(&opCtx, "test.other", "collection-2",
+                                                   CollectionOptions()));
+            ASSERT_FALSE(engine.hasIdent(&opCtx, "collection-2"));
+            ASSERT_EQ(1U, engine.getAllIdents(&opCtx).size());
+        }
+    }
+
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 8))
+    TEST(RocksEngineTest, BulkLoadIsAllOrNothing) {
+        unittest::TempDir tempDir("mongo-rocks-bulk-load-test");
+        IndexDescriptor desc(nullptr, "", BSON("v" << 2 << "ns"
+                                                   << "test.bulk"
+                                                   << "key" << BSON("a" << 1) << "name"
+                                                   << "a_1"));
+        {
+            RocksEngine engine(tempDir.path(), false, 3, false);
+            OperationContextNoop opCtx(engine.newRecoveryUnit());
+            ASSERT_OK(engine.createRecordStore(&opCtx, "test.bulk", "collection-bulk",
+                                               CollectionOptions()));
+            auto rs = engine.getRecordStore(&opCtx, "test.bulk", "collection-bulk",
+                                            CollectionOptions());
+            ASSERT_OK(engine.createSortedDataInterface(&opCtx, "index-bulk", &desc));
+            std::unique_ptr<SortedDataInterface> index(
+                engine.getSortedDataInterface(&opCtx, "index-bulk", &desc));
+
+            ASSERT_OK(engine.beginBulkLoad("test.bulk"));
+            ASSERT_NOT_OK(engine.beginBulkLoad("test.bulk"));
+            RecordId first, rolledBack;
+            for (int i = 0; i < 10; ++i) {
+                WriteUnitOfWork uow(&opCtx);
+                RecordId loc = rs->insertRecord(&opCtx, "abc", 4, false).getValue();
+                ASSERT_OK(index->insert(&opCtx, BSON("" << i), loc, true));
+                if (i == 0) {
+                    first = loc;
+                }
+                uow.commit();
+            }
+            {
+                // neither the document nor its key are loaded
+                WriteUnitOfWork uow(&opCtx);
+                rolledBack = rs->insertRecord(&opCtx, "abc", 4, false).getValue();
+                ASSERT_OK(index->insert(&opCtx, BSON("" << 10), rolledBack, true));
+            }
+            {
+                OperationContextNoop readCtx(engine.newRecoveryUnit());
+                RecordData data;
+                ASSERT(!rs->findRecord(&readCtx, first, &data));
+                ASSERT(index->isEmpty(&readCtx));
+                ASSERT_EQ(0, rs->numRecords(&readCtx));
+            }
+
+            ASSERT_OK(engine.endBulkLoad("test.bulk"));
+            ASSERT_NOT_OK(engine.endBulkLoad("test.bulk"));
+            {
+                OperationContextNoop readCtx(engine.newRecoveryUnit());
+                RecordData data;
+                ASSERT(rs->findRecord(&readCtx, first, &data));
+                ASSERT_EQ(std::string("abc"), data.data());
+                ASSERT(!rs->findRecord(&readCtx, rolledBack, &data));
+                ASSERT_EQ(10, rs->numRecords(&readCtx));
+                ASSERT_EQ(40, rs->dataSize(&readCtx));
+                long long numKeys = 0;
+                index->fullValidate(&readCtx, &numKeys, nullptr);
+                ASSERT_EQ(10, numKeys);
+            }
+
+            // interrupted by a shutdown, the next load is lost
+            ASSERT_OK(engine.beginBulkLoad("test.bulk"));
+            WriteUnitOfWork uow(&opCtx);
+            RecordId loc = rs->insertRecord(&opCtx, "abc", 4, false).getValue();
+            ASSERT_OK(index->insert(&opCtx, BSON("" << 11), loc, true));
+            uow.commit();
+        }
+        {
+            RocksEngine engine(tempDir.path(), false, 3, false);
+            OperationContextNoop opCtx(engine.newRecoveryUnit());
+            // counted again when opened
+            auto rs = engine.getRecordStore(&opCtx, "test.bulk", "collection-bulk",
+                                            CollectionOptions());
+            std::unique_ptr<SortedDataInterface> index(
+                engine.getSortedDataInterface(&opCtx, "index-bulk", &desc));
+            ASSERT_EQ(10, rs->numRecords(&opCtx));
+            ASSERT_EQ(40, rs->dataSize(&opCtx));
+            long long numKeys = 0;
+            index->fullValidate(&opCtx, &numKeys, nullptr);
+            ASSERT_EQ(10, numKeys);
+        }
+    }
+#endif
+
+    TEST(RocksEngineTest, CompactionDropsAccountedExpiredDocuments) {
+        unittest::TempDir tempDir("mongo-rocks-ttl-compaction-test");
+        RocksEngine engine(tempDir.path(), false, 3, false);
+        OperationContextNoop opCtx(engine.newRecoveryUnit());
+        CollectionOptions options;
+        options.storageEngine = BSON("rocksdb" << BSON("expireAfterSeconds" << 10));
+        ASSERT_OK(engine.createRecordStore(&opCtx, "test.ttl", "collection-ttl", options));
+        auto rs = engine.getRecordStore(&opCtx, "test.ttl", "collection-ttl", options);
+        RocksRecordStore* rrs = dynamic_cast<RocksRecordStore*>(rs.get());
+        {
+            WriteUnitOfWork uow(&opCtx);
+            ASSERT_OK(rs->insertRecord(&opCtx, "a", 2, false).getStatus());
+            ASSERT_OK(rs->insertRecord(&opCtx, "b", 2, false).getStatus());
+            uow.commit();
+        }
+
+        auto countDocuments = [&engine] {
+            std::unique_ptr<rocksdb::Iterator> iter(
+                engine.getDB()->NewIterator(rocksdb::ReadOptions()));
+            int count = 0;
+            for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+                if (iter->value() == rocksdb::Slice("a", 2) ||
+                    iter->value() == rocksdb::Slice("b", 2)) {
+                    ++count;
+                }
+            }
+            return count;
+        };
+        auto compact = [&engine] {
+            ASSERT(engine.getDB()->CompactRange(rocksdb::CompactRangeOptions(), nullptr, nullptr)
+                       .ok());
+        };
+
+        RocksTTL::advanceClockForTest(RocksTTL::kCompactionGraceSecs + 20);
+
+        // expired, but not taken out of the counters yet
+        compact();
+        ASSERT_EQ(2, countDocuments());
+        ASSERT_EQ(2, rs->numRecords(&opCtx));
+
+        {
+            WriteUnitOfWork uow(&opCtx);
+            ASSERT_EQ(2, rrs->accountExpiredRecords(&opCtx));
+            uow.commit();
+        }
+        compact();
+        ASSERT_EQ(0, countDocuments());
+        ASSERT_EQ(0, rs->numRecords(&opCtx));
+        ASSERT_EQ(0, rs->dataSize(&opCtx));
+
+        // the watermark goes away with the collection
+        engine.flushAllFiles(&opCtx, true);
+        const std::string accountedKey = RocksRecordStore::ttlAccountedKey("collection-ttl");
+        std::string value;
+        ASSERT(engine.getDB()->Get(rocksdb::ReadOptions(), accountedKey, &value).ok());
+        rs.reset();
+        ASSERT_OK(engine.dropIdent(&opCtx, "collection-ttl"));
+        engine.flushAllFiles(&opCtx, true);
+        ASSERT(engine.getDB()->Get(rocksdb::ReadOptions(), accountedKey, &value).IsNotFound());
+    }
+
+    TEST(RocksDroppedPrefixesTest, DroppedRange) {
+        RocksDroppedPrefixes dropped(1, {3, 5, 6, 7, 10, 0xFFFFFFFEU, 0xFFFFFFFFU});
+        uint32_t next = 0;
+        bool hasNext = false;
+
+        ASSERT_FALSE(dropped.contains(4));
+        ASSERT_FALSE(dropped.droppedRange(4, &next, &hasNext));
+
+        ASSERT_TRUE(dropped.droppedRange(3, &next, &hasNext));
+        ASSERT_TRUE(hasNext);
+        ASSERT_EQ(4U, next);
+
+        // consecutive prefixes are collapsed into one range
+        ASSERT_TRUE(dropped.droppedRange(5, &next, &hasNext));
+        ASSERT_TRUE(hasNext);
+        ASSERT_EQ(8U, next);
+        ASSERT_TRUE(dropped.droppedRange(6, &next, &hasNext));
+        ASSERT_EQ(8U, next);
+
+        // range that reaches the end of the prefix space
+        ASSERT_TRUE(dropped.droppedRange(0xFFFFFFFEU, &next, &hasNext));
+        ASSERT_FALSE(hasNext);
+    }
+
+    TEST(RocksPrefixStatsTest, CollectAndAggregate) {
+        unittest::TempDir tempDir("mongo-rocks-prefix-stats-test");
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        options.table_properties_collector_factories.push_back(
+            std::make_shared<RocksPrefixStatsCollectorFactory>());
+        rocksdb::DB* rawDb;
+        ASSERT(rocksdb::DB::Open(options, tempDir.path(), &rawDb).ok());
+        std::unique_ptr<rocksdb::DB> db(rawDb);
+
+        const std::string first("\0\0\0\1", 4), second("\0\0\0\2", 4);
+        for (int i = 0; i < 100; ++i) {
+            ASSERT(db->Put(rocksdb::WriteOptions(), first + std::to_string(i), "value").ok());
+        }
+        ASSERT(db->Put(rocksdb::WriteOptions(), second + "a", "value").ok());
+        ASSERT(db->Delete(rocksdb::WriteOptions(), second + "b").ok());
+
+        RocksPrefixStats stats;
+        {
+            // nothing is flushed yet
+            RocksPrefixStatsCache cache(db.get(), {db->DefaultColumnFamily()});
+            ASSERT_FALSE(cache.get(first, &stats));
+        }
+
+        ASSERT(db->Flush(rocksdb::FlushOptions()).ok());
+
+        RocksPrefixStatsCache cache(db.get(), {db->DefaultColumnFamily()});
+        ASSERT_TRUE(cache.get(first, &stats));
+        ASSERT_EQ(100, stats.numKeys);
+        ASSERT_EQ(0, stats.numDeletions);
+        ASSERT_GT(stats.rawBytes, 0);
+        ASSERT_GT(stats.storedBytes, 0);
+
+        ASSERT_TRUE(cache.get(second, &stats));
+        ASSERT_EQ(1, stats.numKeys);
+        ASSERT_EQ(1, stats.numDeletions);
+
+        ASSERT_FALSE(cache.get(std::string("\0\0\0\3", 4), &stats));
+    }
+
+    TEST(RocksPrefixStatsTest, StaleTotalsAreRefreshedOnGet) {
+        unittest::TempDir tempDir("mongo-rocks-prefix-stats-stale-test");
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        options.table_properties_collector_factories.push_back(
+            std::make_shared<RocksPrefixStatsCollectorFactory>());
+        rocksdb::DB* rawDb;
+        ASSERT(rocksdb::DB::Open(options, tempDir.path(), &rawDb).ok());
+        std::unique_ptr<rocksdb::DB> db(rawDb);
+
+        const std::string prefix("\0\0\0\1", 4);
+        ASSERT(db->Put(rocksdb::WriteOptions(), prefix + "a", "value").ok());
+        ASSERT(db->Flush(rocksdb::FlushOptions()).ok());
+
+        // the background job isn't running, only get() can refresh
+        RocksPrefixStatsCache cache(db.get(), {db->DefaultColumnFamily()}, 10);
+        RocksPrefixStats stats;
+        ASSERT_TRUE(cache.get(prefix, &stats));
+        ASSERT_EQ(1, stats.numKeys);
+
+        ASSERT(db->Put(rocksdb::WriteOptions(), prefix + "b", "value").ok());
+        ASSERT(db->Flush(rocksdb::FlushOptions()).ok());
+        sleepmillis(20);
+        ASSERT_TRUE(cache.get(prefix, &stats));
+        ASSERT_EQ(2, stats.numKeys);
+    }
+
+    TEST(RocksCacheWarmerTest, HotKeysRoundTrip) {
+        RocksHotKeySampler sampler(4);
+        sampler.record(0, rocksdb::Slice("b"));
+        sampler.record(0, rocksdb::Slice("a"));
+        sampler.record(0, rocksdb::Slice("b"));
+        sampler.record(1, rocksdb::Slice("a"));
+        // overwrites the oldest sample
+        sampler.record(0, rocksdb::Slice(std::string("c\0d", 3)));
+        std::vector<RocksHotKeySampler::HotKey> keys = sampler.snapshot();
+        ASSERT_EQ(4U, keys.size());
+        ASSERT(RocksHotKeySampler::HotKey(0, "a") == keys[0]);
+        ASSERT(RocksHotKeySampler::HotKey(0, "b") == keys[1]);
+        ASSERT(RocksHotKeySampler::HotKey(0, std::string("c\0d", 3)) == keys[2]);
+        ASSERT(RocksHotKeySampler::HotKey(1, "a") == keys[3]);
+
+        unittest::TempDir tempDir("mongo-rocks-cache-warmer-test");
+        const std::string file = tempDir.path() + "/hotkeys";
+        ASSERT_OK(RocksCacheWarmer::writeHotKeys(file, keys));
+        std::vector<RocksHotKeySampler::HotKey> read;
+        ASSERT_OK(RocksCacheWarmer::readHotKeys(file, &read));
+        ASSERT(keys == read);
+    }
+
+    TEST(RocksIncrementalBackupTest, BackupAndRestore) {
+        unittest::TempDir tempDir("mongo-rocks-incremental-backup-test");
+        const std::string dbPath = tempDir.path() + "/db";
+        const std::string root = tempDir.path() + "/backup";
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        options.wal_dir = dbPath + "/journal";
+        options.WAL_ttl_seconds = 3600;
+        {
+            rocksdb::DB* rawDb;
+            ASSERT(rocksdb::DB::Open(options, dbPath, &rawDb).ok());
+            std::unique_ptr<rocksdb::DB> db(rawDb);
+            RocksIncrementalBackup backup(db.get(), 2, 0, 0);
+
+            ASSERT(db->Put(rocksdb::WriteOptions(), "a", "1").ok());
+            ASSERT_OK(backup.backup(root));
+            // nothing new was flushed, the SST file of the first backup is not copied again
+            ASSERT_OK(backup.backup(root));
+            BSONObjBuilder progress;
+            backup.appendProgress(&progress);
+            ASSERT_GT(progress.obj()["files-skipped"].numberLong(), 0);
+
+            // only in the WAL
+            ASSERT(db->Put(rocksdb::WriteOptions(), "b", "2").ok());
+            ASSERT_OK(backup.archiveWal(root));
+        }
+
+        const std::string restorePath = tempDir.path() + "/restored";
+        ASSERT_OK(RocksIncrementalBackup::restore(root, restorePath, restorePath + "/journal", 0,
+                                                  2));
+        options.create_if_missing = false;
+        options.wal_dir = restorePath + "/journal";
+        rocksdb::DB* rawDb;
+        ASSERT(rocksdb::DB::Open(options, restorePath, &rawDb).ok());
+        std::unique_ptr<rocksdb::DB> db(rawDb);
+        std::string value;
+        ASSERT(db->Get(rocksdb::ReadOptions(), "a", &value).ok());
+        ASSERT_EQ("1", value);
+        ASSERT(db->Get(rocksdb::ReadOptions(), "b", &value).ok());
+        ASSERT_EQ("2", value);
+
+        rocksdb::WriteBatch marker;
+        marker.PutLogData("mongorocks-time:1234");
+        long long millis = 0;
+        ASSERT_TRUE(RocksIncrementalBackup::parseTimeMarker(marker, &millis));
+        ASSERT_EQ(1234, millis);
+        RocksPointInTimeWalFilter filter(1000);
+        bool changed = false;
+        ASSERT(rocksdb::WalFilter::WalProcessingOption::kStopReplay ==
+               filter.LogRecord(marker, nullptr, &changed));
+    }
+
+    TEST(RocksIncrementalBackupTest, PrunesOldBackups) {
+        unittest::TempDir tempDir("mongo-rocks-incremental-backup-prune-test");
+        const std::string dbPath = tempDir.path() + "/db";
+        const std::string root = tempDir.path() + "/backup";
+        auto countFiles = [](const std::string& dir) {
+            return std::distance(boost::filesystem::directory_iterator(dir),
+                                 boost::filesystem::directory_iterator());
+        };
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        rocksdb::DB* rawDb;
+        ASSERT(rocksdb::DB::Open(options, dbPath, &rawDb).ok());
+        std::unique_ptr<rocksdb::DB> db(rawDb);
+        {
+            // without WAL archiving, the WAL between two backups would be lost
+            RocksIncrementalBackup backup(db.get(), 2, 0, 1);
+            ASSERT_EQ(ErrorCodes::IllegalOperation, backup.backup(root).code());
+        }
+        db.reset();
+
+        options.WAL_ttl_seconds = 3600;
+        ASSERT(rocksdb::DB::Open(options, dbPath, &rawDb).ok());
+        db.reset(rawDb);
+        RocksIncrementalBackup backup(db.get(), 2, 0, 1);
+        ASSERT(db->Put(rocksdb::WriteOptions(), "a", "1").ok());
+        ASSERT_OK(backup.backup(root));
+        ASSERT(db->Put(rocksdb::WriteOptions(), "b", "2").ok());
+        ASSERT(db->Flush(rocksdb::FlushOptions()).ok());
+        // replaces the SST file of the first backup
+        ASSERT(db->CompactRange(rocksdb::CompactRangeOptions(), nullptr, nullptr).ok());
+        // backups are named after their time
+        sleepmillis(2);
+        ASSERT_OK(backup.backup(root));
+
+        ASSERT_EQ(1, countFiles(root + "/meta"));
+        ASSERT_EQ(1, countFiles(root + "/shared"));
+        BSONObjBuilder progress;
+        backup.appendProgress(&progress);
+        BSONObj obj = progress.obj();
+        ASSERT_EQ(1, obj["backups-pruned"].numberLong());
+        ASSERT_GT(obj["files-pruned"].numberLong(), 0);
+    }
+
+#if defined(ROCKSDB_MAJOR) && ROCKSDB_MAJOR >= 6
+    TEST(RocksSecondaryCatchUpTest, SeesWritesOfThePrimary) {
+        unittest::TempDir tempDir("mongo-rocks-secondary-test");
+        const std::string primaryPath = tempDir.path() + "/primary";
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        rocksdb::DB* rawDb;
+        ASSERT(rocksdb::DB::Open(options, primaryPath, &rawDb).ok());
+        std::unique_ptr<rocksdb::DB> primary(rawDb);
+        ASSERT(primary->Put(rocksdb::WriteOptions(), "a", "1").ok());
+
+        // secondaries need to keep all files open
+        options.max_open_files = -1;
+        ASSERT(rocksdb::DB::OpenAsSecondary(options, primaryPath, tempDir.path() + "/secondary",
+                                            &rawDb)
+                   .ok());
+        std::unique_ptr<rocksdb::DB> secondary(rawDb);
+        RocksSecondaryCatchUp catchUp(secondary.get(), 1000);
+        std::string value;
+        ASSERT(secondary->Get(rocksdb::ReadOptions(), "a", &value).ok());
+        ASSERT_EQ("1", value);
+
+        // one write only in the WAL, one flushed to a new SST file
+        ASSERT(primary->Put(rocksdb::WriteOptions(), "b", "2").ok());
+        ASSERT(primary->Flush(rocksdb::FlushOptions()).ok());
+        ASSERT(primary->Put(rocksdb::WriteOptions(), "c", "3").ok());
+        ASSERT(secondary->Get(rocksdb::ReadOptions(), "b", &value).IsNotFound());
+
+        catchUp.catchUp();
+        ASSERT(secondary->Get(rocksdb::ReadOptions(), "b", &value).ok());
+        ASSERT_EQ("2", value);
+        ASSERT(secondary->Get(rocksdb::ReadOptions(), "c", &value).ok());
+        ASSERT_EQ("3", value);
+
+        BSONObjBuilder builder;
+        catchUp.appendStats(&builder);
+        BSONObj stats = builder.obj();
+        ASSERT_EQ(1, stats["catch-ups"].numberLong());
+        ASSERT_EQ(0, stats["failures"].numberLong());
+        ASSERT_EQ(static_cast<long long>(primary->GetLatestSequenceNumber()),
+                  stats["sequence"].numberLong());
+    }
+
+    TEST(RocksSecondaryCatchUpTest, EngineScansRecordStore) {
+        unittest::TempDir tempDir("mongo-rocks-secondary-engine-test");
+        const std::string primaryPath = tempDir.path() + "/primary";
+        RocksEngine primary(primaryPath, true, 3, false);
+        std::unique_ptr<RecordStore> primaryRs;
+        {
+            OperationContextNoop opCtx(primary.newRecoveryUnit());
+            ASSERT_OK(primary.createRecordStore(&opCtx, "test.scan", "collection-scan",
+                                                CollectionOptions()));
+            primaryRs = primary.getRecordStore(&opCtx, "test.scan", "collection-scan",
+                                               CollectionOptions());
+            WriteUnitOfWork uow(&opCtx);
+            for (int i = 0; i < 3; ++i) {
+                ASSERT_OK(primaryRs->insertRecord(&opCtx, "abc", 4, false).getStatus());
+            }
+            uow.commit();
+        }
+
+        const std::string secondaryOf = rocksGlobalOptions.secondaryOf;
+        const int catchUpIntervalMs = rocksGlobalOptions.secondaryCatchUpIntervalMs;
+        rocksGlobalOptions.secondaryOf = primaryPath;
+        rocksGlobalOptions.secondaryCatchUpIntervalMs = 10;
+        RocksEngine secondary(tempDir.path() + "/secondary", true, 3, true);
+        rocksGlobalOptions.secondaryOf = secondaryOf;
+        rocksGlobalOptions.secondaryCatchUpIntervalMs = catchUpIntervalMs;
+        ASSERT(secondary.isSecondary());
+        ASSERT_FALSE(primary.isSecondary());
+
+        std::unique_ptr<RecordStore> rs;
+        {
+            OperationContextNoop opCtx(secondary.newRecoveryUnit());
+            rs = secondary.getRecordStore(&opCtx, "test.scan", "collection-scan",
+                                          CollectionOptions());
+        }
+        auto countRecords = [&]() {
+            OperationContextNoop opCtx(secondary.newRecoveryUnit());
+            int numRecords = 0;
+            auto cursor = rs->getCursor(&opCtx);
+            while (auto record = cursor->next()) {
+                ASSERT_EQ(std::string("abc"), record->data.data());
+                // a point read on the same recovery unit
+                ASSERT_EQ(std::string("abc"), rs->dataFor(&opCtx, record->id).data());
+                ++numRecords;
+            }
+            return numRecords;
+        };
+        ASSERT_EQ(3, countRecords());
+
+        {
+            OperationContextNoop opCtx(primary.newRecoveryUnit());
+            WriteUnitOfWork uow(&opCtx);
+            ASSERT_OK(primaryRs->insertRecord(&opCtx, "abc", 4, false).getStatus());
+            uow.commit();
+        }
+        int numRecords = 0;
+        for (int i = 0; i < 500 && (numRecords = countRecords()) < 4; ++i) {
+            sleepmillis(10);
+        }
+        ASSERT_EQ(4, numRecords);
+        rs.reset();
+        primaryRs.reset();
+    }
+#endif
+
+    TEST(RocksEventListenerTest, FlushAndCompactionHistory) {
+        unittest::TempDir tempDir("mongo-rocks-event-listener-test");
+        auto listener = std::make_shared<RocksEventListener>(2);
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        options.listeners.push_back(listener);
+        rocksdb::DB* rawDb;
+        ASSERT(rocksdb::DB::Open(options, tempDir.path(), &rawDb).ok());
+        std::unique_ptr<rocksdb::DB> db(rawDb);
+        listener->setDB(db.get(), {db->DefaultColumnFamily()});
+
+        for (int i = 0; i < 2; ++i) {
+            ASSERT(db->Put(rocksdb::WriteOptions(), "a", std::to_string(i)).ok());
+            ASSERT(db->Flush(rocksdb::FlushOptions()).ok());
+        }
+        ASSERT(db->CompactRange(rocksdb::CompactRangeOptions(), nullptr, nullptr).ok());
+        listener->setDB(nullptr, {});
+
+        BSONObjBuilder withoutHistory;
+        listener->appendStats(&withoutHistory, false);
+        ASSERT(withoutHistory.obj()["history"].eoo());
+
+        BSONObjBuilder builder;
+        listener->appendStats(&builder, true);
+        BSONObj stats = builder.obj();
+        ASSERT_EQ(3, stats["events"].numberLong());
+        // only the last two are kept
+        auto history = stats["history"].Array();
+        ASSERT_EQ(2U, history.size());
+        ASSERT_EQ("flush", history[0]["type"].String());
+        ASSERT_EQ(1, history[0]["entries"].numberLong());
+        ASSERT_EQ("compaction", history[1]["type"].String());
+        ASSERT_EQ(2, history[1]["input-files"].numberInt());
+        ASSERT(stats["stalls"].Obj().isEmpty());
+    }
+
+    TEST(RocksPerfProfileTest, SampleAndCollect) {
+        RocksPerfProfile::setSampleEvery(4);
+        int sampled = 0;
+        for (int i = 0; i < 8; ++i) {
+            sampled += RocksPerfProfile::shouldSample() ? 1 : 0;
+        }
+        ASSERT_EQ(2, sampled);
+        RocksPerfProfile::setSampleEvery(0);
+        ASSERT_FALSE(RocksPerfProfile::shouldSample());
+
+        unittest::TempDir tempDir("mongo-rocks-perf-profile-test");
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        rocksdb::DB* rawDb;
+        ASSERT(rocksdb::DB::Open(options, tempDir.path(), &rawDb).ok());
+        std::unique_ptr<rocksdb::DB> db(rawDb);
+        ASSERT(db->Put(rocksdb::WriteOptions(), "a", "1").ok());
+
+        RocksPerfProfile profile;
+        std::string value;
+        {
+            RocksPerfScope scope(&profile);
+            ASSERT(db->Get(rocksdb::ReadOptions(), "a", &value).ok());
+        }
+        {
+            // not sampled
+            RocksPerfScope scope(nullptr);
+            ASSERT(db->Get(rocksdb::ReadOptions(), "a", &value).ok());
+        }
+        auto counters = profile.get();
+        ASSERT_EQ(1, counters.calls);
+        ASSERT_EQ(1, counters.memtableHits);
+        ASSERT_EQ(0, counters.walSyncMicros);
+
+        // recovery units start over with every snapshot or unit of work
+        profile.reset();
+        ASSERT_EQ(0, profile.get().calls);
+    }
+
+    TEST(RocksHistogramTest, BucketsAndPercentiles) {
+        // exact below kSubBuckets, then kSubBuckets buckets per power of two
+        ASSERT_EQ(5, RocksHistogram::bucketFor(5));
+        ASSERT_EQ(8, RocksHistogram::bucketFor(8));
+        ASSERT_EQ(16, RocksHistogram::bucketFor(16));
+        ASSERT_EQ(16, RocksHistogram::bucketFor(17));
+        ASSERT_EQ(17U, RocksHistogram::bucketUpperBound(16));
+        ASSERT_EQ(RocksHistogram::kNumBuckets - 1, RocksHistogram::bucketFor(~0ULL));
+        for (uint64_t value : {1ULL, 100ULL, 1000ULL, 123456ULL, 1ULL << 35}) {
+            int bucket = RocksHistogram::bucketFor(value);
+            ASSERT_LTE(value, RocksHistogram::bucketUpperBound(bucket));
+            ASSERT_GT(value, RocksHistogram::bucketUpperBound(bucket - 1));
+            // at most 12.5% off
+            ASSERT_LTE(RocksHistogram::bucketUpperBound(bucket), value + value / 8);
+        }
+
+        RocksHistogram histogram;
+        ASSERT_EQ(0U, histogram.snapshot().percentile(0.99));
+        for (int i = 0; i < 98; ++i) {
+            histogram.record(100);
+        }
+        auto before = histogram.snapshot();
+        histogram.record(5000);
+        histogram.record(5000);
+        auto snapshot = histogram.snapshot();
+        ASSERT_EQ(100U, snapshot.count());
+        ASSERT_EQ(98U * 100 + 2 * 5000, snapshot.sum());
+        ASSERT_EQ(103U, snapshot.percentile(0.5));
+        ASSERT_EQ(5119U, snapshot.percentile(0.99));
+
+        auto delta = snapshot.since(before);
+        ASSERT_EQ(2U, delta.count());
+        ASSERT_EQ(5119U, delta.percentile(0.5));
+    }
+
+    TEST(RocksMemoryBudgetTest, SplitAndBackOff) {
+        const uint64_t MB = 1 << 20;
+        auto split = RocksMemoryBudget::split(1000 * MB, true);
+        ASSERT_EQ(50 * MB, split.writeBatches);
+        ASSERT_EQ(200 * MB, split.terarkZip);
+        ASSERT_EQ(750 * MB, split.blockCache);
+        ASSERT_LT(split.memtables, split.blockCache);
+
+        split = RocksMemoryBudget::split(1000 * MB, false);
+        ASSERT_EQ(0U, split.terarkZip);
+        ASSERT_EQ(950 * MB, split.blockCache);
+
+        ASSERT_FALSE(RocksMemoryBudget::shouldBackOff(10, 100, 10, 100));
+        ASSERT_TRUE(RocksMemoryBudget::shouldBackOff(101, 100, 10, 100));
+        ASSERT_TRUE(RocksMemoryBudget::shouldBackOff(10, 100, 101, 100));
+        // no limits
+        ASSERT_FALSE(RocksMemoryBudget::shouldBackOff(1000, 0, 1000, 0));
+    }
+
+    TEST(RocksMemoryBudgetTest, ExhaustedBudgetLeavesUnitsOfWorkAlone) {
+        unittest::TempDir tempDir("mongo-rocks-memory-budget-test");
+        const int memoryBudgetMB = rocksGlobalOptions.memoryBudgetMB;
+        rocksGlobalOptions.memoryBudgetMB = 1;
+        RocksEngine engine(tempDir.path(), false, 3, false);
+        rocksGlobalOptions.memoryBudgetMB = memoryBudgetMB;
+        RocksMemoryBudget* budget = engine.getMemoryBudget();
+        ASSERT(budget->enabled());
+
+        OperationContextNoop opCtx(engine.newRecoveryUnit());
+        ASSERT_OK(engine.createRecordStore(&opCtx, "test.budget", "collection-budget",
+                                           CollectionOptions()));
+        auto rs = engine.getRecordStore(&opCtx, "test.budget", "collection-budget",
+                                        CollectionOptions());
+        ASSERT_TRUE(budget->waitForAdmission(10));
+
+        {
+            // an uncommitted batch over the write batch share exhausts the budget
+            WriteUnitOfWork bigUow(&opCtx);
+            std::string big(budget->getSplit().writeBatches + 1024, 'x');
+            ASSERT_OK(rs->insertRecord(&opCtx, big.c_str(), big.size(), false).getStatus());
+            ASSERT_OK(rs->insertRecord(&opCtx, "a", 2, false).getStatus());
+            ASSERT_FALSE(budget->waitForAdmission(10));
+
+            // with a real locker, a unit of work that starts now still goes through and leaves
+            // the locker as it found it
+            OperationContextNoop writer(nullptr, 0, new DefaultLockerImpl(),
+                                        engine.newRecoveryUnit());
+            {
+                WriteUnitOfWork uow(&writer);
+                ASSERT_TRUE(writer.lockState()->inAWriteUnitOfWork());
+                ASSERT_OK(rs->insertRecord(&writer, "b", 2, false).getStatus());
+                uow.commit();
+            }
+            ASSERT_FALSE(writer.lockState()->inAWriteUnitOfWork());
+            {
+                WriteUnitOfWork uow(&writer);
+                ASSERT_OK(rs->insertRecord(&writer, "c", 2, false).getStatus());
+            }
+            ASSERT_FALSE(writer.lockState()->inAWriteUnitOfWork());
+        }
+
+        // the rolled back batch gave its memory back
+        ASSERT_TRUE(budget->waitForAdmission(10));
+        ASSERT_EQ(1, rs->numRecords(&opCtx));
+        rs.reset();
+    }
+
+    TEST(RocksRowCacheTest, SnapshotVisibility) {
+        RocksRowCache cache(1 << 20);
+        std::string value;
+        ASSERT_FALSE(cache.lookup("a", 10, &value));
+
+        cache.insert("a", "v1", 10);
+        ASSERT_TRUE(cache.lookup("a", 10, &value));
+        ASSERT_EQ("v1", value);
+        // older snapshots might not see v1
+        ASSERT_FALSE(cache.lookup("a", 9, &value));
+
+        // no reads are cached while a write is in flight
+        cache.beginInvalidate("a");
+        ASSERT_FALSE(cache.lookup("a", 20, &value));
+        cache.insert("a", "v1", 11);
+        cache.endInvalidate("a", 15);
+        ASSERT_FALSE(cache.lookup("a", 20, &value));
+
+        // a read from before the write is stale
+        cache.insert("a", "v1", 12);
+        ASSERT_FALSE(cache.lookup("a", 20, &value));
+        cache.insert("a", "v2", 15);
+        ASSERT_TRUE(cache.lookup("a", 20, &value));
+        ASSERT_EQ("v2", value);
+    }
+
+    TEST(RocksRateLimiterTunerTest, MaxIsEnforced) {
+        std::unique_ptr<rocksdb::RateLimiter> limiter(
+            rocksdb::NewGenericRateLimiter(1024LL * 1024 * 1024));
+        RocksHistogram reads;
+        RocksHistogram commits;
+        // never started, we only change the maximum
+        RocksRateLimiterTuner tuner(nullptr, limiter.get(), 100, 16, 20000, &reads, &commits);
+        auto current = [&tuner] {
+            BSONObjBuilder builder;
+            tuner.appendStats(&builder);
+            return builder.obj()["current-mb-per-sec"].numberInt();
+        };
+        const int64_t MB = 1024 * 1024;
+        ASSERT_EQ(100, current());
+        ASSERT_EQ(100 * MB, limiter->GetBytesPerSecond());
+        tuner.setMaxMBPerSec(40);
+        ASSERT_EQ(40, current());
+        ASSERT_EQ(40 * MB, limiter->GetBytesPerSecond());
+        // below the minimum, the minimum follows
+        tuner.setMaxMBPerSec(10);
+        ASSERT_EQ(10, current());
+        ASSERT_EQ(10 * MB, limiter->GetBytesPerSecond());
+        // raising the maximum doesn't raise the budget beyond the configured minimum, the tuner
+        // does that when needed
+        tuner.setMaxMBPerSec(200);
+        ASSERT_EQ(16, current());
+        ASSERT_EQ(16 * MB, limiter->GetBytesPerSecond());
+        tuner.setMaxMBPerSec(100);
+        ASSERT_EQ(16, current());
+        ASSERT_EQ(16 * MB, limiter->GetBytesPerSecond());
+    }
+
+    TEST(RocksRateLimiterTunerTest, Decide) {
+        typedef RocksRateLimiterTuner::Decision Decision;
+        const uint64_t GB = 1ull << 30;
+        const uint64_t limit = 64 * GB;
+
+        ASSERT(Decision::kHold == RocksRateLimiterTuner::decide(false, 0, 0, limit));
+        ASSERT(Decision::kRaise == RocksRateLimiterTuner::decide(false, 2 * GB, GB, limit));
+        ASSERT(Decision::kHold == RocksRateLimiterTuner::decide(false, GB, 2 * GB, limit));
+        ASSERT(Decision::kLower == RocksRateLimiterTuner::decide(true, 2 * GB, GB, limit));
+        // compaction is far behind, keep raising regardless of the trend
+        ASSERT(Decision::kRaise == RocksRateLimiterTuner::decide(false, 20 * GB, 30 * GB, limit));
+        // never starve compaction that is far behind, even if latency suffers
+        ASSERT(Decision::kHold == RocksRateLimiterTuner::decide(true, 20 * GB, 10 * GB, limit));
+    }
+
+    TEST(RocksTicketControllerTest, NextLimit) {
+        typedef RocksTicketController::Decision Decision;
+        Decision decision;
+        // latency at the baseline, the pool is busy: grow by a fifth of sqrt(limit)
+        ASSERT_EQ(102, RocksTicketController::nextLimit(100, 16, 256, 100, 100, 100, 0, &decision));
+        ASSERT(Decision::kGrow == decision);
+        // latency doubled
+        ASSERT_EQ(92, RocksTicketController::nextLimit(100, 16, 256, 100, 200, 100, 0, &decision));
+        ASSERT(Decision::kShrink == decision);
+        // nobody waits for tickets, or too few samples to tell
+        ASSERT_EQ(100, RocksTicketController::nextLimit(100, 16, 256, 100, 100, 10, 0, &decision));
+        ASSERT(Decision::kHold == decision);
+        ASSERT_EQ(100, RocksTicketController::nextLimit(100, 16, 256, 100, 0, 100, 0, &decision));
+        // getting close to a write slowdown, stop growing, then shed
+        ASSERT_EQ(100,
+                  RocksTicketController::nextLimit(100, 16, 256, 100, 100, 100, 0.6, &decision));
+        ASSERT(Decision::kHold == decision);
+        ASSERT_EQ(75,
+                  RocksTicketController::nextLimit(100, 16, 256, 100, 100, 100, 0.8, &decision));
+        ASSERT(Decision::kShed == decision);
+        ASSERT_EQ(16, RocksTicketController::nextLimit(16, 16, 256, 100, 100, 16, 0.9, &decision));
+        ASSERT(Decision::kHold == decision);
+    }
 }
 }
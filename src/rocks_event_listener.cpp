@@ -0,0 +1,297 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_event_listener.h"
+
+#include <rocksdb/db.h>
+#include <rocksdb/options.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    namespace {
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 8))
+        const char* compactionReasonName(rocksdb::CompactionReason reason) {
+            switch (reason) {
+                case rocksdb::CompactionReason::kLevelL0FilesNum:
+                    return "level0-files";
+                case rocksdb::CompactionReason::kLevelMaxLevelSize:
+                    return "level-size";
+                case rocksdb::CompactionReason::kUniversalSizeAmplification:
+                    return "universal-size-amplification";
+                case rocksdb::CompactionReason::kUniversalSizeRatio:
+                    return "universal-size-ratio";
+                case rocksdb::CompactionReason::kUniversalSortedRunNum:
+                    return "universal-sorted-runs";
+                case rocksdb::CompactionReason::kFIFOMaxSize:
+                    return "fifo-size";
+                case rocksdb::CompactionReason::kManualCompaction:
+                    return "manual";
+                case rocksdb::CompactionReason::kFilesMarkedForCompaction:
+                    return "marked-files";
+                default:
+                    return "other";
+            }
+        }
+#endif
+
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 13))
+        const char* stallConditionName(rocksdb::WriteStallCondition condition) {
+            switch (condition) {
+                case rocksdb::WriteStallCondition::kDelayed:
+                    return "delayed";
+                case rocksdb::WriteStallCondition::kStopped:
+                    return "stopped";
+                default:
+                    return "normal";
+            }
+        }
+#endif
+    }  // namespace
+
+    RocksEventListener::RocksEventListener(size_t historySize) : _historySize(historySize) {}
+
+    void RocksEventListener::setDB(rocksdb::DB* db,
+                                   std::vector<rocksdb::ColumnFamilyHandle*> cfHandles) {
+        {
+            stdx::lock_guard<stdx::mutex> lk(_dbMutex);
+            _db = db;
+            _cfHandles = std::move(cfHandles);
+        }
+        if (db == nullptr) {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _flushStartMicros.clear();
+        }
+    }
+
+    void RocksEventListener::OnFlushBegin(rocksdb::DB* db, const rocksdb::FlushJobInfo& info) {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        _flushStartMicros[info.job_id] = curTimeMicros64();
+    }
+
+    void RocksEventListener::OnFlushCompleted(rocksdb::DB* db,
+                                              const rocksdb::FlushJobInfo& info) {
+        const auto& props = info.table_properties;
+        BSONObjBuilder builder;
+        builder.appendDate("time", Date_t::now());
+        builder.append("type", "flush");
+        builder.append("cf", info.cf_name);
+        builder.append("job-id", info.job_id);
+        builder.append("file", info.file_path);
+        builder.append("entries", static_cast<long long>(props.num_entries));
+        builder.append("deletions", static_cast<long long>(props.num_deletions));
+        builder.append("bytes-written", static_cast<long long>(props.data_size + props.index_size +
+                                                               props.filter_size));
+        builder.append("smallest-seqno", static_cast<long long>(info.smallest_seqno));
+        builder.append("largest-seqno", static_cast<long long>(info.largest_seqno));
+        builder.append("triggered-writes-slowdown", info.triggered_writes_slowdown);
+        builder.append("triggered-writes-stop", info.triggered_writes_stop);
+
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        auto start = _flushStartMicros.find(info.job_id);
+        if (start != _flushStartMicros.end()) {
+            builder.append("micros", static_cast<long long>(curTimeMicros64() - start->second));
+            _flushStartMicros.erase(start);
+        }
+        _addEvent(builder.obj());
+    }
+
+    void RocksEventListener::OnCompactionCompleted(rocksdb::DB* db,
+                                                   const rocksdb::CompactionJobInfo& info) {
+        BSONObjBuilder builder;
+        builder.appendDate("time", Date_t::now());
+        builder.append("type", "compaction");
+        builder.append("cf", info.cf_name);
+        builder.append("job-id", info.job_id);
+        builder.append("input-level", info.base_input_level);
+        builder.append("output-level", info.output_level);
+        builder.append("input-files", static_cast<int>(info.input_files.size()));
+        builder.append("output-files", static_cast<int>(info.output_files.size()));
+        builder.append("micros", static_cast<long long>(info.stats.elapsed_micros));
+        builder.append("bytes-read", static_cast<long long>(info.stats.total_input_bytes));
+        builder.append("bytes-written", static_cast<long long>(info.stats.total_output_bytes));
+        builder.append("input-records", static_cast<long long>(info.stats.num_input_records));
+        builder.append("output-records", static_cast<long long>(info.stats.num_output_records));
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 8))
+        builder.append("reason", compactionReasonName(info.compaction_reason));
+#endif
+        if (!info.status.ok()) {
+            builder.append("status", info.status.ToString());
+        }
+
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        _addEvent(builder.obj());
+    }
+
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 6))
+    void RocksEventListener::OnBackgroundError(rocksdb::BackgroundErrorReason reason,
+                                               rocksdb::Status* status) {
+        if (reason != rocksdb::BackgroundErrorReason::kFlush) {
+            return;
+        }
+        // the error doesn't say which job failed, and the DB stops flushing after it anyway
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        _flushStartMicros.clear();
+    }
+#endif
+
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 13))
+    void RocksEventListener::OnStallConditionsChanged(const rocksdb::WriteStallInfo& info) {
+        const bool stalled = info.condition.cur != rocksdb::WriteStallCondition::kNormal;
+        const bool wasStalled = info.condition.prev != rocksdb::WriteStallCondition::kNormal;
+        // only worth looking up for a new stall, reads DB properties
+        std::string cause = stalled && !wasStalled ? _stallCause(info.cf_name) : "";
+        const long long now = curTimeMicros64();
+
+        BSONObjBuilder builder;
+        builder.appendDate("time", Date_t::now());
+        builder.append("cf", info.cf_name);
+        builder.append("condition", stallConditionName(info.condition.cur));
+
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        auto active = _activeStalls.find(info.cf_name);
+        if (!stalled) {
+            builder.append("type", "stall-end");
+            if (active != _activeStalls.end()) {
+                const long long micros = now - active->second.startMicros;
+                auto& total = _stallTotals[active->second.cause];
+                total.count++;
+                total.micros += micros;
+                builder.append("cause", active->second.cause);
+                builder.append("micros", micros);
+                _activeStalls.erase(active);
+            }
+        } else if (active == _activeStalls.end()) {
+            builder.append("type", "stall-begin");
+            builder.append("cause", cause);
+            Stall& stall = _activeStalls[info.cf_name];
+            stall.startMicros = now;
+            stall.cause = cause;
+            stall.condition = stallConditionName(info.condition.cur);
+        } else {
+            // delayed <-> stopped, same stall
+            builder.append("type", "stall-change");
+            builder.append("cause", active->second.cause);
+            builder.append("micros", now - active->second.startMicros);
+            active->second.condition = stallConditionName(info.condition.cur);
+        }
+        _addEvent(builder.obj());
+    }
+#endif
+
+    void RocksEventListener::appendStats(BSONObjBuilder* builder, bool withHistory) const {
+        const long long now = curTimeMicros64();
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        builder->append("events", _events);
+
+        // active stalls count towards their cause, so that a long stall shows up while it lasts
+        std::map<std::string, StallTotal> totals(_stallTotals);
+        for (const auto& active : _activeStalls) {
+            auto& total = totals[active.second.cause];
+            total.count++;
+            total.micros += now - active.second.startMicros;
+        }
+        {
+            BSONObjBuilder stallsBuilder(builder->subobjStart("stalls"));
+            for (const auto& total : totals) {
+                BSONObjBuilder causeBuilder(stallsBuilder.subobjStart(total.first));
+                causeBuilder.append("count", total.second.count);
+                causeBuilder.append("micros", total.second.micros);
+            }
+        }
+        {
+            BSONArrayBuilder activeBuilder(builder->subarrayStart("active-stalls"));
+            for (const auto& active : _activeStalls) {
+                BSONObjBuilder stallBuilder(activeBuilder.subobjStart());
+                stallBuilder.append("cf", active.first);
+                stallBuilder.append("cause", active.second.cause);
+                stallBuilder.append("condition", active.second.condition);
+                stallBuilder.append("micros", now - active.second.startMicros);
+            }
+        }
+        if (withHistory) {
+            BSONArrayBuilder historyBuilder(builder->subarrayStart("history"));
+            for (const auto& event : _history) {
+                historyBuilder.append(event);
+            }
+        }
+    }
+
+    void RocksEventListener::_addEvent(BSONObj event) {
+        _events++;
+        if (_historySize == 0) {
+            return;
+        }
+        if (_history.size() >= _historySize) {
+            _history.pop_front();
+        }
+        _history.push_back(std::move(event));
+    }
+
+    std::string RocksEventListener::_stallCause(const std::string& cfName) const {
+        stdx::lock_guard<stdx::mutex> lk(_dbMutex);
+        rocksdb::DB* db = _db;
+        if (db == nullptr) {
+            return "unknown";
+        }
+        rocksdb::ColumnFamilyHandle* cfHandle = nullptr;
+        for (auto handle : _cfHandles) {
+            if (handle->GetName() == cfName) {
+                cfHandle = handle;
+            }
+        }
+        if (cfHandle == nullptr) {
+            return "unknown";
+        }
+
+        rocksdb::Options options = db->GetOptions(cfHandle);
+        uint64_t immutableMemtables = 0;
+        if (db->GetIntProperty(cfHandle, "rocksdb.num-immutable-mem-table", &immutableMemtables) &&
+            static_cast<int>(immutableMemtables) + 1 >= options.max_write_buffer_number) {
+            return "memtable-limit";
+        }
+        std::string level0Files;
+        if (db->GetProperty(cfHandle, "rocksdb.num-files-at-level0", &level0Files) &&
+            std::stoi(level0Files) >= options.level0_slowdown_writes_trigger) {
+            return "level0-file-limit";
+        }
+        uint64_t pendingCompactionBytes = 0;
+        if (db->GetIntProperty(cfHandle, "rocksdb.estimate-pending-compaction-bytes",
+                               &pendingCompactionBytes) &&
+            options.soft_pending_compaction_bytes_limit > 0 &&
+            pendingCompactionBytes >= options.soft_pending_compaction_bytes_limit) {
+            return "pending-compaction-bytes";
+        }
+        return "unknown";
+    }
+}
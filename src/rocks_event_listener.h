@@ -0,0 +1,125 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <rocksdb/listener.h>
+#include <rocksdb/version.h>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/bson/bsonobj.h"
+#include "mongo/stdx/mutex.h"
+
+namespace rocksdb {
+    class ColumnFamilyHandle;
+    class DB;
+}
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Keeps the last historySize flushes, compactions and write stall transitions as BSON, so
+     * that latency spikes seen by clients can be matched with what the engine was doing. Stall
+     * time is also summed up per cause. RocksDB doesn't say why writes are stalled, we look at
+     * the column family when the stall begins and pick the first limit it is over: too many
+     * immutable memtables, too many L0 files or too many pending compaction bytes.
+     *
+     * Callbacks run on RocksDB's background threads without the DB mutex held.
+     */
+    class RocksEventListener : public rocksdb::EventListener {
+        MONGO_DISALLOW_COPYING(RocksEventListener);
+
+    public:
+        explicit RocksEventListener(size_t historySize);
+
+        // Called once the DB is open, and with nullptr before it is closed. Stalls that begin
+        // while there's no DB have an unknown cause. Flushes that haven't completed by then are
+        // forgotten
+        void setDB(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*> cfHandles);
+
+        void OnFlushBegin(rocksdb::DB* db, const rocksdb::FlushJobInfo& info) override;
+        void OnFlushCompleted(rocksdb::DB* db, const rocksdb::FlushJobInfo& info) override;
+        void OnCompactionCompleted(rocksdb::DB* db,
+                                   const rocksdb::CompactionJobInfo& info) override;
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 6))
+        // a failed flush never completes, forgets the running flushes
+        void OnBackgroundError(rocksdb::BackgroundErrorReason reason,
+                               rocksdb::Status* status) override;
+#endif
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 13))
+        void OnStallConditionsChanged(const rocksdb::WriteStallInfo& info) override;
+#endif
+
+        // {events, stalls: {<cause>: {count, micros}}, active-stalls}, and history: [...] if
+        // withHistory is set
+        void appendStats(BSONObjBuilder* builder, bool withHistory) const;
+
+    private:
+        struct Stall {
+            long long startMicros = 0;
+            std::string cause;
+            std::string condition;
+        };
+
+        struct StallTotal {
+            long long count = 0;
+            long long micros = 0;
+        };
+
+        // requires _mutex
+        void _addEvent(BSONObj event);
+
+        std::string _stallCause(const std::string& cfName) const;
+
+        const size_t _historySize;
+
+        // held while looking up the cause of a stall
+        mutable stdx::mutex _dbMutex;
+        rocksdb::DB* _db = nullptr;                            // not owned
+        std::vector<rocksdb::ColumnFamilyHandle*> _cfHandles;  // not owned
+
+        mutable stdx::mutex _mutex;
+        // protected by _mutex
+        std::deque<BSONObj> _history;
+        long long _events = 0;
+        // start of running flushes by job id
+        std::map<int, long long> _flushStartMicros;
+        // by column family
+        std::map<std::string, Stall> _activeStalls;
+        // by cause, without the active stalls
+        std::map<std::string, StallTotal> _stallTotals;
+    };
+}
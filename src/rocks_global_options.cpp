@@ -30,6 +30,9 @@
 
 #include "mongo/platform/basic.h"
 
+#include <set>
+#include <sstream>
+
 #include "mongo/base/status.h"
 #include "mongo/util/log.h"
 #include "mongo/util/options_parser/constraints.h"
@@ -47,12 +50,187 @@ namespace mongo {
                                        moe::Int,
                                        "maximum amount of memory to allocate for cache; "
                                        "defaults to 30%% of physical RAM").validRange(1, 10000);
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.memoryBudgetMB", "rocksdbMemoryBudgetMB",
+                               moe::Int,
+                               "single memory budget shared by the block cache, memtables, "
+                               "Terark zip working memory and uncommitted write batches. "
+                               "Overrides cacheSizeGB. 0 (default) keeps the separate limits")
+            .validRange(0, 10000 * 1024)
+            .setDefault(moe::Value(0));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.cacheHighPriPoolRatio",
+                               "rocksdbCacheHighPriPoolRatio", moe::Double,
+                               "fraction of the block cache reserved for index and filter "
+                               "blocks, so that scans can't evict them. Defaults to 0.2")
+            .setDefault(moe::Value(0.2));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.cacheIndexAndFilterBlocks",
+                               "rocksdbCacheIndexAndFilterBlocks", moe::Bool,
+                               "If true, index and filter blocks are kept in the block cache "
+                               "(in its high priority pool) instead of outside of it. This bounds "
+                               "their memory, but a block cache that is too small for them slows "
+                               "down every read. Defaults to false")
+            .setDefault(moe::Value(false));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.pinL0FilterAndIndexBlocks",
+                               "rocksdbPinL0FilterAndIndexBlocks", moe::Bool,
+                               "If true, index and filter blocks of L0 files are pinned in the "
+                               "block cache")
+            .setDefault(moe::Value(true));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.compressedCacheSizeMB",
+                               "rocksdbCompressedCacheSizeMB", moe::Int,
+                               "size of the second tier cache with compressed blocks. Blocks "
+                               "evicted from the block cache are found there without reading "
+                               "the file. 0 (default) disables it")
+            .validRange(0, 10 * 1024 * 1024)
+            .setDefault(moe::Value(0));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.cacheWarmup", "rocksdbCacheWarmup", moe::Bool,
+                               "If true, a sample of the keys read is persisted to "
+                               "<dbpath>/hotkeys and read again on the next startup in the "
+                               "background to warm up the block cache. The file holds raw keys, "
+                               "i.e. _id and indexed values. Defaults to false")
+            .setDefault(moe::Value(false));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.cacheWarmupKeysPerSec",
+                               "rocksdbCacheWarmupKeysPerSec", moe::Int,
+                               "maximum number of keys read per second by the block cache warm-up")
+            .validRange(1, 1000000)
+            .setDefault(moe::Value(5000));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.rowCacheSizeMB", "rocksdbRowCacheSizeMB",
+                               moe::Int,
+                               "size of the document cache used by collections created with "
+                               "storageEngine: {rocksdb: {rowCache: true}}. 0 disables it")
+            .validRange(0, 10 * 1024 * 1024)
+            .setDefault(moe::Value(256));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.backupThreads", "rocksdbBackupThreads", moe::Int,
+                               "number of threads copying files for incremental backups and "
+                               "restores")
+            .validRange(1, 64)
+            .setDefault(moe::Value(4));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.backupMaxMBPerSec", "rocksdbBackupMaxMBPerSec",
+                               moe::Int,
+                               "maximum rate at which incremental backups copy files. 0 means "
+                               "unlimited")
+            .validRange(0, 1024 * 1024)
+            .setDefault(moe::Value(200));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.backupRetentionCount",
+                               "rocksdbBackupRetentionCount", moe::Int,
+                               "number of incremental backups kept in a backup root. Older ones, "
+                               "and the files only they need, are deleted after each backup. 0 "
+                               "keeps all of them")
+            .validRange(0, 10000)
+            .setDefault(moe::Value(7));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.walArchiveTTLSecs", "rocksdbWalArchiveTTLSecs",
+                               moe::Int,
+                               "keep obsolete WAL segments for this long so that incremental "
+                               "backups can archive them for point in time restores. Needs to be "
+                               "longer than the time between two backups or WAL archivals. 0 "
+                               "(default) disables WAL archiving and incremental backups")
+            .validRange(0, 30 * 24 * 3600)
+            .setDefault(moe::Value(0));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.restoreFromBackup", "rocksdbRestoreFromBackup",
+                               moe::String,
+                               "incremental backup root to restore from on startup if the dbpath "
+                               "is empty");
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.restoreToTimeMillis",
+                               "rocksdbRestoreToTimeMillis", moe::Long,
+                               "with restoreFromBackup, stop replaying the archived WAL at this "
+                               "time (milliseconds since the epoch). 0 replays all of it")
+            .setDefault(moe::Value(0LL));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.secondaryOf", "rocksdbSecondaryOf", moe::String,
+                               "open the RocksDB directory of another mongod (e.g. "
+                               "/data/db/db) as a secondary instance that follows it with some "
+                               "lag. Needs --queryableBackupMode. Reads are only eventually "
+                               "consistent, an operation may see several states of the "
+                               "primary. Collections created after startup and fast counts are "
+                               "only refreshed on restart");
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.secondaryCacheSizeMB",
+                               "rocksdbSecondaryCacheSizeMB", moe::Int,
+                               "block cache size of a secondary instance")
+            .validRange(1, 1024 * 1024)
+            .setDefault(moe::Value(256));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.secondaryCatchUpIntervalMs",
+                               "rocksdbSecondaryCatchUpIntervalMs", moe::Int,
+                               "how often a secondary instance catches up with its primary")
+            .validRange(10, 3600 * 1000)
+            .setDefault(moe::Value(1000));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.perfContextSampleEvery",
+                               "rocksdbPerfContextSampleEvery", moe::Int,
+                               "collect RocksDB perf and IO counters for one out of this many "
+                               "operations, reported in currentOp and logged for slow "
+                               "operations. 0 disables it")
+            .validRange(0, 1000 * 1000 * 1000)
+            .setDefault(moe::Value(1000));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.eventHistorySize", "rocksdbEventHistorySize",
+                               moe::Int,
+                               "number of recent flush, compaction and write stall events kept "
+                               "for serverStatus({rocksdb: {eventHistory: 1}}). 0 disables "
+                               "the event history")
+            .validRange(0, 100 * 1000)
+            .setDefault(moe::Value(256));
         rocksOptions.addOptionChaining("storage.rocksdb.compression", "rocksdbCompression",
                                        moe::String,
                                        "block compression algorithm for collection data "
-                                       "[none|snappy|zlib|lz4|lz4hc]")
-            .format("(:?none)|(:?snappy)|(:?zlib)|(:?lz4)|(:?lz4hc)", "(none/snappy/zlib/lz4/lz4hc)")
+                                       "[none|snappy|zlib|lz4|lz4hc|zstd]")
+            .format("(:?none)|(:?snappy)|(:?zlib)|(:?lz4)|(:?lz4hc)|(:?zstd)",
+                    "(none/snappy/zlib/lz4/lz4hc/zstd)")
             .setDefault(moe::Value(std::string("snappy")));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.compressionPerLevel", "rocksdbCompressionPerLevel",
+                               moe::String,
+                               "comma separated compression algorithm of each level, e.g. "
+                               "none,none,lz4,lz4,zstd. The last one is used for all levels "
+                               "below it. Overrides storage.rocksdb.compression");
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.compressionMaxDictBytes",
+                               "rocksdbCompressionMaxDictBytes", moe::Int,
+                               "size of the compression dictionary built for each SST file "
+                               "written by compactions, 0 disables dictionaries. Best with zstd, "
+                               "16384 is a good start")
+            .validRange(0, 1024 * 1024)
+            .setDefault(moe::Value(0));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.zstdMaxTrainBytes", "rocksdbZstdMaxTrainBytes",
+                               moe::Int,
+                               "data sampled from each SST file to train its zstd dictionary. "
+                               "0 means 100 times storage.rocksdb.compressionMaxDictBytes")
+            .validRange(0, 256 * 1024 * 1024)
+            .setDefault(moe::Value(0));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.blobMinSizeKB", "rocksdbBlobMinSizeKB", moe::Int,
+                               "documents of at least this size are stored in blob files, so "
+                               "that compactions only rewrite a small reference to them. 0 keeps "
+                               "everything in SST files. Needs RocksDB 6.18 and "
+                               "storage.rocksdb.terarkdb.enabled: false")
+            .validRange(0, 64 * 1024)
+            .setDefault(moe::Value(0));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.blobFileSizeMB", "rocksdbBlobFileSizeMB",
+                               moe::Int, "size of the blob files")
+            .validRange(1, 4096)
+            .setDefault(moe::Value(256));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.blobGCAgeCutoff", "rocksdbBlobGCAgeCutoff",
+                               moe::Double,
+                               "fraction of the oldest blob files whose live documents "
+                               "compactions move to new blob files, so that the old ones can be "
+                               "deleted. 0 disables blob garbage collection. Defaults to 0.25")
+            .setDefault(moe::Value(0.25));
         rocksOptions
             .addOptionChaining(
                  "storage.rocksdb.maxWriteMBPerSec", "rocksdbMaxWriteMBPerSec", moe::Int,
@@ -61,6 +239,45 @@ namespace mongo {
                  "below a certain point might slow down writes. Defaults to 1GB/sec")
             .validRange(1, 1024)
             .setDefault(moe::Value(1024));
+        rocksOptions
+            .addOptionChaining(
+                 "storage.rocksdb.rateLimiterAutoTune", "rocksdbRateLimiterAutoTune", moe::Bool,
+                 "If true, the write budget of flushes and compactions is tuned automatically "
+                 "between rateLimiterMinMBPerSec and maxWriteMBPerSec. It goes up when "
+                 "compactions fall behind and down when foreground p99 latency is above "
+                 "rateLimiterTargetP99Micros")
+            .setDefault(moe::Value(false));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.rateLimiterMinMBPerSec",
+                               "rocksdbRateLimiterMinMBPerSec", moe::Int,
+                               "Lower bound of the auto-tuned write budget. Defaults to 16MB/sec")
+            .validRange(1, 1024)
+            .setDefault(moe::Value(16));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.rateLimiterTargetP99Micros",
+                               "rocksdbRateLimiterTargetP99Micros", moe::Int,
+                               "p99 latency of point reads and commits above which the "
+                               "auto-tuned write budget is lowered. Defaults to 20ms")
+            .validRange(100, 10 * 1000 * 1000)
+            .setDefault(moe::Value(20000));
+        rocksOptions
+            .addOptionChaining(
+                 "storage.rocksdb.adaptiveTickets", "rocksdbAdaptiveTickets", moe::Bool,
+                 "If true, the number of concurrent read and write transactions is adjusted "
+                 "every second from Get and commit latency, and write transactions are shed "
+                 "before too many L0 files or pending compaction bytes slow writes down. A pool "
+                 "set through rocksdbConcurrentRead/WriteTransactions is no longer adjusted")
+            .setDefault(moe::Value(false));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.adaptiveTicketsMin", "rocksdbAdaptiveTicketsMin",
+                               moe::Int, "Lower bound of the adaptive ticket pools")
+            .validRange(5, 1024 * 1024)
+            .setDefault(moe::Value(16));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.adaptiveTicketsMax", "rocksdbAdaptiveTicketsMax",
+                               moe::Int, "Upper bound of the adaptive ticket pools")
+            .validRange(5, 1024 * 1024)
+            .setDefault(moe::Value(256));
         rocksOptions.addOptionChaining("storage.rocksdb.configString", "rocksdbConfigString",
                                        moe::String,
                                        "RocksDB storage engine custom "
@@ -93,6 +310,22 @@ namespace mongo {
                                "Use separate column-family to store oplogs. "
                                "An optimization.")
             .setDefault(moe::Value(false));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.oplogCompactionStyle",
+                               "rocksdbOplogCompactionStyle", moe::String,
+                               "Compaction style of the separate oplog column-family "
+                               "[fifo|level]. FIFO drops whole files once the oplog is "
+                               "truncated past them instead of rewriting them")
+            .format("(:?fifo)|(:?level)", "(fifo/level)")
+            .setDefault(moe::Value(std::string("fifo")));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.cappedDeleterThreads",
+                               "rocksdbCappedDeleterThreads", moe::Int,
+                               "number of background threads removing the oldest documents of "
+                               "capped collections other than the oplog, which has its own. 0 "
+                               "makes every insert delete on its own")
+            .validRange(0, 64)
+            .setDefault(moe::Value(2));
 
         // rocks add
 
@@ -286,16 +519,191 @@ namespace mongo {
             rocksGlobalOptions.cacheSizeGB = params["storage.rocksdb.cacheSizeGB"].as<int>();
             log() << "Block Cache Size GB: " << rocksGlobalOptions.cacheSizeGB;
         }
+        if (params.count("storage.rocksdb.memoryBudgetMB")) {
+            rocksGlobalOptions.memoryBudgetMB = params["storage.rocksdb.memoryBudgetMB"].as<int>();
+            log() << "Memory Budget MB: " << rocksGlobalOptions.memoryBudgetMB;
+        }
+        if (params.count("storage.rocksdb.cacheHighPriPoolRatio")) {
+            double ratio = params["storage.rocksdb.cacheHighPriPoolRatio"].as<double>();
+            if (ratio < 0.0 || ratio > 1.0) {
+                return Status(ErrorCodes::BadValue,
+                              "storage.rocksdb.cacheHighPriPoolRatio has to be between 0 and 1");
+            }
+            rocksGlobalOptions.cacheHighPriPoolRatio = ratio;
+            log() << "Block Cache High Priority Pool Ratio: "
+                  << rocksGlobalOptions.cacheHighPriPoolRatio;
+        }
+        if (params.count("storage.rocksdb.cacheIndexAndFilterBlocks")) {
+            rocksGlobalOptions.cacheIndexAndFilterBlocks =
+                params["storage.rocksdb.cacheIndexAndFilterBlocks"].as<bool>();
+            log() << "Cache Index And Filter Blocks: "
+                  << rocksGlobalOptions.cacheIndexAndFilterBlocks;
+        }
+        if (params.count("storage.rocksdb.pinL0FilterAndIndexBlocks")) {
+            rocksGlobalOptions.pinL0FilterAndIndexBlocks =
+                params["storage.rocksdb.pinL0FilterAndIndexBlocks"].as<bool>();
+            log() << "Pin L0 Filter And Index Blocks: "
+                  << rocksGlobalOptions.pinL0FilterAndIndexBlocks;
+        }
+        if (params.count("storage.rocksdb.compressedCacheSizeMB")) {
+            rocksGlobalOptions.compressedCacheSizeMB =
+                params["storage.rocksdb.compressedCacheSizeMB"].as<int>();
+            log() << "Compressed Block Cache Size MB: "
+                  << rocksGlobalOptions.compressedCacheSizeMB;
+        }
+        if (params.count("storage.rocksdb.cacheWarmup")) {
+            rocksGlobalOptions.cacheWarmup = params["storage.rocksdb.cacheWarmup"].as<bool>();
+            log() << "Cache Warmup: " << rocksGlobalOptions.cacheWarmup;
+        }
+        if (params.count("storage.rocksdb.cacheWarmupKeysPerSec")) {
+            rocksGlobalOptions.cacheWarmupKeysPerSec =
+                params["storage.rocksdb.cacheWarmupKeysPerSec"].as<int>();
+            log() << "Cache Warmup Keys Per Sec: " << rocksGlobalOptions.cacheWarmupKeysPerSec;
+        }
+        if (params.count("storage.rocksdb.rowCacheSizeMB")) {
+            rocksGlobalOptions.rowCacheSizeMB = params["storage.rocksdb.rowCacheSizeMB"].as<int>();
+            log() << "Row Cache Size MB: " << rocksGlobalOptions.rowCacheSizeMB;
+        }
+        if (params.count("storage.rocksdb.backupThreads")) {
+            rocksGlobalOptions.backupThreads = params["storage.rocksdb.backupThreads"].as<int>();
+            log() << "Backup Threads: " << rocksGlobalOptions.backupThreads;
+        }
+        if (params.count("storage.rocksdb.backupMaxMBPerSec")) {
+            rocksGlobalOptions.backupMaxMBPerSec =
+                params["storage.rocksdb.backupMaxMBPerSec"].as<int>();
+            log() << "Backup Max MB Per Sec: " << rocksGlobalOptions.backupMaxMBPerSec;
+        }
+        if (params.count("storage.rocksdb.backupRetentionCount")) {
+            rocksGlobalOptions.backupRetentionCount =
+                params["storage.rocksdb.backupRetentionCount"].as<int>();
+            log() << "Backup Retention Count: " << rocksGlobalOptions.backupRetentionCount;
+        }
+        if (params.count("storage.rocksdb.walArchiveTTLSecs")) {
+            rocksGlobalOptions.walArchiveTTLSecs =
+                params["storage.rocksdb.walArchiveTTLSecs"].as<int>();
+            log() << "WAL Archive TTL Secs: " << rocksGlobalOptions.walArchiveTTLSecs;
+        }
+        if (params.count("storage.rocksdb.restoreFromBackup")) {
+            rocksGlobalOptions.restoreFromBackup =
+                params["storage.rocksdb.restoreFromBackup"].as<std::string>();
+            log() << "Restore From Backup: " << rocksGlobalOptions.restoreFromBackup;
+        }
+        if (params.count("storage.rocksdb.restoreToTimeMillis")) {
+            rocksGlobalOptions.restoreToTimeMillis =
+                params["storage.rocksdb.restoreToTimeMillis"].as<long long>();
+            log() << "Restore To Time Millis: " << rocksGlobalOptions.restoreToTimeMillis;
+        }
+        if (params.count("storage.rocksdb.secondaryOf")) {
+            rocksGlobalOptions.secondaryOf =
+                params["storage.rocksdb.secondaryOf"].as<std::string>();
+            log() << "Secondary Of: " << rocksGlobalOptions.secondaryOf;
+        }
+        if (params.count("storage.rocksdb.secondaryCacheSizeMB")) {
+            rocksGlobalOptions.secondaryCacheSizeMB =
+                params["storage.rocksdb.secondaryCacheSizeMB"].as<int>();
+            log() << "Secondary Cache Size MB: " << rocksGlobalOptions.secondaryCacheSizeMB;
+        }
+        if (params.count("storage.rocksdb.secondaryCatchUpIntervalMs")) {
+            rocksGlobalOptions.secondaryCatchUpIntervalMs =
+                params["storage.rocksdb.secondaryCatchUpIntervalMs"].as<int>();
+            log() << "Secondary Catch Up Interval Ms: "
+                  << rocksGlobalOptions.secondaryCatchUpIntervalMs;
+        }
+        if (params.count("storage.rocksdb.perfContextSampleEvery")) {
+            rocksGlobalOptions.perfContextSampleEvery =
+                params["storage.rocksdb.perfContextSampleEvery"].as<int>();
+            log() << "Perf Context Sample Every: " << rocksGlobalOptions.perfContextSampleEvery;
+        }
+        if (params.count("storage.rocksdb.eventHistorySize")) {
+            rocksGlobalOptions.eventHistorySize =
+                params["storage.rocksdb.eventHistorySize"].as<int>();
+            log() << "Event History Size: " << rocksGlobalOptions.eventHistorySize;
+        }
         if (params.count("storage.rocksdb.compression")) {
             rocksGlobalOptions.compression =
                 params["storage.rocksdb.compression"].as<std::string>();
             log() << "Compression: " << redact(rocksGlobalOptions.compression);
         }
+        if (params.count("storage.rocksdb.compressionPerLevel")) {
+            const std::set<std::string> names = {"none", "snappy", "zlib", "lz4", "lz4hc", "zstd"};
+            std::string levels = params["storage.rocksdb.compressionPerLevel"].as<std::string>();
+            std::vector<std::string> compressionPerLevel;
+            std::stringstream stream(levels);
+            std::string name;
+            while (std::getline(stream, name, ',')) {
+                if (names.find(name) == names.end()) {
+                    return Status(ErrorCodes::BadValue,
+                                  "storage.rocksdb.compressionPerLevel has to be a comma "
+                                  "separated list of none, snappy, zlib, lz4, lz4hc or zstd");
+                }
+                compressionPerLevel.push_back(name);
+            }
+            rocksGlobalOptions.compressionPerLevel = std::move(compressionPerLevel);
+            log() << "Compression Per Level: " << levels;
+        }
+        if (params.count("storage.rocksdb.compressionMaxDictBytes")) {
+            rocksGlobalOptions.compressionMaxDictBytes =
+                params["storage.rocksdb.compressionMaxDictBytes"].as<int>();
+            log() << "Compression Max Dict Bytes: " << rocksGlobalOptions.compressionMaxDictBytes;
+        }
+        if (params.count("storage.rocksdb.zstdMaxTrainBytes")) {
+            rocksGlobalOptions.zstdMaxTrainBytes =
+                params["storage.rocksdb.zstdMaxTrainBytes"].as<int>();
+            log() << "Zstd Max Train Bytes: " << rocksGlobalOptions.zstdMaxTrainBytes;
+        }
+        if (params.count("storage.rocksdb.blobMinSizeKB")) {
+            rocksGlobalOptions.blobMinSizeKB = params["storage.rocksdb.blobMinSizeKB"].as<int>();
+            log() << "Blob Min Size KB: " << rocksGlobalOptions.blobMinSizeKB;
+        }
+        if (params.count("storage.rocksdb.blobFileSizeMB")) {
+            rocksGlobalOptions.blobFileSizeMB = params["storage.rocksdb.blobFileSizeMB"].as<int>();
+            log() << "Blob File Size MB: " << rocksGlobalOptions.blobFileSizeMB;
+        }
+        if (params.count("storage.rocksdb.blobGCAgeCutoff")) {
+            double cutoff = params["storage.rocksdb.blobGCAgeCutoff"].as<double>();
+            if (cutoff < 0.0 || cutoff > 1.0) {
+                return Status(ErrorCodes::BadValue,
+                              "storage.rocksdb.blobGCAgeCutoff has to be between 0 and 1");
+            }
+            rocksGlobalOptions.blobGCAgeCutoff = cutoff;
+            log() << "Blob GC Age Cutoff: " << rocksGlobalOptions.blobGCAgeCutoff;
+        }
         if (params.count("storage.rocksdb.maxWriteMBPerSec")) {
             rocksGlobalOptions.maxWriteMBPerSec =
                 params["storage.rocksdb.maxWriteMBPerSec"].as<int>();
             log() << "MaxWriteMBPerSec: " << rocksGlobalOptions.maxWriteMBPerSec;
         }
+        if (params.count("storage.rocksdb.rateLimiterAutoTune")) {
+            rocksGlobalOptions.rateLimiterAutoTune =
+                params["storage.rocksdb.rateLimiterAutoTune"].as<bool>();
+            log() << "RateLimiterAutoTune: " << rocksGlobalOptions.rateLimiterAutoTune;
+        }
+        if (params.count("storage.rocksdb.rateLimiterMinMBPerSec")) {
+            rocksGlobalOptions.rateLimiterMinMBPerSec =
+                params["storage.rocksdb.rateLimiterMinMBPerSec"].as<int>();
+            log() << "RateLimiterMinMBPerSec: " << rocksGlobalOptions.rateLimiterMinMBPerSec;
+        }
+        if (params.count("storage.rocksdb.rateLimiterTargetP99Micros")) {
+            rocksGlobalOptions.rateLimiterTargetP99Micros =
+                params["storage.rocksdb.rateLimiterTargetP99Micros"].as<int>();
+            log() << "RateLimiterTargetP99Micros: "
+                  << rocksGlobalOptions.rateLimiterTargetP99Micros;
+        }
+        if (params.count("storage.rocksdb.adaptiveTickets")) {
+            rocksGlobalOptions.adaptiveTickets =
+                params["storage.rocksdb.adaptiveTickets"].as<bool>();
+            log() << "AdaptiveTickets: " << rocksGlobalOptions.adaptiveTickets;
+        }
+        if (params.count("storage.rocksdb.adaptiveTicketsMin")) {
+            rocksGlobalOptions.adaptiveTicketsMin =
+                params["storage.rocksdb.adaptiveTicketsMin"].as<int>();
+            log() << "AdaptiveTicketsMin: " << rocksGlobalOptions.adaptiveTicketsMin;
+        }
+        if (params.count("storage.rocksdb.adaptiveTicketsMax")) {
+            rocksGlobalOptions.adaptiveTicketsMax =
+                params["storage.rocksdb.adaptiveTicketsMax"].as<int>();
+            log() << "AdaptiveTicketsMax: " << rocksGlobalOptions.adaptiveTicketsMax;
+        }
         if (params.count("storage.rocksdb.configString")) {
             rocksGlobalOptions.configString =
                 params["storage.rocksdb.configString"].as<std::string>();
@@ -321,6 +729,16 @@ namespace mongo {
               params["storage.rocksdb.useSeparateOplogCF"].as<bool>();
             log() << "UseSeparateOplogCF: " << rocksGlobalOptions.useSeparateOplogCF;
         }
+        if (params.count("storage.rocksdb.oplogCompactionStyle")) {
+            rocksGlobalOptions.oplogCompactionStyle =
+              params["storage.rocksdb.oplogCompactionStyle"].as<std::string>();
+            log() << "OplogCompactionStyle: " << rocksGlobalOptions.oplogCompactionStyle;
+        }
+        if (params.count("storage.rocksdb.cappedDeleterThreads")) {
+            rocksGlobalOptions.cappedDeleterThreads =
+                params["storage.rocksdb.cappedDeleterThreads"].as<int>();
+            log() << "Capped Deleter Threads: " << rocksGlobalOptions.cappedDeleterThreads;
+        }
         //rocks add
         if (params.count("storage.rocksdb.targetFileSizeMultiplier")) {
             rocksGlobalOptions.targetFileSizeMultiplier =
@@ -429,6 +847,13 @@ namespace mongo {
         } // if (rocksGlobalOptions.terarkEnable)
         //terark end
 
+        if (rocksGlobalOptions.terarkEnable && rocksGlobalOptions.blobMinSizeKB > 0) {
+            // Terark tables compress the values themselves and don't understand blob references
+            return Status(ErrorCodes::BadValue,
+                          "storage.rocksdb.blobMinSizeKB needs "
+                          "storage.rocksdb.terarkdb.enabled: false");
+        }
+
         return Status::OK();
     }
 
@@ -28,6 +28,9 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "mongo/util/options_parser/startup_option_init.h"
 #include "mongo/util/options_parser/startup_options.h"
 
@@ -39,11 +42,41 @@ namespace mongo {
     public:
         RocksGlobalOptions()
             : cacheSizeGB(0),
+              memoryBudgetMB(0),
+              cacheHighPriPoolRatio(0.2),
+              cacheIndexAndFilterBlocks(false),
+              pinL0FilterAndIndexBlocks(true),
+              compressedCacheSizeMB(0),
+              cacheWarmup(false),
+              cacheWarmupKeysPerSec(5000),
+              rowCacheSizeMB(256),
+              backupThreads(4),
+              backupMaxMBPerSec(200),
+              backupRetentionCount(7),
+              walArchiveTTLSecs(0),
+              restoreToTimeMillis(0),
+              secondaryCacheSizeMB(256),
+              secondaryCatchUpIntervalMs(1000),
+              perfContextSampleEvery(1000),
+              eventHistorySize(256),
               maxWriteMBPerSec(1024),
+              rateLimiterAutoTune(false),
+              rateLimiterMinMBPerSec(16),
+              rateLimiterTargetP99Micros(20000),
+              adaptiveTickets(false),
+              adaptiveTicketsMin(16),
+              adaptiveTicketsMax(256),
               compression("snappy"),
+              compressionMaxDictBytes(0),
+              zstdMaxTrainBytes(0),
+              blobMinSizeKB(0),
+              blobFileSizeMB(256),
+              blobGCAgeCutoff(0.25),
               crashSafeCounters(false),
               singleDeleteIndex(false),
               useSeparateOplogCF(false),
+              oplogCompactionStyle("fifo"),
+              cappedDeleterThreads(2),
               //rocks add
               targetFileSizeMultiplier(0),
               numLevels(7),
@@ -73,15 +106,53 @@ namespace mongo {
         Status store(const moe::Environment& params, const std::vector<std::string>& args);
 
         size_t cacheSizeGB;
+        int memoryBudgetMB;
+        double cacheHighPriPoolRatio;
+        bool cacheIndexAndFilterBlocks;
+        bool pinL0FilterAndIndexBlocks;
+        int compressedCacheSizeMB;
+        bool cacheWarmup;
+        int cacheWarmupKeysPerSec;
+        int rowCacheSizeMB;
+        int backupThreads;
+        int backupMaxMBPerSec;
+        int backupRetentionCount;
+        int walArchiveTTLSecs;
+        std::string restoreFromBackup;
+        long long restoreToTimeMillis;
+        std::string secondaryOf;
+        int secondaryCacheSizeMB;
+        int secondaryCatchUpIntervalMs;
+        int perfContextSampleEvery;
+        int eventHistorySize;
         int maxWriteMBPerSec;
+        bool rateLimiterAutoTune;
+        int rateLimiterMinMBPerSec;
+        int rateLimiterTargetP99Micros;
+        bool adaptiveTickets;
+        int adaptiveTicketsMin;
+        int adaptiveTicketsMax;
 
         std::string compression;
+        // codec of each level, the last one is used for the levels below. When empty, levels 0
+        // and 1 are not compressed and the others use compression
+        std::vector<std::string> compressionPerLevel;
+        int compressionMaxDictBytes;
+        int zstdMaxTrainBytes;
+        // values of at least blobMinSizeKB are stored in blob files, 0 disables blob files
+        int blobMinSizeKB;
+        int blobFileSizeMB;
+        double blobGCAgeCutoff;
         std::string configString;
 
         bool crashSafeCounters;
         bool counters;
         bool singleDeleteIndex;
         bool useSeparateOplogCF;
+        std::string oplogCompactionStyle;
+        // background threads deleting from capped collections other than the oplog, 0 makes
+        // inserts delete
+        int cappedDeleterThreads;
 
         int targetFileSizeMultiplier;
         int numLevels;
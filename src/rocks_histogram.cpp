@@ -0,0 +1,160 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_histogram.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "mongo/bson/bsonobjbuilder.h"
+
+namespace mongo {
+
+    RocksHistogram::RocksHistogram() {
+        for (auto& shard : _shards) {
+            for (auto& bucket : shard.buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            shard.sum.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    int RocksHistogram::_currentShard() {
+#ifdef __linux__
+        // cheap (vDSO), and threads that share a core share a shard
+        int cpu = sched_getcpu();
+        if (cpu >= 0) {
+            return cpu % kNumShards;
+        }
+#endif
+        static thread_local int shard =
+            std::hash<std::thread::id>()(std::this_thread::get_id()) % kNumShards;
+        return shard;
+    }
+
+    int RocksHistogram::bucketFor(uint64_t value) {
+        if (value < static_cast<uint64_t>(kSubBuckets)) {
+            return static_cast<int>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        if (msb >= kMaxBits) {
+            return kNumBuckets - 1;
+        }
+        int shift = msb - kSubBucketBits;
+        // value >> shift is in [kSubBuckets, 2 * kSubBuckets)
+        return ((shift + 1) << kSubBucketBits) + static_cast<int>(value >> shift) - kSubBuckets;
+    }
+
+    uint64_t RocksHistogram::bucketUpperBound(int bucket) {
+        if (bucket < kSubBuckets) {
+            return bucket;
+        }
+        int shift = (bucket >> kSubBucketBits) - 1;
+        uint64_t subBucket = (bucket & (kSubBuckets - 1)) + kSubBuckets;
+        return ((subBucket + 1) << shift) - 1;
+    }
+
+    RocksHistogram::Snapshot RocksHistogram::snapshot() const {
+        Snapshot snapshot;
+        for (const auto& shard : _shards) {
+            for (int i = 0; i < kNumBuckets; ++i) {
+                uint64_t count = shard.buckets[i].load(std::memory_order_relaxed);
+                snapshot._counts[i] += count;
+                snapshot._count += count;
+            }
+            snapshot._sum += shard.sum.load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+
+    uint64_t RocksHistogram::Snapshot::percentile(double percentile) const {
+        if (_count == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(percentile * _count + 0.5));
+        uint64_t seen = 0;
+        for (int i = 0; i < kNumBuckets; ++i) {
+            seen += _counts[i];
+            if (seen >= rank) {
+                return bucketUpperBound(i);
+            }
+        }
+        return bucketUpperBound(kNumBuckets - 1);
+    }
+
+    RocksHistogram::Snapshot RocksHistogram::Snapshot::since(const Snapshot& older) const {
+        Snapshot delta;
+        for (int i = 0; i < kNumBuckets; ++i) {
+            // readers race with writers, never go below zero
+            delta._counts[i] = _counts[i] > older._counts[i] ? _counts[i] - older._counts[i] : 0;
+            delta._count += delta._counts[i];
+        }
+        delta._sum = _sum > older._sum ? _sum - older._sum : 0;
+        return delta;
+    }
+
+    void RocksHistogram::Snapshot::appendTo(BSONObjBuilder* builder) const {
+        builder->append("count", static_cast<long long>(_count));
+        builder->append("mean", mean());
+        builder->append("p50", static_cast<long long>(percentile(0.5)));
+        builder->append("p90", static_cast<long long>(percentile(0.9)));
+        builder->append("p99", static_cast<long long>(percentile(0.99)));
+        builder->append("p999", static_cast<long long>(percentile(0.999)));
+        builder->append("max", static_cast<long long>(percentile(1.0)));
+    }
+
+    namespace {
+        const char* const kHotPathNames[] = {
+            "commit", "get", "seek", "sync-wal", "capped-delete",
+        };
+        static_assert(sizeof(kHotPathNames) / sizeof(kHotPathNames[0]) ==
+                          static_cast<size_t>(RocksHotPath::kNumHotPaths),
+                      "every hot path needs a name");
+
+        RocksHistogram hotPathHistograms[static_cast<int>(RocksHotPath::kNumHotPaths)];
+    }
+
+    RocksHistogram* rocksHotPathHistogram(RocksHotPath path) {
+        return &hotPathHistograms[static_cast<int>(path)];
+    }
+
+    void appendHotPathLatencies(BSONObjBuilder* builder) {
+        for (int i = 0; i < static_cast<int>(RocksHotPath::kNumHotPaths); ++i) {
+            BSONObjBuilder pathBuilder(builder->subobjStart(kHotPathNames[i]));
+            hotPathHistograms[i].snapshot().appendTo(&pathBuilder);
+        }
+    }
+}
@@ -0,0 +1,140 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Log-linear histogram (HDR style) of non-negative values, usually latencies in micros.
+     * Every power of two is split into kSubBuckets linear buckets, so percentiles are within
+     * 12.5% of the real value. Recording is one relaxed atomic increment into the shard of the
+     * current CPU, so threads on different cores don't bounce cache lines. Readers merge the
+     * shards, which is only approximately consistent with concurrent writers.
+     */
+    class RocksHistogram {
+        MONGO_DISALLOW_COPYING(RocksHistogram);
+
+    public:
+        static const int kSubBucketBits = 3;
+        static const int kSubBuckets = 1 << kSubBucketBits;
+        // values of 2^kMaxBits and above (12 days in micros) share the last bucket
+        static const int kMaxBits = 40;
+        static const int kNumBuckets = (kMaxBits - kSubBucketBits + 1) * kSubBuckets;
+        static const int kNumShards = 16;
+
+        class Snapshot {
+        public:
+            Snapshot() : _counts(kNumBuckets, 0) {}
+
+            uint64_t count() const { return _count; }
+            uint64_t sum() const { return _sum; }
+            double mean() const { return _count ? static_cast<double>(_sum) / _count : 0; }
+
+            // Upper bound of the bucket containing the requested percentile (0.0 - 1.0), 0 if
+            // the snapshot is empty
+            uint64_t percentile(double percentile) const;
+
+            // what was recorded between older and this snapshot
+            Snapshot since(const Snapshot& older) const;
+
+            void appendTo(BSONObjBuilder* builder) const;
+
+        private:
+            friend class RocksHistogram;
+
+            std::vector<uint64_t> _counts;
+            uint64_t _count = 0;
+            uint64_t _sum = 0;
+        };
+
+        RocksHistogram();
+
+        void record(uint64_t value) {
+            Shard& shard = _shards[_currentShard()];
+            shard.buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+            shard.sum.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        Snapshot snapshot() const;
+
+        static int bucketFor(uint64_t value);
+        // largest value that goes into bucket
+        static uint64_t bucketUpperBound(int bucket);
+
+    private:
+        struct alignas(64) Shard {
+            std::atomic<uint64_t> buckets[kNumBuckets];  // NOLINT
+            std::atomic<uint64_t> sum;                   // NOLINT
+        };
+
+        static int _currentShard();
+
+        Shard _shards[kNumShards];
+    };
+
+    // Records the micros between its construction and destruction
+    class RocksHistogramTimer {
+        MONGO_DISALLOW_COPYING(RocksHistogramTimer);
+
+    public:
+        explicit RocksHistogramTimer(RocksHistogram* histogram) : _histogram(histogram) {}
+        ~RocksHistogramTimer() { _histogram->record(_timer.micros()); }
+
+    private:
+        RocksHistogram* _histogram;  // not owned
+        Timer _timer;
+    };
+
+    /**
+     * Latencies of the engine's hot paths, in micros, reported in serverStatus.
+     */
+    enum class RocksHotPath {
+        kCommit,          // RocksRecoveryUnit::_commit
+        kGet,             // RocksRecoveryUnit::Get, cache misses of the row cache included
+        kSeek,            // iterator seeks
+        kSyncWal,         // RocksDurabilityManager::waitUntilDurable
+        kCappedDelete,    // one pass of RocksRecordStore::cappedDeleteAsNeeded_inlock
+        kNumHotPaths
+    };
+
+    RocksHistogram* rocksHotPathHistogram(RocksHotPath path);
+
+    // one sub-object per hot path with count, mean and percentiles
+    void appendHotPathLatencies(BSONObjBuilder* builder);
+}
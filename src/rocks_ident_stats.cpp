@@ -0,0 +1,97 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_ident_stats.h"
+
+#include <rocksdb/perf_context.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+
+namespace mongo {
+
+    void RocksIdentStats::add(const Delta& delta) {
+        if (delta.reads) {
+            _reads.fetch_add(delta.reads, std::memory_order_relaxed);
+        }
+        if (delta.seeks) {
+            _seeks.fetch_add(delta.seeks, std::memory_order_relaxed);
+        }
+        if (delta.bytesRead) {
+            _bytesRead.fetch_add(delta.bytesRead, std::memory_order_relaxed);
+        }
+        if (delta.writes) {
+            _writes.fetch_add(delta.writes, std::memory_order_relaxed);
+        }
+        if (delta.bytesWritten) {
+            _bytesWritten.fetch_add(delta.bytesWritten, std::memory_order_relaxed);
+        }
+        if (delta.cacheMisses) {
+            _cacheMisses.fetch_add(delta.cacheMisses, std::memory_order_relaxed);
+        }
+        if (delta.skippedDeletions) {
+            _skippedDeletions.fetch_add(delta.skippedDeletions, std::memory_order_relaxed);
+        }
+    }
+
+    void RocksIdentStats::appendTo(BSONObjBuilder* builder) const {
+        builder->append("reads", _reads.load(std::memory_order_relaxed));
+        builder->append("seeks", _seeks.load(std::memory_order_relaxed));
+        builder->append("bytes-read", _bytesRead.load(std::memory_order_relaxed));
+        builder->append("writes", _writes.load(std::memory_order_relaxed));
+        builder->append("bytes-written", _bytesWritten.load(std::memory_order_relaxed));
+        builder->append("cache-misses", _cacheMisses.load(std::memory_order_relaxed));
+        builder->append("skipped-deletions", _skippedDeletions.load(std::memory_order_relaxed));
+    }
+
+    RocksIdentStatsScope::RocksIdentStatsScope(RocksIdentStats::Delta* delta) : _delta(delta) {
+        if (_delta == nullptr) {
+            return;
+        }
+        _previousLevel = rocksdb::GetPerfLevel();
+        if (_previousLevel == rocksdb::PerfLevel::kDisable) {
+            rocksdb::SetPerfLevel(rocksdb::kEnableCount);
+        }
+        _blockReadsInitial = rocksdb::perf_context.block_read_count;
+        _skippedDeletionsInitial = rocksdb::perf_context.internal_delete_skipped_count;
+    }
+
+    RocksIdentStatsScope::~RocksIdentStatsScope() {
+        if (_delta == nullptr) {
+            return;
+        }
+        _delta->cacheMisses += rocksdb::perf_context.block_read_count - _blockReadsInitial;
+        _delta->skippedDeletions +=
+            rocksdb::perf_context.internal_delete_skipped_count - _skippedDeletionsInitial;
+        if (_previousLevel == rocksdb::PerfLevel::kDisable) {
+            rocksdb::SetPerfLevel(rocksdb::PerfLevel::kDisable);
+        }
+    }
+}
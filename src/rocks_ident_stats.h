@@ -0,0 +1,101 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include <rocksdb/perf_level.h>
+
+#include "mongo/base/disallow_copying.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * I/O and operation counters of one ident (collection or index). All idents share one
+     * column family and are told apart only by their key prefix, so RocksDB statistics can't
+     * break them down. The counters are relaxed atomics, reported by collStats/indexStats and
+     * reset when the ident is reopened. Callers sum up a Delta on their own (an iterator, a point
+     * lookup, the writes of a unit of work) and add it once, so the hot paths don't all write to
+     * the same cache lines.
+     */
+    class RocksIdentStats {
+        MONGO_DISALLOW_COPYING(RocksIdentStats);
+
+    public:
+        struct Delta {
+            // point lookups that returned bytes
+            long long reads = 0;
+            long long seeks = 0;
+            long long bytesRead = 0;
+            // Puts or Deletes that were committed, bytes are key plus value size
+            long long writes = 0;
+            long long bytesWritten = 0;
+            long long cacheMisses = 0;
+            long long skippedDeletions = 0;
+        };
+
+        RocksIdentStats() = default;
+
+        void add(const Delta& delta);
+
+        void appendTo(BSONObjBuilder* builder) const;
+
+    private:
+        std::atomic<long long> _reads{0};
+        std::atomic<long long> _seeks{0};
+        std::atomic<long long> _bytesRead{0};
+        std::atomic<long long> _writes{0};
+        std::atomic<long long> _bytesWritten{0};
+        std::atomic<long long> _cacheMisses{0};
+        std::atomic<long long> _skippedDeletions{0};
+    };
+
+    /**
+     * Adds the block cache misses and skipped deletions of the RocksDB calls made during its
+     * lifetime to a delta. Enables perf_context counting for the thread while it lives, if it was
+     * disabled. Does nothing if delta is nullptr.
+     */
+    class RocksIdentStatsScope {
+        MONGO_DISALLOW_COPYING(RocksIdentStatsScope);
+
+    public:
+        explicit RocksIdentStatsScope(RocksIdentStats::Delta* delta);
+        ~RocksIdentStatsScope();
+
+    private:
+        RocksIdentStats::Delta* _delta;  // not owned, can be nullptr
+        rocksdb::PerfLevel _previousLevel = rocksdb::PerfLevel::kDisable;
+        long long _blockReadsInitial = 0;
+        long long _skippedDeletionsInitial = 0;
+    };
+}
@@ -50,9 +50,13 @@
 #include "mongo/util/log.h"
 #include "mongo/util/mongoutils/str.h"
 
+#include "rocks_bulk_loader.h"
 #include "rocks_engine.h"
+#include "rocks_ident_stats.h"
 #include "rocks_record_store.h"
 #include "rocks_recovery_unit.h"
+#include "rocks_table_properties.h"
+#include "rocks_ttl.h"
 #include "rocks_util.h"
 
 namespace mongo {
@@ -105,15 +109,19 @@ namespace mongo {
         class RocksCursorBase : public SortedDataInterface::Cursor {
         public:
             RocksCursorBase(OperationContext* txn, rocksdb::DB* db, std::string prefix,
-                            bool forward, Ordering order, KeyString::Version keyStringVersion)
+                            bool forward, Ordering order, KeyString::Version keyStringVersion,
+                            bool ttl, std::shared_ptr<RocksIdentStats> identStats)
                 : _db(db),
                   _prefix(prefix),
+                  _identStats(std::move(identStats)),
                   _forward(forward),
                   _order(order),
                   _keyStringVersion(keyStringVersion),
                   _key(keyStringVersion),
                   _typeBits(keyStringVersion),
                   _query(keyStringVersion),
+                  _firstVisible(ttl ? RocksTTL::firstVisibleRecordId(RocksTTL::nowSecs())
+                                    : RecordId()),
                   _txn(txn) {
                 _currentSequenceNumber = RocksRecoveryUnit::getRocksRecoveryUnit(txn)->snapshot()
                     ->GetSequenceNumber();
@@ -128,6 +136,7 @@ namespace mongo {
                     advanceCursor();
                 }
                 updatePosition();
+                skipExpired();
                 return curr(parts);
             }
 
@@ -159,6 +168,7 @@ namespace mongo {
 
                 seekCursor(_query);
                 updatePosition();
+                skipExpired();
                 return curr(parts);
             }
 
@@ -173,6 +183,7 @@ namespace mongo {
                 _query.resetToKey(key, _order, discriminator);
                 seekCursor(_query);
                 updatePosition();
+                skipExpired();
                 return curr(parts);
             }
 
@@ -190,7 +201,7 @@ namespace mongo {
                 auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(_txn);
                 if (!_iterator.get() ||
                     _currentSequenceNumber != ru->snapshot()->GetSequenceNumber()) {
-                    _iterator.reset(ru->NewIterator(_prefix));
+                    _iterator.reset(ru->NewIterator(_prefix, false, _identStats.get()));
                     _currentSequenceNumber = ru->snapshot()->GetSequenceNumber();
 
                     if (!_savedEOF) {
@@ -232,7 +243,7 @@ namespace mongo {
                 }
                 if (_iterator.get() == nullptr) {
                     _iterator.reset(RocksRecoveryUnit::getRocksRecoveryUnit(_txn)
-                            ->NewIterator(_prefix));
+                            ->NewIterator(_prefix, false, _identStats.get()));
                     _iterator->SeekPrefix(rocksdb::Slice(_key.getBuffer(), _key.getSize()));
                     // advanceCursor() should only ever be called in states where the above seek
                     // will succeed in finding the exact key
@@ -303,11 +314,20 @@ namespace mongo {
                 updateLocAndTypeBits();
             }
 
+            // Moves past entries that point to expired records (engine-native TTL). Compaction
+            // removes them eventually, until then we just pretend they are not there.
+            void skipExpired() {
+                while (!_eof && _loc < _firstVisible) {
+                    advanceCursor();
+                    updatePosition();
+                }
+            }
+
             // ensure that _iterator is initialized and return a pointer to it
             RocksIterator * iterator() {
                 if (_iterator.get() == nullptr) {
                     _iterator.reset(RocksRecoveryUnit::getRocksRecoveryUnit(_txn)
-                            ->NewIterator(_prefix));
+                            ->NewIterator(_prefix, false, _identStats.get()));
                 }
                 return _iterator.get();
             }
@@ -333,6 +353,7 @@ namespace mongo {
 
             rocksdb::DB* _db;                                       // not owned
             std::string _prefix;
+            std::shared_ptr<RocksIdentStats> _identStats;
             std::unique_ptr<RocksIterator> _iterator;
             const bool _forward;
             bool _lastMoveWasRestore = false;
@@ -350,6 +371,9 @@ namespace mongo {
 
             KeyString _query;
 
+            // entries pointing to records below this are expired. Null if TTL is not enabled
+            const RecordId _firstVisible;
+
             std::unique_ptr<KeyString> _endPosition;
 
             bool _eof = false;
@@ -362,8 +386,10 @@ namespace mongo {
         class RocksStandardCursor final : public RocksCursorBase {
         public:
             RocksStandardCursor(OperationContext* txn, rocksdb::DB* db, std::string prefix,
-                                bool forward, Ordering order, KeyString::Version keyStringVersion)
-                : RocksCursorBase(txn, db, prefix, forward, order, keyStringVersion) {
+                                bool forward, Ordering order, KeyString::Version keyStringVersion,
+                                bool ttl, std::shared_ptr<RocksIdentStats> identStats)
+                : RocksCursorBase(txn, db, prefix, forward, order, keyStringVersion, ttl,
+                                  std::move(identStats)) {
                 iterator();
             }
 
@@ -377,8 +403,10 @@ namespace mongo {
         class RocksUniqueCursor final : public RocksCursorBase {
         public:
             RocksUniqueCursor(OperationContext* txn, rocksdb::DB* db, std::string prefix,
-                              bool forward, Ordering order, KeyString::Version keyStringVersion)
-                : RocksCursorBase(txn, db, prefix, forward, order, keyStringVersion) {}
+                              bool forward, Ordering order, KeyString::Version keyStringVersion,
+                              bool ttl, std::shared_ptr<RocksIdentStats> identStats)
+                : RocksCursorBase(txn, db, prefix, forward, order, keyStringVersion, ttl,
+                                  std::move(identStats)) {}
 
             boost::optional<IndexKeyEntry> seekExact(const BSONObj& key,
                                                      RequestedInfo parts) override {
@@ -389,7 +417,7 @@ namespace mongo {
                 _query.resetToKey(stripFieldNames(key), _order);
                 prefixedKey.append(_query.getBuffer(), _query.getSize());
                 rocksdb::Status status = RocksRecoveryUnit::getRocksRecoveryUnit(_txn)
-                    ->Get(prefixedKey, &_value);
+                    ->Get(prefixedKey, &_value, _identStats.get());
 
                 if (status.IsNotFound()) {
                     _eof = true;
@@ -397,6 +425,10 @@ namespace mongo {
                     invariantRocksOK(status);
                 }
                 updatePosition();
+                if (!_eof && _loc < _firstVisible) {
+                    // points to an expired record
+                    _eof = true;
+                }
                 return curr(parts);
             }
 
@@ -420,15 +452,41 @@ namespace mongo {
     } // namespace
 
     /**
-     * Bulk builds a non-unique index.
+     * Bulk builds a non-unique index. While the collection bulk loads, keys are added to the
+     * index's loader, otherwise they are inserted into the unit of work.
      */
     class RocksIndexBase::StandardBulkBuilder : public SortedDataBuilderInterface {
     public:
-        StandardBulkBuilder(RocksStandardIndex* index, OperationContext* txn) : _index(index),
-                                                                                _txn(txn) {}
+        StandardBulkBuilder(RocksStandardIndex* index, OperationContext* txn,
+                            std::shared_ptr<RocksBulkLoader> loader)
+            : _index(index), _txn(txn), _loader(std::move(loader)) {}
 
         Status addKey(const BSONObj& key, const RecordId& loc) {
-            return _index->insert(_txn, key, loc, true);
+            if (!_loader) {
+                return _index->insert(_txn, key, loc, true);
+            }
+            Status s = checkKeySize(key);
+            if (!s.isOK()) {
+                return s;
+            }
+
+            KeyString encodedKey(_index->_keyStringVersion, key, _index->_order, loc);
+            std::string prefixedKey(_makePrefixedKey(_index->_prefix, encodedKey));
+            const KeyString::TypeBits& typeBits = encodedKey.getTypeBits();
+            rocksdb::Slice value;
+            if (!typeBits.isAllZeros()) {
+                value = rocksdb::Slice(reinterpret_cast<const char*>(typeBits.getBuffer()),
+                                       typeBits.getSize());
+            }
+            s = _loader->add(prefixedKey, value);
+            if (!s.isOK()) {
+                return s;
+            }
+            _index->_indexStorageSize.fetch_add(static_cast<long long>(prefixedKey.size()),
+                                                std::memory_order_relaxed);
+            RocksRecoveryUnit::getRocksRecoveryUnit(_txn)->recordIdentWrite(
+                _index->_identStats, prefixedKey.size() + value.size());
+            return Status::OK();
         }
 
         void commit(bool mayInterrupt) {
@@ -439,6 +497,8 @@ namespace mongo {
     private:
         RocksStandardIndex* _index;
         OperationContext* _txn;
+        // nullptr unless bulk loading
+        std::shared_ptr<RocksBulkLoader> _loader;
     };
 
     /**
@@ -447,19 +507,22 @@ namespace mongo {
      * In order to support unique indexes in dupsAllowed mode this class only does an actual insert
      * after it sees a key after the one we are trying to insert. This allows us to gather up all
      * duplicate locs and insert them all together. This is necessary since bulk cursors can only
-     * append data.
+     * append data. While the collection bulk loads, keys are added to the index's loader.
      */
     class RocksIndexBase::UniqueBulkBuilder : public SortedDataBuilderInterface {
     public:
         UniqueBulkBuilder(std::string prefix, Ordering ordering,
                           KeyString::Version keyStringVersion, OperationContext* txn,
-                          bool dupsAllowed)
+                          bool dupsAllowed, std::shared_ptr<RocksIdentStats> identStats,
+                          std::shared_ptr<RocksBulkLoader> loader)
             : _prefix(std::move(prefix)),
               _ordering(ordering),
               _keyStringVersion(keyStringVersion),
               _txn(txn),
               _dupsAllowed(dupsAllowed),
-              _keyString(keyStringVersion) {}
+              _keyString(keyStringVersion),
+              _identStats(std::move(identStats)),
+              _loader(std::move(loader)) {}
 
         Status addKey(const BSONObj& newKey, const RecordId& loc) {
             Status s = checkKeySize(newKey);
@@ -472,7 +535,10 @@ namespace mongo {
                 if (!_key.isEmpty()) { // _key.isEmpty() is only true on the first call to addKey().
                     invariant(cmp > 0); // newKey must be > the last key
                     // We are done with dups of the last key so we can insert it now.
-                    doInsert();
+                    s = doInsert();
+                    if (!s.isOK()) {
+                        return s;
+                    }
                 }
                 invariant(_records.empty());
             }
@@ -498,13 +564,13 @@ namespace mongo {
             WriteUnitOfWork uow(_txn);
             if (!_records.empty()) {
                 // This handles inserting the last unique key.
-                doInsert();
+                uassertStatusOK(doInsert());
             }
             uow.commit();
         }
 
     private:
-        void doInsert() {
+        Status doInsert() {
             invariant(!_records.empty());
 
             KeyString value(_keyStringVersion);
@@ -521,9 +587,18 @@ namespace mongo {
             rocksdb::Slice valueSlice(value.getBuffer(), value.getSize());
 
             auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(_txn);
-            ru->writeBatch()->Put(prefixedKey, valueSlice);
+            if (_loader) {
+                Status s = _loader->add(prefixedKey, valueSlice);
+                if (!s.isOK()) {
+                    return s;
+                }
+            } else {
+                ru->writeBatch()->Put(prefixedKey, valueSlice);
+            }
+            ru->recordIdentWrite(_identStats, prefixedKey.size() + valueSlice.size());
 
             _records.clear();
+            return Status::OK();
         }
 
         std::string _prefix;
@@ -534,6 +609,9 @@ namespace mongo {
         BSONObj _key;
         KeyString _keyString;
         std::vector<std::pair<RecordId, KeyString::TypeBits>> _records;
+        std::shared_ptr<RocksIdentStats> _identStats;
+        // nullptr unless bulk loading
+        std::shared_ptr<RocksBulkLoader> _loader;
     };
 
     /// RocksIndexBase
@@ -543,13 +621,13 @@ namespace mongo {
         : _db(db),
           _prefix(prefix),
           _ident(std::move(ident)),
-          _order(order)
+          _identStats(std::make_shared<RocksIdentStats>()),
+          _order(order),
+          _ttl(config.getField("ttl").trueValue())
     {
-        uint64_t storageSize;
-        std::string nextPrefix = rocksGetNextPrefix(_prefix);
-        rocksdb::Range wholeRange(_prefix, nextPrefix);
-        _db->GetApproximateSizes(&wholeRange, 1, &storageSize);
-        _indexStorageSize.store(static_cast<long long>(storageSize), std::memory_order_relaxed);
+        // the size on disk is only read by getSpaceUsedBytes(), so that opening an index stays
+        // cheap
+        _indexStorageSize.store(0, std::memory_order_relaxed);
 
         int indexFormatVersion = 0; // default
         if (config.hasField("index_format_version")) {
@@ -582,9 +660,16 @@ namespace mongo {
         }
     }
 
+    bool RocksIndexBase::appendCustomStats(OperationContext* txn, BSONObjBuilder* output,
+                                           double scale) const {
+        BSONObjBuilder ioStats(output->subobjStart("ioStats"));
+        _identStats->appendTo(&ioStats);
+        return true;
+    }
+
     bool RocksIndexBase::isEmpty(OperationContext* txn) {
         auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(txn);
-        std::unique_ptr<rocksdb::Iterator> it(ru->NewIterator(_prefix));
+        std::unique_ptr<rocksdb::Iterator> it(ru->NewIterator(_prefix, false, _identStats.get()));
 
         it->SeekToFirst();
         return !it->Valid();
@@ -596,10 +681,25 @@ namespace mongo {
     }
 
     long long RocksIndexBase::getSpaceUsedBytes(OperationContext* txn) const {
+        // GetApproximateSizes() only sees SST files, the prefix stats also count blob files
+        RocksPrefixStats stats;
+        if (_prefixStats && _prefixStats->get(_prefix, &stats)) {
+            return std::max(stats.onDiskBytes(), static_cast<long long>(1));
+        }
+        if (_indexStorageSizeAtOpen.load(std::memory_order_relaxed) < 0) {
+            uint64_t storageSize;
+            std::string nextPrefix = rocksGetNextPrefix(_prefix);
+            rocksdb::Range wholeRange(_prefix, nextPrefix);
+            _db->GetApproximateSizes(&wholeRange, 1, &storageSize);
+            // racing callers compute the same value
+            _indexStorageSizeAtOpen.store(static_cast<long long>(storageSize),
+                                          std::memory_order_relaxed);
+        }
+        long long size = _indexStorageSizeAtOpen.load(std::memory_order_relaxed) +
+            _indexStorageSize.load(std::memory_order_relaxed);
         // There might be some bytes in the WAL that we don't count here. Some
         // tests depend on the fact that non-empty indexes have non-zero sizes
-        return static_cast<long long>(
-            std::max(_indexStorageSize.load(std::memory_order_relaxed), static_cast<long long>(1)));
+        return std::max(size, static_cast<long long>(1));
     }
 
     void RocksIndexBase::generateConfig(BSONObjBuilder* configBuilder, int formatVersion,
@@ -612,6 +712,33 @@ namespace mongo {
         }
     }
 
+    void RocksIndexBase::beginBulkLoad(const std::string& dir) {
+        stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+        if (!_bulkLoader) {
+            _bulkLoader = std::make_shared<RocksBulkLoader>(_db, nullptr, dir, _ident);
+        }
+    }
+
+    std::shared_ptr<RocksBulkLoader> RocksIndexBase::stopBulkLoad() {
+        stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+        return std::move(_bulkLoader);
+    }
+
+    std::shared_ptr<RocksBulkLoader> RocksIndexBase::_getBulkLoader() const {
+        stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+        return _bulkLoader;
+    }
+
+    void RocksIndexBase::_put(RocksRecoveryUnit* ru, std::string key,
+                              const rocksdb::Slice& value) {
+        auto loader = _getBulkLoader();
+        if (loader) {
+            RocksBulkLoader::addOnCommit(ru, std::move(loader), std::move(key), value.ToString());
+        } else {
+            ru->writeBatch()->Put(key, value);
+        }
+    }
+
     std::string RocksIndexBase::_makePrefixedKey(const std::string& prefix,
                                                  const KeyString& encodedKey) {
         std::string key(prefix);
@@ -644,7 +771,7 @@ namespace mongo {
                                     std::memory_order_relaxed);
 
         std::string currentValue;
-        auto getStatus = ru->Get(prefixedKey, &currentValue);
+        auto getStatus = ru->Get(prefixedKey, &currentValue, _identStats.get());
         if (!getStatus.ok() && !getStatus.IsNotFound()) {
             return rocksToMongoStatus(getStatus);
         } else if (getStatus.IsNotFound()) {
@@ -654,7 +781,8 @@ namespace mongo {
                 value.appendTypeBits(encodedKey.getTypeBits());
             }
             rocksdb::Slice valueSlice(value.getBuffer(), value.getSize());
-            ru->writeBatch()->Put(prefixedKey, valueSlice);
+            ru->recordIdentWrite(_identStats, prefixedKey.size() + valueSlice.size());
+            _put(ru, std::move(prefixedKey), valueSlice);
             return Status::OK();
         }
 
@@ -694,7 +822,8 @@ namespace mongo {
         }
 
         rocksdb::Slice valueVectorSlice(valueVector.getBuffer(), valueVector.getSize());
-        ru->writeBatch()->Put(prefixedKey, valueVectorSlice);
+        ru->recordIdentWrite(_identStats, prefixedKey.size() + valueVectorSlice.size());
+        _put(ru, std::move(prefixedKey), valueVectorSlice);
         return Status::OK();
     }
 
@@ -727,12 +856,13 @@ namespace mongo {
 
         if (!dupsAllowed) {
             ru->writeBatch()->Delete(prefixedKey);
+            ru->recordIdentWrite(_identStats, prefixedKey.size());
             return;
         }
 
         // dups are allowed, so we have to deal with a vector of RecordIds.
         std::string currentValue;
-        auto getStatus = ru->Get(prefixedKey, &currentValue);
+        auto getStatus = ru->Get(prefixedKey, &currentValue, _identStats.get());
         if (getStatus.IsNotFound()) {
             // nothing here. just return
             return;
@@ -752,6 +882,7 @@ namespace mongo {
                     // This is the common case: we are removing the only loc for this key.
                     // Remove the whole entry.
                     ru->writeBatch()->Delete(prefixedKey);
+                    ru->recordIdentWrite(_identStats, prefixedKey.size());
                     return;
                 }
 
@@ -781,12 +912,13 @@ namespace mongo {
 
         rocksdb::Slice newValueSlice(newValue.getBuffer(), newValue.getSize());
         ru->writeBatch()->Put(prefixedKey, newValueSlice);
+        ru->recordIdentWrite(_identStats, prefixedKey.size() + newValueSlice.size());
     }
 
     std::unique_ptr<SortedDataInterface::Cursor> RocksUniqueIndex::newCursor(OperationContext* txn,
                                                                              bool forward) const {
         return stdx::make_unique<RocksUniqueCursor>(txn, _db, _prefix, forward, _order,
-                                                    _keyStringVersion);
+                                                    _keyStringVersion, _ttl, _identStats);
     }
 
     Status RocksUniqueIndex::dupKeyCheck(OperationContext* txn, const BSONObj& key,
@@ -796,7 +928,7 @@ namespace mongo {
 
         auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(txn);
         std::string value;
-        auto getStatus = ru->Get(prefixedKey, &value);
+        auto getStatus = ru->Get(prefixedKey, &value, _identStats.get());
         if (!getStatus.ok() && !getStatus.IsNotFound()) {
             return rocksToMongoStatus(getStatus);
         } else if (getStatus.IsNotFound()) {
@@ -821,7 +953,8 @@ namespace mongo {
     SortedDataBuilderInterface* RocksUniqueIndex::getBulkBuilder(OperationContext* txn,
                                                                  bool dupsAllowed) {
         return new RocksIndexBase::UniqueBulkBuilder(_prefix, _order, _keyStringVersion, txn,
-                                                     dupsAllowed);
+                                                     dupsAllowed, _identStats,
+                                                     _getBulkLoader());
     }
 
     /// RocksStandardIndex
@@ -855,7 +988,8 @@ namespace mongo {
         _indexStorageSize.fetch_add(static_cast<long long>(prefixedKey.size()),
                                     std::memory_order_relaxed);
 
-        ru->writeBatch()->Put(prefixedKey, value);
+        ru->recordIdentWrite(_identStats, prefixedKey.size() + value.size());
+        _put(ru, std::move(prefixedKey), value);
 
         return Status::OK();
     }
@@ -891,19 +1025,20 @@ namespace mongo {
         } else {
             ru->writeBatch()->Delete(prefixedKey);
         }
+        ru->recordIdentWrite(_identStats, prefixedKey.size());
     }
 
     std::unique_ptr<SortedDataInterface::Cursor> RocksStandardIndex::newCursor(
             OperationContext* txn,
             bool forward) const {
         return stdx::make_unique<RocksStandardCursor>(txn, _db, _prefix, forward, _order,
-                                                      _keyStringVersion);
+                                                      _keyStringVersion, _ttl, _identStats);
     }
 
     SortedDataBuilderInterface* RocksStandardIndex::getBulkBuilder(OperationContext* txn,
                                                                    bool dupsAllowed) {
         invariant(dupsAllowed);
-        return new RocksIndexBase::StandardBulkBuilder(this, txn);
+        return new RocksIndexBase::StandardBulkBuilder(this, txn, _getBulkLoader());
     }
 
 }  // namespace mongo
@@ -30,6 +30,7 @@
 
 #include <atomic>
 #include <boost/shared_ptr.hpp>
+#include <memory>
 #include <string>
 
 #include <rocksdb/db.h>
@@ -37,6 +38,7 @@
 #include "mongo/bson/ordering.h"
 #include "mongo/db/index/index_descriptor.h"
 #include "mongo/db/storage/key_string.h"
+#include "mongo/stdx/mutex.h"
 
 #pragma once
 
@@ -46,7 +48,10 @@ namespace rocksdb {
 
 namespace mongo {
 
+    class RocksBulkLoader;
+    class RocksIdentStats;
     class RocksRecoveryUnit;
+    class RocksPrefixStatsCache;
 
     class RocksIndexBase : public SortedDataInterface {
         MONGO_DISALLOW_COPYING(RocksIndexBase);
@@ -62,10 +67,7 @@ namespace mongo {
                                   ValidateResults* fullResults) const;
 
         virtual bool appendCustomStats(OperationContext* txn, BSONObjBuilder* output,
-                                       double scale) const {
-            // nothing to say here, really
-            return false;
-        }
+                                       double scale) const;
 
         virtual bool isEmpty(OperationContext* txn);
 
@@ -73,10 +75,33 @@ namespace mongo {
 
         virtual long long getSpaceUsedBytes( OperationContext* txn ) const;
 
+        // getSpaceUsedBytes() comes from SST properties when set
+        void setPrefixStats(RocksPrefixStatsCache* prefixStats) { _prefixStats = prefixStats; }
+
         static void generateConfig(BSONObjBuilder* configBuilder, int formatVersion,
                                    IndexDescriptor::IndexVersion descVersion);
 
+        // namespace of the collection, set before the index is used
+        void setNamespace(std::string ns) { _ns = std::move(ns); }
+        const std::string& ns() const { return _ns; }
+
+        /**
+         * Bulk load of the index's collection, see RocksEngine::beginBulkLoad(). Until
+         * stopBulkLoad(), inserted keys are added to a RocksBulkLoader with files in dir when
+         * their unit of work commits, and bulk builders add their keys to it right away (a build
+         * that fails drops the index with its loader). Removed keys still go into the write
+         * batch, only keys from before the load are visible to be removed.
+         */
+        void beginBulkLoad(const std::string& dir);  // no-op if already loading
+        // nullptr if the collection isn't bulk loading
+        std::shared_ptr<RocksBulkLoader> stopBulkLoad();
+
     protected:
+        std::shared_ptr<RocksBulkLoader> _getBulkLoader() const;
+
+        // Put of an index entry, into the bulk loader while there is one
+        void _put(RocksRecoveryUnit* ru, std::string key, const rocksdb::Slice& value);
+
         static std::string _makePrefixedKey(const std::string& prefix, const KeyString& encodedKey);
 
         rocksdb::DB* _db; // not owned
@@ -85,13 +110,30 @@ namespace mongo {
         std::string _prefix;
         std::string _ident;
 
-        // very approximate index storage size
+        // very approximate index storage size, used until the index is flushed to SST files.
+        // _indexStorageSizeAtOpen is the size of the SST files, read on first use (-1 until
+        // then). _indexStorageSize is the size of keys written since open
+        mutable std::atomic<long long> _indexStorageSizeAtOpen{-1};
         std::atomic<long long> _indexStorageSize;
+        RocksPrefixStatsCache* _prefixStats = nullptr;  // not owned
+
+        // reads and writes of this index, shared with its cursors
+        std::shared_ptr<RocksIdentStats> _identStats;
 
         // used to construct RocksCursors
         const Ordering _order;
         KeyString::Version _keyStringVersion;
 
+        // true if the index belongs to a collection with engine-native TTL. Entries pointing to
+        // expired records are hidden from cursors
+        bool _ttl;
+
+        std::string _ns;
+
+        // set between beginBulkLoad() and stopBulkLoad(), protected by _bulkLoadMutex
+        mutable stdx::mutex _bulkLoadMutex;
+        std::shared_ptr<RocksBulkLoader> _bulkLoader;
+
         class StandardBulkBuilder;
         class UniqueBulkBuilder;
         friend class UniqueBulkBuilder;
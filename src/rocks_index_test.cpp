@@ -83,7 +83,8 @@ namespace {
         std::unique_ptr<RecoveryUnit> newRecoveryUnit() {
             return stdx::make_unique<RocksRecoveryUnit>(&_transactionEngine, &_snapshotManager,
                                                         _db.get(), _counterManager.get(),
-                                                        nullptr, _durabilityManager.get(), true);
+                                                        nullptr, _durabilityManager.get(), true,
+                                                        nullptr);
         }
 
     private:
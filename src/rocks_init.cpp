@@ -34,11 +34,15 @@
 #include "mongo/db/storage/storage_options.h"
 #include "mongo/db/storage/kv/kv_storage_engine.h"
 #include "mongo/db/storage/storage_engine_metadata.h"
+#include "mongo/util/assert_util.h"
 #include "mongo/util/mongoutils/str.h"
 
 #include "rocks_engine.h"
+#include "rocks_global_options.h"
 #include "rocks_server_status.h"
 #include "rocks_parameters.h"
+#include "rocks_row_cache.h"
+#include "rocks_ttl.h"
 
 namespace mongo {
     const std::string kRocksDBEngineName = "rocksdb";
@@ -53,6 +57,10 @@ namespace mongo {
                 KVStorageEngineOptions options;
                 options.directoryPerDB = params.directoryperdb;
                 options.forRepair = params.repair;
+                // a secondary instance can't write, mongod has to treat it as read-only
+                uassert(ErrorCodes::InvalidOptions,
+                        "storage.rocksdb.secondaryOf requires --queryableBackupMode",
+                        rocksGlobalOptions.secondaryOf.empty() || params.readOnly);
                 // Mongo keeps some files in params.dbpath. To avoid collision, put out files under
                 // db/ directory
                 if (formatVersion == -1) {
@@ -68,6 +76,12 @@ namespace mongo {
                 auto leaked4 __attribute__((unused)) = new RocksCompactServerParameter(engine);
                 auto leaked5 __attribute__((unused)) = new RocksCacheSizeParameter(engine);
                 auto leaked6 __attribute__((unused)) = new RocksOptionsParameter(engine);
+                auto leaked7 __attribute__((unused)) =
+                    new RocksCompressedCacheSizeParameter(engine);
+                auto leaked8 __attribute__((unused)) =
+                    new RocksIncrementalBackupServerParameter(engine);
+                auto leaked9 __attribute__((unused)) = new RocksPerfContextSampleEveryParameter();
+                auto leaked10 __attribute__((unused)) = new RocksBulkLoadServerParameter(engine);
 
                 return new KVStorageEngine(engine, options);
             }
@@ -120,6 +134,14 @@ namespace mongo {
                 return true;
             }
 
+            virtual Status validateCollectionStorageOptions(const BSONObj& options) const {
+                Status status = RocksTTL::validateCollectionStorageOptions(options);
+                if (!status.isOK()) {
+                    return status;
+                }
+                return RocksRowCache::validateCollectionStorageOptions(options);
+            }
+
         private:
             // Current disk format. We bump this number when we change the disk format. MongoDB will
             // fail to start if the versions don't match. In that case a user needs to run mongodump
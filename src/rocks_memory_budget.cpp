@@ -0,0 +1,129 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_memory_budget.h"
+
+#include <algorithm>
+
+#include <rocksdb/cache.h>
+#include <rocksdb/write_buffer_manager.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/util/log.h"
+#include "mongo/util/time_support.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+    RocksMemoryBudget::Split RocksMemoryBudget::split(uint64_t budgetBytes, bool terark) {
+        Split split;
+        // 5% for uncommitted write batches, 20% for Terark's zip working memory, the rest is the
+        // block cache. A quarter of the block cache may be used by memtables
+        split.writeBatches = budgetBytes / 20;
+        split.terarkZip = terark ? budgetBytes / 5 : 0;
+        split.blockCache = budgetBytes - split.writeBatches - split.terarkZip;
+        split.memtables = split.blockCache / 4;
+        return split;
+    }
+
+    bool RocksMemoryBudget::shouldBackOff(long long writeBatchBytes, uint64_t writeBatchLimit,
+                                          size_t memtableUsage, size_t memtableLimit) {
+        if (writeBatchLimit > 0 && writeBatchBytes > static_cast<long long>(writeBatchLimit)) {
+            return true;
+        }
+        // the WriteBufferManager schedules a flush at 7/8 of its limit. Being over the limit
+        // means flushes can't keep up
+        return memtableLimit > 0 && memtableUsage > memtableLimit;
+    }
+
+    RocksMemoryBudget::RocksMemoryBudget(
+        uint64_t budgetBytes, const Split& split, std::shared_ptr<rocksdb::Cache> blockCache,
+        std::shared_ptr<rocksdb::WriteBufferManager> writeBufferManager)
+        : _budgetBytes(budgetBytes),
+          _split(split),
+          _blockCache(std::move(blockCache)),
+          _writeBufferManager(std::move(writeBufferManager)) {}
+
+    bool RocksMemoryBudget::_shouldBackOff() const {
+        return shouldBackOff(_writeBatchBytes.load(std::memory_order_relaxed),
+                             _split.writeBatches,
+                             _writeBufferManager ? _writeBufferManager->memory_usage() : 0,
+                             _writeBufferManager ? _split.memtables : 0);
+    }
+
+    bool RocksMemoryBudget::waitForAdmission(int maxDelayMillis) {
+        if (!enabled() || !_shouldBackOff()) {
+            return true;
+        }
+        Timer timer;
+        int sleepMillis = 1;
+        bool admitted;
+        do {
+            sleepmillis(std::min(sleepMillis, std::max(1, maxDelayMillis - timer.millis())));
+            sleepMillis = std::min(sleepMillis * 2, 64);
+            admitted = !_shouldBackOff();
+        } while (!admitted && timer.millis() < maxDelayMillis);
+        _admissionDelays.fetch_add(1, std::memory_order_relaxed);
+        _admissionDelayMillis.fetch_add(timer.millis(), std::memory_order_relaxed);
+        if (!admitted) {
+            _admissionTimeouts.fetch_add(1, std::memory_order_relaxed);
+        }
+        LOG(2) << "Operation delayed " << timer.millis() << "ms by the memory budget";
+        return admitted;
+    }
+
+    void RocksMemoryBudget::appendStats(BSONObjBuilder* builder, uint64_t memtableUsage) const {
+        long long memtables = static_cast<long long>(
+            _writeBufferManager ? _writeBufferManager->memory_usage() : memtableUsage);
+        long long cacheUsage = static_cast<long long>(_blockCache->GetUsage());
+        if (_writeBufferManager) {
+            // memtables are charged to the block cache, don't count them twice
+            cacheUsage = std::max(0LL, cacheUsage - memtables);
+        }
+        builder->append("budget", static_cast<long long>(_budgetBytes));
+        builder->append("block-cache-capacity",
+                        static_cast<long long>(_blockCache->GetCapacity()));
+        builder->append("block-cache", cacheUsage);
+        builder->append("memtables", memtables);
+        builder->append("memtables-charged-to-block-cache",
+                        static_cast<bool>(_writeBufferManager));
+        builder->append("write-batches", _writeBatchBytes.load(std::memory_order_relaxed));
+        builder->append("write-batches-limit", static_cast<long long>(_split.writeBatches));
+        builder->append("terark-zip-limit", static_cast<long long>(_split.terarkZip));
+        builder->append("admission-delays", _admissionDelays.load(std::memory_order_relaxed));
+        builder->append("admission-delay-millis",
+                        _admissionDelayMillis.load(std::memory_order_relaxed));
+        builder->append("admission-timeouts",
+                        _admissionTimeouts.load(std::memory_order_relaxed));
+    }
+}
@@ -0,0 +1,113 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "mongo/base/disallow_copying.h"
+
+namespace rocksdb {
+    class Cache;
+    class WriteBufferManager;
+}
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Single memory budget for the block cache, memtables, Terark zip working memory and the
+     * write batches of live recovery units. With a budget set, memtables are charged to the
+     * block cache through a WriteBufferManager, so together they never grow over the block
+     * cache capacity. Terark zip memory and write batches get their own share carved out of the
+     * budget before the block cache is sized.
+     *
+     * Write batches can't be bounded up front, so they are accounted as they grow, and new
+     * operations of user connections back off (for a bounded time) while the batches or
+     * memtables are over their share. They wait when their recovery unit is created, before they
+     * take any lock or ticket, and are never refused. Without a budget (0) nothing is admission
+     * controlled but memory is still accounted for serverStatus.
+     */
+    class RocksMemoryBudget {
+        MONGO_DISALLOW_COPYING(RocksMemoryBudget);
+
+    public:
+        struct Split {
+            uint64_t blockCache = 0;  // includes memtables
+            uint64_t memtables = 0;
+            uint64_t writeBatches = 0;
+            uint64_t terarkZip = 0;
+        };
+
+        // How budgetBytes is shared between the components. terarkZip is 0 unless terark is set
+        static Split split(uint64_t budgetBytes, bool terark);
+
+        // true if a new unit of work should wait for memory to be released
+        static bool shouldBackOff(long long writeBatchBytes, uint64_t writeBatchLimit,
+                                  size_t memtableUsage, size_t memtableLimit);
+
+        RocksMemoryBudget(uint64_t budgetBytes, const Split& split,
+                          std::shared_ptr<rocksdb::Cache> blockCache,
+                          std::shared_ptr<rocksdb::WriteBufferManager> writeBufferManager);
+
+        bool enabled() const { return _budgetBytes > 0; }
+        const Split& getSplit() const { return _split; }
+
+        // called by recovery units when their write batch grows or is cleared
+        void chargeWriteBatch(long long delta) {
+            _writeBatchBytes.fetch_add(delta, std::memory_order_relaxed);
+        }
+
+        // Sleeps with exponential backoff, up to maxDelayMillis, while the budget is exhausted.
+        // Returns false if the budget was still exhausted when it gave up
+        bool waitForAdmission(int maxDelayMillis = kMaxAdmissionDelayMillis);
+
+        static const int kMaxAdmissionDelayMillis = 1000;
+
+        // memtableUsage is only used if there is no WriteBufferManager to ask
+        void appendStats(BSONObjBuilder* builder, uint64_t memtableUsage) const;
+
+    private:
+        bool _shouldBackOff() const;
+
+        const uint64_t _budgetBytes;
+        const Split _split;
+        std::shared_ptr<rocksdb::Cache> _blockCache;
+        // nullptr without a budget or on RocksDB versions that can't charge the block cache
+        std::shared_ptr<rocksdb::WriteBufferManager> _writeBufferManager;
+
+        std::atomic<long long> _writeBatchBytes{0};
+        std::atomic<long long> _admissionDelays{0};
+        std::atomic<long long> _admissionDelayMillis{0};
+        std::atomic<long long> _admissionTimeouts{0};
+    };
+}
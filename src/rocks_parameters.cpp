@@ -30,6 +30,8 @@
 #include "mongo/platform/basic.h"
 
 #include "rocks_parameters.h"
+#include "rocks_backup.h"
+#include "rocks_perf_profile.h"
 #include "rocks_util.h"
 
 #include "mongo/logger/parse_log_component_settings.h"
@@ -101,6 +103,43 @@ namespace mongo {
         return _engine->backup(str);
     }
 
+    RocksIncrementalBackupServerParameter::RocksIncrementalBackupServerParameter(
+        RocksEngine* engine)
+        : ServerParameter(ServerParameterSet::getGlobal(), "rocksdbIncrementalBackup", false,
+                          true),
+          _engine(engine) {}
+
+    void RocksIncrementalBackupServerParameter::append(OperationContext* txn, BSONObjBuilder& b,
+                                                       const std::string& name) {
+        BSONObjBuilder progress(b.subobjStart(name));
+        _engine->getIncrementalBackup()->appendProgress(&progress);
+    }
+
+    Status RocksIncrementalBackupServerParameter::set(const BSONElement& newValueElement) {
+        if (newValueElement.type() == Object) {
+            BSONObj obj = newValueElement.Obj();
+            auto path = obj["path"].str();
+            if (path.size() == 0) {
+                return Status(ErrorCodes::BadValue,
+                              str::stream() << name() << ".path has to be a string");
+            }
+            if (obj["walOnly"].trueValue()) {
+                return _engine->getIncrementalBackup()->archiveWal(path);
+            }
+            return setFromString(path);
+        }
+        auto str = newValueElement.str();
+        if (str.size() == 0) {
+            return Status(ErrorCodes::BadValue,
+                          str::stream() << name() << " has to be a string or an object");
+        }
+        return setFromString(str);
+    }
+
+    Status RocksIncrementalBackupServerParameter::setFromString(const std::string& str) {
+        return _engine->getIncrementalBackup()->backup(str);
+    }
+
     RocksCompactServerParameter::RocksCompactServerParameter(RocksEngine* engine)
         : ServerParameter(ServerParameterSet::getGlobal(), "rocksdbCompact", false, true),
           _engine(engine) {}
@@ -119,6 +158,36 @@ namespace mongo {
         return rocksToMongoStatus(s);
     }
 
+    RocksBulkLoadServerParameter::RocksBulkLoadServerParameter(RocksEngine* engine)
+        : ServerParameter(ServerParameterSet::getGlobal(), "rocksdbBulkLoad", false, true),
+          _engine(engine) {}
+
+    void RocksBulkLoadServerParameter::append(OperationContext* txn, BSONObjBuilder& b,
+                                              const std::string& name) {
+        b.append(name, _engine->getBulkLoadNamespaces());
+    }
+
+    Status RocksBulkLoadServerParameter::set(const BSONElement& newValueElement) {
+        if (newValueElement.type() != Object) {
+            return Status(ErrorCodes::BadValue, str::stream() << name() << " has to be an object");
+        }
+        BSONObj obj = newValueElement.Obj();
+        if (obj["ns"].type() != String) {
+            return Status(ErrorCodes::BadValue,
+                          str::stream() << name() << ".ns has to be a string");
+        }
+        if (obj["enabled"].trueValue()) {
+            return _engine->beginBulkLoad(obj["ns"].valueStringData());
+        }
+        return _engine->endBulkLoad(obj["ns"].valueStringData());
+    }
+
+    Status RocksBulkLoadServerParameter::setFromString(const std::string& str) {
+        // only makes sense for a collection that's open
+        return Status(ErrorCodes::BadValue,
+                      str::stream() << name() << " can't be set on the command line");
+    }
+
     RocksCacheSizeParameter::RocksCacheSizeParameter(RocksEngine* engine)
         : ServerParameter(ServerParameterSet::getGlobal(), "rocksdbRuntimeConfigCacheSizeGB", false,
                           true),
@@ -156,6 +225,49 @@ namespace mongo {
 
         return Status::OK();
     }    
+
+    RocksCompressedCacheSizeParameter::RocksCompressedCacheSizeParameter(RocksEngine* engine)
+        : ServerParameter(ServerParameterSet::getGlobal(),
+                          "rocksdbRuntimeConfigCompressedCacheSizeMB", false, true),
+          _engine(engine) {}
+
+    void RocksCompressedCacheSizeParameter::append(OperationContext* txn, BSONObjBuilder& b,
+                                                   const std::string& name) {
+        const long long bytesInMB = 1024 * 1024LL;
+        auto cache = _engine->getCompressedBlockCache();
+        b.append(name, cache ? static_cast<long long>(cache->GetCapacity() / bytesInMB) : 0LL);
+    }
+
+    Status RocksCompressedCacheSizeParameter::set(const BSONElement& newValueElement) {
+        if (!newValueElement.isNumber()) {
+            return Status(ErrorCodes::BadValue, str::stream() << name() << " has to be a number");
+        }
+        return _set(newValueElement.numberInt());
+    }
+
+    Status RocksCompressedCacheSizeParameter::setFromString(const std::string& str) {
+        int num = 0;
+        Status status = parseNumberFromString(str, &num);
+        if (!status.isOK()) return status;
+        return _set(num);
+    }
+
+    Status RocksCompressedCacheSizeParameter::_set(int newNum) {
+        if (newNum <= 0) {
+            return Status(ErrorCodes::BadValue, str::stream() << name() << " has to be > 0");
+        }
+        auto cache = _engine->getCompressedBlockCache();
+        if (!cache) {
+            return Status(ErrorCodes::IllegalOperation,
+                          str::stream() << name() << " requires the compressed block cache to be "
+                                                     "enabled with rocksdbCompressedCacheSizeMB");
+        }
+        log() << "RocksDB: changing compressed block cache size to " << newNum << "MB";
+        const long long bytesInMB = 1024 * 1024LL;
+        cache->SetCapacity(static_cast<size_t>(newNum * bytesInMB));
+
+        return Status::OK();
+    }
     
     RocksOptionsParameter::RocksOptionsParameter(RocksEngine* engine)
         : ServerParameter(ServerParameterSet::getGlobal(), "rocksdbOptions", false,
@@ -215,4 +327,36 @@ namespace mongo {
         return Status(ErrorCodes::BadValue, "This action is supported for RocksDB 4.13 and up");
 #endif
     }
+
+    RocksPerfContextSampleEveryParameter::RocksPerfContextSampleEveryParameter()
+        : ServerParameter(ServerParameterSet::getGlobal(),
+                          "rocksdbRuntimeConfigPerfContextSampleEvery", false, true) {}
+
+    void RocksPerfContextSampleEveryParameter::append(OperationContext* txn, BSONObjBuilder& b,
+                                                      const std::string& name) {
+        b.append(name, RocksPerfProfile::getSampleEvery());
+    }
+
+    Status RocksPerfContextSampleEveryParameter::set(const BSONElement& newValueElement) {
+        if (!newValueElement.isNumber()) {
+            return Status(ErrorCodes::BadValue, str::stream() << name() << " has to be a number");
+        }
+        return _set(newValueElement.numberInt());
+    }
+
+    Status RocksPerfContextSampleEveryParameter::setFromString(const std::string& str) {
+        int num = 0;
+        Status status = parseNumberFromString(str, &num);
+        if (!status.isOK()) return status;
+        return _set(num);
+    }
+
+    Status RocksPerfContextSampleEveryParameter::_set(int newNum) {
+        if (newNum < 0) {
+            return Status(ErrorCodes::BadValue, str::stream() << name() << " has to be >= 0");
+        }
+        log() << "RocksDB: collecting perf context for one out of " << newNum << " operations";
+        RocksPerfProfile::setSampleEvery(newNum);
+        return Status::OK();
+    }
 }
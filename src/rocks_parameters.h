@@ -67,6 +67,26 @@ namespace mongo {
         RocksEngine* _engine;
     };
 
+    // Incremental backup into a backup root that is reused between backups, see
+    // RocksIncrementalBackup. Only files that are not in the root yet are copied:
+    // db.adminCommand({setParameter:1, rocksdbIncrementalBackup: "/var/lib/mongodb/backup"})
+    // To only archive the WAL segments written since the last call:
+    // db.adminCommand({setParameter:1, rocksdbIncrementalBackup: {path: "/var/lib/mongodb/backup",
+    //                                                              walOnly: true}})
+    // getParameter reports the progress of the running (or last) backup.
+    class RocksIncrementalBackupServerParameter : public ServerParameter {
+        MONGO_DISALLOW_COPYING(RocksIncrementalBackupServerParameter);
+
+    public:
+        RocksIncrementalBackupServerParameter(RocksEngine* engine);
+        virtual void append(OperationContext* txn, BSONObjBuilder& b, const std::string& name);
+        virtual Status set(const BSONElement& newValueElement);
+        virtual Status setFromString(const std::string& str);
+
+    private:
+        RocksEngine* _engine;
+    };
+
     // We use mongo's setParameter() API to issue a compact request to rocksdb.
     // To compact entire RocksDB instance, call:
     // db.adminCommand({setParameter:1, rocksdbCompact: 1})
@@ -83,6 +103,25 @@ namespace mongo {
         RocksEngine* _engine;
     };
 
+    // Bulk load mode of a collection, see RocksEngine::beginBulkLoad(). To load a new collection
+    // from initial sync or mongorestore without going through the WAL and the memtable:
+    // db.adminCommand({setParameter:1, rocksdbBulkLoad: {ns: "test.coll", enabled: true}})
+    // and to ingest what was loaded:
+    // db.adminCommand({setParameter:1, rocksdbBulkLoad: {ns: "test.coll", enabled: false}})
+    // getParameter lists the namespaces that are bulk loading.
+    class RocksBulkLoadServerParameter : public ServerParameter {
+        MONGO_DISALLOW_COPYING(RocksBulkLoadServerParameter);
+
+    public:
+        RocksBulkLoadServerParameter(RocksEngine* engine);
+        virtual void append(OperationContext* txn, BSONObjBuilder& b, const std::string& name);
+        virtual Status set(const BSONElement& newValueElement);
+        virtual Status setFromString(const std::string& str);
+
+    private:
+        RocksEngine* _engine;
+    };
+
     // We use mongo's setParameter() API to dynamically change the size of the block cache
     // To compact entire RocksDB instance, call:
     // db.adminCommand({setParameter:1, rocksdbRuntimeConfigCacheSizeGB: 10})
@@ -99,8 +138,40 @@ namespace mongo {
         Status _set(int newNum);
         RocksEngine* _engine;
     };
+
+    // Same as RocksCacheSizeParameter, for the compressed block cache. Only available if the
+    // compressed block cache was enabled on startup with storage.rocksdb.compressedCacheSizeMB
+    // db.adminCommand({setParameter:1, rocksdbRuntimeConfigCompressedCacheSizeMB: 4096})
+    class RocksCompressedCacheSizeParameter : public ServerParameter {
+        MONGO_DISALLOW_COPYING(RocksCompressedCacheSizeParameter);
+
+    public:
+        RocksCompressedCacheSizeParameter(RocksEngine* engine);
+        virtual void append(OperationContext* txn, BSONObjBuilder& b, const std::string& name);
+        virtual Status set(const BSONElement& newValueElement);
+        virtual Status setFromString(const std::string& str);
+
+    private:
+        Status _set(int newNum);
+        RocksEngine* _engine;
+    };
     
     
+    // To change how many operations collect a RocksDB profile (0 turns it off), run
+    // db.adminCommand({setParameter:1, rocksdbRuntimeConfigPerfContextSampleEvery: 100})
+    class RocksPerfContextSampleEveryParameter : public ServerParameter {
+        MONGO_DISALLOW_COPYING(RocksPerfContextSampleEveryParameter);
+
+    public:
+        RocksPerfContextSampleEveryParameter();
+        virtual void append(OperationContext* txn, BSONObjBuilder& b, const std::string& name);
+        virtual Status set(const BSONElement& newValueElement);
+        virtual Status setFromString(const std::string& str);
+
+    private:
+        Status _set(int newNum);
+    };
+
     // We use mongo's setParameter() API to dynamically change the RocksDB options using the SetOptions API
     // To dynamically change an option, call:
     // db.adminCommand({setParameter:1, "rocksdbOptions": "someoption=1; someoption2=3"})
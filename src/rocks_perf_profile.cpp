@@ -0,0 +1,156 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_perf_profile.h"
+
+#include <rocksdb/iostats_context.h>
+#include <rocksdb/perf_context.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    std::atomic<int> RocksPerfProfile::_sampleEvery(0);
+    std::atomic<unsigned> RocksPerfProfile::_sinceLastSample(0);
+
+    void RocksPerfProfile::Counters::add(const Counters& other) {
+        calls += other.calls;
+        micros += other.micros;
+        blockCacheHits += other.blockCacheHits;
+        blockReads += other.blockReads;
+        blockReadBytes += other.blockReadBytes;
+        blockReadMicros += other.blockReadMicros;
+        bytesRead += other.bytesRead;
+        tombstonesSkipped += other.tombstonesSkipped;
+        keysSkipped += other.keysSkipped;
+        memtableHits += other.memtableHits;
+        mutexWaitMicros += other.mutexWaitMicros;
+        walWriteMicros += other.walWriteMicros;
+        walSyncMicros += other.walSyncMicros;
+    }
+
+    void RocksPerfProfile::Counters::appendTo(BSONObjBuilder* builder) const {
+        builder->append("calls", calls);
+        builder->append("micros", micros);
+        builder->append("blockCacheHits", blockCacheHits);
+        builder->append("blockReads", blockReads);
+        builder->append("blockReadBytes", blockReadBytes);
+        builder->append("blockReadMicros", blockReadMicros);
+        builder->append("bytesRead", bytesRead);
+        builder->append("tombstonesSkipped", tombstonesSkipped);
+        builder->append("keysSkipped", keysSkipped);
+        builder->append("memtableHits", memtableHits);
+        builder->append("mutexWaitMicros", mutexWaitMicros);
+        builder->append("walWriteMicros", walWriteMicros);
+        builder->append("walSyncMicros", walSyncMicros);
+    }
+
+    bool RocksPerfProfile::shouldSample() {
+        int sampleEvery = getSampleEvery();
+        if (sampleEvery <= 0) {
+            return false;
+        }
+        return _sinceLastSample.fetch_add(1, std::memory_order_relaxed) %
+                   static_cast<unsigned>(sampleEvery) ==
+            0;
+    }
+
+    void RocksPerfProfile::add(const Counters& delta) {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        _counters.add(delta);
+    }
+
+    void RocksPerfProfile::reset() {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        _counters = Counters();
+    }
+
+    RocksPerfProfile::Counters RocksPerfProfile::get() const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        return _counters;
+    }
+
+    RocksPerfScope::RocksPerfScope(RocksPerfProfile* profile, bool walSync)
+        : _profile(profile), _walSync(walSync) {
+        if (!_profile) {
+            return;
+        }
+        _previousLevel = rocksdb::GetPerfLevel();
+        // kEnableTime also times the DB mutex, which kEnableTimeExceptForMutex leaves out
+        rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableTime);
+        _start = _readThreadCounters();
+        _startMicros = curTimeMicros64();
+    }
+
+    RocksPerfScope::~RocksPerfScope() {
+        if (!_profile) {
+            return;
+        }
+        long long elapsedMicros = curTimeMicros64() - _startMicros;
+        RocksPerfProfile::Counters delta = _readThreadCounters();
+        delta.blockCacheHits -= _start.blockCacheHits;
+        delta.blockReads -= _start.blockReads;
+        delta.blockReadBytes -= _start.blockReadBytes;
+        delta.blockReadMicros -= _start.blockReadMicros;
+        delta.bytesRead -= _start.bytesRead;
+        delta.tombstonesSkipped -= _start.tombstonesSkipped;
+        delta.keysSkipped -= _start.keysSkipped;
+        delta.memtableHits -= _start.memtableHits;
+        delta.mutexWaitMicros -= _start.mutexWaitMicros;
+        delta.walWriteMicros -= _start.walWriteMicros;
+        delta.calls = 1;
+        delta.micros = elapsedMicros;
+        delta.walSyncMicros = _walSync ? elapsedMicros : 0;
+        rocksdb::SetPerfLevel(_previousLevel);
+        _profile->add(delta);
+    }
+
+    // perf_context and iostats_context are thread local and only grow (nobody resets them in
+    // mongod), so we work with deltas. That also keeps PrefixStrippingIterator's own
+    // internal_delete_skipped_count deltas intact
+    RocksPerfProfile::Counters RocksPerfScope::_readThreadCounters() {
+        RocksPerfProfile::Counters counters;
+        const auto& perf = rocksdb::perf_context;
+        counters.blockCacheHits = perf.block_cache_hit_count;
+        counters.blockReads = perf.block_read_count;
+        counters.blockReadBytes = perf.block_read_byte;
+        counters.blockReadMicros = perf.block_read_time / 1000;
+        counters.tombstonesSkipped = perf.internal_delete_skipped_count;
+        counters.keysSkipped = perf.internal_key_skipped_count;
+        counters.memtableHits = perf.get_from_memtable_count;
+        counters.mutexWaitMicros =
+            (perf.db_mutex_lock_nanos + perf.db_condition_wait_nanos) / 1000;
+        counters.walWriteMicros = perf.write_wal_time / 1000;
+        counters.bytesRead = rocksdb::iostats_context.bytes_read;
+        return counters;
+    }
+}
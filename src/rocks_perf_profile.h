@@ -0,0 +1,119 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include <rocksdb/perf_level.h>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/stdx/mutex.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * RocksDB perf_context and iostats_context counters of one operation. Only a sample of the
+     * recovery units collect them (one out of getSampleEvery()), because timing every RocksDB
+     * call with kEnableTime costs a few clock reads per block. Sampled recovery units report
+     * the counters of their current snapshot or unit of work in currentOp, and log them if that
+     * took longer than slowms.
+     */
+    class RocksPerfProfile {
+        MONGO_DISALLOW_COPYING(RocksPerfProfile);
+
+    public:
+        struct Counters {
+            long long calls = 0;
+            // wall clock time spent inside RocksDB calls
+            long long micros = 0;
+            long long blockCacheHits = 0;
+            // block cache misses
+            long long blockReads = 0;
+            long long blockReadBytes = 0;
+            long long blockReadMicros = 0;
+            // everything read from files, including the WAL
+            long long bytesRead = 0;
+            long long tombstonesSkipped = 0;
+            long long keysSkipped = 0;
+            long long memtableHits = 0;
+            long long mutexWaitMicros = 0;
+            long long walWriteMicros = 0;
+            long long walSyncMicros = 0;
+
+            void add(const Counters& other);
+            void appendTo(BSONObjBuilder* builder) const;
+        };
+
+        RocksPerfProfile() = default;
+
+        // Returns true once out of getSampleEvery() calls, never if it's 0
+        static bool shouldSample();
+        static int getSampleEvery() { return _sampleEvery.load(std::memory_order_relaxed); }
+        static void setSampleEvery(int sampleEvery) { _sampleEvery.store(sampleEvery); }
+
+        void add(const Counters& delta);
+        Counters get() const;
+        void reset();
+
+    private:
+        // currentOp reads the profile of other operations
+        mutable stdx::mutex _mutex;
+        Counters _counters;
+
+        static std::atomic<int> _sampleEvery;  // NOLINT
+        static std::atomic<unsigned> _sinceLastSample;  // NOLINT
+    };
+
+    /**
+     * Adds the perf_context and iostats_context deltas of the RocksDB calls made during its
+     * lifetime to a profile. Does nothing if the profile is nullptr, so that unsampled
+     * operations only pay for a branch.
+     */
+    class RocksPerfScope {
+        MONGO_DISALLOW_COPYING(RocksPerfScope);
+
+    public:
+        // walSync: the scope only syncs the WAL, its time goes to walSyncMicros
+        explicit RocksPerfScope(RocksPerfProfile* profile, bool walSync = false);
+        ~RocksPerfScope();
+
+    private:
+        static RocksPerfProfile::Counters _readThreadCounters();
+
+        RocksPerfProfile* _profile;  // not owned, can be nullptr
+        const bool _walSync;
+        rocksdb::PerfLevel _previousLevel = rocksdb::PerfLevel::kDisable;
+        long long _startMicros = 0;
+        RocksPerfProfile::Counters _start;
+    };
+}
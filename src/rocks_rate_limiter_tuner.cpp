@@ -0,0 +1,199 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_rate_limiter_tuner.h"
+
+#include <algorithm>
+
+#include <rocksdb/db.h>
+#include <rocksdb/options.h>
+#include <rocksdb/rate_limiter.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/db/client.h"
+#include "mongo/stdx/chrono.h"
+#include "mongo/util/log.h"
+
+namespace mongo {
+
+    namespace {
+        const long long kBytesInMB = 1024 * 1024LL;
+
+        const char* decisionName(RocksRateLimiterTuner::Decision decision) {
+            switch (decision) {
+                case RocksRateLimiterTuner::Decision::kRaise:
+                    return "raise";
+                case RocksRateLimiterTuner::Decision::kLower:
+                    return "lower";
+                default:
+                    return "hold";
+            }
+        }
+    }  // namespace
+
+    RocksRateLimiterTuner::RocksRateLimiterTuner(rocksdb::DB* db, rocksdb::RateLimiter* rateLimiter,
+                                                 int maxMBPerSec, int minMBPerSec,
+                                                 uint64_t targetP99Micros,
+                                                 RocksHistogram* readLatency,
+                                                 RocksHistogram* commitLatency)
+        : BackgroundJob(false /* deleteSelf */),
+          _db(db),
+          _rateLimiter(rateLimiter),
+          _readLatency(readLatency),
+          _commitLatency(commitLatency),
+          _targetP99Micros(targetP99Micros),
+          _configuredMinMBPerSec(minMBPerSec),
+          _lastReadSnapshot(readLatency->snapshot()),
+          _lastCommitSnapshot(commitLatency->snapshot()),
+          _maxMBPerSec(maxMBPerSec),
+          _currentMBPerSec(maxMBPerSec) {
+        _rateLimiter->SetBytesPerSecond(static_cast<int64_t>(maxMBPerSec) * kBytesInMB);
+    }
+
+    void RocksRateLimiterTuner::run() {
+        Client::initThread(name().c_str());
+
+        LOG(1) << "starting " << name() << " thread";
+
+        while (true) {
+            {
+                stdx::unique_lock<stdx::mutex> lk(_mutex);
+                _shutdownCondition.wait_for(lk, stdx::chrono::milliseconds(kTuneIntervalMillis),
+                                            [this] { return _shuttingDown; });
+                if (_shuttingDown) {
+                    break;
+                }
+            }
+            _tune();
+        }
+        LOG(1) << "stopping " << name() << " thread";
+    }
+
+    void RocksRateLimiterTuner::shutdown() {
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _shuttingDown = true;
+        }
+        _shutdownCondition.notify_all();
+        wait();
+    }
+
+    void RocksRateLimiterTuner::setMaxMBPerSec(int maxMBPerSec) {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        _maxMBPerSec = maxMBPerSec;
+        _apply_inlock(_currentMBPerSec);
+    }
+
+    RocksRateLimiterTuner::Decision RocksRateLimiterTuner::decide(bool latencyDegraded,
+                                                                  uint64_t pendingBytes,
+                                                                  uint64_t prevPendingBytes,
+                                                                  uint64_t pendingLimitBytes) {
+        bool behind = pendingLimitBytes > 0 && pendingBytes >= pendingLimitBytes / 4;
+        bool growing = pendingBytes > prevPendingBytes && pendingBytes >= kMinPendingBytes;
+        if (latencyDegraded) {
+            return behind ? Decision::kHold : Decision::kLower;
+        }
+        if (behind || growing) {
+            return Decision::kRaise;
+        }
+        return Decision::kHold;
+    }
+
+    void RocksRateLimiterTuner::_tune() {
+        RocksHistogram::Snapshot readSnapshot = _readLatency->snapshot();
+        RocksHistogram::Snapshot commitSnapshot = _commitLatency->snapshot();
+        RocksHistogram::Snapshot readWindow = readSnapshot.since(_lastReadSnapshot);
+        RocksHistogram::Snapshot commitWindow = commitSnapshot.since(_lastCommitSnapshot);
+        _lastReadSnapshot = std::move(readSnapshot);
+        _lastCommitSnapshot = std::move(commitSnapshot);
+        const uint64_t readSamples = readWindow.count();
+        const uint64_t commitSamples = commitWindow.count();
+        const uint64_t readP99 = readWindow.percentile(0.99);
+        const uint64_t commitP99 = commitWindow.percentile(0.99);
+        bool latencyDegraded = (readSamples >= kMinLatencySamples && readP99 > _targetP99Micros) ||
+            (commitSamples >= kMinLatencySamples && commitP99 > _targetP99Micros);
+
+        uint64_t pendingBytes = 0;
+        _db->GetIntProperty("rocksdb.estimate-pending-compaction-bytes", &pendingBytes);
+        uint64_t pendingLimitBytes = _db->GetOptions().soft_pending_compaction_bytes_limit;
+
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        Decision decision = decide(latencyDegraded, pendingBytes, _lastPendingBytes,
+                                   pendingLimitBytes);
+        int newMBPerSec = _currentMBPerSec;
+        if (decision == Decision::kRaise) {
+            newMBPerSec = std::min(_maxMBPerSec, std::max(_currentMBPerSec + 1,
+                                                          _currentMBPerSec * 5 / 4));
+        } else if (decision == Decision::kLower) {
+            newMBPerSec = std::max(_minMBPerSec_inlock(), _currentMBPerSec * 4 / 5);
+        }
+
+        if (newMBPerSec != _currentMBPerSec) {
+            log() << "RocksDB rate limiter: changing background write budget from "
+                  << _currentMBPerSec << "MB/s to " << newMBPerSec
+                  << "MB/s (pending compaction bytes: " << pendingBytes
+                  << ", read p99: " << readP99 << "us, commit p99: " << commitP99
+                  << "us, target p99: " << _targetP99Micros << "us)";
+            if (decision == Decision::kRaise) {
+                ++_numRaises;
+            } else {
+                ++_numLowers;
+            }
+            _apply_inlock(newMBPerSec);
+        }
+        _lastDecision = decision;
+        _lastPendingBytes = pendingBytes;
+        _lastReadP99Micros = readP99;
+        _lastCommitP99Micros = commitP99;
+    }
+
+    void RocksRateLimiterTuner::_apply_inlock(int newMBPerSec) {
+        // the maximum can move underneath us through setMaxMBPerSec()
+        _currentMBPerSec = std::max(_minMBPerSec_inlock(), std::min(_maxMBPerSec, newMBPerSec));
+        _rateLimiter->SetBytesPerSecond(static_cast<int64_t>(_currentMBPerSec) * kBytesInMB);
+    }
+
+    void RocksRateLimiterTuner::appendStats(BSONObjBuilder* builder) const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        builder->append("current-mb-per-sec", _currentMBPerSec);
+        builder->append("min-mb-per-sec", _minMBPerSec_inlock());
+        builder->append("max-mb-per-sec", _maxMBPerSec);
+        builder->append("target-p99-micros", static_cast<long long>(_targetP99Micros));
+        builder->append("read-p99-micros", static_cast<long long>(_lastReadP99Micros));
+        builder->append("commit-p99-micros", static_cast<long long>(_lastCommitP99Micros));
+        builder->append("pending-compaction-bytes", static_cast<long long>(_lastPendingBytes));
+        builder->append("raises", _numRaises);
+        builder->append("lowers", _numLowers);
+        builder->append("last-decision", decisionName(_lastDecision));
+    }
+}
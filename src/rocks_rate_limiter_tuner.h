@@ -0,0 +1,129 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/stdx/condition_variable.h"
+#include "mongo/stdx/mutex.h"
+#include "mongo/util/background.h"
+
+#include "rocks_histogram.h"
+
+namespace rocksdb {
+    class DB;
+    class RateLimiter;
+}
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Adjusts the background write budget (flushes and compactions) of the rate limiter. The
+     * budget goes up when the estimated pending compaction bytes grow and goes down when the
+     * p99 foreground read or commit latency is above the target. The tuner is the only one
+     * moving the rate, so the limiter must not be RocksDB's auto-tuned one, and the rate never
+     * leaves [minMBPerSec, maxMBPerSec].
+     *
+     * Latencies come from the hot path histograms (see RocksHotPath), which the tuner samples
+     * once per interval. It doesn't time anything itself.
+     */
+    class RocksRateLimiterTuner : public BackgroundJob {
+        MONGO_DISALLOW_COPYING(RocksRateLimiterTuner);
+
+    public:
+        enum class Decision { kHold, kRaise, kLower };
+
+        RocksRateLimiterTuner(rocksdb::DB* db, rocksdb::RateLimiter* rateLimiter, int maxMBPerSec,
+                              int minMBPerSec, uint64_t targetP99Micros,
+                              RocksHistogram* readLatency, RocksHistogram* commitLatency);
+
+        virtual std::string name() const { return "RocksRateLimiterTuner"; }
+
+        virtual void run();
+
+        void shutdown();
+
+        // upper bound of the budget, changed by rocksdbRuntimeConfigMaxWriteMBPerSec
+        void setMaxMBPerSec(int maxMBPerSec);
+
+        void appendStats(BSONObjBuilder* builder) const;
+
+        /**
+         * Pure decision function of a single tuning step. We never lower the budget while
+         * compaction is already far behind (pendingBytes above a quarter of pendingLimitBytes),
+         * since the write stall that follows is worse than the read latency we'd save.
+         */
+        static Decision decide(bool latencyDegraded, uint64_t pendingBytes,
+                               uint64_t prevPendingBytes, uint64_t pendingLimitBytes);
+
+    private:
+        void _tune();
+        // clamps newMBPerSec between the minimum and the maximum and hands it to _rateLimiter
+        void _apply_inlock(int newMBPerSec);
+        // the configured minimum, unless the maximum is below it
+        int _minMBPerSec_inlock() const { return std::min(_configuredMinMBPerSec, _maxMBPerSec); }
+
+        rocksdb::DB* _db;                    // not owned
+        rocksdb::RateLimiter* _rateLimiter;  // not owned
+        RocksHistogram* _readLatency;        // not owned
+        RocksHistogram* _commitLatency;      // not owned
+        const uint64_t _targetP99Micros;
+        const int _configuredMinMBPerSec;
+        // the histograms as of the previous interval, only used by the tuner thread
+        RocksHistogram::Snapshot _lastReadSnapshot;
+        RocksHistogram::Snapshot _lastCommitSnapshot;
+
+        mutable stdx::mutex _mutex;
+        stdx::condition_variable _shutdownCondition;
+        bool _shuttingDown = false;
+
+        // protected by _mutex
+        int _maxMBPerSec;
+        int _currentMBPerSec;
+        uint64_t _lastPendingBytes = 0;
+        uint64_t _lastReadP99Micros = 0;
+        uint64_t _lastCommitP99Micros = 0;
+        long long _numRaises = 0;
+        long long _numLowers = 0;
+        Decision _lastDecision = Decision::kHold;
+
+        // Tune every 5 seconds
+        static const int kTuneIntervalMillis = 5000;
+        // ignore latency windows with fewer samples than this, their p99 is noise
+        static const uint64_t kMinLatencySamples = 100;
+        // pending compaction growth below 256MB doesn't warrant a bigger budget
+        static const uint64_t kMinPendingBytes = 256ull << 20;
+    };
+}
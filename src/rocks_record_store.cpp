@@ -58,11 +58,17 @@
 #include "mongo/util/background.h"
 #include "mongo/util/log.h"
 #include "mongo/util/mongoutils/str.h"
+#include "mongo/util/time_support.h"
 
+#include "rocks_bulk_loader.h"
 #include "rocks_counter_manager.h"
 #include "rocks_durability_manager.h"
 #include "rocks_engine.h"
+#include "rocks_histogram.h"
+#include "rocks_ident_stats.h"
 #include "rocks_recovery_unit.h"
+#include "rocks_table_properties.h"
+#include "rocks_ttl.h"
 #include "rocks_util.h"
 
 namespace mongo {
@@ -274,10 +280,32 @@ namespace mongo {
         }        
 
     private:
-        std::atomic<long long> _deletedKeysSinceCompaction;
+        std::atomic<long long> _deletedKeysSinceCompaction{0};
         std::string _prefix;
     };
 
+    const int64_t RocksRecordStore::kCappedDeleteMinBatch;
+    const int64_t RocksRecordStore::kCappedDeleteMaxBatch;
+
+    void CappedDeleterSignal::notify() {
+        if (_listener) {
+            _listener();
+            return;
+        }
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _notified = true;
+        }
+        _cv.notify_one();
+    }
+
+    bool CappedDeleterSignal::wait(stdx::chrono::milliseconds timeout) {
+        stdx::unique_lock<stdx::mutex> lk(_mutex);
+        bool notified = _cv.wait_for(lk, timeout, [this] { return _notified; });
+        _notified = false;
+        return notified;
+    }
+
     RocksRecordStore::RocksRecordStore(StringData ns, StringData id, rocksdb::DB* db,
                                        RocksCounterManager* counterManager,
                                        RocksDurabilityManager* durabilityManager,
@@ -293,17 +321,21 @@ namespace mongo {
           _cappedMaxDocs(cappedMaxDocs),
           _cappedCallback(cappedCallback),
           _cappedDeleteCheckCount(0),
+          _cappedDeleterWakeupSize(std::max(_cappedMaxSizeSlack / 16, int64_t(1))),
+          _cappedDeleterSignal(isCapped ? std::make_shared<CappedDeleterSignal>() : nullptr),
           _isOplog(NamespaceString::oplog(ns)),
           _oplogKeyTracker(_isOplog ? new RocksOplogKeyTracker(rocksGetNextPrefix(_prefix))
                                     : nullptr),
 	  _cfHandle(nullptr),
+          _identStats(std::make_shared<RocksIdentStats>()),
           _cappedOldestKeyHint(0),
           _cappedVisibilityManager((_isCapped || _isOplog)
                                        ? new CappedVisibilityManager(this, durabilityManager)
                                        : nullptr),
           _ident(id.toString()),
-          _dataSizeKey(std::string("\0\0\0\0", 4) + "datasize-" + id.toString()),
-          _numRecordsKey(std::string("\0\0\0\0", 4) + "numrecords-" + id.toString()),
+          _ttlAccountedKey(ttlAccountedKey(id)),
+          _dataSizeKey(counterKeyPrefixes()[0] + id.toString()),
+          _numRecordsKey(counterKeyPrefixes()[1] + id.toString()),
           _shuttingDown(false) {
         _oplogSinceLastCompaction.reset();
 
@@ -319,24 +351,10 @@ namespace mongo {
             invariant(_cappedMaxDocs == -1);
         }
 
-        // Get next id
-        std::unique_ptr<RocksIterator> iter(RocksRecoveryUnit::NewIteratorNoSnapshot(_db, _cfHandle, _prefix));
-        // first check if the collection is empty
-        iter->SeekPrefix("");
-        bool emptyCollection = !iter->Valid();
-        if (!emptyCollection) {
-            // if it's not empty, find next RecordId
-            iter->SeekToLast();
-            dassert(iter->Valid());
-            rocksdb::Slice lastSlice = iter->key();
-            RecordId lastId = _makeRecordId(lastSlice);
-            if (_isOplog || _isCapped) {
-                _cappedVisibilityManager->updateHighestSeen(lastId);
-            }
-            _nextIdNum.store(lastId.repr() + 1);
-        } else {
-            // Need to start at 1 so we are always higher than RecordId::min()
-            _nextIdNum.store(1);
+        // Capped visibility needs the highest RecordId right away. Other collections only need
+        // it for the first insert, which keeps opening many collections at startup cheap
+        if (_isOplog || _isCapped) {
+            _loadNextIdNum();
         }
 
         // load metadata
@@ -350,6 +368,28 @@ namespace mongo {
         }
 
         _hasBackgroundThread = RocksEngine::initRsOplogBackgroundThread(ns);
+        if (!_hasBackgroundThread && _isCapped && _cappedMaxDocs == -1) {
+            // with max docs inserts always delete, the count has to be exact
+            _hasBackgroundThread = RocksEngine::initCappedDeleter(ns, _cappedDeleterSignal);
+        }
+    }
+
+    void RocksRecordStore::setExpireAfterSeconds(int64_t expireAfterSeconds) {
+        invariant(!_isCapped);
+        _expireAfterSeconds = expireAfterSeconds;
+        _ttlAccountedBeforeSecs = std::make_shared<std::atomic<long long>>(
+            _counterManager->loadCounter(_ttlAccountedKey));
+        RocksEngine::initTTLMonitor(_ident, ns());
+    }
+
+    // static
+    std::string RocksRecordStore::ttlAccountedKey(StringData ident) {
+        return std::string("\0\0\0\0", 4) + "ttlaccounted-" + ident.toString();
+    }
+
+    void RocksRecordStore::enableCappedKeyTracker() {
+        invariant(_isCapped && !_oplogKeyTracker);
+        _oplogKeyTracker = new RocksOplogKeyTracker(rocksGetNextPrefix(_prefix));
     }
 
     RocksRecordStore::~RocksRecordStore() {
@@ -366,14 +406,25 @@ namespace mongo {
 
     int64_t RocksRecordStore::storageSize(OperationContext* txn, BSONObjBuilder* extraInfo,
                                           int infoLevel) const {
+        long long size = _dataSize.load();
+        RocksPrefixStats stats;
+        if (_prefixStats && _prefixStats->get(_prefix, &stats)) {
+            // large documents may live in blob files
+            size = stats.onDiskBytes();
+            RocksPrefixStats trackerStats;
+            if (_oplogKeyTracker &&
+                _prefixStats->get(rocksGetNextPrefix(_prefix), &trackerStats)) {
+                size += trackerStats.onDiskBytes();
+            }
+        }
         // We need to make it multiple of 256 to make
         // jstests/concurrency/fsm_workloads/convert_to_capped_collection.js happy
-        return static_cast<int64_t>(
-            std::max(_dataSize.load() & (~255), static_cast<long long>(256)));
+        return static_cast<int64_t>(std::max(size & (~255), static_cast<long long>(256)));
     }
 
     RecordData RocksRecordStore::dataFor(OperationContext* txn, const RecordId& loc) const {
-        RecordData rd = _getDataFor(_db, _cfHandle, _prefix, txn, loc);
+        RecordData rd =
+            _getDataFor(_db, _cfHandle, _prefix, txn, loc, _rowCache, _identStats.get());
         massert(28605, "Didn't find RecordId in RocksRecordStore", (rd.data() != nullptr));
         return rd;
     }
@@ -387,15 +438,22 @@ namespace mongo {
         }
 
         std::string oldValue;
-	auto status = ru->Get(_cfHandle, key, &oldValue);
+	auto status = ru->Get(_cfHandle, key, &oldValue, _identStats.get());
         invariantRocksOK(status);
         int oldLength = oldValue.size();
 
 	ru->writeBatch()->Delete(_cfHandle, key);
-        if (_isOplog) {
+        ru->recordIdentWrite(_identStats, key.size());
+        if (_oplogKeyTracker) {
 	    _oplogKeyTracker->deleteKey(ru, _cfHandle, dl);
         }
+        if (_rowCache) {
+            ru->invalidateRowCacheOnCommit(_rowCache, std::move(key));
+        }
 
+        if (_expiryAccounted(dl)) {
+            return;
+        }
         _changeNumRecords(txn, -1);
         _increaseDataSize(txn, -oldLength);
     }
@@ -452,20 +510,33 @@ namespace mongo {
         if (_cappedMaxDocs != -1) {
             lock.lock(); // Max docs has to be exact, so have to check every time.
         } else if(_hasBackgroundThread) {
-            // We are foreground, and there is a background thread,
+            // We are foreground, and there is a background thread. Wake it up once there is
+            // enough to delete to be worth a pass
+            long long overshoot = _dataSize.load() - _cappedMaxSize;
+            if (overshoot < _cappedDeleterWakeupSize) {
+                return 0;
+            }
+            _notifyCappedDeleter(overshoot);
 
-            // Check if we need some back pressure.
-            if ((_dataSize.load() - _cappedMaxSize) < _cappedMaxSizeSlack) {
+            // Check if we need some back pressure. Only if the deleter is really behind: it
+            // didn't catch up a while after it was woken up, or inserts got way ahead of it
+            if (overshoot < _cappedMaxSizeSlack) {
+                return 0;
+            }
+            if (overshoot < 2 * _cappedMaxSizeSlack &&
+                _cappedDeleterLagMillis() < kCappedDeleterMaxLagMillis) {
                 return 0;
             }
 
             // Back pressure needed!
             // We're not actually going to delete anything, but we're going to syncronize
             // on the deleter thread.
-
+            _cappedBackPressureWaits.fetch_add(1);
+            Timer timer;
             if (!lock.try_lock()) {
                 (void)lock.try_lock_for(boost::chrono::milliseconds(200));
             }
+            _cappedBackPressureMicros.fetch_add(timer.micros());
             return 0;
         } else {
             if (!lock.try_lock()) {
@@ -487,8 +558,40 @@ namespace mongo {
         return cappedDeleteAsNeeded_inlock(txn, justInserted);
     }
 
+    void RocksRecordStore::_notifyCappedDeleter(long long overshoot) {
+        long long maxOvershoot = _cappedMaxOvershoot.load();
+        while (overshoot > maxOvershoot &&
+               !_cappedMaxOvershoot.compare_exchange_weak(maxOvershoot, overshoot)) {
+        }
+        // only the first insert since the deleter caught up wakes it up, it runs until it
+        // catches up again
+        long long caughtUp = 0;
+        if (_cappedDeleterBehindSinceMillis.compare_exchange_strong(
+                caughtUp, static_cast<long long>(curTimeMillis64()))) {
+            _cappedDeleterWakeups.fetch_add(1);
+            _cappedDeleterSignal->notify();
+        }
+    }
+
+    long long RocksRecordStore::_cappedDeleterLagMillis() const {
+        long long behindSince = _cappedDeleterBehindSinceMillis.load();
+        if (behindSince == 0) {
+            return 0;
+        }
+        return std::max(0LL, static_cast<long long>(curTimeMillis64()) - behindSince);
+    }
+
+    bool RocksRecordStore::cappedDeleterBehind() const {
+        invariant(_isCapped);
+        if (_dataSize.load() - _cappedMaxSize >= _cappedDeleterWakeupSize) {
+            return true;
+        }
+        return _cappedMaxDocs != -1 && _numRecords.load() > _cappedMaxDocs;
+    }
+
     int64_t RocksRecordStore::cappedDeleteAsNeeded_inlock(OperationContext* txn,
                                                           const RecordId& justInserted) {
+        RocksHistogramTimer passTimer(rocksHotPathHistogram(RocksHotPath::kCappedDelete));
         // we do this is a sub transaction in case it aborts
         RocksRecoveryUnit* realRecoveryUnit =
             checked_cast<RocksRecoveryUnit*>(txn->releaseRecoveryUnit());
@@ -508,26 +611,37 @@ namespace mongo {
         }
         BSONObj emptyBson;
 
+        int64_t maxDocsToRemove = kCappedDeleteMinBatch;
+        if (numRecords > 0 && dataSize > 0) {
+            int64_t averageSize = std::max(dataSize / numRecords, int64_t(1));
+            maxDocsToRemove = std::max(
+                maxDocsToRemove,
+                std::min(kCappedDeleteMaxBatch, sizeOverCap / averageSize + docsOverCap));
+        }
+
         try {
             WriteUnitOfWork wuow(txn);
             auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(txn);
             std::unique_ptr<rocksdb::Iterator> iter;
-            if (_isOplog) {
+            const bool useKeyTracker =
+                _oplogKeyTracker && (_isOplog || !_cappedDocumentsNeeded.load());
+            if (useKeyTracker) {
                 // we're using _oplogKeyTracker to find which keys to delete -- this is much faster
                 // because we don't need to read any values. We theoretically need values to pass
                 // the document to the cappedCallback, but the callback is only using
-                // documents to remove them from indexes. opLog doesn't have indexes, so there
-                // should be no need for us to reconstruct the document to pass it to the callback
+                // documents to remove them from indexes. opLog and capped collections without
+                // indexes don't have any, so there should be no need for us to reconstruct the
+                // document to pass it to the callback
                 iter.reset(_oplogKeyTracker->newIterator(ru, _cfHandle));
             } else {
-                iter.reset(ru->NewIterator(_cfHandle, _prefix, _isOplog));
+                iter.reset(ru->NewIterator(_cfHandle, _prefix, _isOplog, _identStats.get()));
             }
             int64_t storage;
             iter->Seek(RocksRecordStore::_makeKey(_cappedOldestKeyHint, &storage));
 
             RecordId newestOld;
             while ((sizeSaved < sizeOverCap || docsRemoved < docsOverCap) &&
-                   (docsRemoved < 20000) && iter->Valid()) {
+                   (docsRemoved < maxDocsToRemove) && iter->Valid()) {
 
                 newestOld = _makeRecordId(iter->key());
 
@@ -554,7 +668,7 @@ namespace mongo {
 
                 rocksdb::Slice oldValue;
                 ++docsRemoved;
-                if (_isOplog) {
+                if (useKeyTracker) {
                     // trick the callback by giving it empty bson document
                     oldValue = rocksdb::Slice(emptyBson.objdata(), emptyBson.objsize());
                     // we keep data size in the value
@@ -574,9 +688,13 @@ namespace mongo {
                 }
 
 		ru->writeBatch()->Delete(_cfHandle, key);
-                if (_isOplog) {
+                ru->recordIdentWrite(_identStats, key.size());
+                if (_oplogKeyTracker) {
                     _oplogKeyTracker->deleteKey(ru, _cfHandle, newestOld);
                 }
+                if (_rowCache) {
+                    ru->invalidateRowCacheOnCommit(_rowCache, std::move(key));
+                }
 
                 iter->Next();
             }
@@ -618,11 +736,26 @@ namespace mongo {
         delete txn->releaseRecoveryUnit();
         txn->setRecoveryUnit(realRecoveryUnit, realRUstate);
 
-        if (_isOplog) {
+        if (_hasBackgroundThread) {
+            _cappedDeleterPasses.fetch_add(1);
+            if (!cappedDeleterBehind()) {
+                _cappedDeleterBehindSinceMillis.store(0);
+            }
+        }
+
+        if (_oplogKeyTracker) {
             if ((_oplogSinceLastCompaction.minutes() >= kOplogCompactEveryMins) || 
             (_oplogKeyTracker->getDeletedSinceCompaction() >= kOplogCompactEveryDeletedRecords)) {
-                log() << "Scheduling oplog compactions. time since last " << _oplogSinceLastCompaction.minutes() <<
-                    " deleted since last " << _oplogKeyTracker->getDeletedSinceCompaction();
+                if (_fifoCompaction) {
+                    // FIFO compaction drops whole files once they fall out of the oplog, there is
+                    // nothing to rewrite
+                    _oplogSinceLastCompaction.reset();
+                    _oplogKeyTracker->resetDeletedSinceCompaction();
+                    return docsRemoved;
+                }
+                log() << "Scheduling compactions of " << ns() << ". time since last "
+                      << _oplogSinceLastCompaction.minutes() << " deleted since last "
+                      << _oplogKeyTracker->getDeletedSinceCompaction();
                 _oplogSinceLastCompaction.reset();
                 // schedule compaction for oplog
                 std::string oldestAliveKey(_makePrefixedKey(_prefix, _cappedOldestKeyHint));
@@ -655,6 +788,23 @@ namespace mongo {
 
         RocksRecoveryUnit* ru = RocksRecoveryUnit::getRocksRecoveryUnit( txn );
 
+        if (_bulkLoading.load()) {
+            std::shared_ptr<RocksBulkLoader> loader;
+            {
+                stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+                loader = _bulkLoader;
+            }
+            if (loader) {
+                // counted by addBulkLoadedRecords() once the load is ingested
+                RecordId loc = _nextId();
+                std::string key(_makePrefixedKey(_prefix, loc));
+                ru->recordIdentWrite(_identStats, key.size() + len);
+                RocksBulkLoader::addOnCommit(ru, std::move(loader), std::move(key),
+                                             std::string(data, len));
+                return StatusWith<RecordId>(loc);
+            }
+        }
+
         RecordId loc;
         if (_isOplog) {
             StatusWith<RecordId> status = oploghack::extractKey(data, len);
@@ -672,8 +822,10 @@ namespace mongo {
 
         // No need to register the write here, since we just allocated a new RecordId so no other
         // transaction can access this key before we commit
-	ru->writeBatch()->Put(_cfHandle, _makePrefixedKey(_prefix, loc), rocksdb::Slice(data, len));
-        if (_isOplog) {
+        std::string key(_makePrefixedKey(_prefix, loc));
+	ru->writeBatch()->Put(_cfHandle, key, rocksdb::Slice(data, len));
+        ru->recordIdentWrite(_identStats, key.size() + len);
+        if (_oplogKeyTracker) {
             _oplogKeyTracker->insertKey(ru, _cfHandle, loc, len);
         }
 
@@ -729,16 +881,22 @@ namespace mongo {
         }
 
         std::string old_value;
-        auto status = ru->Get(_cfHandle, key, &old_value);
+        auto status = ru->Get(_cfHandle, key, &old_value, _identStats.get());
         invariantRocksOK(status);
         int old_length = old_value.size();
 
 	ru->writeBatch()->Put(_cfHandle, key, rocksdb::Slice(data, len));
-        if (_isOplog) {
+        ru->recordIdentWrite(_identStats, key.size() + len);
+        if (_oplogKeyTracker) {
             _oplogKeyTracker->insertKey(ru, _cfHandle, loc, len);
         }
+        if (_rowCache) {
+            ru->invalidateRowCacheOnCommit(_rowCache, std::move(key));
+        }
 
-        _increaseDataSize(txn, len - old_length);
+        if (!_expiryAccounted(loc)) {
+            _increaseDataSize(txn, len - old_length);
+        }
 
         cappedDeleteAsNeeded(txn, loc);
 
@@ -772,14 +930,16 @@ namespace mongo {
         }
 
         return stdx::make_unique<Cursor>(txn, _db, _cfHandle, _prefix, _cappedVisibilityManager, forward,
-                                         _isCapped);
+                                         _isCapped, _firstVisibleRecordId(), _rowCache,
+                                         _identStats);
     }
 
     Status RocksRecordStore::truncate(OperationContext* txn) {
         // We can't use getCursor() here because we need to ignore the visibility of records (i.e.
         // we need to delete all records, regardless of visibility)
         auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(txn);
-        std::unique_ptr<RocksIterator> iterator(ru->NewIterator(_cfHandle, _prefix, _isOplog));
+        std::unique_ptr<RocksIterator> iterator(
+            ru->NewIterator(_cfHandle, _prefix, _isOplog, _identStats.get()));
         for (iterator->SeekToFirst(); iterator->Valid(); iterator->Next()) {
             deleteRecord(txn, _makeRecordId(iterator->key()));
         }
@@ -855,7 +1015,27 @@ namespace mongo {
         if (_isCapped) {
             result->appendIntOrLL("max", _cappedMaxDocs);
             result->appendIntOrLL("maxSize", _cappedMaxSize / scale);
+            if (_hasBackgroundThread) {
+                BSONObjBuilder deleter(result->subobjStart("cappedDeleter"));
+                long long overshoot = std::max(0LL, _dataSize.load() - _cappedMaxSize);
+                deleter.appendNumber("overshoot", static_cast<long long>(overshoot / scale));
+                deleter.appendNumber("maxOvershoot",
+                                     static_cast<long long>(_cappedMaxOvershoot.load() / scale));
+                deleter.appendNumber("lagMillis", _cappedDeleterLagMillis());
+                deleter.appendNumber("wakeups", _cappedDeleterWakeups.load());
+                deleter.appendNumber("passes", _cappedDeleterPasses.load());
+                deleter.appendNumber("backPressureWaits", _cappedBackPressureWaits.load());
+                deleter.appendNumber("backPressureMicros", _cappedBackPressureMicros.load());
+            }
+        }
+        result->appendBool("rowCache", _rowCache != nullptr);
+        RocksPrefixStats stats;
+        if (_prefixStats && _prefixStats->get(_prefix, &stats)) {
+            BSONObjBuilder sstStats(result->subobjStart("sstStats"));
+            stats.appendToBson(&sstStats, scale);
         }
+        BSONObjBuilder ioStats(result->subobjStart("ioStats"));
+        _identStats->appendTo(&ioStats);
     }
 
     Status RocksRecordStore::oplogDiskLocRegister(OperationContext* txn, const Timestamp& opTime) {
@@ -886,6 +1066,49 @@ namespace mongo {
         }
     }
 
+    Status RocksRecordStore::beginBulkLoad(const std::string& dir) {
+        if (_isCapped) {
+            return Status(ErrorCodes::InvalidOptions,
+                          str::stream() << "bulk load is not supported for capped collection "
+                                        << _ns);
+        }
+        stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+        if (_bulkLoader) {
+            return Status(ErrorCodes::IllegalOperation,
+                          str::stream() << _ns << " is already bulk loading");
+        }
+        _bulkLoader = std::make_shared<RocksBulkLoader>(_db, _cfHandle, dir, _ident);
+        _bulkLoading.store(true);
+        return Status::OK();
+    }
+
+    std::shared_ptr<RocksBulkLoader> RocksRecordStore::stopBulkLoad() {
+        stdx::lock_guard<stdx::mutex> lk(_bulkLoadMutex);
+        _bulkLoading.store(false);
+        return std::move(_bulkLoader);
+    }
+
+    void RocksRecordStore::addBulkLoadedRecords(long long numRecords, long long dataSize) {
+        updateStatsAfterRepair(nullptr, _numRecords.fetch_add(numRecords) + numRecords,
+                               _dataSize.fetch_add(dataSize) + dataSize);
+    }
+
+    void RocksRecordStore::recomputeStats() {
+        long long numRecords = 0;
+        long long dataSize = 0;
+        std::unique_ptr<RocksIterator> iter(
+            RocksRecoveryUnit::NewIteratorNoSnapshot(_db, _cfHandle, _prefix));
+        for (iter->SeekPrefix(""); iter->Valid(); iter->Next()) {
+            ++numRecords;
+            dataSize += iter->value().size();
+        }
+        invariantRocksOK(iter->status());
+        log() << _ns << " holds " << numRecords << " documents (" << dataSize
+              << " bytes), numRecords was " << _numRecords.load() << " and dataSize "
+              << _dataSize.load();
+        updateStatsAfterRepair(nullptr, numRecords, dataSize);
+    }
+
     /**
      * Return the RecordId of an oplog entry as close to startingPosition as possible without
      * being higher. If there are no entries <= startingPosition, return RecordId().
@@ -977,11 +1200,107 @@ namespace mongo {
         wuow.commit();
     }
 
+    void RocksRecordStore::_loadNextIdNum() {
+        if (_nextIdNumLoaded.load(std::memory_order_acquire)) {
+            return;
+        }
+        stdx::lock_guard<stdx::mutex> lk(_nextIdNumMutex);
+        if (_nextIdNumLoaded.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::unique_ptr<RocksIterator> iter(
+            RocksRecoveryUnit::NewIteratorNoSnapshot(_db, _cfHandle, _prefix));
+        // first check if the collection is empty
+        iter->SeekPrefix("");
+        bool emptyCollection = !iter->Valid();
+        if (!emptyCollection) {
+            // if it's not empty, find next RecordId
+            iter->SeekToLast();
+            dassert(iter->Valid());
+            rocksdb::Slice lastSlice = iter->key();
+            RecordId lastId = _makeRecordId(lastSlice);
+            if (_isOplog || _isCapped) {
+                _cappedVisibilityManager->updateHighestSeen(lastId);
+            }
+            _nextIdNum.store(lastId.repr() + 1);
+        } else {
+            // Need to start at 1 so we are always higher than RecordId::min()
+            _nextIdNum.store(1);
+        }
+        _nextIdNumLoaded.store(true, std::memory_order_release);
+    }
+
     RecordId RocksRecordStore::_nextId() {
         invariant(!_isOplog);
+        _loadNextIdNum();
+        if (_expireAfterSeconds > 0) {
+            // the expiry time lives in the high bits of the RecordId. We still need RecordIds to
+            // grow monotonically, so if the clock goes backwards we just keep counting
+            const uint64_t minId = static_cast<uint64_t>(
+                RocksTTL::minRecordIdForExpiry(RocksTTL::nowSecs() + _expireAfterSeconds).repr());
+            while (true) {
+                uint64_t current = _nextIdNum.load();
+                uint64_t next = std::max(current, minId);
+                if (_nextIdNum.compareAndSwap(current, next + 1) == current) {
+                    return RecordId(static_cast<int64_t>(next));
+                }
+            }
+        }
         return RecordId(_nextIdNum.fetchAndAdd(1));
     }
 
+    std::vector<std::string> RocksRecordStore::counterKeyPrefixes() {
+        return {std::string("\0\0\0\0", 4) + "datasize-",
+                std::string("\0\0\0\0", 4) + "numrecords-"};
+    }
+
+    RecordId RocksRecordStore::_firstVisibleRecordId() const {
+        if (_expireAfterSeconds <= 0) {
+            return RecordId();
+        }
+        return RocksTTL::firstVisibleRecordId(RocksTTL::nowSecs());
+    }
+
+    bool RocksRecordStore::_expiryAccounted(const RecordId& loc) const {
+        return _expireAfterSeconds > 0 &&
+            loc < RocksTTL::minRecordIdForExpiry(_ttlAccountedBeforeSecs->load());
+    }
+
+    int64_t RocksRecordStore::accountExpiredRecords(OperationContext* txn) {
+        invariant(_expireAfterSeconds > 0);
+        const long long accountedBefore = _ttlAccountedBeforeSecs->load();
+        // readers don't see anything that expired up to now
+        const long long expiredBefore = RocksTTL::nowSecs() + 1;
+        if (expiredBefore <= accountedBefore) {
+            return 0;
+        }
+
+        // Compaction leaves everything from accountedBefore on alone, so the snapshot has all
+        // of those documents, and only their live versions
+        auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(txn);
+        std::unique_ptr<rocksdb::Iterator> iter(
+            ru->NewIterator(_cfHandle, _prefix, false, _identStats.get()));
+        int64_t storage;
+        iter->Seek(_makeKey(RocksTTL::minRecordIdForExpiry(accountedBefore), &storage));
+        const RecordId end = RocksTTL::minRecordIdForExpiry(expiredBefore);
+        int64_t numRecords = 0;
+        int64_t dataSize = 0;
+        for (; iter->Valid() && _makeRecordId(iter->key()) < end; iter->Next()) {
+            ++numRecords;
+            dataSize += iter->value().size();
+        }
+        invariantRocksOK(iter->status());
+
+        LOG(1) << numRecords << " documents (" << dataSize << " bytes) of " << ns()
+               << " expired";
+        _changeNumRecords(txn, -numRecords);
+        _increaseDataSize(txn, -dataSize);
+        // committed with the counters, compaction can drop these documents from then on
+        ru->incrementCounter(_ttlAccountedKey, _ttlAccountedBeforeSecs.get(),
+                             expiredBefore - accountedBefore);
+        return numRecords;
+    }
+
     rocksdb::Slice RocksRecordStore::_makeKey(const RecordId& loc, int64_t* storage) {
         *storage = endian::nativeToBig(loc.repr());
         return rocksdb::Slice(reinterpret_cast<const char*>(storage), sizeof(*storage));
@@ -1004,7 +1323,12 @@ namespace mongo {
 
     bool RocksRecordStore::findRecord( OperationContext* txn,
                                        const RecordId& loc, RecordData* out ) const {
-        RecordData rd = _getDataFor(_db, _cfHandle, _prefix, txn, loc);
+        if (loc < _firstVisibleRecordId()) {
+            // expired, compaction will remove it eventually
+            return false;
+        }
+        RecordData rd =
+            _getDataFor(_db, _cfHandle, _prefix, txn, loc, _rowCache, _identStats.get());
         if ( rd.data() == NULL )
             return false;
         *out = rd;
@@ -1013,11 +1337,14 @@ namespace mongo {
 
     RecordData RocksRecordStore::_getDataFor(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cfHandle,
 					     const std::string& prefix,
-                                             OperationContext* txn, const RecordId& loc) {
+                                             OperationContext* txn, const RecordId& loc,
+                                             RocksRowCache* rowCache,
+                                             RocksIdentStats* identStats) {
         RocksRecoveryUnit* ru = RocksRecoveryUnit::getRocksRecoveryUnit(txn);
 
         std::string valueStorage;
-	auto status = ru->Get(cfHandle, _makePrefixedKey(prefix, loc), &valueStorage);
+        auto status = ru->GetWithRowCache(rowCache, cfHandle, _makePrefixedKey(prefix, loc),
+                                          &valueStorage, identStats);
         if (status.IsNotFound()) {
             return RecordData(nullptr, 0);
         }
@@ -1047,7 +1374,10 @@ namespace mongo {
             std::string prefix,
             std::shared_ptr<CappedVisibilityManager> cappedVisibilityManager,
             bool forward,
-            bool isCapped)
+            bool isCapped,
+            RecordId firstVisible,
+            RocksRowCache* rowCache,
+            std::shared_ptr<RocksIdentStats> identStats)
         : _txn(txn),
           _db(db),
 	  _cfHandle(cfHandle),
@@ -1055,7 +1385,10 @@ namespace mongo {
           _cappedVisibilityManager(cappedVisibilityManager),
           _forward(forward),
           _isCapped(isCapped),
-          _readUntilForOplog(RocksRecoveryUnit::getRocksRecoveryUnit(txn)->getOplogReadTill()) {
+          _readUntilForOplog(RocksRecoveryUnit::getRocksRecoveryUnit(txn)->getOplogReadTill()),
+          _firstVisible(firstVisible),
+          _rowCache(rowCache),
+          _identStats(std::move(identStats)) {
         _currentSequenceNumber =
           RocksRecoveryUnit::getRocksRecoveryUnit(txn)->snapshot()->GetSequenceNumber();
     }
@@ -1101,7 +1434,8 @@ namespace mongo {
             return _iterator.get();
         }
         _iterator.reset(RocksRecoveryUnit::getRocksRecoveryUnit(_txn)
-			->NewIterator(_cfHandle, _prefix, /* isOplog */ !_readUntilForOplog.isNull()));
+			->NewIterator(_cfHandle, _prefix, /* isOplog */ !_readUntilForOplog.isNull(),
+                                      _identStats.get()));
         if (!_needFirstSeek) {
             positionIterator();
         }
@@ -1119,7 +1453,11 @@ namespace mongo {
         if (!_skipNextAdvance) {
             if (_needFirstSeek) {
                 _needFirstSeek = false;
-                if (_forward) {
+                if (_forward && !_firstVisible.isNull()) {
+                    // skip over all expired records in one go
+                    int64_t locStorage;
+                    iter->Seek(RocksRecordStore::_makeKey(_firstVisible, &locStorage));
+                } else if (_forward) {
                     iter->SeekToFirst();
                 } else {
                     iter->SeekToLast();
@@ -1142,8 +1480,15 @@ namespace mongo {
         _skipNextAdvance = false;
         _iterator.reset();
 
-        rocksdb::Status status = RocksRecoveryUnit::getRocksRecoveryUnit(_txn)
-            ->Get(_cfHandle, _makePrefixedKey(_prefix, id), &_seekExactResult);
+        if (id < _firstVisible) {
+            _eof = true;
+            return {};
+        }
+
+        rocksdb::Status status =
+            RocksRecoveryUnit::getRocksRecoveryUnit(_txn)->GetWithRowCache(
+                _rowCache, _cfHandle, _makePrefixedKey(_prefix, id), &_seekExactResult,
+                _identStats.get());
 
         if (status.IsNotFound()) {
             _eof = true;
@@ -1166,7 +1511,9 @@ namespace mongo {
     bool RocksRecordStore::Cursor::restore() {
         auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(_txn);
         if (!_iterator.get() || _currentSequenceNumber != ru->snapshot()->GetSequenceNumber()) {
-            _iterator.reset(ru->NewIterator(_cfHandle, _prefix, /* isOplog */ !_readUntilForOplog.isNull()));
+            _iterator.reset(ru->NewIterator(_cfHandle, _prefix,
+                                            /* isOplog */ !_readUntilForOplog.isNull(),
+                                            _identStats.get()));
             _currentSequenceNumber = ru->snapshot()->GetSequenceNumber();
         }
 
@@ -1199,6 +1546,18 @@ namespace mongo {
         _eof = false;
         _lastLoc = _makeRecordId(_iterator->key());
 
+        if (_lastLoc < _firstVisible) {
+            if (!_forward) {
+                // records are ordered by expiry, everything before this one is expired as well
+                _eof = true;
+                return {};
+            }
+            // we got here by restoring or seeking into the expired range
+            int64_t locStorage;
+            _iterator->Seek(RocksRecordStore::_makeKey(_firstVisible, &locStorage));
+            return curr();
+        }
+
         if (_cappedVisibilityManager && _forward) {  // isCapped and forward?
             if (_readUntilForOplog.isNull()) {
                 // this is the normal capped case
@@ -43,6 +43,7 @@
 #include "mongo/db/storage/capped_callback.h"
 #include "mongo/db/storage/record_store.h"
 #include "mongo/platform/atomic_word.h"
+#include "mongo/stdx/chrono.h"
 #include "mongo/stdx/condition_variable.h"
 #include "mongo/stdx/mutex.h"
 #include "mongo/stdx/thread.h"
@@ -57,9 +58,13 @@ namespace rocksdb {
 
 namespace mongo {
 
+    class RocksBulkLoader;
     class RocksCounterManager;
     class RocksDurabilityManager;
+    class RocksIdentStats;
     class RocksRecoveryUnit;
+    class RocksPrefixStatsCache;
+    class RocksRowCache;
     class RocksOplogKeyTracker;
     class RocksRecordStore;
 
@@ -103,6 +108,28 @@ namespace mongo {
         stdx::thread _oplogJournalThread;
     };
 
+    /**
+     * Wakes up the background thread deleting from a capped collection once inserts put the
+     * collection far enough over its cap, so that it doesn't have to poll. A notification sent
+     * while nobody waits is kept for the next wait(). Shared with the thread, which may outlive
+     * the record store
+     */
+    class CappedDeleterSignal {
+    public:
+        void notify();
+        // true if notified, false on timeout
+        bool wait(stdx::chrono::milliseconds timeout);
+        // notify() calls listener instead of waking up wait(), e.g. to queue the collection for
+        // a pool of deleters. Must be set before the first notify()
+        void setListener(std::function<void()> listener) { _listener = std::move(listener); }
+
+    private:
+        stdx::mutex _mutex;
+        stdx::condition_variable _cv;
+        bool _notified = false;
+        std::function<void()> _listener;
+    };
+
     class RocksRecordStore : public RecordStore {
     public:
         RocksRecordStore(StringData ns, StringData id, rocksdb::DB* db,
@@ -198,16 +225,84 @@ namespace mongo {
         bool cappedMaxDocs() const { invariant(_isCapped); return _cappedMaxDocs; }
         bool cappedMaxSize() const { invariant(_isCapped); return _cappedMaxSize; }
         bool isOplog() const { return _isOplog; }
-	void setCFHandle(rocksdb::ColumnFamilyHandle* cfHandle) {
+
+        // prefixes of the dataSize and numRecords counter keys of all record stores
+        static std::vector<std::string> counterKeyPrefixes();
+
+        /**
+         * Turns on engine-native TTL (see RocksTTL). Must be called before the record store is
+         * used.
+         */
+        void setExpireAfterSeconds(int64_t expireAfterSeconds);
+        int64_t expireAfterSeconds() const { return _expireAfterSeconds; }
+
+        /**
+         * Subtracts the documents that expired since the last call from numRecords and dataSize,
+         * as part of txn's unit of work. Only live documents are counted, and each one only once:
+         * compaction doesn't drop expired documents before they are accounted for here (see
+         * ttlAccountedBeforeSecs()). Called periodically by a background thread, one call at a
+         * time. Returns the number of documents accounted for.
+         */
+        int64_t accountExpiredRecords(OperationContext* txn);
+        // documents that expired before this (seconds since epoch) are taken out of the counters
+        std::shared_ptr<const std::atomic<long long>> ttlAccountedBeforeSecs() const {
+            return _ttlAccountedBeforeSecs;
+        }
+
+        /**
+         * Bulk load, see RocksEngine::beginBulkLoad(). Until stopBulkLoad(), inserted documents
+         * are added to a RocksBulkLoader with files in dir when their unit of work commits,
+         * instead of going into its write batch. numRecords and dataSize don't change until the
+         * engine has ingested the loader and calls addBulkLoadedRecords(). Not supported for
+         * capped collections.
+         */
+        Status beginBulkLoad(const std::string& dir);
+        // nullptr if the collection isn't bulk loading
+        std::shared_ptr<RocksBulkLoader> stopBulkLoad();
+        void addBulkLoadedRecords(long long numRecords, long long dataSize);
+        bool isBulkLoading() const { return _bulkLoading.load(); }
+        const std::string& getIdent() const { return _ident; }
+
+        // counter key of the TTL accounting watermark of the collection ident
+        static std::string ttlAccountedKey(StringData ident);
+
+        // Counts numRecords and dataSize again from the documents, after an interrupted bulk
+        // load left them behind. Reads the whole collection
+        void recomputeStats();
+
+        // storageSize() comes from SST properties when set, otherwise from dataSize
+        void setPrefixStats(RocksPrefixStatsCache* prefixStats) { _prefixStats = prefixStats; }
+        // point reads go through rowCache when set. Must be called before the record store is
+        // used
+        void setRowCache(RocksRowCache* rowCache) {
+            invariant(!_isOplog);
+            _rowCache = rowCache;
+        }
+        // Capped collections created with a key tracker keep the size of every document under
+        // the next prefix, like the oplog does (see RocksOplogKeyTracker), so that capped deletes
+        // don't have to read the documents. Must be called before the record store is used
+        void enableCappedKeyTracker();
+        // whether the capped callback needs the documents it's told about, it only uses them to
+        // remove their index entries. Only matters with the key tracker
+        void setCappedDocumentsNeeded(bool needed) { _cappedDocumentsNeeded.store(needed); }
+	// fifoCompaction: the column family uses FIFO compaction, see RocksEngine::_oplogCFOptions
+	void setCFHandle(rocksdb::ColumnFamilyHandle* cfHandle, bool fifoCompaction = false) {
 	    stdx::lock_guard<stdx::mutex> lk(_cfMutex);
             if (_cfHandle == nullptr) {
 		_cfHandle = cfHandle;
+		_fifoCompaction = fifoCompaction;
 	    }
 	}
 	
         int64_t cappedDeleteAsNeeded(OperationContext* txn, const RecordId& justInserted);
         int64_t cappedDeleteAsNeeded_inlock(OperationContext* txn, const RecordId& justInserted);
         boost::timed_mutex& cappedDeleterMutex() { return _cappedDeleterMutex; }
+        // nullptr if not capped
+        std::shared_ptr<CappedDeleterSignal> cappedDeleterSignal() const {
+            return _cappedDeleterSignal;
+        }
+        // true while the collection is over its cap by enough to wake up the deleter
+        bool cappedDeleterBehind() const;
 
         static rocksdb::Comparator* newRocksCollectionComparator();
 
@@ -222,7 +317,9 @@ namespace mongo {
         public:
             Cursor(OperationContext* txn, rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cfHandle,
 		   std::string prefix, std::shared_ptr<CappedVisibilityManager> cappedVisibilityManager,
-                   bool forward, bool _isCapped);
+                   bool forward, bool _isCapped, RecordId firstVisible = RecordId(),
+                   RocksRowCache* rowCache = nullptr,
+                   std::shared_ptr<RocksIdentStats> identStats = nullptr);
 
             boost::optional<Record> next() final;
             boost::optional<Record> seekExact(const RecordId& id) final;
@@ -253,6 +350,12 @@ namespace mongo {
             rocksdb::SequenceNumber _currentSequenceNumber;
             const RecordId _readUntilForOplog;
             RecordId _lastLoc;
+            // records below this are expired (engine-native TTL) and are hidden. Null otherwise
+            const RecordId _firstVisible;
+            // can be nullptr
+            RocksRowCache* _rowCache;  // not owned
+            // can be nullptr
+            std::shared_ptr<RocksIdentStats> _identStats;
             std::unique_ptr<rocksdb::Iterator> _iterator;
             std::string _seekExactResult;
             void positionIterator();
@@ -263,10 +366,23 @@ namespace mongo {
 
         static RecordData _getDataFor(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cfHandle,
 				      const std::string& prefix,
-                                      OperationContext* txn, const RecordId& loc);
+                                      OperationContext* txn, const RecordId& loc,
+                                      RocksRowCache* rowCache = nullptr,
+                                      RocksIdentStats* identStats = nullptr);
 
         RecordId _nextId();
+        // Finds the highest RecordId in the collection. Called once, opening a collection with a
+        // lot of data or a lot of deletes at the end can take a while
+        void _loadNextIdNum();
+        // first RecordId that is not expired right now. Null if TTL is not enabled
+        RecordId _firstVisibleRecordId() const;
+        // true if loc expired and accountExpiredRecords() already took it out of the counters
+        bool _expiryAccounted(const RecordId& loc) const;
         bool cappedAndNeedDelete(long long dataSizeDelta, long long numRecordsDelta) const;
+        // called by inserts that put the collection at least _cappedDeleterWakeupSize over its cap
+        void _notifyCappedDeleter(long long overshoot);
+        // how long the deleter has been behind since it was woken up, 0 if it caught up
+        long long _cappedDeleterLagMillis() const;
 
         // The use of this function requires that the passed in storage outlives the returned Slice
         static rocksdb::Slice _makeKey(const RecordId& loc, int64_t* storage);
@@ -289,13 +405,39 @@ namespace mongo {
         mutable boost::timed_mutex _cappedDeleterMutex;  // see comment in ::cappedDeleteAsNeeded
         int _cappedDeleteCheckCount;      // see comment in ::cappedDeleteAsNeeded
 
+        // Only used with _hasBackgroundThread. Inserts wake up the deleter through
+        // _cappedDeleterSignal once the collection is _cappedDeleterWakeupSize over its cap.
+        // _cappedDeleterBehindSinceMillis is when that happened, 0 once the deleter caught up
+        const int64_t _cappedDeleterWakeupSize;
+        std::shared_ptr<CappedDeleterSignal> _cappedDeleterSignal;
+        std::atomic<long long> _cappedDeleterBehindSinceMillis{0};
+        std::atomic<long long> _cappedMaxOvershoot{0};
+        std::atomic<long long> _cappedDeleterWakeups{0};
+        std::atomic<long long> _cappedDeleterPasses{0};
+        std::atomic<long long> _cappedBackPressureWaits{0};
+        std::atomic<long long> _cappedBackPressureMicros{0};
+        // a deleter woken up this long ago that still didn't catch up is behind, and inserts get
+        // back-pressure
+        static const int kCappedDeleterMaxLagMillis = 1000;
+        // Docs removed per cappedDeleteAsNeeded_inlock() call. Each call costs the background
+        // thread its locks and a WriteUnitOfWork, so the batch grows with the overshoot up to
+        // the max, which bounds the size of the write batch
+        static const int64_t kCappedDeleteMinBatch = 20000;
+        static const int64_t kCappedDeleteMaxBatch = 200000;
+
         const bool _isOplog;
-        // nullptr iff _isOplog == false
+        // nullptr unless _isOplog or enableCappedKeyTracker() was called
         RocksOplogKeyTracker* _oplogKeyTracker;
+        std::atomic<bool> _cappedDocumentsNeeded{true};
 	
 	mutable stdx::mutex _cfMutex;
 	rocksdb::ColumnFamilyHandle* _cfHandle;
-        // keep track of when we compacted oplog last time. only valid when _isOplog == true.
+	bool _fifoCompaction = false;
+        RocksPrefixStatsCache* _prefixStats = nullptr;  // not owned
+        RocksRowCache* _rowCache = nullptr;             // not owned
+        // reads and writes of this collection, shared with its cursors
+        std::shared_ptr<RocksIdentStats> _identStats;
+        // keep track of when we compacted oplog last time. only valid with _oplogKeyTracker.
         // Protected by _cappedDeleterMutex.
         Timer _oplogSinceLastCompaction;
         // compact oplog every 30 min
@@ -315,13 +457,26 @@ namespace mongo {
         std::shared_ptr<CappedVisibilityManager> _cappedVisibilityManager;
 
         std::string _ident;
+        // > 0 iff engine-native TTL is enabled
+        int64_t _expireAfterSeconds = 0;
+        // only with TTL, persisted under _ttlAccountedKey together with the counters
+        std::shared_ptr<std::atomic<long long>> _ttlAccountedBeforeSecs;
+        const std::string _ttlAccountedKey;
+        // loaded by _loadNextIdNum() on the first insert, or on open for capped collections
         AtomicUInt64 _nextIdNum;
+        std::atomic<bool> _nextIdNumLoaded{false};
+        stdx::mutex _nextIdNumMutex;
         std::atomic<long long> _dataSize;
         std::atomic<long long> _numRecords;
 
         const std::string _dataSizeKey;
         const std::string _numRecordsKey;
 
+        // set between beginBulkLoad() and stopBulkLoad(), _bulkLoadMutex protects _bulkLoader
+        std::atomic<bool> _bulkLoading{false};
+        stdx::mutex _bulkLoadMutex;
+        std::shared_ptr<RocksBulkLoader> _bulkLoader;
+
         bool _shuttingDown;
         bool _hasBackgroundThread;
     };
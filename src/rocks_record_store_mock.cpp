@@ -44,6 +44,20 @@ bool RocksEngine::initRsOplogBackgroundThread(StringData ns) {
     return NamespaceString::oplog(ns);
 }
 
+// static
+bool RocksEngine::initCappedDeleter(StringData ns,
+                                    const std::shared_ptr<CappedDeleterSignal>& signal) {
+    return false;
+}
+
+// static
+bool RocksEngine::initTTLMonitor(StringData ident, StringData ns) {
+    return false;
+}
+
+// static
+void RocksEngine::stopTTLMonitor(StringData ident) {}
+
 MONGO_INITIALIZER(SetGlobalEnvironment)(InitializerContext* context) {
     setGlobalServiceContext(stdx::make_unique<ServiceContextNoop>());
     return Status::OK();
@@ -31,6 +31,8 @@
 
 #include "mongo/platform/basic.h"
 
+#include <deque>
+#include <map>
 #include <set>
 #include <mutex>
 
@@ -39,6 +41,7 @@
 #include "mongo/db/catalog/database.h"
 #include "mongo/db/client.h"
 #include "mongo/db/concurrency/d_concurrency.h"
+#include "mongo/db/concurrency/write_conflict_exception.h"
 #include "mongo/db/db_raii.h"
 #include "mongo/db/service_context.h"
 #include "mongo/db/namespace_string.h"
@@ -46,8 +49,10 @@
 #include "mongo/util/background.h"
 #include "mongo/util/exit.h"
 #include "mongo/util/log.h"
+#include "mongo/util/timer.h"
 
 #include "rocks_engine.h"
+#include "rocks_global_options.h"
 #include "rocks_record_store.h"
 #include "rocks_recovery_unit.h"
 
@@ -58,6 +63,85 @@ namespace mongo {
         std::set<NamespaceString> _backgroundThreadNamespaces;
         stdx::mutex _backgroundThreadMutex;
 
+        // how often capped collections that are behind, but had nothing to delete, are retried
+        const int kCappedDeleterRetryMillis = 100;
+
+        // idents of the collections with engine-native TTL, and the namespace each was last
+        // opened as. See RocksTTLMonitorThread
+        std::map<std::string, NamespaceString> _ttlIdents;
+        bool _ttlMonitorStarted = false;
+        const int kTTLMonitorIntervalSecs = 10;
+
+        /**
+         * Deletes excess documents of the capped collection ns in one pass. Errors are fatal
+         * only for the oplog. Other collections are left alone until an insert queues them
+         * again, and write conflicts are retried like a pass that couldn't delete anything.
+         * @param signal set to the collection's CappedDeleterSignal, if there is a collection
+         * @param behind set if the collection is still over its cap after the pass
+         * @return Number of documents deleted.
+         */
+        int64_t deleteExcessDocuments(const NamespaceString& ns,
+                                      std::shared_ptr<CappedDeleterSignal>* signal,
+                                      bool* behind) {
+            if (!getGlobalServiceContext()->getGlobalStorageEngine()) {
+                LOG(1) << "no global storage engine yet";
+                return 0;
+            }
+
+            const auto txn = cc().makeOperationContext();
+
+            try {
+                AutoGetDb autoDb(txn.get(), ns.db(), MODE_IX);
+                Database* db = autoDb.getDb();
+                if (!db) {
+                    LOG(2) << "no database " << ns.db() << " yet";
+                    return 0;
+                }
+
+                Lock::CollectionLock collectionLock(txn->lockState(), ns.ns(), MODE_IX);
+                Collection* collection = db->getCollection(ns);
+                if (!collection) {
+                    LOG(2) << "no collection " << ns;
+                    return 0;
+                }
+
+                OldClientContext ctx(txn.get(), ns.ns(), false);
+                RocksRecordStore* rs =
+                    checked_cast<RocksRecordStore*>(collection->getRecordStore());
+                WriteUnitOfWork wuow(txn.get());
+                stdx::lock_guard<boost::timed_mutex> lock(rs->cappedDeleterMutex());
+                *signal = rs->cappedDeleterSignal();
+                int64_t removed = rs->cappedDeleteAsNeeded_inlock(txn.get(), RecordId::max());
+                wuow.commit();
+                *behind = rs->cappedDeleterBehind();
+                return removed;
+            }
+            catch (const WriteConflictException&) {
+                LOG(1) << "write conflict deleting from capped collection " << ns
+                       << ", retrying";
+                *behind = true;
+                return 0;
+            }
+            catch (const std::exception& e) {
+                if (ns.isOplog()) {
+                    severe() << "error deleting from capped collection " << ns << ": "
+                             << redact(e.what());
+                    fassertFailedNoTrace(!"error in RocksRecordStoreThread");
+                }
+                error() << "error deleting from capped collection " << ns << ": "
+                        << redact(e.what()) << ", retrying after the next insert";
+            }
+            catch (...) {
+                if (ns.isOplog()) {
+                    fassertFailedNoTrace(!"unknown error in RocksRecordStoreThread");
+                }
+                error() << "unknown error deleting from capped collection " << ns
+                        << ", retrying after the next insert";
+            }
+            *behind = false;
+            return 0;
+        }
+
         class RocksRecordStoreThread : public BackgroundJob {
         public:
             RocksRecordStoreThread(const NamespaceString& ns)
@@ -69,63 +153,129 @@ namespace mongo {
                 return _name;
             }
 
-            /**
-             * @return Number of documents deleted.
-             */
-            int64_t _deleteExcessDocuments() {
-                if (!getGlobalServiceContext()->getGlobalStorageEngine()) {
-                    LOG(1) << "no global storage engine yet";
-                    return 0;
+            virtual void run() {
+                Client::initThread(_name.c_str());
+
+                while (!globalInShutdownDeprecated()) {
+                    std::shared_ptr<CappedDeleterSignal> signal;
+                    bool behind = false;
+                    int64_t removed = deleteExcessDocuments(_ns, &signal, &behind);
+                    LOG(2) << "RocksRecordStoreThread deleted " << removed;
+                    if (behind && removed > 0) {
+                        // still over the cap, go on with the next batch right away
+                        continue;
+                    }
+                    if (!signal) {
+                        // no collection yet
+                        sleepmillis(1000);
+                        continue;
+                    }
+                    // Inserts wake us up once the collection is far enough over its cap. The
+                    // timeout covers anything they missed. If we're behind but couldn't delete
+                    // anything, the oldest records aren't committed yet, so retry soon
+                    signal->wait(stdx::chrono::milliseconds(behind ? 100 : 1000));
                 }
 
-                const auto txn = cc().makeOperationContext();
+                log() << "shutting down";
+            }
 
-                try {
-                    AutoGetDb autoDb(txn.get(), _ns.db(), MODE_IX);
-                    Database* db = autoDb.getDb();
-                    if (!db) {
-                        LOG(2) << "no local database yet";
-                        return 0;
-                    }
+        private:
+            NamespaceString _ns;
+            std::string _name;
+        };
 
-                    Lock::CollectionLock collectionLock(txn->lockState(), _ns.ns(), MODE_IX);
-                    Collection* collection = db->getCollection(_ns);
-                    if (!collection) {
-                        LOG(2) << "no collection " << _ns;
-                        return 0;
+        /**
+         * Queue of the capped collections (other than the oplog) that are over their cap, served
+         * by a few RocksCappedDeleterThreads shared by all of them. Inserts queue their
+         * collection through its CappedDeleterSignal. A thread runs one pass on it and queues
+         * it again while it's behind, so that a collection far over its cap doesn't hold up
+         * the others.
+         */
+        class RocksCappedDeleterQueue {
+        public:
+            void push(const NamespaceString& ns) {
+                {
+                    stdx::lock_guard<stdx::mutex> lk(_mutex);
+                    if (!_queued.insert(ns).second) {
+                        return;
                     }
-
-                    OldClientContext ctx(txn.get(), _ns.ns(), false);
-                    RocksRecordStore* rs =
-                        checked_cast<RocksRecordStore*>(collection->getRecordStore());
-                    WriteUnitOfWork wuow(txn.get());
-                    stdx::lock_guard<boost::timed_mutex> lock(rs->cappedDeleterMutex());
-                    int64_t removed = rs->cappedDeleteAsNeeded_inlock(txn.get(), RecordId::max());
-                    wuow.commit();
-                    return removed;
+                    _queue.push_back(ns);
                 }
-                catch (const std::exception& e) {
-                    severe() << "error in RocksRecordStoreThread: " << redact(e.what());
-                    fassertFailedNoTrace(!"error in RocksRecordStoreThread");
+                _cv.notify_one();
+            }
+
+            // for collections that are behind but whose oldest records aren't committed yet
+            void pushLater(const NamespaceString& ns) {
+                stdx::lock_guard<stdx::mutex> lk(_mutex);
+                _later.insert(ns);
+            }
+
+            // false if there is nothing to delete from for a while
+            bool pop(NamespaceString* ns) {
+                stdx::unique_lock<stdx::mutex> lk(_mutex);
+                _cv.wait_for(lk, stdx::chrono::milliseconds(kCappedDeleterRetryMillis),
+                             [this] { return !_queue.empty(); });
+                if (_sinceRetry.millis() >= kCappedDeleterRetryMillis) {
+                    for (const auto& later : _later) {
+                        if (_queued.insert(later).second) {
+                            _queue.push_back(later);
+                        }
+                    }
+                    _later.clear();
+                    _sinceRetry.reset();
                 }
-                catch (...) {
-                    fassertFailedNoTrace(!"unknown error in RocksRecordStoreThread");
+                if (_queue.empty()) {
+                    return false;
                 }
+                *ns = _queue.front();
+                _queue.pop_front();
+                _queued.erase(*ns);
+                return true;
+            }
+
+        private:
+            stdx::mutex _mutex;
+            stdx::condition_variable _cv;
+            std::deque<NamespaceString> _queue;
+            std::set<NamespaceString> _queued;
+            std::set<NamespaceString> _later;
+            Timer _sinceRetry;
+        };
+
+        // never deleted, the threads may outlive everything else
+        RocksCappedDeleterQueue* _cappedDeleterQueue = nullptr;
+
+        class RocksCappedDeleterThread : public BackgroundJob {
+        public:
+            RocksCappedDeleterThread(RocksCappedDeleterQueue* queue, int id)
+                : BackgroundJob(true /* deleteSelf */), _queue(queue) {
+                _name = std::string("RocksCappedDeleterThread") + std::to_string(id);
+            }
+
+            virtual std::string name() const {
+                return _name;
             }
 
             virtual void run() {
                 Client::initThread(_name.c_str());
 
                 while (!globalInShutdownDeprecated()) {
-                    int64_t removed = _deleteExcessDocuments();
-                    LOG(2) << "RocksRecordStoreThread deleted " << removed;
-                    if (removed == 0) {
-                        // If we removed 0 documents, sleep a bit in case we're on a laptop
-                        // or something to be nice.
-                        sleepmillis(1000);
+                    NamespaceString ns;
+                    if (!_queue->pop(&ns)) {
+                        continue;
+                    }
+                    std::shared_ptr<CappedDeleterSignal> signal;
+                    bool behind = false;
+                    int64_t removed = deleteExcessDocuments(ns, &signal, &behind);
+                    LOG(2) << _name << " deleted " << removed << " from " << ns;
+                    if (!signal || !behind) {
+                        // dropped, or caught up until an insert queues it again
+                        continue;
+                    }
+                    if (removed > 0) {
+                        _queue->push(ns);
                     } else {
-                        // wake up every 100ms
-                        sleepmillis(100);
+                        _queue->pushLater(ns);
                     }
                 }
 
@@ -133,10 +283,77 @@ namespace mongo {
             }
 
         private:
-            NamespaceString _ns;
+            RocksCappedDeleterQueue* _queue;
             std::string _name;
         };
 
+        /**
+         * Takes documents that expired out of the counters of the collections with engine-native
+         * TTL. Compaction only removes them after that. Collections are tracked by ident until
+         * they're dropped. One that isn't open under its namespace (its database isn't open yet,
+         * or it's being renamed and registers again under the new name) is retried next round.
+         */
+        class RocksTTLMonitorThread : public BackgroundJob {
+        public:
+            RocksTTLMonitorThread() : BackgroundJob(true /* deleteSelf */) {}
+
+            virtual std::string name() const {
+                return "RocksTTLMonitor";
+            }
+
+            virtual void run() {
+                Client::initThread(name().c_str());
+
+                while (!globalInShutdownDeprecated()) {
+                    sleepsecs(kTTLMonitorIntervalSecs);
+                    std::map<std::string, NamespaceString> idents;
+                    {
+                        stdx::lock_guard<stdx::mutex> lock(_backgroundThreadMutex);
+                        idents = _ttlIdents;
+                    }
+                    for (const auto& ident : idents) {
+                        if (globalInShutdownDeprecated()) {
+                            break;
+                        }
+                        _accountExpiredRecords(ident.first, ident.second);
+                    }
+                }
+
+                log() << "shutting down";
+            }
+
+        private:
+            void _accountExpiredRecords(const std::string& ident, const NamespaceString& ns) {
+                const auto txn = cc().makeOperationContext();
+                try {
+                    AutoGetDb autoDb(txn.get(), ns.db(), MODE_IX);
+                    Database* db = autoDb.getDb();
+                    if (!db) {
+                        LOG(2) << name() << ": no database " << ns.db() << " yet";
+                        return;
+                    }
+                    Lock::CollectionLock collectionLock(txn->lockState(), ns.ns(), MODE_IX);
+                    Collection* collection = db->getCollection(ns);
+                    RocksRecordStore* rs = collection
+                        ? checked_cast<RocksRecordStore*>(collection->getRecordStore())
+                        : nullptr;
+                    if (!rs || rs->getIdent() != ident) {
+                        LOG(2) << name() << ": " << ident << " isn't open as " << ns;
+                        return;
+                    }
+                    WriteUnitOfWork wuow(txn.get());
+                    int64_t expired = rs->accountExpiredRecords(txn.get());
+                    wuow.commit();
+                    LOG(2) << name() << " accounted for " << expired << " expired documents of "
+                           << ns;
+                } catch (const std::exception& e) {
+                    // the documents stay until the next round
+                    warning() << "error accounting for expired documents of " << ns << ": "
+                              << redact(e.what());
+                }
+            }
+        };
+
     }  // namespace
 
     // static
@@ -165,4 +382,62 @@ namespace mongo {
         return true;
     }
 
+    // static
+    bool RocksEngine::initCappedDeleter(StringData ns,
+                                        const std::shared_ptr<CappedDeleterSignal>& signal) {
+        if (NamespaceString::oplog(ns) || rocksGlobalOptions.cappedDeleterThreads == 0) {
+            return false;
+        }
+
+        if (storageGlobalParams.repair) {
+            LOG(1) << "not deleting from " << ns << " in the background because we are in repair";
+            return false;
+        }
+
+        RocksCappedDeleterQueue* queue;
+        {
+            stdx::lock_guard<stdx::mutex> lock(_backgroundThreadMutex);
+            if (!_cappedDeleterQueue) {
+                log() << "Starting " << rocksGlobalOptions.cappedDeleterThreads
+                      << " RocksCappedDeleterThreads";
+                _cappedDeleterQueue = new RocksCappedDeleterQueue();
+                for (int i = 0; i < rocksGlobalOptions.cappedDeleterThreads; ++i) {
+                    BackgroundJob* backgroundThread =
+                        new RocksCappedDeleterThread(_cappedDeleterQueue, i);
+                    backgroundThread->go();
+                }
+            }
+            queue = _cappedDeleterQueue;
+        }
+        NamespaceString nss(ns);
+        signal->setListener([queue, nss] { queue->push(nss); });
+        return true;
+    }
+
+    // static
+    bool RocksEngine::initTTLMonitor(StringData ident, StringData ns) {
+        if (storageGlobalParams.repair || storageGlobalParams.readOnly) {
+            LOG(1) << "not accounting for expired documents of " << ns
+                   << " because we are in repair or read-only";
+            return false;
+        }
+
+        stdx::lock_guard<stdx::mutex> lock(_backgroundThreadMutex);
+        // a rename opens the collection again under its new name
+        _ttlIdents[ident.toString()] = NamespaceString(ns);
+        if (!_ttlMonitorStarted) {
+            log() << "Starting RocksTTLMonitor";
+            BackgroundJob* backgroundThread = new RocksTTLMonitorThread();
+            backgroundThread->go();
+            _ttlMonitorStarted = true;
+        }
+        return true;
+    }
+
+    // static
+    void RocksEngine::stopTTLMonitor(StringData ident) {
+        stdx::lock_guard<stdx::mutex> lock(_backgroundThreadMutex);
+        _ttlIdents.erase(ident.toString());
+    }
+
 }  // namespace mongo
@@ -42,11 +42,14 @@
 #include "mongo/db/storage/record_store_test_harness.h"
 #include "mongo/unittest/unittest.h"
 #include "mongo/unittest/temp_dir.h"
+#include "mongo/util/time_support.h"
 
 #include "rocks_record_store.h"
 #include "rocks_recovery_unit.h"
 #include "rocks_transaction.h"
 #include "rocks_snapshot_manager.h"
+#include "rocks_table_properties.h"
+#include "rocks_ttl.h"
 
 namespace mongo {
 
@@ -54,10 +57,10 @@ namespace mongo {
 
     class RocksRecordStoreHarnessHelper final : public RecordStoreHarnessHelper {
     public:
-        RocksRecordStoreHarnessHelper() : _tempDir(_testNamespace) {
+        explicit RocksRecordStoreHarnessHelper(rocksdb::Options options = rocksdb::Options())
+            : _tempDir(_testNamespace) {
             boost::filesystem::remove_all(_tempDir.path());
             rocksdb::DB* db;
-            rocksdb::Options options;
             options.create_if_missing = true;
             auto s = rocksdb::DB::Open(options, _tempDir.path(), &db);
             ASSERT(s.ok());
@@ -69,9 +72,10 @@ namespace mongo {
         virtual std::unique_ptr<RecordStore> newNonCappedRecordStore() {
           return newNonCappedRecordStore("foo.bar");
         }
-        std::unique_ptr<RecordStore> newNonCappedRecordStore(const std::string& ns) {
+        std::unique_ptr<RecordStore> newNonCappedRecordStore(const std::string& ns,
+                                                             const std::string& prefix = "prefix") {
             return stdx::make_unique<RocksRecordStore>(ns, "1", _db.get(), _counterManager.get(),
-                                                       _durabilityManager.get(), "prefix");
+                                                       _durabilityManager.get(), prefix);
         }
 
         std::unique_ptr<RecordStore> newCappedRecordStore(int64_t cappedMaxSize,
@@ -90,13 +94,16 @@ namespace mongo {
         std::unique_ptr<RecoveryUnit> newRecoveryUnit() final {
             return stdx::make_unique<RocksRecoveryUnit>(&_transactionEngine, &_snapshotManager,
                                                         _db.get(), _counterManager.get(), nullptr,
-                                                        _durabilityManager.get(), true);
+                                                        _durabilityManager.get(), true,
+                                                        nullptr);
         }
 
         bool supportsDocLocking() final {
           return true;
         }
 
+        rocksdb::DB* getDB() { return _db.get(); }
+
     private:
         string _testNamespace = "mongo-rocks-record-store-test";
         unittest::TempDir _tempDir;
@@ -455,6 +462,295 @@ namespace mongo {
         }
     }
 
+    TEST(RocksRecordStoreTest, ExpireAfterSecondsHidesExpiredRecords) {
+        RocksRecordStoreHarnessHelper harnessHelper;
+        std::unique_ptr<RecordStore> rs(harnessHelper.newNonCappedRecordStore("a.ttl"));
+        RocksRecordStore* rrs = dynamic_cast<RocksRecordStore*>(rs.get());
+        rrs->setExpireAfterSeconds(1);
+
+        RecordId first, second;
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            first = rs->insertRecord(opCtx.get(), "a", 2, false).getValue();
+            second = rs->insertRecord(opCtx.get(), "b", 2, false).getValue();
+            uow.commit();
+        }
+
+        // expiry is encoded in the RecordId and RecordIds keep growing
+        ASSERT_LT(first, second);
+        ASSERT_GTE(RocksTTL::expireAtSecs(first), RocksTTL::nowSecs());
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            auto cursor = rs->getCursor(opCtx.get());
+            ASSERT(cursor->next());
+            ASSERT(cursor->next());
+            ASSERT(!cursor->next());
+        }
+
+        RocksTTL::advanceClockForTest(3);
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            RecordData data;
+            ASSERT_FALSE(rs->findRecord(opCtx.get(), first, &data));
+            ASSERT(!rs->getCursor(opCtx.get(), true)->next());
+            ASSERT(!rs->getCursor(opCtx.get(), false)->next());
+            ASSERT(!rs->getCursor(opCtx.get())->seekExact(second));
+        }
+    }
+
+    TEST(RocksRecordStoreTest, ExpiredRecordsAreCountedOnce) {
+        RocksRecordStoreHarnessHelper harnessHelper;
+        std::unique_ptr<RecordStore> rs(harnessHelper.newNonCappedRecordStore("a.ttlcount"));
+        RocksRecordStore* rrs = dynamic_cast<RocksRecordStore*>(rs.get());
+        rrs->setExpireAfterSeconds(10);
+
+        RecordId deleted, updated, expired;
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            deleted = rs->insertRecord(opCtx.get(), "a", 2, false).getValue();
+            updated = rs->insertRecord(opCtx.get(), "b", 2, false).getValue();
+            expired = rs->insertRecord(opCtx.get(), "c", 2, false).getValue();
+            uow.commit();
+        }
+        {
+            // neither the deleted document nor the old version of the updated one is counted
+            // again once they expire
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            rs->deleteRecord(opCtx.get(), deleted);
+            ASSERT_OK(rs->updateRecord(opCtx.get(), updated, "bbbb", 5, false, nullptr));
+            uow.commit();
+        }
+
+        RocksTTL::advanceClockForTest(20);
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            ASSERT_EQUALS(2, rs->numRecords(opCtx.get()));
+            ASSERT_EQUALS(7, rs->dataSize(opCtx.get()));
+            WriteUnitOfWork uow(opCtx.get());
+            ASSERT_EQUALS(2, rrs->accountExpiredRecords(opCtx.get()));
+            uow.commit();
+        }
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            ASSERT_EQUALS(0, rs->numRecords(opCtx.get()));
+            ASSERT_EQUALS(0, rs->dataSize(opCtx.get()));
+            WriteUnitOfWork uow(opCtx.get());
+            ASSERT_EQUALS(0, rrs->accountExpiredRecords(opCtx.get()));
+            // already accounted for
+            rs->deleteRecord(opCtx.get(), expired);
+            uow.commit();
+        }
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            ASSERT_EQUALS(0, rs->numRecords(opCtx.get()));
+            ASSERT_EQUALS(0, rs->dataSize(opCtx.get()));
+            ASSERT_GT(rrs->ttlAccountedBeforeSecs()->load(), RocksTTL::expireAtSecs(expired));
+        }
+    }
+
+    TEST(RocksRecordStoreTest, IoStatsCountReadsAndWrites) {
+        RocksRecordStoreHarnessHelper harnessHelper;
+        std::unique_ptr<RecordStore> rs(harnessHelper.newNonCappedRecordStore("a.io"));
+
+        RecordId loc;
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            loc = rs->insertRecord(opCtx.get(), "abc", 4, false).getValue();
+            uow.commit();
+        }
+        {
+            // rolled back writes are not counted
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            rs->insertRecord(opCtx.get(), "def", 4, false).getValue();
+        }
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            RecordData data;
+            ASSERT(rs->findRecord(opCtx.get(), loc, &data));
+            {
+                // cursors charge their reads when they are destroyed
+                auto cursor = rs->getCursor(opCtx.get());
+                ASSERT(cursor->next());
+                ASSERT(!cursor->next());
+            }
+
+            BSONObjBuilder builder;
+            rs->appendCustomStats(opCtx.get(), &builder, 1);
+            BSONObj ioStats = builder.obj()["ioStats"].Obj();
+            ASSERT_EQ(1, ioStats["writes"].numberLong());
+            ASSERT_GT(ioStats["bytes-written"].numberLong(), 4);
+            ASSERT_EQ(1, ioStats["reads"].numberLong());
+            ASSERT_EQ(1, ioStats["seeks"].numberLong());
+            ASSERT_GTE(ioStats["bytes-read"].numberLong(), 8);
+        }
+    }
+
+    TEST(RocksRecordStoreTest, OplogInsertsWakeUpCappedDeleter) {
+        RocksRecordStoreHarnessHelper harnessHelper;
+        std::unique_ptr<RecordStore> rs(
+            harnessHelper.newCappedRecordStore("local.oplog.foo", 10000, -1));
+        RocksRecordStore* rrs = dynamic_cast<RocksRecordStore*>(rs.get());
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            // 17 bytes per entry, 1050 bytes over the cap
+            for (int i = 0; i < 650; ++i) {
+                ASSERT_OK(insertBSON(opCtx, rs, Timestamp(1, i + 1)).getStatus());
+            }
+        }
+        ASSERT(rrs->cappedDeleterBehind());
+        ASSERT(rrs->cappedDeleterSignal()->wait(stdx::chrono::milliseconds(0)));
+        ASSERT_FALSE(rrs->cappedDeleterSignal()->wait(stdx::chrono::milliseconds(0)));
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            WriteUnitOfWork wuow(opCtx.get());
+            stdx::lock_guard<boost::timed_mutex> lock(rrs->cappedDeleterMutex());
+            ASSERT_GT(rrs->cappedDeleteAsNeeded_inlock(opCtx.get(), RecordId::max()), 0);
+            wuow.commit();
+        }
+        ASSERT_FALSE(rrs->cappedDeleterBehind());
+
+        ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+        BSONObjBuilder builder;
+        rs->appendCustomStats(opCtx.get(), &builder, 1);
+        BSONObj stats = builder.obj();
+        BSONObj deleter = stats["cappedDeleter"].Obj();
+        ASSERT_EQ(1, deleter["wakeups"].numberLong());
+        ASSERT_EQ(1, deleter["passes"].numberLong());
+        ASSERT_EQ(0, deleter["lagMillis"].numberLong());
+        ASSERT_EQ(0, deleter["overshoot"].numberLong());
+        ASSERT_GTE(deleter["maxOvershoot"].numberLong(), 1000);
+        // the deleter was never behind for long, inserts didn't wait for it
+        ASSERT_EQ(0, deleter["backPressureWaits"].numberLong());
+    }
+
+    // remembers the size of the documents capped deletes pass to it
+    class DeletedSizesCallback : public CappedCallback {
+    public:
+        Status aboutToDeleteCapped(OperationContext* txn, const RecordId& loc,
+                                   RecordData data) final {
+            sizes.push_back(data.size());
+            return Status::OK();
+        }
+        bool haveCappedWaiters() final { return false; }
+        void notifyCappedWaitersIfNeeded() final {}
+
+        std::vector<int> sizes;
+    };
+
+    TEST(RocksRecordStoreTest, CappedKeyTrackerReadsDocumentsOnlyForIndexes) {
+        RocksRecordStoreHarnessHelper harnessHelper;
+        std::unique_ptr<RecordStore> rs(harnessHelper.newCappedRecordStore("a.tracked", 100, -1));
+        RocksRecordStore* rrs = dynamic_cast<RocksRecordStore*>(rs.get());
+        rrs->enableCappedKeyTracker();
+        rrs->setCappedDocumentsNeeded(false);
+        DeletedSizesCallback callback;
+        rrs->setCappedCallback(&callback);
+
+        const std::string doc(19, 'x');
+        auto insert = [&] {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            ASSERT_OK(rs->insertRecord(opCtx.get(), doc.c_str(), 20, false).getStatus());
+            uow.commit();
+        };
+        for (int i = 0; i < 10; ++i) {
+            insert();
+        }
+        ASSERT_EQ(5U, callback.sizes.size());
+        for (int size : callback.sizes) {
+            // an empty BSON object instead of the document
+            ASSERT_EQ(BSONObj().objsize(), size);
+        }
+
+        rrs->setCappedDocumentsNeeded(true);
+        insert();
+        ASSERT_EQ(6U, callback.sizes.size());
+        ASSERT_EQ(20, callback.sizes.back());
+
+        ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+        ASSERT_EQ(5, rs->numRecords(opCtx.get()));
+        ASSERT_EQ(100, rs->dataSize(opCtx.get()));
+        rrs->setCappedCallback(nullptr);
+    }
+
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 6 || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR >= 18))
+    TEST(RocksRecordStoreTest, LargeDocumentsRoundTripThroughBlobFiles) {
+        rocksdb::Options options;
+        options.enable_blob_files = true;
+        options.min_blob_size = 1024;
+        options.table_properties_collector_factories.push_back(
+            std::make_shared<RocksPrefixStatsCollectorFactory>());
+        RocksRecordStoreHarnessHelper harnessHelper(options);
+        rocksdb::DB* db = harnessHelper.getDB();
+        const std::string prefix("\0\0\0\1", 4);
+        std::unique_ptr<RecordStore> rs(harnessHelper.newNonCappedRecordStore("a.blob", prefix));
+
+        const int kLargeSize = 4096;
+        std::vector<RecordId> large, small;
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            for (int i = 0; i < 10; ++i) {
+                std::string data(kLargeSize, 'a' + i);
+                large.push_back(
+                    rs->insertRecord(opCtx.get(), data.c_str(), data.size() + 1, false).getValue());
+                small.push_back(rs->insertRecord(opCtx.get(), "small", 6, false).getValue());
+            }
+            uow.commit();
+        }
+        ASSERT(db->Flush(rocksdb::FlushOptions()).ok());
+        uint64_t numBlobFiles = 0;
+        ASSERT(db->GetIntProperty("rocksdb.num-blob-files", &numBlobFiles));
+        ASSERT_GT(numBlobFiles, 0U);
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            std::string data(kLargeSize, 'z');
+            ASSERT_OK(rs->updateRecord(opCtx.get(), large[0], data.c_str(), data.size() + 1,
+                                       false, nullptr));
+            uow.commit();
+        }
+        ASSERT(db->Flush(rocksdb::FlushOptions()).ok());
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper.newOperationContext());
+            for (int i = 0; i < 10; ++i) {
+                RecordData data = rs->dataFor(opCtx.get(), large[i]);
+                ASSERT_EQ(kLargeSize + 1, data.size());
+                ASSERT_EQ(std::string(kLargeSize, i == 0 ? 'z' : 'a' + i), data.data());
+                ASSERT_EQ(std::string("small"), rs->dataFor(opCtx.get(), small[i]).data());
+            }
+            int numRecords = 0;
+            auto cursor = rs->getCursor(opCtx.get());
+            while (auto record = cursor->next()) {
+                ++numRecords;
+            }
+            ASSERT_EQ(20, numRecords);
+
+            // SST files only hold references, storageSize counts the blob files too
+            RocksPrefixStatsCache cache(db, {db->DefaultColumnFamily()});
+            RocksPrefixStats stats;
+            ASSERT_TRUE(cache.get(prefix, &stats));
+            ASSERT_GTE(stats.blobBytes, 10 * kLargeSize);
+            ASSERT_LT(stats.storedBytes, stats.blobBytes);
+            dynamic_cast<RocksRecordStore*>(rs.get())->setPrefixStats(&cache);
+            ASSERT_GTE(rs->storageSize(opCtx.get()), 10 * kLargeSize);
+            dynamic_cast<RocksRecordStore*>(rs.get())->setPrefixStats(nullptr);
+        }
+    }
+#endif
+
     RecordId _oplogOrderInsertOplog( OperationContext* txn,
                                     std::unique_ptr<RecordStore>& rs,
                                     int inc ) {
@@ -32,6 +32,8 @@
 
 #include "rocks_recovery_unit.h"
 
+#include <algorithm>
+
 #include <rocksdb/comparator.h>
 #include <rocksdb/db.h>
 #include <rocksdb/iterator.h>
@@ -42,11 +44,17 @@
 #include <rocksdb/utilities/write_batch_with_index.h>
 
 #include "mongo/base/checked_cast.h"
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/db/client.h"
 #include "mongo/db/concurrency/write_conflict_exception.h"
 #include "mongo/db/operation_context.h"
+#include "mongo/db/server_options.h"
 #include "mongo/db/storage/journal_listener.h"
 #include "mongo/util/log.h"
+#include "mongo/util/timer.h"
 
+#include "rocks_histogram.h"
+#include "rocks_ident_stats.h"
 #include "rocks_transaction.h"
 #include "rocks_util.h"
 
@@ -54,12 +62,40 @@
 
 namespace mongo {
     namespace {
+        // Only new operations of user connections are admission controlled by the memory budget.
+        // Their recovery unit is created with the operation context, before it is attached to
+        // the client, so they hold no lock or ticket yet. Recovery units swapped in later, and
+        // replication, internal threads and direct clients, have to make progress for memory to
+        // be released
+        bool isAdmissionControlled() {
+            if (!haveClient()) {
+                return false;
+            }
+            Client& client = cc();
+            return client.hasRemote() && !client.isInDirectClient() &&
+                client.getOperationContext() == nullptr;
+        }
+
+        // point lookup that returned bytes
+        void recordRead(RocksIdentStats* identStats, size_t bytes) {
+            if (identStats) {
+                RocksIdentStats::Delta delta;
+                delta.reads = 1;
+                delta.bytesRead = bytes;
+                identStats->add(delta);
+            }
+        }
+
         class PrefixStrippingIterator : public RocksIterator {
         public:
             // baseIterator is consumed
             PrefixStrippingIterator(std::string prefix, Iterator* baseIterator,
                                     RocksCompactionScheduler* compactionScheduler,
-                                    std::unique_ptr<rocksdb::Slice> upperBound)
+                                    std::unique_ptr<rocksdb::Slice> upperBound,
+                                    RocksHotKeySampler* hotKeySampler = nullptr,
+                                    uint32_t hotKeyCFId = 0,
+                                    std::shared_ptr<RocksPerfProfile> perfProfile = nullptr,
+                                    RocksIdentStats* identStats = nullptr)
                 : _rocksdbSkippedDeletionsInitial(0),
                   _prefix(std::move(prefix)),
                   _nextPrefix(rocksGetNextPrefix(_prefix)),
@@ -67,11 +103,15 @@ namespace mongo {
                   _prefixSliceEpsilon(_prefix.data(), _prefix.size() + 1),
                   _baseIterator(baseIterator),
                   _compactionScheduler(compactionScheduler),
-                  _upperBound(std::move(upperBound)) {
+                  _upperBound(std::move(upperBound)),
+                  _hotKeySampler(hotKeySampler),
+                  _hotKeyCFId(hotKeyCFId),
+                  _perfProfile(std::move(perfProfile)),
+                  _identStats(identStats) {
                 *_upperBound.get() = rocksdb::Slice(_nextPrefix);
             }
 
-            ~PrefixStrippingIterator() {}
+            ~PrefixStrippingIterator() { flushStats(); }
 
             virtual bool Valid() const {
                 return _baseIterator->Valid() && _baseIterator->key().starts_with(_prefixSlice) &&
@@ -79,12 +119,19 @@ namespace mongo {
             }
 
             virtual void SeekToFirst() {
+                RocksHistogramTimer seekTimer(rocksHotPathHistogram(RocksHotPath::kSeek));
+                RocksPerfScope perfScope(_perfProfile.get());
+                RocksIdentStatsScope statsScope(_statsDelta());
                 startOp();
                 // seek to first key bigger than prefix
                 _baseIterator->Seek(_prefixSliceEpsilon);
                 endOp();
+                recordSeek();
             }
             virtual void SeekToLast() {
+                RocksHistogramTimer seekTimer(rocksHotPathHistogram(RocksHotPath::kSeek));
+                RocksPerfScope perfScope(_perfProfile.get());
+                RocksIdentStatsScope statsScope(_statsDelta());
                 startOp();
                 // we can't have upper bound set to _nextPrefix since we need to seek to it
                 *_upperBound.get() = rocksdb::Slice("\xFF\xFF\xFF\xFF");
@@ -98,27 +145,44 @@ namespace mongo {
                     _baseIterator->Prev();
                 }
                 endOp();
+                recordSeek();
             }
 
             virtual void Seek(const rocksdb::Slice& target) {
+                RocksHistogramTimer seekTimer(rocksHotPathHistogram(RocksHotPath::kSeek));
+                RocksPerfScope perfScope(_perfProfile.get());
+                RocksIdentStatsScope statsScope(_statsDelta());
                 startOp();
                 std::unique_ptr<char[]> buffer(new char[_prefix.size() + target.size()]);
                 memcpy(buffer.get(), _prefix.data(), _prefix.size());
                 memcpy(buffer.get() + _prefix.size(), target.data(), target.size());
-                _baseIterator->Seek(rocksdb::Slice(buffer.get(), _prefix.size() + target.size()));
+                rocksdb::Slice fullTarget(buffer.get(), _prefix.size() + target.size());
+                if (_hotKeySampler) {
+                    // only the first seek, the iterator then mostly walks the same blocks
+                    _hotKeySampler->record(_hotKeyCFId, fullTarget);
+                    _hotKeySampler = nullptr;
+                }
+                _baseIterator->Seek(fullTarget);
                 endOp();
+                recordSeek();
             }
 
             virtual void Next() {
+                RocksPerfScope perfScope(_perfProfile.get());
+                RocksIdentStatsScope statsScope(_statsDelta());
                 startOp();
                 _baseIterator->Next();
                 endOp();
+                recordPosition();
             }
 
             virtual void Prev() {
+                RocksPerfScope perfScope(_perfProfile.get());
+                RocksIdentStatsScope statsScope(_statsDelta());
                 startOp();
                 _baseIterator->Prev();
                 endOp();
+                recordPosition();
             }
 
             virtual void SeekForPrev(const rocksdb::Slice& target) {
@@ -139,6 +203,9 @@ namespace mongo {
             // This Seek is specific because it will succeed only if it finds a key with `target`
             // prefix. If there is no such key, it will be !Valid()
             virtual void SeekPrefix(const rocksdb::Slice& target) {
+                RocksHistogramTimer seekTimer(rocksHotPathHistogram(RocksHotPath::kSeek));
+                RocksPerfScope perfScope(_perfProfile.get());
+                RocksIdentStatsScope statsScope(_statsDelta());
                 std::unique_ptr<char[]> buffer(new char[_prefix.size() + target.size()]);
                 memcpy(buffer.get(), _prefix.data(), _prefix.size());
                 memcpy(buffer.get() + _prefix.size(), target.data(), target.size());
@@ -156,9 +223,38 @@ namespace mongo {
                 }
                 // reset back to original value
                 *_upperBound.get() = rocksdb::Slice(_nextPrefix);
+                recordSeek();
             }
 
         private:
+            RocksIdentStats::Delta* _statsDelta() {
+                return _identStats ? &_identStatsDelta : nullptr;
+            }
+            // bytes of the entry we landed on are charged to the ident as read
+            void recordPosition() {
+                if (_identStats != nullptr && Valid()) {
+                    _identStatsDelta.bytesRead +=
+                        _baseIterator->key().size() + _baseIterator->value().size();
+                    // long lived cursors shouldn't hide their reads for too long
+                    if (++_positionsSinceFlush >= kFlushStatsEvery) {
+                        flushStats();
+                    }
+                }
+            }
+            void recordSeek() {
+                if (_identStats != nullptr) {
+                    ++_identStatsDelta.seeks;
+                    recordPosition();
+                }
+            }
+            void flushStats() {
+                if (_identStats != nullptr) {
+                    _identStats->add(_identStatsDelta);
+                    _identStatsDelta = RocksIdentStats::Delta();
+                    _positionsSinceFlush = 0;
+                }
+            }
+
             void startOp() {
                 if (_compactionScheduler == nullptr) {
                     return;
@@ -194,31 +290,58 @@ namespace mongo {
             RocksCompactionScheduler* _compactionScheduler;  // not owned
 
             std::unique_ptr<rocksdb::Slice> _upperBound;
+
+            // set if this iterator's first Seek() should be sampled
+            RocksHotKeySampler* _hotKeySampler;  // not owned
+            uint32_t _hotKeyCFId;
+
+            // set if the operation that created this iterator is profiled
+            std::shared_ptr<RocksPerfProfile> _perfProfile;
+
+            // set if reads through this iterator are charged to an ident
+            RocksIdentStats* _identStats;  // not owned
+            // added to _identStats on destruction and every kFlushStatsEvery positions
+            RocksIdentStats::Delta _identStatsDelta;
+            int _positionsSinceFlush = 0;
+            static const int kFlushStatsEvery = 1024;
         };
 
     }  // anonymous namespace
 
     std::atomic<int> RocksRecoveryUnit::_totalLiveRecoveryUnits(0);
 
+    RocksHotKeySampler RocksRecoveryUnit::_hotKeySampler;
+
     RocksRecoveryUnit::RocksRecoveryUnit(RocksTransactionEngine* transactionEngine,
                                          RocksSnapshotManager* snapshotManager, rocksdb::DB* db,
                                          RocksCounterManager* counterManager,
                                          RocksCompactionScheduler* compactionScheduler,
                                          RocksDurabilityManager* durabilityManager,
-                                         bool durable)
+                                         bool durable, RocksMemoryBudget* memoryBudget,
+                                         bool secondary)
         : _transactionEngine(transactionEngine),
           _snapshotManager(snapshotManager),
           _db(db),
           _counterManager(counterManager),
           _compactionScheduler(compactionScheduler),
           _durabilityManager(durabilityManager),
+          _memoryBudget(memoryBudget),
           _durable(durable),
+          _secondary(secondary),
           _transaction(transactionEngine),
           _writeBatch(rocksdb::BytewiseComparator(), 0, true),
           _snapshot(nullptr),
           _preparedSnapshot(nullptr),
           _myTransactionCount(1) {
         RocksRecoveryUnit::_totalLiveRecoveryUnits.fetch_add(1, std::memory_order_relaxed);
+        if (_memoryBudget && isAdmissionControlled()) {
+            // we can't tell reads from writes yet. Once it gives up the operation goes ahead,
+            // failing it here or in beginUnitOfWork() would be worse than the memory
+            _memoryBudget->waitForAdmission();
+        }
+        if (RocksPerfProfile::shouldSample()) {
+            _perfProfile = std::make_shared<RocksPerfProfile>();
+        }
     }
 
     RocksRecoveryUnit::~RocksRecoveryUnit() {
@@ -231,8 +354,31 @@ namespace mongo {
         RocksRecoveryUnit::_totalLiveRecoveryUnits.fetch_sub(1, std::memory_order_relaxed);
     }
 
+    void RocksRecoveryUnit::_startProfile() {
+        if (_perfProfile && !_profileActive) {
+            _profileActive = true;
+            _profileTimer.reset();
+        }
+    }
+
+    void RocksRecoveryUnit::_endProfile() {
+        if (!_profileActive) {
+            return;
+        }
+        _profileActive = false;
+        if (_profileTimer.millis() >= serverGlobalParams.slowMS) {
+            // goes next to the slow operation line, to tell whether RocksDB was the reason
+            BSONObjBuilder builder;
+            _perfProfile->get().appendTo(&builder);
+            log() << "slow RocksDB snapshot or unit of work, profile after "
+                  << _profileTimer.millis() << "ms: " << builder.obj();
+        }
+        _perfProfile->reset();
+    }
+
     void RocksRecoveryUnit::beginUnitOfWork(OperationContext* opCtx) {
         invariant(!_areWriteUnitOfWorksBanned);
+        _startProfile();
     }
 
     void RocksRecoveryUnit::commitUnitOfWork() {
@@ -259,18 +405,45 @@ namespace mongo {
     }
 
     bool RocksRecoveryUnit::waitUntilDurable() {
+        RocksPerfScope perfScope(_perfProfile.get(), true /* walSync */);
         _durabilityManager->waitUntilDurable(false);
         return true;
     }
 
     void RocksRecoveryUnit::abandonSnapshot() {
+        _identWrites.clear();
         _deltaCounters.clear();
-        _writeBatch.Clear();
+        _clearWriteBatch();
         _releaseSnapshot();
         _areWriteUnitOfWorksBanned = false;
     }
 
-    rocksdb::WriteBatchWithIndex* RocksRecoveryUnit::writeBatch() { return &_writeBatch; }
+    rocksdb::WriteBatchWithIndex* RocksRecoveryUnit::writeBatch() {
+        // callers write right after this, so the charge lags one write behind
+        _chargeWriteBatch();
+        return &_writeBatch;
+    }
+
+    void RocksRecoveryUnit::_chargeWriteBatch() {
+        if (!_memoryBudget) {
+            return;
+        }
+        // the index of the batch is not counted, it's small compared to the data
+        long long size = static_cast<long long>(_writeBatch.GetWriteBatch()->GetDataSize());
+        if (size != _chargedWriteBatchBytes) {
+            _memoryBudget->chargeWriteBatch(size - _chargedWriteBatchBytes);
+            _chargedWriteBatchBytes = size;
+        }
+    }
+
+    void RocksRecoveryUnit::_clearWriteBatch() {
+        _writeBatch.Clear();
+        _rowCacheInvalidations.clear();
+        if (_memoryBudget && _chargedWriteBatchBytes != 0) {
+            _memoryBudget->chargeWriteBatch(-_chargedWriteBatchBytes);
+        }
+        _chargedWriteBatchBytes = 0;
+    }
 
     void RocksRecoveryUnit::setOplogReadTill(const RecordId& record) { _oplogReadTill = record; }
 
@@ -295,6 +468,16 @@ namespace mongo {
 
     SnapshotId RocksRecoveryUnit::getSnapshotId() const { return SnapshotId(_myTransactionCount); }
 
+    void RocksRecoveryUnit::reportState(BSONObjBuilder* b) const {
+        if (_perfProfile) {
+            BSONObjBuilder profileBuilder(b->subobjStart("rocksdbProfile"));
+            profileBuilder.append("millis",
+                                  _profileActive ? static_cast<long long>(_profileTimer.millis())
+                                                 : 0LL);
+            _perfProfile->get().appendTo(&profileBuilder);
+        }
+    }
+
     void RocksRecoveryUnit::_releaseSnapshot() {
         if (_snapshot) {
             _transaction.abort();
@@ -302,6 +485,7 @@ namespace mongo {
             _snapshot = nullptr;
         }
         _snapshotHolder.reset();
+        _endProfile();
 
         _myTransactionCount++;
     }
@@ -330,12 +514,31 @@ namespace mongo {
             // _transaction.recordSnapshotId() and _db->GetSnapshot() and
             rocksdb::WriteOptions writeOptions;
             writeOptions.disableWAL = !_durable;
-            auto status = _db->Write(writeOptions, wb);
+            for (const auto& invalidation : _rowCacheInvalidations) {
+                invalidation.first->beginInvalidate(invalidation.second);
+            }
+            Timer timer;
+            rocksdb::Status status;
+            {
+                RocksPerfScope perfScope(_perfProfile.get());
+                status = _db->Write(writeOptions, wb);
+            }
             invariantRocksOK(status);
+            rocksHotPathHistogram(RocksHotPath::kCommit)->record(timer.micros());
+            if (!_rowCacheInvalidations.empty()) {
+                auto latestSequence = _db->GetLatestSequenceNumber();
+                for (const auto& invalidation : _rowCacheInvalidations) {
+                    invalidation.first->endInvalidate(invalidation.second, latestSequence);
+                }
+            }
             _transaction.commit();
         }
+        for (const auto& identWrites : _identWrites) {
+            identWrites.first->add(identWrites.second);
+        }
+        _identWrites.clear();
         _deltaCounters.clear();
-        _writeBatch.Clear();
+        _clearWriteBatch();
     }
 
     void RocksRecoveryUnit::_abort() {
@@ -352,8 +555,9 @@ namespace mongo {
             std::terminate();
         }
 
+        _identWrites.clear();
         _deltaCounters.clear();
-        _writeBatch.Clear();
+        _clearWriteBatch();
 
         _releaseSnapshot();
     }
@@ -369,6 +573,7 @@ namespace mongo {
     }
 
     const rocksdb::Snapshot* RocksRecoveryUnit::snapshot() {
+        _startProfile();
         if (_readFromMajorityCommittedSnapshot) {
             if (_snapshotHolder.get() == nullptr) {
                 _snapshotHolder = _snapshotManager->getCommittedSnapshot();
@@ -385,8 +590,16 @@ namespace mongo {
         return _snapshot;
     }
 
+    const rocksdb::Snapshot* RocksRecoveryUnit::_readSnapshot() {
+        // still taken on a secondary, cursors compare its sequence number to tell whether they
+        // have to seek again
+        const rocksdb::Snapshot* readSnapshot = snapshot();
+        return _secondary ? nullptr : readSnapshot;
+    }
+
     rocksdb::Status RocksRecoveryUnit::Get(rocksdb::ColumnFamilyHandle* cfHandle,
-					   const rocksdb::Slice& key, std::string* value) {
+					   const rocksdb::Slice& key, std::string* value,
+                                           RocksIdentStats* identStats) {
         if (_writeBatch.GetWriteBatch()->Count() > 0) {
             std::unique_ptr<rocksdb::WBWIIterator> wb_iterator(_writeBatch.NewIterator());
             wb_iterator->Seek(key);
@@ -396,31 +609,77 @@ namespace mongo {
                     return rocksdb::Status::NotFound();
                 }
                 *value = std::string(entry.value.data(), entry.value.size());
+                recordRead(identStats, value->size());
                 return rocksdb::Status::OK();
             }
         }
         rocksdb::ReadOptions options;
-        options.snapshot = snapshot();
-	if (cfHandle) {
-	    return _db->Get(options, cfHandle, key, value);
-	} else {
-	    return _db->Get(options, key, value);
-	}
+        options.snapshot = _readSnapshot();
+        Timer timer;
+        rocksdb::Status status;
+        RocksIdentStats::Delta statsDelta;
+        {
+            RocksPerfScope perfScope(_perfProfile.get());
+            RocksIdentStatsScope statsScope(identStats ? &statsDelta : nullptr);
+            status = cfHandle ? _db->Get(options, cfHandle, key, value)
+                              : _db->Get(options, key, value);
+        }
+        rocksHotPathHistogram(RocksHotPath::kGet)->record(timer.micros());
+        if (identStats) {
+            if (status.ok()) {
+                statsDelta.reads = 1;
+                statsDelta.bytesRead = value->size();
+            }
+            identStats->add(statsDelta);
+        }
+        if (status.ok() && _hotKeySampler.enabled() && RocksHotKeySampler::shouldSample()) {
+            _hotKeySampler.record(cfHandle ? cfHandle->GetID() : 0, key);
+        }
+        return status;
+    }
+
+    rocksdb::Status RocksRecoveryUnit::GetWithRowCache(RocksRowCache* rowCache,
+                                                       rocksdb::ColumnFamilyHandle* cfHandle,
+                                                       const rocksdb::Slice& key,
+                                                       std::string* value,
+                                                       RocksIdentStats* identStats) {
+        if (rowCache == nullptr || _writeBatch.GetWriteBatch()->Count() > 0) {
+            return Get(cfHandle, key, value, identStats);
+        }
+        auto snapshotSequence = snapshot()->GetSequenceNumber();
+        if (rowCache->lookup(key, snapshotSequence, value)) {
+            recordRead(identStats, value->size());
+            return rocksdb::Status::OK();
+        }
+        auto status = Get(cfHandle, key, value, identStats);
+        if (status.ok()) {
+            rowCache->insert(key, *value, snapshotSequence);
+        }
+        return status;
+    }
+
+    void RocksRecoveryUnit::invalidateRowCacheOnCommit(RocksRowCache* rowCache, std::string key) {
+        _rowCacheInvalidations.emplace_back(rowCache, std::move(key));
     }
 
     RocksIterator* RocksRecoveryUnit::NewIterator(rocksdb::ColumnFamilyHandle* cfHandle,
-						  std::string prefix, bool isOplog) {
+						  std::string prefix, bool isOplog,
+                                                  RocksIdentStats* identStats) {
         std::unique_ptr<rocksdb::Slice> upperBound(new rocksdb::Slice());
         rocksdb::ReadOptions options;
         options.iterate_upper_bound = upperBound.get();
-        options.snapshot = snapshot();
+        options.snapshot = _readSnapshot();
 	
 	auto iterator = (cfHandle) ?
 	    _writeBatch.NewIteratorWithBase(_db->NewIterator(options, cfHandle)) :
 	    _writeBatch.NewIteratorWithBase(_db->NewIterator(options));
+        bool sample = _hotKeySampler.enabled() && RocksHotKeySampler::shouldSample();
         auto prefixIterator = new PrefixStrippingIterator(std::move(prefix), iterator,
                                                           isOplog ? nullptr : _compactionScheduler,
-                                                          std::move(upperBound));
+                                                          std::move(upperBound),
+                                                          sample ? &_hotKeySampler : nullptr,
+                                                          cfHandle ? cfHandle->GetID() : 0,
+                                                          _perfProfile, identStats);
         return prefixIterator;
     }
 
@@ -452,6 +711,21 @@ namespace mongo {
         }
     }
 
+    void RocksRecoveryUnit::recordIdentWrite(const std::shared_ptr<RocksIdentStats>& identStats,
+                                             size_t bytes) {
+        // a unit of work touches few idents, usually the same one many times in a row
+        auto it = std::find_if(_identWrites.rbegin(), _identWrites.rend(),
+                               [&identStats](const IdentWrites& identWrites) {
+                                   return identWrites.first == identStats;
+                               });
+        if (it == _identWrites.rend()) {
+            _identWrites.emplace_back(identStats, RocksIdentStats::Delta());
+            it = _identWrites.rbegin();
+        }
+        ++it->second.writes;
+        it->second.bytesWritten += bytes;
+    }
+
     long long RocksRecoveryUnit::getDeltaCounter(const rocksdb::Slice& counterKey) {
         auto counter = _deltaCounters.find(counterKey.ToString());
         if (counter == _deltaCounters.end()) {
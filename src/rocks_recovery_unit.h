@@ -30,6 +30,7 @@
 
 #include <atomic>
 #include <map>
+#include <memory>
 #include <stack>
 #include <string>
 #include <vector>
@@ -46,12 +47,18 @@
 #include "mongo/base/owned_pointer_vector.h"
 #include "mongo/db/record_id.h"
 #include "mongo/db/storage/recovery_unit.h"
+#include "mongo/util/timer.h"
 
 #include "rocks_compaction_scheduler.h"
 #include "rocks_transaction.h"
 #include "rocks_counter_manager.h"
 #include "rocks_snapshot_manager.h"
 #include "rocks_durability_manager.h"
+#include "rocks_memory_budget.h"
+#include "rocks_perf_profile.h"
+#include "rocks_ident_stats.h"
+#include "rocks_cache_warmer.h"
+#include "rocks_row_cache.h"
 
 namespace rocksdb {
     class ColumnFamilyHandle;
@@ -85,7 +92,8 @@ namespace mongo {
                           RocksSnapshotManager* snapshotManager, rocksdb::DB* db,
                           RocksCounterManager* counterManager,
                           RocksCompactionScheduler* compactionScheduler,
-                          RocksDurabilityManager* durabilityManager, bool durable);
+                          RocksDurabilityManager* durabilityManager, bool durable,
+                          RocksMemoryBudget* memoryBudget, bool secondary = false);
         virtual ~RocksRecoveryUnit();
 
         virtual void beginUnitOfWork(OperationContext* opCtx);
@@ -111,6 +119,9 @@ namespace mongo {
 
         virtual SnapshotId getSnapshotId() const;
 
+        // the RocksDB profile of this operation, if it was sampled
+        virtual void reportState(BSONObjBuilder* b) const;
+
         // local api
 
         rocksdb::WriteBatchWithIndex* writeBatch();
@@ -125,17 +136,33 @@ namespace mongo {
 
         RocksTransaction* transaction() { return &_transaction; }
 
-	rocksdb::Status Get(const rocksdb::Slice& key, std::string* value) {
-	    return Get(nullptr, key, value);
+	rocksdb::Status Get(const rocksdb::Slice& key, std::string* value,
+                            RocksIdentStats* identStats = nullptr) {
+	    return Get(nullptr, key, value, identStats);
 	}
+        // identStats, if set, is charged with the read
         rocksdb::Status Get(rocksdb::ColumnFamilyHandle* cfHandle,
-			    const rocksdb::Slice& key, std::string* value);
+			    const rocksdb::Slice& key, std::string* value,
+                            RocksIdentStats* identStats = nullptr);
+
+        // Same as Get(), but goes through rowCache first unless this unit of work wrote something
+        rocksdb::Status GetWithRowCache(RocksRowCache* rowCache,
+                                        rocksdb::ColumnFamilyHandle* cfHandle,
+                                        const rocksdb::Slice& key, std::string* value,
+                                        RocksIdentStats* identStats = nullptr);
+
+        // key is written in this unit of work. Its rowCache entry is invalidated on commit
+        void invalidateRowCacheOnCommit(RocksRowCache* rowCache, std::string key);
 
-	RocksIterator* NewIterator(std::string prefix, bool isOplog = false) {
-	    return NewIterator(nullptr, prefix, isOplog);
+	RocksIterator* NewIterator(std::string prefix, bool isOplog = false,
+                                   RocksIdentStats* identStats = nullptr) {
+	    return NewIterator(nullptr, prefix, isOplog, identStats);
 	}
+        // identStats, if set, is charged with the seeks and reads of the iterator. It has to
+        // outlive the iterator
         RocksIterator* NewIterator(rocksdb::ColumnFamilyHandle* cfHandle,
-				   std::string prefix, bool isOplog = false);
+				   std::string prefix, bool isOplog = false,
+                                   RocksIdentStats* identStats = nullptr);
 
 	static RocksIterator* NewIteratorNoSnapshot(rocksdb::DB* db, std::string prefix) {
 	    return NewIteratorNoSnapshot(db, nullptr, prefix);
@@ -148,12 +175,17 @@ namespace mongo {
 
         long long getDeltaCounter(const rocksdb::Slice& counterKey);
 
+        // Put or Delete of bytes (key plus value size) added to the write batch. Charged to the
+        // ident when the unit of work commits
+        void recordIdentWrite(const std::shared_ptr<RocksIdentStats>& identStats, size_t bytes);
+
         void setOplogReadTill(const RecordId& loc);
         RecordId getOplogReadTill() const { return _oplogReadTill; }
 
         RocksRecoveryUnit* newRocksRecoveryUnit() {
             return new RocksRecoveryUnit(_transactionEngine, _snapshotManager, _db, _counterManager,
-                                         _compactionScheduler, _durabilityManager, _durable);
+                                         _compactionScheduler, _durabilityManager, _durable,
+                                         _memoryBudget, _secondary);
         }
 
         struct Counter {
@@ -170,6 +202,9 @@ namespace mongo {
 
         static int getTotalLiveRecoveryUnits() { return _totalLiveRecoveryUnits.load(); }
 
+        // sampled keys of point reads and seeks, persisted by the cache warmer
+        static RocksHotKeySampler* getHotKeySampler() { return &_hotKeySampler; }
+
         void prepareForCreateSnapshot(OperationContext* opCtx);
 
         void setCommittedSnapshot(const rocksdb::Snapshot* committedSnapshot);
@@ -179,21 +214,43 @@ namespace mongo {
     private:
         void _releaseSnapshot();
 
+        void _startProfile();
+        // logs the profile if it was slow and starts over
+        void _endProfile();
+
         void _commit();
 
         void _abort();
+
+        // charges the growth of _writeBatch since the last call to the memory budget
+        void _chargeWriteBatch();
+        // clears _writeBatch, releases its charge and forgets its row cache invalidations
+        void _clearWriteBatch();
+
+        // snapshot() for ReadOptions, nullptr on a secondary
+        const rocksdb::Snapshot* _readSnapshot();
+
         RocksTransactionEngine* _transactionEngine;      // not owned
         RocksSnapshotManager* _snapshotManager;          // not owned
         rocksdb::DB* _db;                                // not owned
         RocksCounterManager* _counterManager;            // not owned
         RocksCompactionScheduler* _compactionScheduler;  // not owned
         RocksDurabilityManager* _durabilityManager;      // not owned
+        RocksMemoryBudget* _memoryBudget;                // not owned, can be nullptr
 
         const bool _durable;
+        // A secondary instance (storage.rocksdb.secondaryOf) refuses iterators on a snapshot and
+        // ignores the snapshot of a Get(). Each read sees the state of the latest catch-up with
+        // the primary instead, so reads of one snapshot are only eventually consistent
+        const bool _secondary;
 
         RocksTransaction _transaction;
 
         rocksdb::WriteBatchWithIndex _writeBatch;
+        // bytes of _writeBatch charged to _memoryBudget
+        long long _chargedWriteBatchBytes = 0;
+        // keys in _writeBatch that may be in a row cache
+        std::vector<std::pair<RocksRowCache*, std::string>> _rowCacheInvalidations;
 
         // bare because we need to call ReleaseSnapshot when we're done with this
         const rocksdb::Snapshot* _snapshot; // owned
@@ -204,6 +261,9 @@ namespace mongo {
 
         CounterMap _deltaCounters;
 
+        typedef std::pair<std::shared_ptr<RocksIdentStats>, RocksIdentStats::Delta> IdentWrites;
+        std::vector<IdentWrites> _identWrites;
+
         typedef OwnedPointerVector<Change> Changes;
         Changes _changes;
 
@@ -213,10 +273,21 @@ namespace mongo {
 
         static std::atomic<int> _totalLiveRecoveryUnits;
 
+        static RocksHotKeySampler _hotKeySampler;
+
         // If we read from a committed snapshot, then ownership of the snapshot
         // should be shared here to ensure that it is not released early
         std::shared_ptr<RocksSnapshotManager::SnapshotHolder> _snapshotHolder;
 
+        // only set if this operation was picked by RocksPerfProfile::shouldSample(). Shared with
+        // the iterators, which can outlive us
+        std::shared_ptr<RocksPerfProfile> _perfProfile;
+        // A recovery unit can outlive many operations of a client, so the profile covers one
+        // unit of work or snapshot: from beginUnitOfWork() or the first read to the release of
+        // the snapshot
+        bool _profileActive = false;
+        Timer _profileTimer;
+
         bool _readFromMajorityCommittedSnapshot = false;
         bool _areWriteUnitOfWorksBanned = false;
     };
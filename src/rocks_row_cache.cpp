@@ -0,0 +1,177 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_row_cache.h"
+
+#include <functional>
+
+#include "mongo/bson/bsonobj.h"
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/util/mongoutils/str.h"
+
+namespace mongo {
+
+    namespace {
+        const char* const kRowCacheField = "rowCache";
+    }  // namespace
+
+    Status RocksRowCache::parseCollectionOptions(const BSONObj& storageEngineOptions,
+                                                 bool* rowCache) {
+        *rowCache = false;
+        BSONElement rocksOptions = storageEngineOptions.getField("rocksdb");
+        if (rocksOptions.eoo()) {
+            return Status::OK();
+        }
+        if (rocksOptions.type() != Object) {
+            return Status(ErrorCodes::BadValue, "storageEngine.rocksdb has to be a document");
+        }
+        Status status = validateCollectionStorageOptions(rocksOptions.Obj());
+        if (!status.isOK()) {
+            return status;
+        }
+        *rowCache = rocksOptions.Obj().getBoolField(kRowCacheField);
+        return Status::OK();
+    }
+
+    Status RocksRowCache::validateCollectionStorageOptions(const BSONObj& options) {
+        BSONElement element = options.getField(kRowCacheField);
+        if (element.eoo()) {
+            return Status::OK();
+        }
+        if (element.type() != Bool) {
+            return Status(ErrorCodes::BadValue,
+                          str::stream() << kRowCacheField << " has to be a boolean");
+        }
+        return Status::OK();
+    }
+
+    RocksRowCache::RocksRowCache(size_t capacityBytes)
+        : _shardCapacity(capacityBytes / kNumShards) {}
+
+    RocksRowCache::Shard& RocksRowCache::_shardFor(const rocksdb::Slice& key) {
+        // keys of one collection differ only in the last bytes, hash the whole key
+        size_t hash = std::hash<std::string>()(key.ToString());
+        return _shards[hash % kNumShards];
+    }
+
+    void RocksRowCache::_erase_inlock(Shard* shard, const std::string& key) {
+        auto it = shard->map.find(key);
+        if (it == shard->map.end()) {
+            return;
+        }
+        shard->usage -= it->second->key.size() + it->second->value.size() + kEntryOverhead;
+        shard->lru.erase(it->second);
+        shard->map.erase(it);
+    }
+
+    bool RocksRowCache::lookup(const rocksdb::Slice& key,
+                               rocksdb::SequenceNumber snapshotSequence, std::string* value) {
+        Shard& shard = _shardFor(key);
+        {
+            stdx::lock_guard<stdx::mutex> lk(shard.mutex);
+            auto it = shard.map.find(key.ToString());
+            if (shard.pendingWrites == 0 && it != shard.map.end() &&
+                it->second->sequence <= snapshotSequence) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                *value = it->second->value;
+                _hits.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void RocksRowCache::insert(const rocksdb::Slice& key, const rocksdb::Slice& value,
+                               rocksdb::SequenceNumber snapshotSequence) {
+        const size_t charge = key.size() + value.size() + kEntryOverhead;
+        if (charge > _shardCapacity) {
+            return;
+        }
+        Shard& shard = _shardFor(key);
+        stdx::lock_guard<stdx::mutex> lk(shard.mutex);
+        if (shard.pendingWrites > 0 || snapshotSequence < shard.lastWriteSequence) {
+            // the value might already be replaced
+            return;
+        }
+        std::string keyString(key.ToString());
+        _erase_inlock(&shard, keyString);
+        while (shard.usage + charge > _shardCapacity && !shard.lru.empty()) {
+            _erase_inlock(&shard, shard.lru.back().key);
+            _evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        shard.lru.push_front(Entry{keyString, value.ToString(), snapshotSequence});
+        shard.map[keyString] = shard.lru.begin();
+        shard.usage += charge;
+        _inserts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void RocksRowCache::beginInvalidate(const rocksdb::Slice& key) {
+        Shard& shard = _shardFor(key);
+        stdx::lock_guard<stdx::mutex> lk(shard.mutex);
+        _erase_inlock(&shard, key.ToString());
+        shard.pendingWrites++;
+    }
+
+    void RocksRowCache::endInvalidate(const rocksdb::Slice& key,
+                                      rocksdb::SequenceNumber latestSequence) {
+        Shard& shard = _shardFor(key);
+        stdx::lock_guard<stdx::mutex> lk(shard.mutex);
+        // nothing can be inserted while the write is pending, but be safe
+        _erase_inlock(&shard, key.ToString());
+        shard.pendingWrites--;
+        if (latestSequence > shard.lastWriteSequence) {
+            shard.lastWriteSequence = latestSequence;
+        }
+        _invalidations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t RocksRowCache::getUsage() const {
+        size_t usage = 0;
+        for (const auto& shard : _shards) {
+            stdx::lock_guard<stdx::mutex> lk(shard.mutex);
+            usage += shard.usage;
+        }
+        return usage;
+    }
+
+    void RocksRowCache::appendStats(BSONObjBuilder* builder) const {
+        builder->append("capacity", static_cast<long long>(getCapacity()));
+        builder->append("usage", static_cast<long long>(getUsage()));
+        builder->append("hits", _hits.load(std::memory_order_relaxed));
+        builder->append("misses", _misses.load(std::memory_order_relaxed));
+        builder->append("inserts", _inserts.load(std::memory_order_relaxed));
+        builder->append("invalidations", _invalidations.load(std::memory_order_relaxed));
+        builder->append("evictions", _evictions.load(std::memory_order_relaxed));
+    }
+}
@@ -0,0 +1,132 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <rocksdb/slice.h>
+#include <rocksdb/types.h>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/base/status.h"
+#include "mongo/stdx/mutex.h"
+
+namespace mongo {
+
+    class BSONObj;
+    class BSONObjBuilder;
+
+    /**
+     * LRU cache of whole documents, keyed by prefixed RecordId, for collections created with
+     * storageEngine: {rocksdb: {rowCache: true}}. A hit skips the block cache lookup, the block
+     * search and the decompression of the block.
+     *
+     * Every entry remembers the sequence number of the snapshot it was read at, and is only
+     * returned to readers whose snapshot is at least as new. Writers bracket their DB write with
+     * beginInvalidate() and endInvalidate(): while a write to a shard is in flight the shard is
+     * bypassed, and reads from snapshots older than the last write to the shard are never
+     * inserted. This way the cache never returns a document that the reader's snapshot can't
+     * see, and never keeps a document that a later write replaced.
+     */
+    class RocksRowCache {
+        MONGO_DISALLOW_COPYING(RocksRowCache);
+
+    public:
+        explicit RocksRowCache(size_t capacityBytes);
+
+        /**
+         * Extracts rowCache from the collection's storageEngine options. Sets *rowCache to false
+         * if it's not requested.
+         */
+        static Status parseCollectionOptions(const BSONObj& storageEngineOptions, bool* rowCache);
+
+        // Validates the contents of storageEngine.rocksdb
+        static Status validateCollectionStorageOptions(const BSONObj& options);
+
+        // Returns true and sets value if key is cached and visible at snapshotSequence
+        bool lookup(const rocksdb::Slice& key, rocksdb::SequenceNumber snapshotSequence,
+                    std::string* value);
+
+        // value was read at snapshotSequence
+        void insert(const rocksdb::Slice& key, const rocksdb::Slice& value,
+                    rocksdb::SequenceNumber snapshotSequence);
+
+        // Called before the write of key is applied to the DB
+        void beginInvalidate(const rocksdb::Slice& key);
+        // Called after the write is applied. latestSequence is the DB's latest sequence number
+        // after the write
+        void endInvalidate(const rocksdb::Slice& key, rocksdb::SequenceNumber latestSequence);
+
+        size_t getUsage() const;
+        size_t getCapacity() const { return _shardCapacity * kNumShards; }
+
+        void appendStats(BSONObjBuilder* builder) const;
+
+    private:
+        struct Entry {
+            std::string key;
+            std::string value;
+            rocksdb::SequenceNumber sequence;
+        };
+        typedef std::list<Entry> LRUList;
+
+        struct Shard {
+            mutable stdx::mutex mutex;
+            // front is the most recently used
+            LRUList lru;
+            std::unordered_map<std::string, LRUList::iterator> map;
+            size_t usage = 0;
+            // number of writes between beginInvalidate() and endInvalidate()
+            int pendingWrites = 0;
+            // the sequence number after the last endInvalidate()
+            rocksdb::SequenceNumber lastWriteSequence = 0;
+        };
+
+        static const int kNumShards = 64;
+        // per entry overhead of the list and the map
+        static const size_t kEntryOverhead = 64;
+
+        Shard& _shardFor(const rocksdb::Slice& key);
+        void _erase_inlock(Shard* shard, const std::string& key);
+
+        const size_t _shardCapacity;
+        Shard _shards[kNumShards];
+
+        std::atomic<long long> _hits{0};
+        std::atomic<long long> _misses{0};
+        std::atomic<long long> _inserts{0};
+        std::atomic<long long> _invalidations{0};
+        std::atomic<long long> _evictions{0};
+    };
+}
@@ -0,0 +1,121 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_secondary.h"
+
+#include <algorithm>
+
+#include <rocksdb/db.h>
+#include <rocksdb/version.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/db/client.h"
+#include "mongo/stdx/chrono.h"
+#include "mongo/util/log.h"
+#include "mongo/util/time_support.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+    RocksSecondaryCatchUp::RocksSecondaryCatchUp(rocksdb::DB* db, int intervalMs)
+        : BackgroundJob(false /* deleteSelf */),
+          _db(db),
+          _intervalMs(std::max(intervalMs, 1)),
+          _caughtUpTo(curTimeMillis64()),
+          _sequence(db->GetLatestSequenceNumber()) {}
+
+    void RocksSecondaryCatchUp::run() {
+        Client::initThread(name().c_str());
+
+        LOG(1) << "starting " << name() << " thread";
+
+        while (true) {
+            {
+                stdx::unique_lock<stdx::mutex> lk(_mutex);
+                _shutdownCondition.wait_for(lk, stdx::chrono::milliseconds(_intervalMs),
+                                            [this] { return _shuttingDown; });
+                if (_shuttingDown) {
+                    break;
+                }
+            }
+            catchUp();
+        }
+        LOG(1) << "stopping " << name() << " thread";
+    }
+
+    void RocksSecondaryCatchUp::shutdown() {
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _shuttingDown = true;
+        }
+        _shutdownCondition.notify_all();
+        wait();
+    }
+
+    void RocksSecondaryCatchUp::catchUp() {
+        const long long startedAt = curTimeMillis64();
+        Timer timer;
+#if defined(ROCKSDB_MAJOR) && ROCKSDB_MAJOR >= 6
+        auto s = _db->TryCatchUpWithPrimary();
+#else
+        auto s = rocksdb::Status::NotSupported("secondary instances need RocksDB 6.0");
+#endif
+        unsigned long long sequence = _db->GetLatestSequenceNumber();
+
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        ++_catchUps;
+        _lastDurationMillis = timer.millis();
+        if (!s.ok()) {
+            // the primary may have deleted a WAL segment we were reading. The next round starts
+            // over from the new MANIFEST, so just keep going
+            ++_failures;
+            _lastError = s.ToString();
+            LOG(1) << "Failed to catch up with the primary: " << _lastError;
+            return;
+        }
+        _caughtUpTo = startedAt;
+        _sequence = sequence;
+    }
+
+    void RocksSecondaryCatchUp::appendStats(BSONObjBuilder* builder) const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        builder->append("lag-millis", curTimeMillis64() - _caughtUpTo);
+        builder->append("catch-ups", _catchUps);
+        builder->append("failures", _failures);
+        builder->append("last-catch-up-millis", _lastDurationMillis);
+        builder->append("sequence", static_cast<long long>(_sequence));
+        if (!_lastError.empty()) {
+            builder->append("last-error", _lastError);
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/stdx/condition_variable.h"
+#include "mongo/stdx/mutex.h"
+#include "mongo/util/background.h"
+
+namespace rocksdb {
+    class DB;
+}
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Keeps a secondary instance (a DB opened with storage.rocksdb.secondaryOf) close to its
+     * primary. Every interval it replays the MANIFEST and WAL the primary wrote since the last
+     * round. The view lags behind by up to the interval plus the time a round takes, which is
+     * what we report as the lag.
+     *
+     * Secondary instances don't support snapshots, and catching up doesn't wait for readers. A
+     * single iterator or Get() sees the state of one round, but two reads of the same operation
+     * may straddle a round, so a scan and a later lookup can disagree. Views are only eventually
+     * consistent.
+     */
+    class RocksSecondaryCatchUp : public BackgroundJob {
+        MONGO_DISALLOW_COPYING(RocksSecondaryCatchUp);
+
+    public:
+        RocksSecondaryCatchUp(rocksdb::DB* db, int intervalMs);
+
+        virtual std::string name() const { return "RocksSecondaryCatchUp"; }
+
+        virtual void run();
+
+        void shutdown();
+
+        void appendStats(BSONObjBuilder* builder) const;
+
+        // one round, run() calls it every interval
+        void catchUp();
+
+    private:
+        rocksdb::DB* _db;  // not owned
+        const int _intervalMs;
+
+        mutable stdx::mutex _mutex;
+        stdx::condition_variable _shutdownCondition;
+        // protected by _mutex
+        bool _shuttingDown = false;
+        long long _catchUps = 0;
+        long long _failures = 0;
+        std::string _lastError;
+        long long _lastDurationMillis = 0;
+        // wall clock time at which the last successful round started. The view is at least as
+        // recent as this
+        long long _caughtUpTo;
+        unsigned long long _sequence = 0;
+    };
+}
@@ -47,6 +47,10 @@
 
 #include "rocks_recovery_unit.h"
 #include "rocks_engine.h"
+#include "rocks_event_listener.h"
+#include "rocks_global_options.h"
+#include "rocks_histogram.h"
+#include "rocks_row_cache.h"
 #include "rocks_transaction.h"
 
 namespace mongo {
@@ -115,10 +119,54 @@ namespace mongo {
         }
         bob.append("total-live-recovery-units", RocksRecoveryUnit::getTotalLiveRecoveryUnits());
         bob.append("block-cache-usage", PrettyPrintBytes(_engine->getBlockCacheUsage()));
+        bob.append("block-cache-pinned-usage",
+                   PrettyPrintBytes(_engine->getBlockCache()->GetPinnedUsage()));
+        auto compressedBlockCache = _engine->getCompressedBlockCache();
+        if (compressedBlockCache) {
+            bob.append("compressed-block-cache-usage",
+                       PrettyPrintBytes(compressedBlockCache->GetUsage()));
+        }
         bob.append("transaction-engine-keys",
                    static_cast<long long>(_engine->getTransactionEngine()->numKeysTracked()));
         bob.append("transaction-engine-snapshots",
                    static_cast<long long>(_engine->getTransactionEngine()->numActiveSnapshots()));
+        {
+            BSONObjBuilder rateLimiterBuilder(bob.subobjStart("rate-limiter"));
+            _engine->appendRateLimiterStats(&rateLimiterBuilder);
+        }
+        {
+            BSONObjBuilder cacheWarmupBuilder(bob.subobjStart("cache-warmup"));
+            _engine->appendCacheWarmerStats(&cacheWarmupBuilder);
+        }
+        {
+            BSONObjBuilder memoryBudgetBuilder(bob.subobjStart("memory-budget"));
+            _engine->appendMemoryBudgetStats(&memoryBudgetBuilder);
+        }
+        if (rocksGlobalOptions.blobMinSizeKB > 0 && !rocksGlobalOptions.terarkEnable) {
+            BSONObjBuilder blobFilesBuilder(bob.subobjStart("blob-files"));
+            _engine->appendBlobFileStats(&blobFilesBuilder);
+        }
+        auto rowCache = _engine->getRowCache();
+        if (rowCache) {
+            BSONObjBuilder rowCacheBuilder(bob.subobjStart("row-cache"));
+            rowCache->appendStats(&rowCacheBuilder);
+        }
+        {
+            BSONObjBuilder latencyBuilder(bob.subobjStart("latency-micros"));
+            appendHotPathLatencies(&latencyBuilder);
+        }
+        auto eventListener = _engine->getEventListener();
+        if (eventListener) {
+            // the history is large, only with db.serverStatus({rocksdb: {eventHistory: 1}})
+            const bool withHistory = configElement.isABSONObj() &&
+                configElement.Obj()["eventHistory"].trueValue();
+            BSONObjBuilder eventsBuilder(bob.subobjStart("events"));
+            eventListener->appendStats(&eventsBuilder, withHistory);
+        }
+        if (_engine->isSecondary()) {
+            BSONObjBuilder secondaryBuilder(bob.subobjStart("secondary"));
+            _engine->appendSecondaryStats(&secondaryBuilder);
+        }
 
         std::vector<rocksdb::ThreadStatus> threadList;
         auto s = rocksdb::Env::Default()->GetThreadList(&threadList);
@@ -189,6 +237,10 @@ namespace mongo {
             {rocksdb::NUMBER_DB_PREV, "num-backward-iterations"},
             {rocksdb::BLOCK_CACHE_MISS, "block-cache-misses"},
             {rocksdb::BLOCK_CACHE_HIT, "block-cache-hits"},
+            {rocksdb::BLOCK_CACHE_INDEX_MISS, "block-cache-index-misses"},
+            {rocksdb::BLOCK_CACHE_FILTER_MISS, "block-cache-filter-misses"},
+            {rocksdb::BLOCK_CACHE_COMPRESSED_MISS, "compressed-block-cache-misses"},
+            {rocksdb::BLOCK_CACHE_COMPRESSED_HIT, "compressed-block-cache-hits"},
             {rocksdb::BLOOM_FILTER_USEFUL, "bloom-filter-useful"},
             {rocksdb::BYTES_WRITTEN, "bytes-written"},
             {rocksdb::BYTES_READ, "bytes-read-point-lookup"},
@@ -225,7 +277,7 @@ namespace mongo {
           bob.append("table-options", optionObjBuilder.obj());
         }
         
-        RocksEngine::appendGlobalStats(bob);
+        _engine->appendGlobalStats(bob);
 
         return bob.obj();
     }
@@ -0,0 +1,403 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_table_properties.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <rocksdb/db.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/db/client.h"
+#include "mongo/platform/endian.h"
+#include "mongo/stdx/chrono.h"
+#include "mongo/util/log.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    namespace {
+        void appendFixed64(std::string* out, long long value) {
+            uint64_t le = endian::nativeToLittle(static_cast<uint64_t>(value));
+            out->append(reinterpret_cast<const char*>(&le), sizeof(le));
+        }
+
+        long long readFixed64(const char* data) {
+            uint64_t le;
+            std::memcpy(&le, data, sizeof(le));
+            return static_cast<long long>(endian::littleToNative(le));
+        }
+
+        // prefix + 4 counters
+        const size_t kEncodedEntrySize = sizeof(uint32_t) + 4 * sizeof(uint64_t);
+        // prefix + blobBytes
+        const size_t kEncodedBlobBytesEntrySize = sizeof(uint32_t) + sizeof(uint64_t);
+
+        bool readVarint64(const char** p, const char* limit, uint64_t* value) {
+            *value = 0;
+            for (int shift = 0; shift <= 63 && *p < limit; shift += 7) {
+                uint64_t byte = static_cast<unsigned char>(*((*p)++));
+                *value |= (byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Size of the blob file record a blob reference points to. The reference is RocksDB's
+         * BlobIndex: a type byte, an expiration for TTL blobs, then the file number, offset and
+         * size of the value as varint64s. The record adds a 32 byte header and the key.
+         */
+        long long blobRecordSize(const rocksdb::Slice& key, const rocksdb::Slice& blobIndex) {
+            const uint8_t kBlob = 1, kBlobTTL = 2;
+            const char* p = blobIndex.data();
+            const char* limit = p + blobIndex.size();
+            if (p == limit) {
+                return 0;
+            }
+            uint8_t type = static_cast<uint8_t>(*p++);
+            uint64_t expiration, fileNumber, offset, size;
+            if ((type != kBlob && type != kBlobTTL) ||
+                (type == kBlobTTL && !readVarint64(&p, limit, &expiration)) ||
+                !readVarint64(&p, limit, &fileNumber) || !readVarint64(&p, limit, &offset) ||
+                !readVarint64(&p, limit, &size)) {
+                // inlined TTL values stay in the SST file
+                return 0;
+            }
+            return static_cast<long long>(32 + key.size() + size);
+        }
+    }  // namespace
+
+    void RocksPrefixStats::add(const RocksPrefixStats& other) {
+        numKeys += other.numKeys;
+        numDeletions += other.numDeletions;
+        rawBytes += other.rawBytes;
+        storedBytes += other.storedBytes;
+        blobBytes += other.blobBytes;
+    }
+
+    void RocksPrefixStats::appendToBson(BSONObjBuilder* builder, double scale) const {
+        builder->append("numKeys", numKeys);
+        builder->append("numDeletions", numDeletions);
+        builder->appendIntOrLL("rawBytes", static_cast<long long>(rawBytes / scale));
+        builder->appendIntOrLL("storedBytes", static_cast<long long>(storedBytes / scale));
+        builder->appendIntOrLL("blobBytes", static_cast<long long>(blobBytes / scale));
+    }
+
+    const std::string RocksPrefixStatsCollector::kPropertyName("mongorocks.prefixstats");
+    const std::string RocksPrefixStatsCollector::kBlobBytesPropertyName(
+        "mongorocks.prefixblobbytes");
+
+    rocksdb::Status RocksPrefixStatsCollector::AddUserKey(const rocksdb::Slice& key,
+                                                          const rocksdb::Slice& value,
+                                                          rocksdb::EntryType type,
+                                                          rocksdb::SequenceNumber seq,
+                                                          uint64_t fileSize) {
+        // the file grows when a data block is flushed. That block holds the keys we've seen
+        // before this one, so the growth belongs to the previous key's prefix
+        if (fileSize > _lastFileSize) {
+            if (!_entries.empty()) {
+                _entries.back().stats.storedBytes += fileSize - _lastFileSize;
+            }
+            _lastFileSize = fileSize;
+        }
+
+        uint32_t prefix = 0;
+        if (key.size() >= sizeof(uint32_t)) {
+            uint32_t bigEndianPrefix;
+            std::memcpy(&bigEndianPrefix, key.data(), sizeof(uint32_t));
+            prefix = endian::bigToNative(bigEndianPrefix);
+        }
+        if (_entries.empty() || _entries.back().prefix != prefix) {
+            _entries.push_back(Entry());
+            _entries.back().prefix = prefix;
+        }
+        auto& stats = _entries.back().stats;
+        if (type == rocksdb::kEntryDelete || type == rocksdb::kEntrySingleDelete) {
+            stats.numDeletions++;
+        } else {
+            stats.numKeys++;
+        }
+        stats.rawBytes += key.size() + value.size();
+#if defined(ROCKSDB_MAJOR) && (ROCKSDB_MAJOR > 6 || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR >= 18))
+        if (type == rocksdb::kEntryBlobIndex) {
+            stats.blobBytes += blobRecordSize(key, value);
+        }
+#endif
+        return rocksdb::Status::OK();
+    }
+
+    rocksdb::Status RocksPrefixStatsCollector::Finish(
+        rocksdb::UserCollectedProperties* properties) {
+        properties->insert({kPropertyName, encode(_entries)});
+        std::string blobBytes = encodeBlobBytes(_entries);
+        if (!blobBytes.empty()) {
+            properties->insert({kBlobBytesPropertyName, std::move(blobBytes)});
+        }
+        return rocksdb::Status::OK();
+    }
+
+    rocksdb::UserCollectedProperties RocksPrefixStatsCollector::GetReadableProperties() const {
+        rocksdb::UserCollectedProperties readable;
+        readable.insert({"mongorocks.prefixes", std::to_string(_entries.size())});
+        return readable;
+    }
+
+    std::string RocksPrefixStatsCollector::encode(const std::vector<Entry>& entries) {
+        std::string encoded;
+        encoded.reserve(entries.size() * kEncodedEntrySize);
+        for (const auto& entry : entries) {
+            uint32_t le = endian::nativeToLittle(entry.prefix);
+            encoded.append(reinterpret_cast<const char*>(&le), sizeof(le));
+            appendFixed64(&encoded, entry.stats.numKeys);
+            appendFixed64(&encoded, entry.stats.numDeletions);
+            appendFixed64(&encoded, entry.stats.rawBytes);
+            appendFixed64(&encoded, entry.stats.storedBytes);
+        }
+        return encoded;
+    }
+
+    bool RocksPrefixStatsCollector::decode(const std::string& encoded,
+                                           std::vector<Entry>* entries) {
+        if (encoded.size() % kEncodedEntrySize != 0) {
+            return false;
+        }
+        entries->clear();
+        entries->reserve(encoded.size() / kEncodedEntrySize);
+        for (const char* p = encoded.data(); p < encoded.data() + encoded.size();
+             p += kEncodedEntrySize) {
+            Entry entry;
+            uint32_t le;
+            std::memcpy(&le, p, sizeof(le));
+            entry.prefix = endian::littleToNative(le);
+            const char* counters = p + sizeof(uint32_t);
+            entry.stats.numKeys = readFixed64(counters);
+            entry.stats.numDeletions = readFixed64(counters + 8);
+            entry.stats.rawBytes = readFixed64(counters + 16);
+            entry.stats.storedBytes = readFixed64(counters + 24);
+            entries->push_back(entry);
+        }
+        return true;
+    }
+
+    std::string RocksPrefixStatsCollector::encodeBlobBytes(const std::vector<Entry>& entries) {
+        std::string encoded;
+        for (const auto& entry : entries) {
+            if (entry.stats.blobBytes == 0) {
+                continue;
+            }
+            uint32_t le = endian::nativeToLittle(entry.prefix);
+            encoded.append(reinterpret_cast<const char*>(&le), sizeof(le));
+            appendFixed64(&encoded, entry.stats.blobBytes);
+        }
+        return encoded;
+    }
+
+    bool RocksPrefixStatsCollector::decodeBlobBytes(const std::string& encoded,
+                                                    std::vector<Entry>* entries) {
+        if (encoded.size() % kEncodedBlobBytesEntrySize != 0) {
+            return false;
+        }
+        // both lists are in key order
+        auto entry = entries->begin();
+        for (const char* p = encoded.data(); p < encoded.data() + encoded.size();
+             p += kEncodedBlobBytesEntrySize) {
+            uint32_t le;
+            std::memcpy(&le, p, sizeof(le));
+            uint32_t prefix = endian::littleToNative(le);
+            while (entry != entries->end() && entry->prefix != prefix) {
+                ++entry;
+            }
+            if (entry == entries->end()) {
+                return false;
+            }
+            entry->stats.blobBytes = readFixed64(p + sizeof(uint32_t));
+        }
+        return true;
+    }
+
+    RocksPrefixStatsCache::RocksPrefixStatsCache(
+        rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*> cfHandles, int maxAgeMillis)
+        : BackgroundJob(false /* deleteSelf */),
+          _db(db),
+          _cfHandles(std::move(cfHandles)),
+          _maxAgeMillis(maxAgeMillis) {
+        refresh();
+    }
+
+    void RocksPrefixStatsCache::run() {
+        Client::initThread(name().c_str());
+
+        LOG(1) << "starting " << name() << " thread";
+
+        while (true) {
+            {
+                stdx::unique_lock<stdx::mutex> lk(_mutex);
+                _shutdownCondition.wait_for(lk, stdx::chrono::milliseconds(kRefreshIntervalMillis),
+                                            [this] { return _shuttingDown; });
+                if (_shuttingDown) {
+                    break;
+                }
+            }
+            if (_used.exchange(false)) {
+                refresh();
+            }
+        }
+        LOG(1) << "stopping " << name() << " thread";
+    }
+
+    void RocksPrefixStatsCache::shutdown() {
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _shuttingDown = true;
+        }
+        _shutdownCondition.notify_all();
+        wait();
+    }
+
+    bool RocksPrefixStatsCache::get(const std::string& prefix, RocksPrefixStats* stats) {
+        if (prefix.size() != sizeof(uint32_t)) {
+            return false;
+        }
+        uint32_t bigEndianPrefix;
+        std::memcpy(&bigEndianPrefix, prefix.data(), sizeof(uint32_t));
+
+        _used.store(true, std::memory_order_relaxed);
+        if (_isStale()) {
+            // the job only refreshes while someone asks, don't serve totals from before an idle
+            // period. Concurrent callers wait for one refresh instead of all doing their own
+            stdx::lock_guard<stdx::mutex> lk(_refreshMutex);
+            if (_isStale()) {
+                _refresh_inlock();
+            }
+        }
+        std::shared_ptr<const Totals> totals;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            totals = _totals;
+        }
+        auto it = totals->find(endian::bigToNative(bigEndianPrefix));
+        if (it == totals->end()) {
+            return false;
+        }
+        *stats = it->second;
+        return true;
+    }
+
+    bool RocksPrefixStatsCache::_isStale() const {
+        return static_cast<long long>(curTimeMillis64()) -
+                   _refreshedAtMillis.load(std::memory_order_relaxed) >
+            _maxAgeMillis;
+    }
+
+    void RocksPrefixStatsCache::refresh() {
+        stdx::lock_guard<stdx::mutex> lk(_refreshMutex);
+        _refresh_inlock();
+    }
+
+    void RocksPrefixStatsCache::_refresh_inlock() {
+        // taken before reading the tables, files added meanwhile make the totals older
+        const long long startedAt = static_cast<long long>(curTimeMillis64());
+        decltype(_files) liveFiles;
+        for (auto cfHandle : _cfHandles) {
+            rocksdb::TablePropertiesCollection collection;
+            auto s = _db->GetPropertiesOfAllTables(cfHandle, &collection);
+            if (!s.ok()) {
+                LOG(1) << "Failed to get table properties: " << s.ToString();
+                continue;
+            }
+            for (const auto& file : collection) {
+                auto cached = _files.find(file.first);
+                if (cached != _files.end()) {
+                    liveFiles[file.first] = std::move(cached->second);
+                    continue;
+                }
+                const auto& props = *file.second;
+                auto& entries = liveFiles[file.first];
+                auto encoded = props.user_collected_properties.find(
+                    RocksPrefixStatsCollector::kPropertyName);
+                if (encoded == props.user_collected_properties.end() ||
+                    !RocksPrefixStatsCollector::decode(encoded->second, &entries) ||
+                    entries.empty()) {
+                    // written before we started collecting, or a table format that doesn't
+                    // run collectors
+                    continue;
+                }
+                auto blobBytes = props.user_collected_properties.find(
+                    RocksPrefixStatsCollector::kBlobBytesPropertyName);
+                if (blobBytes != props.user_collected_properties.end() &&
+                    !RocksPrefixStatsCollector::decodeBlobBytes(blobBytes->second, &entries)) {
+                    LOG(1) << "Failed to decode blob bytes of " << file.first;
+                }
+
+                // Complete storedBytes. Data blocks we saw being flushed were attributed while
+                // building. The last data block goes to the last prefix. Index and filter blocks,
+                // or everything if we saw no block boundaries, are split by raw bytes
+                long long rawTotal = 0, attributed = 0;
+                for (const auto& entry : entries) {
+                    rawTotal += entry.stats.rawBytes;
+                    attributed += entry.stats.storedBytes;
+                }
+                long long dataSize = static_cast<long long>(props.data_size);
+                long long metaSize = static_cast<long long>(props.index_size + props.filter_size);
+                if (attributed == 0) {
+                    metaSize += dataSize;
+                } else {
+                    entries.back().stats.storedBytes += std::max(0LL, dataSize - attributed);
+                }
+                if (rawTotal > 0) {
+                    for (auto& entry : entries) {
+                        entry.stats.storedBytes += static_cast<long long>(
+                            static_cast<double>(metaSize) * entry.stats.rawBytes / rawTotal);
+                    }
+                }
+            }
+        }
+        _files = std::move(liveFiles);
+
+        auto totals = std::make_shared<Totals>();
+        for (const auto& file : _files) {
+            for (const auto& entry : file.second) {
+                (*totals)[entry.prefix].add(entry.stats);
+            }
+        }
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _totals = std::move(totals);
+        }
+        _refreshedAtMillis.store(startedAt, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,184 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <rocksdb/table_properties.h>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/stdx/condition_variable.h"
+#include "mongo/stdx/mutex.h"
+#include "mongo/util/background.h"
+
+namespace rocksdb {
+    class ColumnFamilyHandle;
+    class DB;
+}
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Storage statistics of a single prefix (collection, index or oplog key tracker), summed over
+     * SST files. Data that is still in memtables is not included.
+     */
+    struct RocksPrefixStats {
+        long long numKeys = 0;
+        long long numDeletions = 0;
+        // uncompressed key + value bytes
+        long long rawBytes = 0;
+        // bytes on disk, including the prefix's share of index and filter blocks
+        long long storedBytes = 0;
+        // bytes in blob files referenced by the prefix's keys. Their values are only counted
+        // as blob references in rawBytes and storedBytes
+        long long blobBytes = 0;
+
+        // SST and blob file bytes, what storage sizes report
+        long long onDiskBytes() const { return storedBytes + blobBytes; }
+
+        void add(const RocksPrefixStats& other);
+        // byte counts are divided by scale, like the rest of collStats
+        void appendToBson(BSONObjBuilder* builder, double scale = 1) const;
+    };
+
+    /**
+     * Records RocksPrefixStats of every prefix in an SST file as a user collected property.
+     * Keys are added in order, so the stats of a prefix are contiguous. blobBytes go to a
+     * property of their own, so files written before we counted them still decode.
+     */
+    class RocksPrefixStatsCollector : public rocksdb::TablePropertiesCollector {
+    public:
+        static const std::string kPropertyName;
+        static const std::string kBlobBytesPropertyName;
+
+        virtual rocksdb::Status AddUserKey(const rocksdb::Slice& key, const rocksdb::Slice& value,
+                                           rocksdb::EntryType type, rocksdb::SequenceNumber seq,
+                                           uint64_t fileSize) override;
+
+        virtual rocksdb::Status Finish(rocksdb::UserCollectedProperties* properties) override;
+
+        virtual rocksdb::UserCollectedProperties GetReadableProperties() const override;
+
+        virtual const char* Name() const override { return "MongoRocksPrefixStatsCollector"; }
+
+        struct Entry {
+            uint32_t prefix;
+            // stats.storedBytes is filled only from the data block boundaries we observed while
+            // building, RocksPrefixStatsCache completes it from the table properties
+            RocksPrefixStats stats;
+        };
+
+        static std::string encode(const std::vector<Entry>& entries);
+        static bool decode(const std::string& encoded, std::vector<Entry>* entries);
+        // only prefixes that reference blob files. Decoding fills blobBytes of decoded entries
+        static std::string encodeBlobBytes(const std::vector<Entry>& entries);
+        static bool decodeBlobBytes(const std::string& encoded, std::vector<Entry>* entries);
+
+    private:
+        std::vector<Entry> _entries;
+        uint64_t _lastFileSize = 0;
+    };
+
+    class RocksPrefixStatsCollectorFactory : public rocksdb::TablePropertiesCollectorFactory {
+    public:
+        virtual rocksdb::TablePropertiesCollector* CreateTablePropertiesCollector(
+            rocksdb::TablePropertiesCollectorFactory::Context context) override {
+            return new RocksPrefixStatsCollector();
+        }
+
+        virtual const char* Name() const override { return "MongoRocksPrefixStatsCollector"; }
+    };
+
+    /**
+     * Sums the collected RocksPrefixStats of all live SST files per prefix. Properties of a file
+     * are decoded once, when we first see the file. The totals are an immutable snapshot that
+     * the background job replaces every few seconds while somebody is asking for them, so
+     * lookups from collStats and dbStats never wait for table properties to be read.
+     */
+    class RocksPrefixStatsCache : public BackgroundJob {
+        MONGO_DISALLOW_COPYING(RocksPrefixStatsCache);
+
+    public:
+        // reads the properties of all tables once before returning. get() doesn't return totals
+        // older than maxAgeMillis
+        RocksPrefixStatsCache(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*> cfHandles,
+                              int maxAgeMillis = kRefreshIntervalMillis);
+
+        virtual std::string name() const { return "RocksPrefixStatsCache"; }
+
+        virtual void run();
+
+        void shutdown();
+
+        /**
+         * prefix is the encoded (big endian) prefix. Returns false if no SST file contains the
+         * prefix. Refreshes the totals first if they are older than maxAgeMillis, e.g. because
+         * nobody asked for a while and the job stopped refreshing them.
+         */
+        bool get(const std::string& prefix, RocksPrefixStats* stats);
+
+        // rebuilds the totals
+        void refresh();
+
+    private:
+        typedef std::unordered_map<uint32_t, RocksPrefixStats> Totals;
+
+        bool _isStale() const;
+        void _refresh_inlock();
+
+        rocksdb::DB* _db;  // not owned
+        const std::vector<rocksdb::ColumnFamilyHandle*> _cfHandles;  // not owned
+        const int _maxAgeMillis;
+
+        // serializes refreshes, protects _files
+        stdx::mutex _refreshMutex;
+        // file name -> decoded stats of that file. Only used by refresh()
+        std::unordered_map<std::string, std::vector<RocksPrefixStatsCollector::Entry>> _files;
+
+        // _mutex only protects swapping the pointer
+        stdx::mutex _mutex;
+        stdx::condition_variable _shutdownCondition;
+        bool _shuttingDown = false;
+        std::shared_ptr<const Totals> _totals;
+        // set by get(), the job only refreshes while the totals are used
+        std::atomic<bool> _used{false};  // NOLINT
+        // curTimeMillis64() when _totals were built
+        std::atomic<long long> _refreshedAtMillis{0};  // NOLINT
+
+        static const int kRefreshIntervalMillis = 5000;
+    };
+}
@@ -0,0 +1,311 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_ticket_controller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <rocksdb/db.h>
+#include <rocksdb/options.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/db/client.h"
+#include "mongo/stdx/chrono.h"
+#include "mongo/util/concurrency/ticketholder.h"
+#include "mongo/util/log.h"
+
+namespace mongo {
+
+    namespace {
+        const char* decisionName(RocksTicketController::Decision decision) {
+            switch (decision) {
+                case RocksTicketController::Decision::kGrow:
+                    return "grow";
+                case RocksTicketController::Decision::kShrink:
+                    return "shrink";
+                case RocksTicketController::Decision::kShed:
+                    return "shed";
+                default:
+                    return "hold";
+            }
+        }
+    }  // namespace
+
+    constexpr double RocksTicketController::kHoldPressure;
+    constexpr double RocksTicketController::kShedPressure;
+
+    RocksTicketController::RocksTicketController(
+        rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*> cfHandles,
+        TicketHolder* readTickets, std::function<bool()> readSetManually,
+        TicketHolder* writeTickets, std::function<bool()> writeSetManually, int minTickets,
+        int maxTickets)
+        : BackgroundJob(false /* deleteSelf */),
+          _db(db),
+          _minTickets(minTickets),
+          _maxTickets(maxTickets),
+          _read("read", readTickets, RocksHotPath::kGet, std::move(readSetManually)),
+          _write("write", writeTickets, RocksHotPath::kCommit, std::move(writeSetManually)) {
+        _read.lastSnapshot = rocksHotPathHistogram(_read.path)->snapshot();
+        _write.lastSnapshot = rocksHotPathHistogram(_write.path)->snapshot();
+        for (auto cfHandle : cfHandles) {
+            _columnFamilies.push_back({cfHandle, 0, 0});
+        }
+        _refreshOptions();
+    }
+
+    void RocksTicketController::run() {
+        Client::initThread(name().c_str());
+
+        LOG(1) << "starting " << name() << " thread";
+
+        int samples = 0;
+        while (true) {
+            {
+                stdx::unique_lock<stdx::mutex> lk(_mutex);
+                _shutdownCondition.wait_for(lk, stdx::chrono::milliseconds(kSampleIntervalMillis),
+                                            [this] { return _shuttingDown; });
+                if (_shuttingDown) {
+                    break;
+                }
+            }
+            _sample();
+            if (++samples % kAdjustEverySamples == 0) {
+                _adjust(&_read, 0);
+                _adjust(&_write, _writePressure());
+            }
+        }
+        LOG(1) << "stopping " << name() << " thread";
+    }
+
+    void RocksTicketController::shutdown() {
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _shuttingDown = true;
+        }
+        _shutdownCondition.notify_all();
+        wait();
+    }
+
+    int RocksTicketController::nextLimit(int limit, int minLimit, int maxLimit,
+                                         uint64_t baselineMicros, uint64_t latencyMicros,
+                                         int maxInUse, double pressure, Decision* decision) {
+        double target = limit;
+        if (baselineMicros > 0 && latencyMicros > 0) {
+            double gradient = std::max(
+                0.5, std::min(1.0, static_cast<double>(baselineMicros) / latencyMicros));
+            // sqrt(limit) of headroom lets the limit grow while latency holds
+            target = limit * gradient + std::sqrt(static_cast<double>(limit));
+        }
+        if (maxInUse < limit / 2) {
+            // nobody was waiting for a ticket, more of them won't help
+            target = std::min(target, static_cast<double>(limit));
+        }
+
+        int newLimit;
+        if (pressure >= kShedPressure) {
+            newLimit = static_cast<int>(std::min(target, limit * 0.75));
+        } else {
+            if (pressure >= kHoldPressure) {
+                target = std::min(target, static_cast<double>(limit));
+            }
+            // a single noisy second only moves the limit a fifth of the way
+            newLimit = static_cast<int>(std::lround(limit * 0.8 + target * 0.2));
+        }
+        newLimit = std::max(minLimit, std::min(maxLimit, newLimit));
+
+        if (newLimit > limit) {
+            *decision = Decision::kGrow;
+        } else if (newLimit < limit) {
+            *decision = pressure >= kShedPressure ? Decision::kShed : Decision::kShrink;
+        } else {
+            *decision = Decision::kHold;
+        }
+        return newLimit;
+    }
+
+    void RocksTicketController::_sample() {
+        // maxInUse is only touched by this thread
+        _read.maxInUse = std::max(_read.maxInUse, _read.tickets->used());
+        _write.maxInUse = std::max(_write.maxInUse, _write.tickets->used());
+    }
+
+    void RocksTicketController::_adjust(Pool* pool, double pressure) {
+        auto snapshot = rocksHotPathHistogram(pool->path)->snapshot();
+        auto window = snapshot.since(pool->lastSnapshot);
+        pool->lastSnapshot = snapshot;
+        uint64_t latency = window.count() >= kMinLatencySamples ? window.percentile(0.5) : 0;
+        int maxInUse = pool->maxInUse;
+        pool->maxInUse = 0;
+        int limit = pool->tickets->outof();
+        if (pool->setManually()) {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            if (!pool->manual) {
+                log() << "RocksDB ticket controller: " << pool->name << " tickets were set to "
+                      << limit << " manually, no longer adjusting them";
+                pool->manual = true;
+            }
+            pool->latencyMicros = latency;
+            pool->lastMaxInUse = maxInUse;
+            pool->lastDecision = Decision::kHold;
+            return;
+        }
+
+        int newLimit;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            if (latency > 0) {
+                if (pool->baselineMicros == 0 || latency < pool->baselineMicros) {
+                    pool->baselineMicros = latency;
+                } else {
+                    pool->baselineMicros +=
+                        std::max<uint64_t>(1, pool->baselineMicros / kBaselineDecay);
+                }
+            }
+            Decision decision;
+            newLimit = nextLimit(limit, _minTickets, _maxTickets, pool->baselineMicros, latency,
+                                 maxInUse, pressure, &decision);
+            pool->latencyMicros = latency;
+            pool->opsPerSec = window.count() * 1000 / (kSampleIntervalMillis * kAdjustEverySamples);
+            pool->lastMaxInUse = maxInUse;
+            pool->lastDecision = decision;
+            if (decision == Decision::kGrow) {
+                ++pool->numGrows;
+            } else if (decision == Decision::kShrink) {
+                ++pool->numShrinks;
+            } else if (decision == Decision::kShed) {
+                ++pool->numSheds;
+                log() << "RocksDB ticket controller: shedding " << pool->name
+                      << " tickets from " << limit << " to " << newLimit
+                      << " (L0 files: " << _level0Files << "/" << _level0SlowdownTrigger
+                      << ", pending compaction bytes: " << _pendingCompactionBytes << "/"
+                      << _pendingCompactionBytesLimit << ")";
+            }
+        }
+        if (newLimit != limit) {
+            LOG(1) << "RocksDB ticket controller: " << pool->name << " tickets " << limit
+                   << " -> " << newLimit << " (median latency " << latency << "us)";
+            // shrinking waits for tickets to be returned, don't hold _mutex
+            Status status = pool->tickets->resize(newLimit);
+            if (!status.isOK()) {
+                warning() << "RocksDB ticket controller: failed to resize " << pool->name
+                          << " tickets: " << status;
+            }
+        }
+    }
+
+    double RocksTicketController::_writePressure() {
+        if (++_adjustmentsSinceRefresh >= kRefreshOptionsEveryAdjustments) {
+            _refreshOptions();
+        }
+
+        // reports the column family under the most pressure
+        double pressure = 0;
+        uint64_t level0Files = 0;
+        uint64_t slowdownTrigger = 0;
+        uint64_t pendingBytes = 0;
+        uint64_t pendingLimit = 0;
+        for (const auto& cf : _columnFamilies) {
+            uint64_t cfLevel0Files = 0;
+            std::string level0FilesString;
+            if (_db->GetProperty(cf.handle, "rocksdb.num-files-at-level0", &level0FilesString)) {
+                cfLevel0Files = std::stoull(level0FilesString);
+            }
+            uint64_t cfPendingBytes = 0;
+            _db->GetIntProperty(cf.handle, "rocksdb.estimate-pending-compaction-bytes",
+                                &cfPendingBytes);
+
+            double cfPressure = 0;
+            if (cf.level0SlowdownTrigger > 0) {
+                cfPressure = static_cast<double>(cfLevel0Files) / cf.level0SlowdownTrigger;
+            }
+            if (cf.pendingCompactionBytesLimit > 0) {
+                cfPressure = std::max(cfPressure, static_cast<double>(cfPendingBytes) /
+                                                      cf.pendingCompactionBytesLimit);
+            }
+            if (cfPressure >= pressure) {
+                pressure = cfPressure;
+                level0Files = cfLevel0Files;
+                slowdownTrigger = cf.level0SlowdownTrigger;
+                pendingBytes = cfPendingBytes;
+                pendingLimit = cf.pendingCompactionBytesLimit;
+            }
+        }
+
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        _level0Files = level0Files;
+        _level0SlowdownTrigger = slowdownTrigger;
+        _pendingCompactionBytes = pendingBytes;
+        _pendingCompactionBytesLimit = pendingLimit;
+        _writePressureLevel = pressure;
+        return pressure;
+    }
+
+    void RocksTicketController::_refreshOptions() {
+        _adjustmentsSinceRefresh = 0;
+        for (auto& cf : _columnFamilies) {
+            auto options = _db->GetOptions(cf.handle);
+            cf.level0SlowdownTrigger = std::max(0, options.level0_slowdown_writes_trigger);
+            cf.pendingCompactionBytesLimit = options.soft_pending_compaction_bytes_limit;
+        }
+    }
+
+    void RocksTicketController::_appendPool(const Pool& pool, BSONObjBuilder* builder) const {
+        BSONObjBuilder poolBuilder(builder->subobjStart(pool.name));
+        poolBuilder.append("tickets", pool.tickets->outof());
+        poolBuilder.append("baseline-micros", static_cast<long long>(pool.baselineMicros));
+        poolBuilder.append("latency-micros", static_cast<long long>(pool.latencyMicros));
+        poolBuilder.append("ops-per-sec", static_cast<long long>(pool.opsPerSec));
+        poolBuilder.append("max-in-use", pool.lastMaxInUse);
+        poolBuilder.append("grows", pool.numGrows);
+        poolBuilder.append("shrinks", pool.numShrinks);
+        poolBuilder.append("sheds", pool.numSheds);
+        poolBuilder.append("last-decision", decisionName(pool.lastDecision));
+        poolBuilder.append("manual", pool.manual);
+    }
+
+    void RocksTicketController::appendStats(BSONObjBuilder* builder) const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        builder->append("min-tickets", _minTickets);
+        builder->append("max-tickets", _maxTickets);
+        builder->append("write-pressure", _writePressureLevel);
+        builder->append("level0-files", static_cast<long long>(_level0Files));
+        builder->append("level0-slowdown-trigger", static_cast<long long>(_level0SlowdownTrigger));
+        builder->append("pending-compaction-bytes",
+                        static_cast<long long>(_pendingCompactionBytes));
+        builder->append("pending-compaction-bytes-limit",
+                        static_cast<long long>(_pendingCompactionBytesLimit));
+        _appendPool(_read, builder);
+        _appendPool(_write, builder);
+    }
+}
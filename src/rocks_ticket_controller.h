@@ -0,0 +1,173 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/stdx/condition_variable.h"
+#include "mongo/stdx/mutex.h"
+#include "mongo/util/background.h"
+
+#include "rocks_histogram.h"
+
+namespace rocksdb {
+    class ColumnFamilyHandle;
+    class DB;
+}
+
+namespace mongo {
+
+    class BSONObjBuilder;
+    class TicketHolder;
+
+    /**
+     * Sizes the read and write ticket pools (rocksdbConcurrentReadTransactions and
+     * rocksdbConcurrentWriteTransactions) from what the engine observes, instead of leaving them
+     * at a fixed 128.
+     *
+     * Every second each pool follows the gradient of its latency: the median Get (reads) or
+     * commit (writes) latency of the last second against a baseline, the lowest median seen
+     * recently. While latency stays at the baseline the pool grows by about sqrt(limit), when
+     * latency goes up the pool shrinks in proportion, down to half. A pool that isn't used
+     * doesn't grow.
+     *
+     * Write tickets are also shed before RocksDB slows writes down by itself. Pressure is the
+     * larger of L0 files over level0_slowdown_writes_trigger and pending compaction bytes over
+     * soft_pending_compaction_bytes_limit, in the column family closest to its limits. Above
+     * kHoldPressure the pool stops growing, above kShedPressure it shrinks right away, without
+     * smoothing.
+     *
+     * Once an operator sets the size of a pool through its server parameter, the controller
+     * leaves that pool alone.
+     */
+    class RocksTicketController : public BackgroundJob {
+        MONGO_DISALLOW_COPYING(RocksTicketController);
+
+    public:
+        enum class Decision { kHold, kGrow, kShrink, kShed };
+
+        // setManually returns true once the size of the pool was set by an operator
+        RocksTicketController(rocksdb::DB* db,
+                              std::vector<rocksdb::ColumnFamilyHandle*> cfHandles,
+                              TicketHolder* readTickets, std::function<bool()> readSetManually,
+                              TicketHolder* writeTickets, std::function<bool()> writeSetManually,
+                              int minTickets, int maxTickets);
+
+        virtual std::string name() const { return "RocksTicketController"; }
+
+        virtual void run();
+
+        void shutdown();
+
+        void appendStats(BSONObjBuilder* builder) const;
+
+        /**
+         * Pure decision function of a single step. Returns the new limit of a pool and sets
+         * decision. latencyMicros is 0 if there were too few samples to tell.
+         */
+        static int nextLimit(int limit, int minLimit, int maxLimit, uint64_t baselineMicros,
+                             uint64_t latencyMicros, int maxInUse, double pressure,
+                             Decision* decision);
+
+        static constexpr double kHoldPressure = 0.5;
+        static constexpr double kShedPressure = 0.75;
+
+    private:
+        struct Pool {
+            Pool(const char* name, TicketHolder* tickets, RocksHotPath path,
+                 std::function<bool()> setManually)
+                : name(name), tickets(tickets), path(path), setManually(std::move(setManually)) {}
+
+            const char* name;
+            TicketHolder* tickets;  // not owned
+            const RocksHotPath path;
+            const std::function<bool()> setManually;
+            RocksHistogram::Snapshot lastSnapshot;
+            int maxInUse = 0;
+            // protected by _mutex
+            uint64_t baselineMicros = 0;
+            uint64_t latencyMicros = 0;
+            uint64_t opsPerSec = 0;
+            int lastMaxInUse = 0;
+            Decision lastDecision = Decision::kHold;
+            long long numGrows = 0;
+            long long numShrinks = 0;
+            long long numSheds = 0;
+            bool manual = false;
+        };
+
+        // limits of a column family, GetOptions() copies all of the options
+        struct ColumnFamily {
+            rocksdb::ColumnFamilyHandle* handle;  // not owned
+            uint64_t level0SlowdownTrigger;
+            uint64_t pendingCompactionBytesLimit;
+        };
+
+        void _sample();
+        void _adjust(Pool* pool, double pressure);
+        double _writePressure();
+        void _refreshOptions();
+        void _appendPool(const Pool& pool, BSONObjBuilder* builder) const;
+
+        rocksdb::DB* _db;  // not owned
+        // only touched by the controller thread
+        std::vector<ColumnFamily> _columnFamilies;
+        int _adjustmentsSinceRefresh = 0;
+        const int _minTickets;
+        const int _maxTickets;
+        Pool _read;
+        Pool _write;
+
+        mutable stdx::mutex _mutex;
+        stdx::condition_variable _shutdownCondition;
+        bool _shuttingDown = false;
+        // protected by _mutex
+        uint64_t _level0Files = 0;
+        uint64_t _level0SlowdownTrigger = 0;
+        uint64_t _pendingCompactionBytes = 0;
+        uint64_t _pendingCompactionBytesLimit = 0;
+        double _writePressureLevel = 0;
+
+        // tickets in use are sampled this often, limits change once per kAdjustEverySamples
+        static const int kSampleIntervalMillis = 100;
+        static const int kAdjustEverySamples = 10;
+        // a median of fewer samples is noise
+        static const uint64_t kMinLatencySamples = 50;
+        // the baseline creeps up by 1/kBaselineDecay per second, so that it follows a slower
+        // device or bigger documents instead of remembering one good second forever
+        static const uint64_t kBaselineDecay = 64;
+        // options can change at runtime, they are read again once a minute
+        static const int kRefreshOptionsEveryAdjustments = 60;
+    };
+}
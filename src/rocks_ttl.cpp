@@ -0,0 +1,146 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_ttl.h"
+
+#include <algorithm>
+
+#include <rocksdb/slice.h>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/platform/endian.h"
+#include "mongo/util/bufreader.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    namespace {
+        const size_t kPrefixSize = sizeof(uint32_t);
+        const char* const kExpireAfterSecondsField = "expireAfterSeconds";
+        std::atomic<int64_t> clockOffsetSecs{0};  // NOLINT
+
+        bool expiredRecordId(const RecordId& id, int64_t nowSecs) {
+            return RocksTTL::expireAtSecs(id) <= nowSecs;
+        }
+    }  // namespace
+
+    int64_t RocksTTL::nowSecs() {
+        return static_cast<int64_t>(time(nullptr)) + clockOffsetSecs.load();
+    }
+
+    void RocksTTL::advanceClockForTest(int64_t secs) { clockOffsetSecs.fetch_add(secs); }
+
+    Status RocksTTL::parseCollectionOptions(const BSONObj& storageEngineOptions,
+                                            int64_t* expireAfterSeconds) {
+        *expireAfterSeconds = 0;
+        BSONElement rocksOptions = storageEngineOptions.getField("rocksdb");
+        if (rocksOptions.eoo()) {
+            return Status::OK();
+        }
+        if (rocksOptions.type() != Object) {
+            return Status(ErrorCodes::BadValue, "storageEngine.rocksdb has to be a document");
+        }
+        Status status = validateCollectionStorageOptions(rocksOptions.Obj());
+        if (!status.isOK()) {
+            return status;
+        }
+        BSONElement element = rocksOptions.Obj().getField(kExpireAfterSecondsField);
+        if (!element.eoo()) {
+            *expireAfterSeconds = element.safeNumberLong();
+        }
+        return Status::OK();
+    }
+
+    Status RocksTTL::validateCollectionStorageOptions(const BSONObj& options) {
+        BSONElement element = options.getField(kExpireAfterSecondsField);
+        if (element.eoo()) {
+            return Status::OK();
+        }
+        if (!element.isNumber() || element.safeNumberLong() <= 0) {
+            return Status(ErrorCodes::BadValue,
+                          str::stream() << kExpireAfterSecondsField
+                                        << " has to be a positive number");
+        }
+        return Status::OK();
+    }
+
+    const RocksTTLPrefixes::Entry* RocksTTLPrefixes::find(uint32_t prefix) const {
+        Entry needle{prefix, Kind::kRecordStore, KeyString::Version::V0};
+        auto it = std::lower_bound(_entries.begin(), _entries.end(), needle);
+        if (it == _entries.end() || it->prefix != prefix) {
+            return nullptr;
+        }
+        return &(*it);
+    }
+
+    bool RocksTTLPrefixes::isExpired(const Entry& entry, const rocksdb::Slice& key,
+                                     const rocksdb::Slice& value, int64_t nowSecs) {
+        if (key.size() <= kPrefixSize) {
+            // <prefix> marker key written by the engine when creating the ident
+            return false;
+        }
+        const char* data = key.data() + kPrefixSize;
+        const size_t size = key.size() - kPrefixSize;
+
+        switch (entry.kind) {
+            case Kind::kRecordStore: {
+                if (size != sizeof(int64_t)) {
+                    return false;
+                }
+                int64_t repr = endian::bigToNative(*reinterpret_cast<const int64_t*>(data));
+                return expiredRecordId(RecordId(repr), nowSecs);
+            }
+            case Kind::kStandardIndex:
+                return expiredRecordId(KeyString::decodeRecordIdAtEnd(data, size), nowSecs);
+            case Kind::kUniqueIndex: {
+                // value is a list of (RecordId, TypeBits). We only drop the entry once all of the
+                // records it points to are expired
+                BufReader br(value.data(), value.size());
+                if (!br.remaining()) {
+                    return false;
+                }
+                while (br.remaining()) {
+                    if (!expiredRecordId(KeyString::decodeRecordId(&br), nowSecs)) {
+                        return false;
+                    }
+                    if (br.remaining()) {
+                        KeyString::TypeBits::fromBuffer(entry.keyStringVersion, &br);
+                    }
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+}
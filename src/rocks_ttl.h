@@ -0,0 +1,144 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "mongo/base/status.h"
+#include "mongo/bson/bsonobj.h"
+#include "mongo/db/record_id.h"
+#include "mongo/db/storage/key_string.h"
+
+namespace rocksdb {
+    class Slice;
+}
+
+namespace mongo {
+
+    /**
+     * Engine-native TTL for collections created with
+     * storageEngine: {rocksdb: {expireAfterSeconds: N}}.
+     *
+     * The expiry time of a document is encoded in the high bits of its RecordId (seconds since
+     * epoch, at insert time + N), with the low kSequenceBits used as a sequence number. The
+     * compaction filter can therefore decide whether a record or any of its index entries are
+     * expired just by looking at the RecordId in the key (or in the value for unique indexes),
+     * without reading the document. Records are ordered by expiry, so expired records are always
+     * a prefix of the collection.
+     */
+    class RocksTTL {
+    public:
+        static const int kSequenceBits = 22;
+
+        // Compaction only drops entries that expired at least this long ago. Readers hide entries
+        // as soon as they expire, so this gives operations that are still working with an index
+        // entry they saw just before the expiry a chance to fetch the document.
+        static const int64_t kCompactionGraceSecs = 300;
+
+        static int64_t nowSecs();
+        // moves nowSecs() forward, so that tests don't have to wait for documents to expire
+        static void advanceClockForTest(int64_t secs);
+
+        static RecordId minRecordIdForExpiry(int64_t expireAtSecs) {
+            return RecordId(expireAtSecs << kSequenceBits);
+        }
+
+        static int64_t expireAtSecs(const RecordId& id) { return id.repr() >> kSequenceBits; }
+
+        /**
+         * Returns the lowest RecordId that is still visible at nowSecs. All RecordIds below it are
+         * logically expired.
+         */
+        static RecordId firstVisibleRecordId(int64_t nowSecs) {
+            return minRecordIdForExpiry(nowSecs + 1);
+        }
+
+        /**
+         * Extracts expireAfterSeconds from the collection's storageEngine options. Sets
+         * *expireAfterSeconds to 0 if engine-native TTL is not requested.
+         */
+        static Status parseCollectionOptions(const BSONObj& storageEngineOptions,
+                                             int64_t* expireAfterSeconds);
+
+        /**
+         * Validates the rocksdb sub-document of a collection's storageEngine options.
+         */
+        static Status validateCollectionStorageOptions(const BSONObj& options);
+    };
+
+    /**
+     * Immutable, sorted snapshot of all prefixes that belong to collections with engine-native TTL
+     * (and their indexes). Shared with compaction filters the same way as RocksDroppedPrefixes.
+     *
+     * Compaction only drops expired documents that their record store has already subtracted
+     * from numRecords and dataSize (see RocksRecordStore::accountExpiredRecords()), so that every
+     * document is counted exactly once no matter how many versions of it compaction sees.
+     */
+    class RocksTTLPrefixes {
+    public:
+        enum class Kind { kRecordStore, kStandardIndex, kUniqueIndex };
+
+        struct Entry {
+            uint32_t prefix;
+            Kind kind;
+            KeyString::Version keyStringVersion;
+            // kRecordStore only: documents that expired before this (in seconds) are accounted
+            // for. Owned by the open record store, nullptr until it's opened
+            std::shared_ptr<const std::atomic<long long>> accountedBeforeSecs;
+
+            bool operator<(const Entry& other) const { return prefix < other.prefix; }
+        };
+
+        RocksTTLPrefixes(uint64_t version, std::vector<Entry> entries)
+            : _version(version), _entries(std::move(entries)) {}
+
+        uint64_t version() const { return _version; }
+        bool empty() const { return _entries.empty(); }
+        const std::vector<Entry>& entries() const { return _entries; }
+
+        // returns nullptr if prefix doesn't belong to a TTL collection
+        const Entry* find(uint32_t prefix) const;
+
+        /**
+         * Returns true if the key/value pair (key includes the 4-byte prefix) was expired at
+         * nowSecs.
+         */
+        static bool isExpired(const Entry& entry, const rocksdb::Slice& key,
+                              const rocksdb::Slice& value, int64_t nowSecs);
+
+    private:
+        const uint64_t _version;
+        // sorted by prefix
+        const std::vector<Entry> _entries;
+    };
+}